@@ -0,0 +1,21 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+
+public class ArduinoInputCore : ModuleRules
+{
+	public ArduinoInputCore(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
+
+		// Serial transport, ring buffers and parsers only. Keep this module free of
+		// Engine/CoreUObject so TestControlInputBench can link it without the editor
+		PublicDependencyModuleNames.AddRange(new string[] { "Core" });
+
+		// Winsock for FArduinoUdpTransport, POSIX sockets come with libc
+		if (Target.Platform.IsInGroup(UnrealPlatformGroup.Windows))
+		{
+			PublicAdditionalLibraries.Add("ws2_32.lib");
+		}
+	}
+}
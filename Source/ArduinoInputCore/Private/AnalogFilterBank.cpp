@@ -0,0 +1,282 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "AnalogFilterBank.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ANALOGFILTERBANK_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define ANALOGFILTERBANK_NEON 1
+#include <arm_neon.h>
+#endif
+
+FAnalogFilterBank::FAnalogFilterBank()
+	: m_samplesProcessed(0)
+{
+	Configure(0, FAnalogFilterSettings());
+}
+
+void FAnalogFilterBank::Configure(int32 NumChannels, const FAnalogFilterSettings& Settings)
+{
+	m_numChannels = FMath::Clamp(NumChannels, 0, MaxChannels);
+	m_numLanes = (m_numChannels + 3) & ~3;
+	m_window = FMath::Clamp(Settings.MovingAverageWindow, 1, MaxWindow);
+	m_invWindow = 1.0f / m_window;
+	m_alpha = FMath::Clamp(Settings.SmoothingAlpha, 0.0f, 1.0f);
+	m_debounceSamples = FMath::Max(Settings.DebounceSamples, 1);
+	m_bPrimed = false;
+	m_batchCount = 0;
+	m_historyPos = 0;
+
+	FMemory::Memzero(m_batch, sizeof(m_batch));
+	FMemory::Memzero(m_history, sizeof(m_history));
+	FMemory::Memzero(m_sum, sizeof(m_sum));
+	FMemory::Memzero(m_smoothed, sizeof(m_smoothed));
+	FMemory::Memzero(m_hysteresis, sizeof(m_hysteresis));
+	FMemory::Memzero(m_debounced, sizeof(m_debounced));
+	FMemory::Memzero(m_debounceCount, sizeof(m_debounceCount));
+	for (int32 Channel = 0; Channel < MaxChannels; ++Channel)
+	{
+		m_pressThreshold[Channel] = Settings.PressThreshold;
+		m_releaseThreshold[Channel] = FMath::Min(Settings.ReleaseThreshold, Settings.PressThreshold);
+		m_publishedValue[Channel].store(0.0f, std::memory_order_relaxed);
+		m_publishedPressed[Channel].store(false, std::memory_order_relaxed);
+	}
+}
+
+void FAnalogFilterBank::AddSampleSet(const float* Values)
+{
+	if (m_numChannels == 0)
+	{
+		return;
+	}
+	if (m_batchCount == BatchCapacity)
+	{
+		Process();
+	}
+
+	// Padding lanes stay 0 from Configure, so they never press
+	FMemory::Memcpy(m_batch[m_batchCount], Values, m_numChannels * sizeof(float));
+	++m_batchCount;
+}
+
+void FAnalogFilterBank::Prime(const float* Row)
+{
+	for (int32 Channel = 0; Channel < m_numLanes; ++Channel)
+	{
+		float Sum = 0.0f;
+		for (int32 Slot = 0; Slot < m_window; ++Slot)
+		{
+			m_history[Slot][Channel] = Row[Channel];
+			Sum += Row[Channel];
+		}
+		m_sum[Channel] = Sum;
+		m_smoothed[Channel] = Row[Channel];
+	}
+	m_bPrimed = true;
+}
+
+void FAnalogFilterBank::Process()
+{
+	if (m_batchCount == 0)
+	{
+		return;
+	}
+	if (!m_bPrimed)
+	{
+		Prime(m_batch[0]);
+	}
+
+#if ANALOGFILTERBANK_SSE2
+	const __m128 InvWindow = _mm_set1_ps(m_invWindow);
+	const __m128 Alpha = _mm_set1_ps(m_alpha);
+	const __m128i One = _mm_set1_epi32(1);
+	const __m128i DebounceLimit = _mm_set1_epi32(m_debounceSamples - 1);
+
+	for (int32 Row = 0; Row < m_batchCount; ++Row)
+	{
+		float* History = m_history[m_historyPos];
+		for (int32 Lane = 0; Lane < m_numLanes; Lane += 4)
+		{
+			// Moving average from a running sum: add the new sample, drop the one leaving the window
+			const __m128 Sample = _mm_load_ps(m_batch[Row] + Lane);
+			const __m128 Oldest = _mm_load_ps(History + Lane);
+			_mm_store_ps(History + Lane, Sample);
+			const __m128 Sum = _mm_sub_ps(_mm_add_ps(_mm_load_ps(m_sum + Lane), Sample), Oldest);
+			_mm_store_ps(m_sum + Lane, Sum);
+			const __m128 Average = _mm_mul_ps(Sum, InvWindow);
+
+			__m128 Smoothed = _mm_load_ps(m_smoothed + Lane);
+			Smoothed = _mm_add_ps(Smoothed, _mm_mul_ps(Alpha, _mm_sub_ps(Average, Smoothed)));
+			_mm_store_ps(m_smoothed + Lane, Smoothed);
+
+			// Hysteresis: set above the press threshold, cleared below the release threshold, kept in between
+			const __m128i Press = _mm_castps_si128(_mm_cmpgt_ps(Smoothed, _mm_load_ps(m_pressThreshold + Lane)));
+			const __m128i Release = _mm_castps_si128(_mm_cmplt_ps(Smoothed, _mm_load_ps(m_releaseThreshold + Lane)));
+			const __m128i Hysteresis = _mm_andnot_si128(Release, _mm_or_si128(_mm_load_si128(reinterpret_cast<const __m128i*>(m_hysteresis + Lane)), Press));
+			_mm_store_si128(reinterpret_cast<__m128i*>(m_hysteresis + Lane), Hysteresis);
+
+			// Debounce: count consecutive disagreeing samples, flip once the count reaches the limit
+			__m128i Debounced = _mm_load_si128(reinterpret_cast<const __m128i*>(m_debounced + Lane));
+			const __m128i Differs = _mm_xor_si128(Hysteresis, Debounced);
+			__m128i Count = _mm_and_si128(_mm_add_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(m_debounceCount + Lane)), One), Differs);
+			const __m128i Flip = _mm_cmpgt_epi32(Count, DebounceLimit);
+			Debounced = _mm_xor_si128(Debounced, Flip);
+			Count = _mm_andnot_si128(Flip, Count);
+			_mm_store_si128(reinterpret_cast<__m128i*>(m_debounced + Lane), Debounced);
+			_mm_store_si128(reinterpret_cast<__m128i*>(m_debounceCount + Lane), Count);
+		}
+
+		// Recompute the sums once per turn of the history, so float rounding never builds up
+		if (++m_historyPos == m_window)
+		{
+			m_historyPos = 0;
+			for (int32 Lane = 0; Lane < m_numLanes; Lane += 4)
+			{
+				__m128 Sum = _mm_setzero_ps();
+				for (int32 Slot = 0; Slot < m_window; ++Slot)
+				{
+					Sum = _mm_add_ps(Sum, _mm_load_ps(m_history[Slot] + Lane));
+				}
+				_mm_store_ps(m_sum + Lane, Sum);
+			}
+		}
+	}
+
+	m_samplesProcessed.fetch_add((uint64)m_batchCount * m_numChannels, std::memory_order_relaxed);
+	m_batchCount = 0;
+	Publish();
+#elif ANALOGFILTERBANK_NEON
+	const float32x4_t InvWindow = vdupq_n_f32(m_invWindow);
+	const float32x4_t Alpha = vdupq_n_f32(m_alpha);
+	const uint32x4_t One = vdupq_n_u32(1);
+	const uint32x4_t DebounceLimit = vdupq_n_u32((uint32)(m_debounceSamples - 1));
+
+	for (int32 Row = 0; Row < m_batchCount; ++Row)
+	{
+		float* History = m_history[m_historyPos];
+		for (int32 Lane = 0; Lane < m_numLanes; Lane += 4)
+		{
+			const float32x4_t Sample = vld1q_f32(m_batch[Row] + Lane);
+			const float32x4_t Oldest = vld1q_f32(History + Lane);
+			vst1q_f32(History + Lane, Sample);
+			const float32x4_t Sum = vsubq_f32(vaddq_f32(vld1q_f32(m_sum + Lane), Sample), Oldest);
+			vst1q_f32(m_sum + Lane, Sum);
+			const float32x4_t Average = vmulq_f32(Sum, InvWindow);
+
+			float32x4_t Smoothed = vld1q_f32(m_smoothed + Lane);
+			Smoothed = vaddq_f32(Smoothed, vmulq_f32(Alpha, vsubq_f32(Average, Smoothed)));
+			vst1q_f32(m_smoothed + Lane, Smoothed);
+
+			const uint32x4_t Press = vcgtq_f32(Smoothed, vld1q_f32(m_pressThreshold + Lane));
+			const uint32x4_t Release = vcltq_f32(Smoothed, vld1q_f32(m_releaseThreshold + Lane));
+			const uint32x4_t Hysteresis = vbicq_u32(vorrq_u32(vld1q_u32(m_hysteresis + Lane), Press), Release);
+			vst1q_u32(m_hysteresis + Lane, Hysteresis);
+
+			uint32x4_t Debounced = vld1q_u32(m_debounced + Lane);
+			const uint32x4_t Differs = veorq_u32(Hysteresis, Debounced);
+			uint32x4_t Count = vandq_u32(vaddq_u32(vld1q_u32(reinterpret_cast<const uint32*>(m_debounceCount + Lane)), One), Differs);
+			const uint32x4_t Flip = vcgtq_u32(Count, DebounceLimit);
+			Debounced = veorq_u32(Debounced, Flip);
+			Count = vbicq_u32(Count, Flip);
+			vst1q_u32(m_debounced + Lane, Debounced);
+			vst1q_u32(reinterpret_cast<uint32*>(m_debounceCount + Lane), Count);
+		}
+
+		if (++m_historyPos == m_window)
+		{
+			m_historyPos = 0;
+			for (int32 Lane = 0; Lane < m_numLanes; Lane += 4)
+			{
+				float32x4_t Sum = vdupq_n_f32(0.0f);
+				for (int32 Slot = 0; Slot < m_window; ++Slot)
+				{
+					Sum = vaddq_f32(Sum, vld1q_f32(m_history[Slot] + Lane));
+				}
+				vst1q_f32(m_sum + Lane, Sum);
+			}
+		}
+	}
+
+	m_samplesProcessed.fetch_add((uint64)m_batchCount * m_numChannels, std::memory_order_relaxed);
+	m_batchCount = 0;
+	Publish();
+#else
+	ProcessScalar();
+#endif
+}
+
+void FAnalogFilterBank::ProcessScalar()
+{
+	if (m_batchCount == 0)
+	{
+		return;
+	}
+	if (!m_bPrimed)
+	{
+		Prime(m_batch[0]);
+	}
+
+	// Same operations in the same order as the vector version, lane by lane
+	for (int32 Row = 0; Row < m_batchCount; ++Row)
+	{
+		float* History = m_history[m_historyPos];
+		for (int32 Lane = 0; Lane < m_numLanes; ++Lane)
+		{
+			const float Sample = m_batch[Row][Lane];
+			const float Oldest = History[Lane];
+			History[Lane] = Sample;
+			m_sum[Lane] = (m_sum[Lane] + Sample) - Oldest;
+			const float Average = m_sum[Lane] * m_invWindow;
+			m_smoothed[Lane] = m_smoothed[Lane] + m_alpha * (Average - m_smoothed[Lane]);
+
+			const uint32 Press = m_smoothed[Lane] > m_pressThreshold[Lane] ? ~0u : 0u;
+			const uint32 Release = m_smoothed[Lane] < m_releaseThreshold[Lane] ? ~0u : 0u;
+			m_hysteresis[Lane] = (m_hysteresis[Lane] | Press) & ~Release;
+
+			const uint32 Differs = m_hysteresis[Lane] ^ m_debounced[Lane];
+			int32 Count = (m_debounceCount[Lane] + 1) & (int32)Differs;
+			const uint32 Flip = Count > m_debounceSamples - 1 ? ~0u : 0u;
+			m_debounced[Lane] ^= Flip;
+			m_debounceCount[Lane] = Count & ~(int32)Flip;
+		}
+
+		if (++m_historyPos == m_window)
+		{
+			m_historyPos = 0;
+			for (int32 Lane = 0; Lane < m_numLanes; ++Lane)
+			{
+				float Sum = 0.0f;
+				for (int32 Slot = 0; Slot < m_window; ++Slot)
+				{
+					Sum += m_history[Slot][Lane];
+				}
+				m_sum[Lane] = Sum;
+			}
+		}
+	}
+
+	m_samplesProcessed.fetch_add((uint64)m_batchCount * m_numChannels, std::memory_order_relaxed);
+	m_batchCount = 0;
+	Publish();
+}
+
+void FAnalogFilterBank::Publish()
+{
+	for (int32 Channel = 0; Channel < m_numChannels; ++Channel)
+	{
+		m_publishedValue[Channel].store(m_smoothed[Channel], std::memory_order_relaxed);
+		m_publishedPressed[Channel].store(m_debounced[Channel] != 0, std::memory_order_relaxed);
+	}
+}
+
+float FAnalogFilterBank::GetValue(int32 Channel) const
+{
+	return Channel >= 0 && Channel < m_numChannels ? m_publishedValue[Channel].load(std::memory_order_relaxed) : 0.0f;
+}
+
+bool FAnalogFilterBank::IsPressed(int32 Channel) const
+{
+	return Channel >= 0 && Channel < m_numChannels && m_publishedPressed[Channel].load(std::memory_order_relaxed);
+}
@@ -0,0 +1,247 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoComboRecognizer.h"
+#include "HAL/PlatformTime.h"
+
+namespace
+{
+	/** The symbols of a combo sequence, without separators. False if it cannot be matched */
+	bool ReadSymbols(const FString& Sequence, TArray<uint8>& OutSymbols, FString& OutError)
+	{
+		for (int32 i = 0; i < Sequence.Len(); ++i)
+		{
+			const TCHAR Char = Sequence[i];
+			if (Char == TEXT(',') || Char == TEXT(' '))
+			{
+				continue;
+			}
+			if (Char <= 0 || Char > 127)
+			{
+				OutError = FString::Printf(TEXT("combo \"%s\" has a symbol the board cannot send"), *Sequence);
+				return false;
+			}
+			OutSymbols.Add((uint8)Char);
+		}
+		if (OutSymbols.Num() > FArduinoComboRecognizer::MaxPatternLength)
+		{
+			OutError = FString::Printf(TEXT("combo \"%s\" is longer than %d symbols"), *Sequence, FArduinoComboRecognizer::MaxPatternLength);
+			return false;
+		}
+		return true;
+	}
+}
+
+FArduinoComboRecognizer::FArduinoComboRecognizer()
+	: m_numClasses(1)
+	, m_numStates(1)
+	, m_state(0)
+	, m_symbolCount(0)
+{
+	FMemory::Memzero(m_classOf);
+	FMemory::Memzero(m_symbolCycles);
+	m_next.Add(0);
+	m_outputStart.Init(0, 2);
+}
+
+bool FArduinoComboRecognizer::Compile(const TArray<FArduinoComboPattern>& Patterns, FString* OutError)
+{
+	// Built into locals and kept only if every pattern is valid
+	uint8 ClassOf[256] = {};
+	int32 NumClasses = 1;
+	TArray<TArray<uint8>> Sequences;
+	Sequences.Reserve(Patterns.Num());
+	for (const FArduinoComboPattern& Pattern : Patterns)
+	{
+		TArray<uint8>& Symbols = Sequences.AddDefaulted_GetRef();
+		FString Error;
+		if (!ReadSymbols(Pattern.Sequence, Symbols, Error))
+		{
+			if (OutError != nullptr)
+			{
+				*OutError = MoveTemp(Error);
+			}
+			// Match nothing rather than half a set
+			Compile(TArray<FArduinoComboPattern>());
+			return false;
+		}
+		for (uint8 Symbol : Symbols)
+		{
+			if (ClassOf[Symbol] == 0)
+			{
+				ClassOf[Symbol] = (uint8)NumClasses++;
+			}
+		}
+	}
+
+	// The trie, -1 where it has no edge yet
+	TArray<int32> Next;
+	Next.Init(-1, NumClasses);
+	TArray<TArray<int32>> StateOutputs;
+	StateOutputs.AddDefaulted();
+	TArray<FCompiledPattern> CompiledPatterns;
+	TArray<FResult> Results;
+	TMap<uint32, int32> ResultOfKey;
+	for (int32 PatternIndex = 0; PatternIndex < Patterns.Num(); ++PatternIndex)
+	{
+		const TArray<uint8>& Symbols = Sequences[PatternIndex];
+		if (Symbols.Num() == 0)
+		{
+			continue;
+		}
+
+		int32 State = 0;
+		for (uint8 Symbol : Symbols)
+		{
+			const int32 Edge = State * NumClasses + ClassOf[Symbol];
+			if (Next[Edge] == -1)
+			{
+				Next[Edge] = StateOutputs.Num();
+				StateOutputs.AddDefaulted();
+				Next.AddUninitialized(NumClasses);
+				FMemory::Memset(Next.GetData() + Next.Num() - NumClasses, 0xff, NumClasses * sizeof(int32));
+			}
+			State = Next[Edge];
+		}
+
+		const FArduinoComboPattern& Pattern = Patterns[PatternIndex];
+		const uint32 Key = (uint32)Pattern.Opcode | ((uint32)(uint16)Pattern.Payload << 8);
+		int32* Result = ResultOfKey.Find(Key);
+		if (Result == nullptr)
+		{
+			Result = &ResultOfKey.Add(Key, Results.Num());
+			Results.Add({ Pattern.Opcode, Pattern.Payload });
+		}
+
+		FCompiledPattern& Compiled = CompiledPatterns.AddDefaulted_GetRef();
+		Compiled.WindowCycles = Pattern.WindowSeconds > 0.0 ? FMath::Max<uint64>((uint64)(Pattern.WindowSeconds / FPlatformTime::GetSecondsPerCycle64()), 1) : 0;
+		Compiled.Length = Symbols.Num();
+		Compiled.Result = *Result;
+		StateOutputs[State].Add(CompiledPatterns.Num() - 1);
+	}
+
+	// Breadth first, so a state's suffix (fail) state is complete before the state itself.
+	// Missing edges become the suffix state's edge, which makes the table a plain DFA.
+	// A state's outputs are its own patterns, then its suffix state's, so the longest come first
+	const int32 NumStates = StateOutputs.Num();
+	TArray<int32> Fail;
+	Fail.Init(0, NumStates);
+	TArray<int32> Queue;
+	Queue.Reserve(NumStates);
+	Next[0] = 0;
+	for (int32 Class = 1; Class < NumClasses; ++Class)
+	{
+		if (Next[Class] == -1)
+		{
+			Next[Class] = 0;
+		}
+		else
+		{
+			Queue.Add(Next[Class]);
+		}
+	}
+	for (int32 QueueIndex = 0; QueueIndex < Queue.Num(); ++QueueIndex)
+	{
+		const int32 State = Queue[QueueIndex];
+		StateOutputs[State].Append(StateOutputs[Fail[State]]);
+
+		int32* StateNext = Next.GetData() + State * NumClasses;
+		const int32* FailNext = Next.GetData() + Fail[State] * NumClasses;
+		StateNext[0] = 0;
+		for (int32 Class = 1; Class < NumClasses; ++Class)
+		{
+			if (StateNext[Class] == -1)
+			{
+				StateNext[Class] = FailNext[Class];
+			}
+			else
+			{
+				Fail[StateNext[Class]] = FailNext[Class];
+				Queue.Add(StateNext[Class]);
+			}
+		}
+	}
+
+	FMemory::Memcpy(m_classOf, ClassOf, sizeof(m_classOf));
+	m_numClasses = NumClasses;
+	m_numStates = NumStates;
+	m_next = MoveTemp(Next);
+	m_outputStart.SetNumUninitialized(NumStates + 1);
+	m_outputs.Reset();
+	for (int32 State = 0; State < NumStates; ++State)
+	{
+		m_outputStart[State] = m_outputs.Num();
+		m_outputs.Append(StateOutputs[State]);
+	}
+	m_outputStart[NumStates] = m_outputs.Num();
+	m_patterns = MoveTemp(CompiledPatterns);
+	m_results = MoveTemp(Results);
+	m_resultEnd.Init(0, m_results.Num());
+	Reset();
+	return true;
+}
+
+int32 FArduinoComboRecognizer::Parse(const char* pData, int32 length, uint64 readCycles, TArray<FArduinoComboMatch>& outMatches)
+{
+	const int32 StartNum = outMatches.Num();
+	const int32* Next = m_next.GetData();
+	const int32* OutputStart = m_outputStart.GetData();
+	const int32* Outputs = m_outputs.GetData();
+	int32 State = m_state;
+	for (int32 i = 0; i < length; ++i)
+	{
+		const int32 Class = m_classOf[(uint8)pData[i]];
+		if (Class == 0)
+		{
+			State = 0;
+			continue;
+		}
+
+		const uint64 Index = ++m_symbolCount;
+		m_symbolCycles[Index % MaxPatternLength] = readCycles;
+		State = Next[State * m_numClasses + Class];
+		for (int32 Output = OutputStart[State]; Output < OutputStart[State + 1]; ++Output)
+		{
+			const FCompiledPattern& Pattern = m_patterns[Outputs[Output]];
+			const uint64 First = Index - Pattern.Length + 1;
+			uint64& ResultEnd = m_resultEnd[Pattern.Result];
+			if (First <= ResultEnd)
+			{
+				continue;
+			}
+			const uint64 FirstCycles = m_symbolCycles[First % MaxPatternLength];
+			if (Pattern.WindowCycles != 0 && FirstCycles != 0 && readCycles - FirstCycles > Pattern.WindowCycles)
+			{
+				continue;
+			}
+			ResultEnd = Index;
+			const FResult& Result = m_results[Pattern.Result];
+			outMatches.Add({ Result.Opcode, Result.Payload });
+		}
+	}
+	m_state = State;
+	return outMatches.Num() - StartNum;
+}
+
+void FArduinoComboRecognizer::Reset()
+{
+	// Symbol indices keep counting, so the match ends recorded before still cannot block a new match
+	m_state = 0;
+}
+
+TArray<FArduinoComboPattern> FArduinoComboRecognizer::MakeDefaultPatterns(double StepWindowSeconds)
+{
+	TArray<FArduinoComboPattern> Patterns;
+	for (const TCHAR* Step : { TEXT("L,R"), TEXT("R,L") })
+	{
+		FArduinoComboPattern& Pattern = Patterns.AddDefaulted_GetRef();
+		Pattern.Sequence = Step;
+		Pattern.WindowSeconds = StepWindowSeconds;
+		Pattern.Opcode = EArduinoOpcode::Run;
+		Pattern.Payload = 1;
+	}
+	FArduinoComboPattern& Jump = Patterns.AddDefaulted_GetRef();
+	Jump.Sequence = TEXT("J");
+	Jump.Opcode = EArduinoOpcode::Jump;
+	return Patterns;
+}
@@ -0,0 +1,32 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "CoreMinimal.h"
+#include "Modules/ModuleManager.h"
+#include "Containers/Ticker.h"
+#include "ArduinoInputStats.h"
+
+class FArduinoInputCoreModule : public IModuleInterface
+{
+public:
+	virtual void StartupModule() override
+	{
+		// Publish the input counters once per frame, whichever threads bumped them
+		StatsTickerHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&FArduinoInputCoreModule::PublishStats));
+	}
+
+	virtual void ShutdownModule() override
+	{
+		FTicker::GetCoreTicker().RemoveTicker(StatsTickerHandle);
+	}
+
+private:
+	static bool PublishStats(float DeltaTime)
+	{
+		FArduinoInputCounters::PublishStats(DeltaTime);
+		return true;
+	}
+
+	FDelegateHandle StatsTickerHandle;
+};
+
+IMPLEMENT_MODULE( FArduinoInputCoreModule, ArduinoInputCore );
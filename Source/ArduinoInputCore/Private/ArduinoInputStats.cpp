@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoInputStats.h"
+#include <atomic>
+
+DEFINE_STAT(STAT_ArduinoReadInput);
+DEFINE_STAT(STAT_ArduinoAnalyzeInput);
+DEFINE_STAT(STAT_ArduinoCharacterInput);
+DEFINE_STAT(STAT_ArduinoWriteOutput);
+DEFINE_STAT(STAT_ArduinoBytesPerSecond);
+DEFINE_STAT(STAT_ArduinoGesturesPerSecond);
+DEFINE_STAT(STAT_ArduinoQueueDepth);
+DEFINE_STAT(STAT_ArduinoDroppedBytes);
+DEFINE_STAT(STAT_ArduinoReconnects);
+
+namespace
+{
+	std::atomic<uint64> GBytesRead(0);
+	std::atomic<uint64> GGestures(0);
+	std::atomic<uint64> GDroppedBytes(0);
+	std::atomic<uint32> GReconnects(0);
+	std::atomic<uint64> GGameThreadCycles(0);
+
+	/** Totals at the last PublishStats, game thread only */
+	uint64 GPublishedBytesRead = 0;
+	uint64 GPublishedGestures = 0;
+}
+
+void FArduinoInputCounters::AddBytesRead(uint32 Count)
+{
+	GBytesRead.fetch_add(Count, std::memory_order_relaxed);
+}
+
+void FArduinoInputCounters::AddGestures(uint32 Count)
+{
+	GGestures.fetch_add(Count, std::memory_order_relaxed);
+}
+
+void FArduinoInputCounters::AddDroppedBytes(uint32 Count)
+{
+	GDroppedBytes.fetch_add(Count, std::memory_order_relaxed);
+}
+
+void FArduinoInputCounters::AddReconnect()
+{
+	GReconnects.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FArduinoInputCounters::AddGameThreadCycles(uint64 Cycles)
+{
+	GGameThreadCycles.fetch_add(Cycles, std::memory_order_relaxed);
+}
+
+uint64 FArduinoInputCounters::GetGameThreadCycles()
+{
+	return GGameThreadCycles.load(std::memory_order_relaxed);
+}
+
+void FArduinoInputCounters::PublishStats(float DeltaSeconds)
+{
+	const uint64 BytesRead = GBytesRead.load(std::memory_order_relaxed);
+	const uint64 Gestures = GGestures.load(std::memory_order_relaxed);
+	if (DeltaSeconds > 0.0f)
+	{
+		SET_FLOAT_STAT(STAT_ArduinoBytesPerSecond, (BytesRead - GPublishedBytesRead) / DeltaSeconds);
+		SET_FLOAT_STAT(STAT_ArduinoGesturesPerSecond, (Gestures - GPublishedGestures) / DeltaSeconds);
+	}
+	GPublishedBytesRead = BytesRead;
+	GPublishedGestures = Gestures;
+
+	SET_DWORD_STAT(STAT_ArduinoDroppedBytes, (uint32)GDroppedBytes.load(std::memory_order_relaxed));
+	SET_DWORD_STAT(STAT_ArduinoReconnects, GReconnects.load(std::memory_order_relaxed));
+}
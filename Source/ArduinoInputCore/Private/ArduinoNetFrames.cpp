@@ -0,0 +1,303 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoNetFrames.h"
+#include "HAL/PlatformTime.h"
+
+namespace
+{
+	/** Bits of an opcode on the wire */
+	const int32 OpcodeBits = 2;
+	static_assert((uint32)EArduinoOpcode::Last < (1u << OpcodeBits), "EArduinoOpcode outgrew the net frame opcode field, widen OpcodeBits");
+
+	/** Bit writes and reads of FArduinoNetPacket::Serialize, counting the bits */
+	class FPacketBits
+	{
+	public:
+		explicit FPacketBits(FArchive& InAr)
+			: Ar(InAr)
+			, Bits(0)
+		{
+		}
+
+		/** Value below 2^NumBits, in NumBits bits */
+		void SerializeBits(uint32& Value, int32 NumBits)
+		{
+			Ar.SerializeInt(Value, 1u << NumBits);
+			Bits += NumBits;
+		}
+
+		bool SerializeFlag(bool bValue)
+		{
+			uint32 Value = bValue ? 1 : 0;
+			SerializeBits(Value, 1);
+			return Value != 0;
+		}
+
+		/** 4 bits at a time, lowest first, each followed by a more-to-come bit */
+		void SerializeVarInt(uint32& Value)
+		{
+			if (Ar.IsLoading())
+			{
+				Value = 0;
+				for (int32 Shift = 0; Shift < 32 && !Ar.IsError(); Shift += 4)
+				{
+					uint32 Chunk = 0;
+					SerializeBits(Chunk, 4);
+					Value |= Chunk << Shift;
+					if (!SerializeFlag(false))
+					{
+						break;
+					}
+				}
+			}
+			else
+			{
+				uint32 Rest = Value;
+				do
+				{
+					uint32 Chunk = Rest & 0xf;
+					SerializeBits(Chunk, 4);
+					Rest >>= 4;
+					SerializeFlag(Rest != 0);
+				} while (Rest != 0);
+			}
+		}
+
+		FArchive& Ar;
+		int32 Bits;
+	};
+
+	/** What a command of this opcode usually carries, sent as a single bit */
+	int16 UsualPayload(EArduinoOpcode Opcode)
+	{
+		return Opcode == EArduinoOpcode::Run ? 1 : 0;
+	}
+
+	/** Distance from B to A on the wrapping sequence, negative if A is older */
+	int32 SequenceDiff(uint16 A, uint16 B)
+	{
+		return (int16)(uint16)(A - B);
+	}
+}
+
+bool FArduinoNetPacket::Serialize(FArchive& Ar, int32* OutBits)
+{
+	FPacketBits Bits(Ar);
+	const bool bLoading = Ar.IsLoading();
+
+	uint32 NewestSequence = Frames.Num() > 0 ? Frames.Last().Sequence : 0;
+	uint32 FrameCount = (uint32)FMath::Clamp(Frames.Num(), 1, MaxFrames) - 1;
+	Bits.SerializeBits(NewestSequence, 16);
+	Bits.SerializeBits(FrameCount, 3);
+	if (bLoading)
+	{
+		Frames.Reset();
+		Frames.SetNum(FrameCount + 1);
+	}
+	else
+	{
+		// An empty packet goes out as one empty frame
+		check(Frames.Num() <= MaxFrames);
+	}
+
+	// Ages go down command after command, sent as the difference
+	bool bFirstCommand = true;
+	uint32 PreviousAge = 0;
+	uint32 PreviousDeviceId = 0;
+	for (int32 FrameIndex = 0; FrameIndex < Frames.Num() && !Ar.IsError(); ++FrameIndex)
+	{
+		FArduinoNetFrame& Frame = Frames[FrameIndex];
+		Frame.Sequence = (uint16)(NewestSequence - (Frames.Num() - 1 - FrameIndex));
+		for (int32 CommandIndex = 0; ; ++CommandIndex)
+		{
+			const bool bMore = Bits.SerializeFlag(CommandIndex < Frame.Commands.Num());
+			if (!bMore || Ar.IsError())
+			{
+				break;
+			}
+			if (bLoading)
+			{
+				if (Frame.Commands.Num() >= MaxCommandsPerFrame)
+				{
+					Ar.SetError();
+					break;
+				}
+				Frame.Commands.AddDefaulted();
+			}
+			FArduinoNetCommand& Command = Frame.Commands[CommandIndex];
+
+			uint32 Opcode = (uint32)Command.Opcode;
+			Bits.SerializeBits(Opcode, OpcodeBits);
+			Command.Opcode = (EArduinoOpcode)Opcode;
+
+			uint32 DeviceId = Command.DeviceId;
+			if (!Bits.SerializeFlag(DeviceId == PreviousDeviceId))
+			{
+				Bits.SerializeBits(DeviceId, 8);
+			}
+			else
+			{
+				DeviceId = PreviousDeviceId;
+			}
+			Command.DeviceId = (uint8)DeviceId;
+			PreviousDeviceId = DeviceId;
+
+			if (Bits.SerializeFlag(Command.Payload == UsualPayload(Command.Opcode)))
+			{
+				Command.Payload = UsualPayload(Command.Opcode);
+			}
+			else
+			{
+				// Zigzag, so small negative payloads stay short too
+				uint32 Zigzag = (uint32)(((int32)Command.Payload << 1) ^ ((int32)Command.Payload >> 31));
+				Bits.SerializeVarInt(Zigzag);
+				Command.Payload = (int16)((int32)(Zigzag >> 1) ^ -(int32)(Zigzag & 1));
+			}
+
+			uint32 AgeDelta = bFirstCommand ? Command.AgeMs : PreviousAge - FMath::Min(Command.AgeMs, PreviousAge);
+			Bits.SerializeVarInt(AgeDelta);
+			Command.AgeMs = bFirstCommand ? AgeDelta : PreviousAge - FMath::Min(AgeDelta, PreviousAge);
+			PreviousAge = Command.AgeMs;
+			bFirstCommand = false;
+		}
+	}
+	if (!bLoading && Frames.Num() == 0)
+	{
+		// The one empty frame the header announced
+		Bits.SerializeFlag(false);
+	}
+
+	if (OutBits != nullptr)
+	{
+		*OutBits = Bits.Bits;
+	}
+	if (bLoading && Ar.IsError())
+	{
+		Frames.Reset();
+		return false;
+	}
+	return true;
+}
+
+FArduinoNetFrameSender::FArduinoNetFrameSender(int32 InRedundancy)
+	: Redundancy(0)
+	, NextSequence(0)
+	, NewestSends(0)
+{
+	SetRedundancy(InRedundancy);
+}
+
+void FArduinoNetFrameSender::SetRedundancy(int32 InRedundancy)
+{
+	Redundancy = FMath::Clamp(InRedundancy, 0, FArduinoNetPacket::MaxFrames - 1);
+	if (Frames.Num() > Redundancy + 1)
+	{
+		Frames.RemoveAt(0, Frames.Num() - (Redundancy + 1));
+	}
+}
+
+void FArduinoNetFrameSender::AddFrame(const FArduinoCommand* Commands, int32 Num)
+{
+	if (Num <= 0)
+	{
+		return;
+	}
+	int32 Added = 0;
+	do
+	{
+		const int32 Count = FMath::Min(Num - Added, FArduinoNetPacket::MaxCommandsPerFrame);
+		if (Frames.Num() > Redundancy)
+		{
+			// Only ever a few frames, cheaper than a ring
+			Frames.RemoveAt(0, Frames.Num() - Redundancy, false);
+		}
+		FPendingFrame& Frame = Frames.AddDefaulted_GetRef();
+		Frame.Sequence = NextSequence++;
+		Frame.Commands.Append(Commands + Added, Count);
+		Added += Count;
+	} while (Added < Num);
+	NewestSends = 0;
+}
+
+bool FArduinoNetFrameSender::HasPendingSends() const
+{
+	return Frames.Num() > 0 && NewestSends <= Redundancy;
+}
+
+void FArduinoNetFrameSender::MakePacket(uint64 NowCycles, FArduinoNetPacket& OutPacket)
+{
+	OutPacket.Frames.Reset();
+	uint32 PreviousAge = MAX_uint32;
+	for (const FPendingFrame& Pending : Frames)
+	{
+		FArduinoNetFrame& Frame = OutPacket.Frames.AddDefaulted_GetRef();
+		Frame.Sequence = Pending.Sequence;
+		for (const FArduinoCommand& Command : Pending.Commands)
+		{
+			FArduinoNetCommand& NetCommand = Frame.Commands.AddDefaulted_GetRef();
+			NetCommand.Opcode = Command.Opcode;
+			NetCommand.Payload = Command.Payload;
+			NetCommand.DeviceId = Command.DeviceId;
+
+			// An unknown read time counts as the command before's. Read times out of order are evened out, ages only go down
+			uint32 Age = PreviousAge != MAX_uint32 ? PreviousAge : 0;
+			if (Command.TimestampCycles != 0)
+			{
+				Age = NowCycles > Command.TimestampCycles ? (uint32)FMath::Min(FPlatformTime::ToMilliseconds64(NowCycles - Command.TimestampCycles), (double)MAX_int32) : 0;
+			}
+			NetCommand.AgeMs = FMath::Min(Age, PreviousAge);
+			PreviousAge = NetCommand.AgeMs;
+		}
+	}
+	++NewestSends;
+}
+
+void FArduinoNetFrameSender::Reset()
+{
+	Frames.Reset();
+	NextSequence = 0;
+	NewestSends = 0;
+}
+
+FArduinoNetFrameReceiver::FArduinoNetFrameReceiver()
+{
+	Reset();
+}
+
+int32 FArduinoNetFrameReceiver::Accept(const FArduinoNetPacket& Packet, TArray<const FArduinoNetFrame*>& OutFrames)
+{
+	const int32 StartNum = OutFrames.Num();
+	for (int32 Index = 0; Index < Packet.Frames.Num(); ++Index)
+	{
+		const FArduinoNetFrame& Frame = Packet.Frames[Index];
+		if (!bHasSequence)
+		{
+			// The first packet may hold frames sent before: all of them are new
+			bHasSequence = true;
+		}
+		else
+		{
+			const int32 Diff = SequenceDiff(Frame.Sequence, LastSequence);
+			if (Diff <= 0)
+			{
+				continue;
+			}
+			FramesLost += Diff - 1;
+			FramesRecovered += Index < Packet.Frames.Num() - 1;
+		}
+		LastSequence = Frame.Sequence;
+		++FramesTaken;
+		OutFrames.Add(&Frame);
+	}
+	return OutFrames.Num() - StartNum;
+}
+
+void FArduinoNetFrameReceiver::Reset()
+{
+	LastSequence = 0;
+	bHasSequence = false;
+	FramesTaken = 0;
+	FramesRecovered = 0;
+	FramesLost = 0;
+}
@@ -0,0 +1,231 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoOutputQueue.h"
+#include "ArduinoInputStats.h"
+#include "ArduinoTransport.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+
+FArduinoOutputQueue::FArduinoOutputQueue()
+	: Port(nullptr)
+	, Thread(nullptr)
+	, WakeEvent(FPlatformProcess::GetSynchEventFromPool(false))
+	, bStopping(false)
+	, DirtySlots(0)
+	, Sequence(0)
+	, BatchUsed(0)
+	, BatchFrames(0)
+	, BytesWritten(0)
+	, WriteCalls(0)
+	, FramesWritten(0)
+	, Coalesced(0)
+	, Dropped(0)
+{
+	for (int32 Slot = 0; Slot < SlotCount; ++Slot)
+	{
+		SlotPayload[Slot].store(0, std::memory_order_relaxed);
+		SlotPostCycles[Slot].store(0, std::memory_order_relaxed);
+	}
+}
+
+FArduinoOutputQueue::~FArduinoOutputQueue()
+{
+	Close();
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+}
+
+bool FArduinoOutputQueue::Start(IArduinoTransport& InPort, uint8 FirstSequence)
+{
+	if (Thread != nullptr)
+	{
+		return false;
+	}
+
+	Port = &InPort;
+	Sequence = FirstSequence;
+	BatchUsed = 0;
+	BatchFrames = 0;
+
+	// Pulses posted while closed are stale by now. Slots are kept, so the board gets the latest state on (re)connect
+	Dropped.fetch_add(Events.Size(), std::memory_order_relaxed);
+	Events.Consume(Events.Size());
+
+	bStopping = false;
+	Thread = FRunnableThread::Create(this, TEXT("ArduinoOutput"), 0, TPri_AboveNormal);
+	if (Thread == nullptr)
+	{
+		return false;
+	}
+
+	// Send the state posted before Start
+	WakeEvent->Trigger();
+	return true;
+}
+
+void FArduinoOutputQueue::Close()
+{
+	if (Thread == nullptr)
+	{
+		return;
+	}
+
+	Thread->Kill(true);
+	delete Thread;
+	Thread = nullptr;
+	Port = nullptr;
+}
+
+bool FArduinoOutputQueue::SetLedColor(int32 Led, uint8 R, uint8 G, uint8 B)
+{
+	if (Led < 0 || Led >= MaxLeds)
+	{
+		return false;
+	}
+	SetSlot(Led, (uint32)Led | ((uint32)R << 8) | ((uint32)G << 16) | ((uint32)B << 24));
+	return true;
+}
+
+bool FArduinoOutputQueue::SetRumble(int32 Motor, uint8 Strength)
+{
+	if (Motor < 0 || Motor >= MaxMotors)
+	{
+		return false;
+	}
+	SetSlot(MaxLeds + Motor, (uint32)Motor | ((uint32)Strength << 8));
+	return true;
+}
+
+bool FArduinoOutputQueue::PostPulse(int32 Motor, uint8 Strength, uint16 DurationMs)
+{
+	if (Motor < 0 || Motor >= MaxMotors)
+	{
+		return false;
+	}
+
+	FArduinoOutputEvent Event;
+	Event.Type = EArduinoFrameType::Rumble;
+	Event.Payload[0] = (uint8)Motor;
+	Event.Payload[1] = Strength;
+	Event.Payload[2] = (uint8)DurationMs;
+	Event.Payload[3] = (uint8)(DurationMs >> 8);
+	Event.PostCycles = FPlatformTime::Cycles64();
+	if (!Events.Push(Event))
+	{
+		Dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	WakeEvent->Trigger();
+	return true;
+}
+
+void FArduinoOutputQueue::SetSlot(int32 Slot, uint32 Payload)
+{
+	// Payload before the dirty bit, so the writer never sends a slot it has not seen the value of
+	SlotPostCycles[Slot].store(FPlatformTime::Cycles64(), std::memory_order_relaxed);
+	SlotPayload[Slot].store(Payload, std::memory_order_relaxed);
+	const uint64 Bit = 1ull << Slot;
+	if ((DirtySlots.fetch_or(Bit, std::memory_order_acq_rel) & Bit) != 0)
+	{
+		Coalesced.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	WakeEvent->Trigger();
+}
+
+uint32 FArduinoOutputQueue::Run()
+{
+	while (!bStopping.load(std::memory_order_acquire))
+	{
+		WakeEvent->Wait();
+		Flush();
+	}
+
+	// What was posted before Close still goes out
+	Flush();
+	return 0;
+}
+
+void FArduinoOutputQueue::Stop()
+{
+	bStopping.store(true, std::memory_order_release);
+	WakeEvent->Trigger();
+}
+
+void FArduinoOutputQueue::Flush()
+{
+	SCOPE_CYCLE_COUNTER(STAT_ArduinoWriteOutput);
+	ARDUINO_TRACE_SCOPE(ArduinoWriteOutput);
+	uint64 Dirty = DirtySlots.exchange(0, std::memory_order_acq_rel);
+	while (Dirty != 0)
+	{
+		const int32 Slot = (int32)FPlatformMath::CountTrailingZeros64(Dirty);
+		Dirty &= Dirty - 1;
+
+		const uint32 Payload = SlotPayload[Slot].load(std::memory_order_relaxed);
+		const uint8 Bytes[4] = { (uint8)Payload, (uint8)(Payload >> 8), (uint8)(Payload >> 16), (uint8)(Payload >> 24) };
+		if (Slot < MaxLeds)
+		{
+			AppendFrame(EArduinoFrameType::LedColor, Bytes, SlotPostCycles[Slot].load(std::memory_order_relaxed));
+		}
+		else
+		{
+			// Continuous strength: duration 0
+			const uint8 RumbleBytes[4] = { Bytes[0], Bytes[1], 0, 0 };
+			AppendFrame(EArduinoFrameType::Rumble, RumbleBytes, SlotPostCycles[Slot].load(std::memory_order_relaxed));
+		}
+	}
+
+	const FArduinoOutputEvent* Pending = nullptr;
+	uint32 Count;
+	while ((Count = Events.PeekContiguous(Pending)) > 0)
+	{
+		for (uint32 i = 0; i < Count; ++i)
+		{
+			AppendFrame(Pending[i].Type, Pending[i].Payload, Pending[i].PostCycles);
+		}
+		Events.Consume(Count);
+	}
+
+	WriteBatch();
+}
+
+void FArduinoOutputQueue::AppendFrame(EArduinoFrameType Type, const uint8* Payload, uint64 PostCycles)
+{
+	if (BatchUsed + ArduinoProtocol::MaxEncodedFrame + 1 > BatchBytes || BatchFrames == MaxBatchFrames)
+	{
+		WriteBatch();
+	}
+	BatchUsed += FArduinoFrameParser::BuildFrame(Sequence++, Type, Payload, 4, Batch + BatchUsed);
+	BatchPostCycles[BatchFrames++] = PostCycles;
+}
+
+void FArduinoOutputQueue::WriteBatch()
+{
+	if (BatchFrames == 0)
+	{
+		return;
+	}
+
+	if (Port->WriteData(reinterpret_cast<char*>(Batch), (unsigned int)BatchUsed))
+	{
+		const uint64 WrittenCycles = FPlatformTime::Cycles64();
+		for (int32 i = 0; i < BatchFrames; ++i)
+		{
+			QueueLatency.Record((uint64)(FPlatformTime::ToMilliseconds64(WrittenCycles - BatchPostCycles[i]) * 1000.0));
+		}
+		BytesWritten.fetch_add(BatchUsed, std::memory_order_relaxed);
+		WriteCalls.fetch_add(1, std::memory_order_relaxed);
+		FramesWritten.fetch_add(BatchFrames, std::memory_order_relaxed);
+	}
+	else
+	{
+		// The connector notices the lost board, the frames are not worth retrying
+		Dropped.fetch_add(BatchFrames, std::memory_order_relaxed);
+	}
+	BatchUsed = 0;
+	BatchFrames = 0;
+}
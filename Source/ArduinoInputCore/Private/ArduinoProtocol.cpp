@@ -0,0 +1,212 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoProtocol.h"
+#include <string.h>
+
+namespace
+{
+	struct FArduinoCrc16Table
+	{
+		uint16 Entries[256];
+	};
+
+	constexpr FArduinoCrc16Table BuildArduinoCrc16Table()
+	{
+		FArduinoCrc16Table Table = {};
+		for (int32 Byte = 0; Byte < 256; ++Byte)
+		{
+			uint16 Crc = (uint16)(Byte << 8);
+			for (int32 Bit = 0; Bit < 8; ++Bit)
+			{
+				Crc = (Crc & 0x8000) ? (uint16)((Crc << 1) ^ 0x1021) : (uint16)(Crc << 1);
+			}
+			Table.Entries[Byte] = Crc;
+		}
+		return Table;
+	}
+
+	constexpr FArduinoCrc16Table GArduinoCrc16Table = BuildArduinoCrc16Table();
+}
+
+uint16 ArduinoProtocol::Crc16(const uint8* pData, int32 length, uint16 crc)
+{
+	for (int32 i = 0; i < length; ++i)
+	{
+		crc = (uint16)((crc << 8) ^ GArduinoCrc16Table.Entries[((crc >> 8) ^ pData[i]) & 0xFF]);
+	}
+	return crc;
+}
+
+int32 ArduinoProtocol::CobsEncode(const uint8* pData, int32 length, uint8* pOut)
+{
+	int32 codeIndex = 0;
+	int32 outIndex = 1;
+	uint8 code = 1;
+	for (int32 i = 0; i < length; ++i)
+	{
+		if (pData[i] == 0)
+		{
+			pOut[codeIndex] = code;
+			codeIndex = outIndex++;
+			code = 1;
+			continue;
+		}
+		pOut[outIndex++] = pData[i];
+		if (++code == 0xFF)
+		{
+			pOut[codeIndex] = code;
+			codeIndex = outIndex++;
+			code = 1;
+		}
+	}
+	pOut[codeIndex] = code;
+	return outIndex;
+}
+
+int32 ArduinoProtocol::CobsDecode(const uint8* pData, int32 length, uint8* pOut, int32 outCapacity)
+{
+	int32 inIndex = 0;
+	int32 outIndex = 0;
+	while (inIndex < length)
+	{
+		const uint8 code = pData[inIndex++];
+		if (code == 0 || inIndex + code - 1 > length)
+		{
+			return -1;
+		}
+		for (int32 i = 1; i < code; ++i)
+		{
+			if (outIndex >= outCapacity)
+			{
+				return -1;
+			}
+			pOut[outIndex++] = pData[inIndex++];
+		}
+		/** A code below 0xFF stands for a zero, except at the very end of the frame */
+		if (code != 0xFF && inIndex < length)
+		{
+			if (outIndex >= outCapacity)
+			{
+				return -1;
+			}
+			pOut[outIndex++] = 0;
+		}
+	}
+	return outIndex;
+}
+
+FArduinoFrameParser::FArduinoFrameParser()
+	: m_encodedLength(0), m_bDiscarding(false), m_bHaveSequence(false), m_lastSequence(0)
+{
+}
+
+void FArduinoFrameParser::Reset()
+{
+	m_encodedLength = 0;
+	m_bDiscarding = false;
+	m_bHaveSequence = false;
+}
+
+int32 FArduinoFrameParser::Parse(const char* pData, int32 length, TArray<FArduinoFrame>& outFrames)
+{
+	const int32 startNum = outFrames.Num();
+	const uint8* pBytes = reinterpret_cast<const uint8*>(pData);
+	while (length > 0)
+	{
+		const uint8* pDelimiter = static_cast<const uint8*>(memchr(pBytes, 0, length));
+		const int32 chunk = pDelimiter ? (int32)(pDelimiter - pBytes) : length;
+
+		if (!m_bDiscarding)
+		{
+			if (m_encodedLength + chunk > ArduinoProtocol::MaxEncodedFrame)
+			{
+				++m_stats.OversizeErrors;
+				m_bDiscarding = true;
+				m_encodedLength = 0;
+			}
+			else
+			{
+				memcpy(m_encoded + m_encodedLength, pBytes, chunk);
+				m_encodedLength += chunk;
+			}
+		}
+
+		if (!pDelimiter)
+		{
+			break;
+		}
+
+		if (m_bDiscarding)
+		{
+			m_bDiscarding = false;
+		}
+		else if (m_encodedLength > 0)
+		{
+			FinishFrame(outFrames);
+		}
+		m_encodedLength = 0;
+
+		pBytes += chunk + 1;
+		length -= chunk + 1;
+	}
+	return outFrames.Num() - startNum;
+}
+
+void FArduinoFrameParser::FinishFrame(TArray<FArduinoFrame>& outFrames)
+{
+	uint8 decoded[ArduinoProtocol::MaxDecodedFrame];
+	const int32 decodedLength = ArduinoProtocol::CobsDecode(m_encoded, m_encodedLength, decoded, sizeof(decoded));
+	if (decodedLength < 4)
+	{
+		++m_stats.FramingErrors;
+		return;
+	}
+
+	const int32 bodyLength = decodedLength - 2;
+	const uint16 expectedCrc = (uint16)(decoded[bodyLength] | (decoded[bodyLength + 1] << 8));
+	if (ArduinoProtocol::Crc16(decoded, bodyLength) != expectedCrc)
+	{
+		++m_stats.CrcErrors;
+		return;
+	}
+
+	FArduinoFrame& frame = outFrames[outFrames.AddUninitialized()];
+	frame.Sequence = decoded[0];
+	frame.Type = (EArduinoFrameType)decoded[1];
+	frame.PayloadLength = (uint8)(bodyLength - 2);
+	memcpy(frame.Payload, decoded + 2, frame.PayloadLength);
+
+	/** Sequence numbers wrap at 256. A backwards step means the device restarted, not a huge gap */
+	const uint8 missed = (uint8)(frame.Sequence - m_lastSequence - 1);
+	if (m_bHaveSequence && missed < 128)
+	{
+		m_stats.SequenceGaps += missed;
+	}
+	m_bHaveSequence = true;
+	m_lastSequence = frame.Sequence;
+	++m_stats.FramesOk;
+}
+
+int32 FArduinoFrameParser::BuildFrame(uint8 sequence, EArduinoFrameType type, const uint8* pPayload, int32 payloadLength, uint8* pOut)
+{
+	if (payloadLength < 0 || payloadLength > ArduinoProtocol::MaxPayload)
+	{
+		return 0;
+	}
+
+	uint8 decoded[ArduinoProtocol::MaxDecodedFrame];
+	decoded[0] = sequence;
+	decoded[1] = (uint8)type;
+	if (payloadLength > 0)
+	{
+		memcpy(decoded + 2, pPayload, payloadLength);
+	}
+	const uint16 crc = ArduinoProtocol::Crc16(decoded, payloadLength + 2);
+	decoded[payloadLength + 2] = (uint8)(crc & 0xFF);
+	decoded[payloadLength + 3] = (uint8)(crc >> 8);
+
+	const int32 encodedLength = ArduinoProtocol::CobsEncode(decoded, payloadLength + 4, pOut);
+	pOut[encodedLength] = 0;
+	return encodedLength + 1;
+}
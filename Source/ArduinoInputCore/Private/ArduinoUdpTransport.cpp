@@ -0,0 +1,544 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoUdpTransport.h"
+#include "ArduinoInputStats.h"
+#include "SerialPortFilter.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	static_assert((FArduinoUdpTransport::SlotCount & (FArduinoUdpTransport::SlotCount - 1)) == 0, "Slot indices wrap with a mask");
+	const uint32 SlotMask = FArduinoUdpTransport::SlotCount - 1;
+
+#if PLATFORM_WINDOWS
+	typedef SOCKET FSocketHandle;
+	const UPTRINT ClosedSocket = (UPTRINT)INVALID_SOCKET;
+#else
+	typedef int FSocketHandle;
+	const int ClosedSocket = -1;
+#endif
+
+	/** What one receive call got for one slot */
+	struct FDatagram
+	{
+		int32 Length;
+		/** Sender, host order */
+		uint32 Address;
+		uint16 Port;
+		/** Longer than a slot, the rest was cut off */
+		bool bTruncated;
+	};
+
+	/** Host order IPv4 address of Text, 0 when empty or not an address */
+	uint32 ParseIpv4(const FString& Text)
+	{
+		in_addr Address;
+		if (Text.IsEmpty() || inet_pton(AF_INET, TCHAR_TO_ANSI(*Text), &Address) != 1)
+		{
+			return 0;
+		}
+		return ntohl(Address.s_addr);
+	}
+
+	/** Receive up to Num datagrams into Targets without blocking. Returns how many, 0 when the socket is empty, -1 once it failed */
+	int32 ReceiveDatagrams(FSocketHandle Socket, char* const* Targets, int32 Num, FDatagram* OutDatagrams)
+	{
+		sockaddr_in Senders[FArduinoUdpTransport::BatchSize];
+#if PLATFORM_LINUX
+		// One syscall for the whole batch, each datagram straight into its slot
+		mmsghdr Messages[FArduinoUdpTransport::BatchSize];
+		iovec Vectors[FArduinoUdpTransport::BatchSize];
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			Vectors[Index].iov_base = Targets[Index];
+			Vectors[Index].iov_len = FArduinoUdpTransport::SlotBytes;
+			FMemory::Memzero(Messages[Index]);
+			Messages[Index].msg_hdr.msg_name = &Senders[Index];
+			Messages[Index].msg_hdr.msg_namelen = sizeof(Senders[Index]);
+			Messages[Index].msg_hdr.msg_iov = &Vectors[Index];
+			Messages[Index].msg_hdr.msg_iovlen = 1;
+		}
+
+		int Received;
+		do
+		{
+			Received = recvmmsg(Socket, Messages, (unsigned int)Num, MSG_DONTWAIT, nullptr);
+		} while (Received < 0 && errno == EINTR);
+		if (Received < 0)
+		{
+			// ECONNREFUSED is a late ICMP answer to a feedback datagram, not a broken socket
+			return errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED ? 0 : -1;
+		}
+		for (int32 Index = 0; Index < Received; ++Index)
+		{
+			OutDatagrams[Index].Length = (int32)Messages[Index].msg_len;
+			OutDatagrams[Index].bTruncated = (Messages[Index].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+		}
+#else
+		int32 Received = 0;
+		while (Received < Num)
+		{
+#if PLATFORM_WINDOWS
+			socklen_t SenderLength = sizeof(Senders[Received]);
+			const int Result = (int)recvfrom(Socket, Targets[Received], FArduinoUdpTransport::SlotBytes, 0, (sockaddr*)&Senders[Received], &SenderLength);
+			const int Error = Result < 0 ? WSAGetLastError() : 0;
+			if (Result < 0 && Error != WSAEMSGSIZE)
+			{
+				return Error == WSAEWOULDBLOCK || Error == WSAECONNRESET ? Received : -1;
+			}
+			OutDatagrams[Received].Length = Result < 0 ? FArduinoUdpTransport::SlotBytes : Result;
+			OutDatagrams[Received].bTruncated = Result < 0;
+#else
+			// recvmsg and not recvfrom: only its flags tell a datagram cut to the slot from one that fits it exactly
+			iovec Vector;
+			Vector.iov_base = Targets[Received];
+			Vector.iov_len = FArduinoUdpTransport::SlotBytes;
+			msghdr Message;
+			FMemory::Memzero(Message);
+			Message.msg_name = &Senders[Received];
+			Message.msg_namelen = sizeof(Senders[Received]);
+			Message.msg_iov = &Vector;
+			Message.msg_iovlen = 1;
+			const int Result = (int)recvmsg(Socket, &Message, 0);
+			if (Result < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+				return errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNREFUSED ? Received : -1;
+			}
+			OutDatagrams[Received].Length = Result;
+			OutDatagrams[Received].bTruncated = (Message.msg_flags & MSG_TRUNC) != 0;
+#endif
+			++Received;
+		}
+#endif
+		for (int32 Index = 0; Index < Received; ++Index)
+		{
+			OutDatagrams[Index].Address = ntohl(Senders[Index].sin_addr.s_addr);
+			OutDatagrams[Index].Port = ntohs(Senders[Index].sin_port);
+		}
+		return Received;
+	}
+}
+
+FArduinoUdpTransport::FArduinoUdpTransport()
+	: BoardAddress(0)
+	, BoundPort(0)
+	, ProducedSlots(0)
+	, ConsumedSlots(0)
+	, ProducedBytes(0)
+	, ConsumedBytes(0)
+	, FrontOffset(0)
+	, PeerAddress(0)
+	, Thread(nullptr)
+	, bExit(false)
+	, bLost(false)
+	, bWaitingForSlot(false)
+	, InputEvent(nullptr)
+	, DatagramsReceived(0)
+	, ReceiveCalls(0)
+	, DatagramsDropped(0)
+	, Socket(ClosedSocket)
+{
+#if !PLATFORM_WINDOWS
+	WakePipe[0] = -1;
+	WakePipe[1] = -1;
+#endif
+}
+
+FArduinoUdpTransport::~FArduinoUdpTransport()
+{
+	Close();
+}
+
+bool FArduinoUdpTransport::Open(const FArduinoUdpSettings& InSettings)
+{
+	if (IsOpen())
+	{
+		return false;
+	}
+	Settings = InSettings;
+	BoardAddress = ParseIpv4(Settings.BoardAddress);
+
+	// Allocated once, the receive thread never allocates
+	if (Slots.Num() == 0)
+	{
+		Slots.SetNumUninitialized(SlotCount);
+	}
+	ProducedSlots = 0;
+	ConsumedSlots = 0;
+	ProducedBytes = 0;
+	ConsumedBytes = 0;
+	FrontOffset = 0;
+	PeerAddress = 0;
+	bExit = false;
+	bLost = false;
+	bWaitingForSlot = false;
+
+#if PLATFORM_WINDOWS
+	WSADATA WsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &WsaData) != 0)
+	{
+		return false;
+	}
+	const SOCKET Handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (Handle == INVALID_SOCKET)
+	{
+		WSACleanup();
+		return false;
+	}
+	Socket = (UPTRINT)Handle;
+	u_long NonBlocking = 1;
+	ioctlsocket(Handle, FIONBIO, &NonBlocking);
+#else
+	if (pipe(WakePipe) != 0)
+	{
+		WakePipe[0] = WakePipe[1] = -1;
+		return false;
+	}
+	// Non-blocking: the consumer never waits to wake us, and Run drains every wakeup at once
+	for (int Fd : WakePipe)
+	{
+		fcntl(Fd, F_SETFD, FD_CLOEXEC);
+		fcntl(Fd, F_SETFL, fcntl(Fd, F_GETFL) | O_NONBLOCK);
+	}
+	Socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (Socket == -1)
+	{
+		CloseSocket();
+		return false;
+	}
+	fcntl(Socket, F_SETFD, FD_CLOEXEC);
+	fcntl(Socket, F_SETFL, fcntl(Socket, F_GETFL) | O_NONBLOCK);
+	const FSocketHandle Handle = Socket;
+#endif
+
+	// Room in the kernel for a whole ring of datagrams, so a burst waits there while the parser catches up
+	const int BufferBytes = SlotCount * SlotBytes;
+	setsockopt(Handle, SOL_SOCKET, SO_RCVBUF, (const char*)&BufferBytes, sizeof(BufferBytes));
+
+	sockaddr_in Local;
+	FMemory::Memzero(Local);
+	Local.sin_family = AF_INET;
+	Local.sin_port = htons(Settings.Port);
+	Local.sin_addr.s_addr = htonl(Settings.BindAddress.IsEmpty() ? INADDR_ANY : ParseIpv4(Settings.BindAddress));
+	socklen_t LocalLength = sizeof(Local);
+	if (bind(Handle, (const sockaddr*)&Local, sizeof(Local)) != 0 || getsockname(Handle, (sockaddr*)&Local, &LocalLength) != 0)
+	{
+		CloseSocket();
+		return false;
+	}
+	BoundPort = ntohs(Local.sin_port);
+
+	Thread = FRunnableThread::Create(this, TEXT("ArduinoUdpReceive"), 0, TPri_AboveNormal);
+	if (Thread == nullptr)
+	{
+		CloseSocket();
+		return false;
+	}
+	return true;
+}
+
+void FArduinoUdpTransport::Close()
+{
+	if (Thread != nullptr)
+	{
+		// Kill calls Stop, which wakes the thread at once
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+	CloseSocket();
+}
+
+void FArduinoUdpTransport::CloseSocket()
+{
+#if PLATFORM_WINDOWS
+	if (Socket != ClosedSocket)
+	{
+		closesocket((SOCKET)Socket);
+		Socket = ClosedSocket;
+		WSACleanup();
+	}
+#else
+	if (Socket != ClosedSocket)
+	{
+		close(Socket);
+		Socket = ClosedSocket;
+	}
+	if (WakePipe[0] != -1)
+	{
+		close(WakePipe[0]);
+		close(WakePipe[1]);
+		WakePipe[0] = WakePipe[1] = -1;
+	}
+#endif
+}
+
+uint32 FArduinoUdpTransport::Run()
+{
+#if PLATFORM_WINDOWS
+	// No pipe to wake select() with, it checks bExit every 50 ms instead
+	while (!bExit)
+	{
+		// Ring full: the datagrams wait in the kernel buffer, checked every millisecond until the consumer frees a slot
+		if (bWaitingForSlot)
+		{
+			FPlatformProcess::Sleep(0.001f);
+			continue;
+		}
+
+		fd_set ReadSet;
+		FD_ZERO(&ReadSet);
+		FD_SET((SOCKET)Socket, &ReadSet);
+		timeval Timeout = { 0, 50000 };
+		const int Ready = select(0, &ReadSet, nullptr, nullptr, &Timeout);
+		if (Ready < 0 || (Ready > 0 && !ReceiveBatch()))
+		{
+			bLost = true;
+			break;
+		}
+	}
+#else
+	pollfd Fds[2];
+	Fds[0].fd = Socket;
+	Fds[0].events = POLLIN;
+	Fds[1].fd = WakePipe[0];
+	Fds[1].events = POLLIN;
+
+	// Block until datagrams arrive, or Close or a freed slot wakes us
+	while (!bExit)
+	{
+		// Ring full: leave the socket out, its datagrams wait in the kernel buffer until the consumer frees a slot
+		Fds[0].fd = bWaitingForSlot ? -1 : Socket;
+		Fds[0].revents = 0;
+		Fds[1].revents = 0;
+		if (poll(Fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			bLost = true;
+			break;
+		}
+		if (Fds[1].revents != 0)
+		{
+			// Close, or a freed slot: the loop checks which
+			char Drain[64];
+			while (read(WakePipe[0], Drain, sizeof(Drain)) > 0)
+			{
+			}
+			continue;
+		}
+		if (Fds[0].revents == 0)
+		{
+			continue;
+		}
+		if ((Fds[0].revents & POLLNVAL) != 0 || !ReceiveBatch())
+		{
+			bLost = true;
+			break;
+		}
+	}
+#endif
+	return 0;
+}
+
+void FArduinoUdpTransport::Stop()
+{
+	bExit = true;
+	WakeReceiveThread();
+}
+
+void FArduinoUdpTransport::WakeReceiveThread()
+{
+#if !PLATFORM_WINDOWS
+	if (WakePipe[1] == -1)
+	{
+		return;
+	}
+	// A full pipe already guarantees a wakeup, so EAGAIN is fine
+	const char Wake = 0;
+	while (write(WakePipe[1], &Wake, 1) == -1 && errno == EINTR)
+	{
+	}
+#endif
+}
+
+bool FArduinoUdpTransport::ReceiveBatch()
+{
+	char* Targets[BatchSize];
+	FDatagram Datagrams[BatchSize];
+	for (;;)
+	{
+		const uint32 Produced = ProducedSlots.load(std::memory_order_relaxed);
+		uint32 FreeSlots = SlotCount - (Produced - ConsumedSlots.load(std::memory_order_acquire));
+		if (FreeSlots == 0)
+		{
+			// Ring full: leave the rest in the kernel buffer and have Run stop reading until a slot is freed.
+			// Flag, then look again, both sequentially consistent: either we see the freed slot or the consumer sees the flag
+			bWaitingForSlot.store(true);
+			FreeSlots = SlotCount - (Produced - ConsumedSlots.load());
+			if (FreeSlots == 0)
+			{
+				return true;
+			}
+			bWaitingForSlot.store(false);
+		}
+
+		const int32 Num = (int32)FMath::Min<uint32>(FreeSlots, BatchSize);
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			Targets[Index] = Slots[(Produced + Index) & SlotMask].Data;
+		}
+
+		const int32 Received = ReceiveDatagrams((FSocketHandle)Socket, Targets, Num, Datagrams);
+		if (Received <= 0)
+		{
+			return Received == 0;
+		}
+		ReceiveCalls.fetch_add(1, std::memory_order_relaxed);
+		const uint64 ReadCycles = FPlatformTime::Cycles64();
+
+		// Filtered in place, a slot the filter emptied stays in the ring with no chars and the consumer steps over it
+		uint32 Bytes = 0;
+		int32 Kept = 0;
+		uint64 Peer = 0;
+		for (int32 Index = 0; Index < Received; ++Index)
+		{
+			FSlot& Slot = Slots[(Produced + Index) & SlotMask];
+			const FDatagram& Datagram = Datagrams[Index];
+			Slot.ReadCycles = ReadCycles;
+			Slot.Length = 0;
+			if (Datagram.bTruncated || (BoardAddress != 0 && Datagram.Address != BoardAddress))
+			{
+				// A truncated datagram counts only the bytes that reached its slot
+				DatagramsDropped.fetch_add(1, std::memory_order_relaxed);
+				FArduinoInputCounters::AddDroppedBytes((uint32)Datagram.Length);
+				continue;
+			}
+			Slot.Length = Settings.bStripPadding ? SerialPortFilter::StripIgnoredChars(Slot.Data, Datagram.Length) : Datagram.Length;
+			Bytes += (uint32)Slot.Length;
+			Peer = ((uint64)Datagram.Address << 32) | Datagram.Port;
+			++Kept;
+		}
+		if (Peer != 0)
+		{
+			PeerAddress.store(Peer, std::memory_order_release);
+		}
+		DatagramsReceived.fetch_add((uint64)Kept, std::memory_order_relaxed);
+		FArduinoInputCounters::AddBytesRead(Bytes);
+
+		// Bytes first, so SizeOfMessageQueue never sees chars removed before they were counted
+		ProducedBytes.fetch_add(Bytes, std::memory_order_relaxed);
+		ProducedSlots.store(Produced + (uint32)Received, std::memory_order_release);
+		if (Bytes > 0)
+		{
+			if (FEvent* Event = InputEvent.load(std::memory_order_acquire))
+			{
+				Event->Trigger();
+			}
+		}
+
+		// A short batch means the socket is empty
+		if (Received < Num)
+		{
+			return true;
+		}
+	}
+}
+
+int FArduinoUdpTransport::PeekContiguousFromQueue(const char*& pData, uint64& readCycles)
+{
+	readCycles = 0;
+	const uint32 Produced = ProducedSlots.load(std::memory_order_acquire);
+	uint32 Consumed = ConsumedSlots.load(std::memory_order_relaxed);
+	while (Consumed != Produced)
+	{
+		const FSlot& Slot = Slots[Consumed & SlotMask];
+		if (FrontOffset < Slot.Length)
+		{
+			pData = Slot.Data + FrontOffset;
+			readCycles = Slot.ReadCycles;
+			return Slot.Length - FrontOffset;
+		}
+
+		// Read through, the receive thread may fill it again
+		FrontOffset = 0;
+		ConsumedSlots.store(++Consumed);
+
+		// The receive thread stopped reading the socket on a full ring, one slot is enough to go on
+		if (bWaitingForSlot.load() && bWaitingForSlot.exchange(false))
+		{
+			WakeReceiveThread();
+		}
+	}
+	return 0;
+}
+
+int FArduinoUdpTransport::RemoveCharsFromQueue(int count)
+{
+	int Removed = 0;
+	const char* Data = nullptr;
+	uint64 ReadCycles = 0;
+	while (Removed < count)
+	{
+		const int Available = PeekContiguousFromQueue(Data, ReadCycles);
+		if (Available == 0)
+		{
+			break;
+		}
+		const int Taken = FMath::Min(Available, count - Removed);
+		FrontOffset += Taken;
+		Removed += Taken;
+	}
+	ConsumedBytes.fetch_add((uint32)Removed, std::memory_order_relaxed);
+
+	// Hand a slot read through back right away rather than at the next peek
+	PeekContiguousFromQueue(Data, ReadCycles);
+	return Removed;
+}
+
+int FArduinoUdpTransport::SizeOfMessageQueue()
+{
+	return (int)(ProducedBytes.load(std::memory_order_acquire) - ConsumedBytes.load(std::memory_order_relaxed));
+}
+
+bool FArduinoUdpTransport::WriteData(char* pData, unsigned int length)
+{
+	const uint64 Peer = PeerAddress.load(std::memory_order_acquire);
+	if (Socket == ClosedSocket || Peer == 0 || length > (unsigned int)SlotBytes)
+	{
+		return false;
+	}
+
+	// Unconnected, so the board may change address (DHCP) and feedback follows it
+	sockaddr_in To;
+	FMemory::Memzero(To);
+	To.sin_family = AF_INET;
+	To.sin_addr.s_addr = htonl((uint32)(Peer >> 32));
+	To.sin_port = htons((uint16)Peer);
+	return (int)sendto((FSocketHandle)Socket, pData, (int)length, 0, (const sockaddr*)&To, sizeof(To)) == (int)length;
+}
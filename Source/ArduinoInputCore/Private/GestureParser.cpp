@@ -0,0 +1,87 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "GestureParser.h"
+
+namespace
+{
+	enum EGestureParserState : uint8
+	{
+		GPS_Idle,
+		GPS_SawLeft,
+		GPS_SawRight,
+		GPS_Count,
+	};
+
+	/** Each entry packs the next state in the low 2 bits and the gesture to emit above them */
+	struct FGestureParserTable
+	{
+		uint8 Entries[GPS_Count][256];
+	};
+
+	constexpr uint8 PackTransition(uint8 NextState, EArduinoOpcode Gesture)
+	{
+		return (uint8)(NextState | ((uint8)Gesture << 2));
+	}
+
+	/** Same rules AnalyzeInput used to spell out with nested ifs:
+	 *  L then R, or R then L, is a run step; J is a jump whether or not a foot came first;
+	 *  a repeated foot restarts the pair; anything else is ignored. */
+	constexpr FGestureParserTable BuildGestureParserTable()
+	{
+		FGestureParserTable Table = {};
+		for (int32 State = 0; State < GPS_Count; ++State)
+		{
+			for (int32 Char = 0; Char < 256; ++Char)
+			{
+				uint8 Entry = PackTransition(GPS_Idle, EArduinoOpcode::None);
+				if (Char == 'J')
+				{
+					Entry = PackTransition(GPS_Idle, EArduinoOpcode::Jump);
+				}
+				else if (Char == 'L')
+				{
+					Entry = State == GPS_SawRight
+						? PackTransition(GPS_Idle, EArduinoOpcode::Run)
+						: PackTransition(GPS_SawLeft, EArduinoOpcode::None);
+				}
+				else if (Char == 'R')
+				{
+					Entry = State == GPS_SawLeft
+						? PackTransition(GPS_Idle, EArduinoOpcode::Run)
+						: PackTransition(GPS_SawRight, EArduinoOpcode::None);
+				}
+				Table.Entries[State][Char] = Entry;
+			}
+		}
+		return Table;
+	}
+
+	constexpr FGestureParserTable GGestureParserTable = BuildGestureParserTable();
+}
+
+GestureParser::GestureParser() : m_state(GPS_Idle)
+{
+}
+
+int32 GestureParser::Parse(const char* pData, int32 length, TArray<EArduinoOpcode>& outGestures)
+{
+	const int32 StartNum = outGestures.Num();
+	uint8 State = m_state;
+	for (int32 i = 0; i < length; ++i)
+	{
+		const uint8 Entry = GGestureParserTable.Entries[State][(uint8)pData[i]];
+		State = Entry & 0x3;
+		if (Entry >> 2)
+		{
+			outGestures.Add((EArduinoOpcode)(Entry >> 2));
+		}
+	}
+	m_state = State;
+	return outGestures.Num() - StartNum;
+}
+
+void GestureParser::Reset()
+{
+	m_state = GPS_Idle;
+}
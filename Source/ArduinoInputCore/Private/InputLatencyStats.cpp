@@ -0,0 +1,224 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "InputLatencyStats.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+FLatencyHistogram::FLatencyHistogram()
+{
+	Reset();
+}
+
+int32 FLatencyHistogram::BucketIndex(uint64 Microseconds)
+{
+	/** Values below SubBucketCount get one bucket each, above that 8 buckets per power of two */
+	if (Microseconds < SubBucketCount)
+	{
+		return (int32)Microseconds;
+	}
+	const int32 Exponent = 63 - (int32)FPlatformMath::CountLeadingZeros64(Microseconds);
+	const int32 SubBucket = (int32)((Microseconds >> (Exponent - SubBucketBits)) & (SubBucketCount - 1));
+	const int32 Index = (Exponent - SubBucketBits + 1) * SubBucketCount + SubBucket;
+	return FMath::Min(Index, BucketCount - 1);
+}
+
+uint64 FLatencyHistogram::BucketUpperBound(int32 Index)
+{
+	if (Index < SubBucketCount)
+	{
+		return (uint64)Index;
+	}
+	const int32 Exponent = Index / SubBucketCount + SubBucketBits - 1;
+	const uint64 SubBucket = (uint64)(Index % SubBucketCount);
+	return ((SubBucketCount + SubBucket + 1) << (Exponent - SubBucketBits)) - 1;
+}
+
+void FLatencyHistogram::Record(uint64 Microseconds)
+{
+	Buckets[BucketIndex(Microseconds)].fetch_add(1, std::memory_order_relaxed);
+	Count.fetch_add(1, std::memory_order_relaxed);
+	Sum.fetch_add(Microseconds, std::memory_order_relaxed);
+
+	uint64 PreviousMax = Max.load(std::memory_order_relaxed);
+	while (Microseconds > PreviousMax && !Max.compare_exchange_weak(PreviousMax, Microseconds, std::memory_order_relaxed))
+	{
+	}
+}
+
+void FLatencyHistogram::Reset()
+{
+	for (std::atomic<uint64>& Bucket : Buckets)
+	{
+		Bucket.store(0, std::memory_order_relaxed);
+	}
+	Count.store(0, std::memory_order_relaxed);
+	Sum.store(0, std::memory_order_relaxed);
+	Max.store(0, std::memory_order_relaxed);
+}
+
+uint64 FLatencyHistogram::GetCount() const
+{
+	return Count.load(std::memory_order_relaxed);
+}
+
+uint64 FLatencyHistogram::GetMax() const
+{
+	return Max.load(std::memory_order_relaxed);
+}
+
+double FLatencyHistogram::GetMean() const
+{
+	const uint64 Samples = GetCount();
+	return Samples > 0 ? (double)Sum.load(std::memory_order_relaxed) / (double)Samples : 0.0;
+}
+
+uint64 FLatencyHistogram::GetPercentile(double Percentile) const
+{
+	const uint64 Samples = GetCount();
+	if (Samples == 0)
+	{
+		return 0;
+	}
+
+	const uint64 Rank = FMath::Max<uint64>(1, (uint64)FMath::CeilToDouble(Samples * FMath::Clamp(Percentile, 0.0, 100.0) / 100.0));
+	uint64 Seen = 0;
+	for (int32 Index = 0; Index < BucketCount; ++Index)
+	{
+		Seen += Buckets[Index].load(std::memory_order_relaxed);
+		if (Seen >= Rank)
+		{
+			return FMath::Min(BucketUpperBound(Index), GetMax());
+		}
+	}
+	return GetMax();
+}
+
+uint64 FLatencyHistogram::GetBucketCount(int32 Index) const
+{
+	return Index >= 0 && Index < BucketCount ? Buckets[Index].load(std::memory_order_relaxed) : 0;
+}
+
+FInputLatencyStats& FInputLatencyStats::Get()
+{
+	static FInputLatencyStats Instance;
+	return Instance;
+}
+
+void FInputLatencyStats::RecordCycles(EInputLatencyStage Stage, uint64 FromCycles, uint64 ToCycles)
+{
+	if (FromCycles == 0 || ToCycles < FromCycles)
+	{
+		return;
+	}
+	const double Microseconds = FPlatformTime::ToMilliseconds64(ToCycles - FromCycles) * 1000.0;
+	Histograms[(int32)Stage].Record((uint64)Microseconds);
+}
+
+const FLatencyHistogram& FInputLatencyStats::GetHistogram(EInputLatencyStage Stage) const
+{
+	return Histograms[(int32)Stage];
+}
+
+const TCHAR* FInputLatencyStats::GetStageName(EInputLatencyStage Stage)
+{
+	switch (Stage)
+	{
+	case EInputLatencyStage::ReadToParse: return TEXT("ReadToParse");
+	case EInputLatencyStage::ParseToDequeue: return TEXT("ParseToDequeue");
+	case EInputLatencyStage::DequeueToAction: return TEXT("DequeueToAction");
+	case EInputLatencyStage::ReadToAction: return TEXT("ReadToAction");
+	case EInputLatencyStage::ReadToServer: return TEXT("ReadToServer");
+	default: return TEXT("Unknown");
+	}
+}
+
+void FInputLatencyStats::Dump() const
+{
+	for (int32 Stage = 0; Stage < (int32)EInputLatencyStage::Count; ++Stage)
+	{
+		const FLatencyHistogram& Histogram = Histograms[Stage];
+		UE_LOG(LogTemp, Display, TEXT("Arduino latency %-16s count=%llu mean=%.1fus p50=%lluus p99=%lluus max=%lluus"),
+			GetStageName((EInputLatencyStage)Stage),
+			Histogram.GetCount(),
+			Histogram.GetMean(),
+			Histogram.GetPercentile(50.0),
+			Histogram.GetPercentile(99.0),
+			Histogram.GetMax());
+	}
+}
+
+void FInputLatencyStats::Reset()
+{
+	for (FLatencyHistogram& Histogram : Histograms)
+	{
+		Histogram.Reset();
+	}
+}
+
+bool FInputLatencyStats::WriteCSV(const FString& Filename) const
+{
+	FString Csv = TEXT("Stage,Count,MeanUs,P50Us,P90Us,P99Us,MaxUs\n");
+	for (int32 Stage = 0; Stage < (int32)EInputLatencyStage::Count; ++Stage)
+	{
+		const FLatencyHistogram& Histogram = Histograms[Stage];
+		Csv += FString::Printf(TEXT("%s,%llu,%.1f,%llu,%llu,%llu,%llu\n"),
+			GetStageName((EInputLatencyStage)Stage),
+			Histogram.GetCount(),
+			Histogram.GetMean(),
+			Histogram.GetPercentile(50.0),
+			Histogram.GetPercentile(90.0),
+			Histogram.GetPercentile(99.0),
+			Histogram.GetMax());
+	}
+
+	// Then every non-empty bucket, to plot the distributions or merge runs
+	Csv += TEXT("\nStage,UpToUs,Samples\n");
+	for (int32 Stage = 0; Stage < (int32)EInputLatencyStage::Count; ++Stage)
+	{
+		const FLatencyHistogram& Histogram = Histograms[Stage];
+		for (int32 Index = 0; Index < FLatencyHistogram::GetNumBuckets(); ++Index)
+		{
+			const uint64 Samples = Histogram.GetBucketCount(Index);
+			if (Samples > 0)
+			{
+				Csv += FString::Printf(TEXT("%s,%llu,%llu\n"), GetStageName((EInputLatencyStage)Stage), FLatencyHistogram::GetBucketUpperBound(Index), Samples);
+			}
+		}
+	}
+	return FFileHelper::SaveStringToFile(Csv, *Filename);
+}
+
+static FAutoConsoleCommand GArduinoLatencyDumpCommand(
+	TEXT("Arduino.Latency.Dump"),
+	TEXT("Log p50/p99/max latency of each Arduino input stage"),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		FInputLatencyStats::Get().Dump();
+	}));
+
+static FAutoConsoleCommand GArduinoLatencyResetCommand(
+	TEXT("Arduino.Latency.Reset"),
+	TEXT("Clear the Arduino input latency histograms"),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		FInputLatencyStats::Get().Reset();
+	}));
+
+static FAutoConsoleCommand GArduinoLatencyWriteCSVCommand(
+	TEXT("Arduino.Latency.WriteCSV"),
+	TEXT("Write the Arduino input latency summary and buckets to a CSV file. Arduino.Latency.WriteCSV [Filename]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const FString Filename = Args.Num() > 0 ? Args[0] : FPaths::ProfilingDir() / TEXT("ArduinoLatency.csv");
+		if (FInputLatencyStats::Get().WriteCSV(Filename))
+		{
+			UE_LOG(LogTemp, Display, TEXT("Arduino latency written to %s"), *Filename);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Could not write Arduino latency to %s"), *Filename);
+		}
+	}));
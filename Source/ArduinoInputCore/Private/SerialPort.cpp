@@ -0,0 +1,590 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SerialPort.h"
+#include "ArduinoInputStats.h"
+#include "SerialPortFilter.h"
+#include "SerialPortSet.h"
+#include "SerialSession.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+
+using namespace std;
+
+/** Runs SerialPort::ListenLoop on an FRunnableThread, see OpenListenThread */
+class FSerialPortListener : public FRunnable
+{
+public:
+    explicit FSerialPortListener(SerialPort* pPort) : m_pPort(pPort)
+    {
+    }
+
+    virtual uint32 Run() override
+    {
+        m_pPort->ListenLoop();
+        return 0;
+    }
+
+    /** Called by FRunnableThread::Kill before it waits for Run to return */
+    virtual void Stop() override
+    {
+        m_pPort->m_bExit = true;
+        m_pPort->WakeListenThread();
+    }
+
+private:
+    SerialPort* m_pPort;
+};
+
+bool SerialPort::InitPort(uint32 portNo /*= 1*/, uint32 baud /*= CBR_9600*/, char parity /*= 'N'*/,
+    uint32 databits /*= 8*/, uint32 stopsbits /*= 1*/, uint32 dwCommEvents /*= EV_RXCHAR*/)
+{
+    /** 打开指定串口,该函数内部已经有临界区保护,上面请不要加保护 */
+    if (!openPort(portNo))
+    {
+        return false;
+    }
+
+    m_parity = parity;
+    m_databits = databits;
+    m_stopsbits = stopsbits;
+    return configurePort(baud, parity, databits, stopsbits);
+}
+
+bool SerialPort::InitPort(const char* szPort, uint32 baud /*= CBR_9600*/, char parity /*= 'N'*/,
+    uint32 databits /*= 8*/, uint32 stopsbits /*= 1*/, uint32 dwCommEvents /*= EV_RXCHAR*/)
+{
+    /** 打开指定串口,该函数内部已经有临界区保护,上面请不要加保护 */
+    if (!openPort(szPort))
+    {
+        return false;
+    }
+
+    m_parity = parity;
+    m_databits = databits;
+    m_stopsbits = stopsbits;
+    return configurePort(baud, parity, databits, stopsbits);
+}
+
+bool SerialPort::SetBaudRate(uint32 baud)
+{
+    return configurePort(baud, m_parity, m_databits, m_stopsbits);
+}
+
+void SerialPort::SetStripPadding(bool bStrip)
+{
+    m_bStripPadding = bStrip;
+}
+
+bool SerialPort::IsLost() const
+{
+    return m_bLost;
+}
+
+void SerialPort::SetRecorder(FSerialSessionRecorder* pRecorder)
+{
+    m_pRecorder = pRecorder;
+}
+
+void SerialPort::SetInputEvent(FEvent* pEvent)
+{
+    m_pInputEvent = pEvent;
+}
+
+void SerialPort::DrainInput(uint32 BytesInQue)
+{
+    SCOPE_CYCLE_COUNTER(STAT_ArduinoReadInput);
+    while (BytesInQue > 0)
+    {
+        ARDUINO_TRACE_SCOPE(ArduinoReadBatch);
+        uint32 BytesRead = 0;
+        if (!ReadBlock(m_rxBuffer, FMath::Min(BytesInQue, RX_BUFFER_SIZE), BytesRead))
+        {
+            /** A read error on a port that reported data: the device went away */
+            m_bLost = true;
+            return;
+        }
+        if (BytesRead == 0)
+        {
+            return;
+        }
+        const uint64 ReadCycles = FPlatformTime::Cycles64();
+        BytesInQue -= FMath::Min(BytesInQue, BytesRead);
+
+        /** Record the raw block, before StripIgnoredChars rewrites m_rxBuffer */
+        FSerialSessionRecorder* pRecorder = m_pRecorder.load(std::memory_order_acquire);
+        if (pRecorder != nullptr)
+        {
+            pRecorder->Append(ReadCycles, m_rxBuffer, BytesRead);
+        }
+
+        QueueReceived(BytesRead, ReadCycles);
+    }
+}
+
+uint32 SerialPort::InjectInput(const char* pData, uint32 length, uint64 readCycles)
+{
+    /** Only take what is sure to fit, so the caller can retry the rest once the game drained the queue */
+    uint32 BytesTaken = 0;
+    while (BytesTaken < length)
+    {
+        const uint32 FreeChars = MESSAGE_CACHE_SIZE - message_cache.Size();
+        const uint32 BlockLength = FMath::Min(FMath::Min(length - BytesTaken, RX_BUFFER_SIZE), FreeChars);
+        if (BlockLength == 0)
+        {
+            break;
+        }
+
+        FMemory::Memcpy(m_rxBuffer, pData + BytesTaken, BlockLength);
+        QueueReceived(BlockLength, readCycles);
+        BytesTaken += BlockLength;
+    }
+    return BytesTaken;
+}
+
+void SerialPort::QueueReceived(uint32 BytesRead, uint64 ReadCycles)
+{
+    /** Chars that do not fit are dropped, the parser resynchronizes on the next gesture */
+    const int32 BytesKept = m_bStripPadding ? SerialPortFilter::StripIgnoredChars(m_rxBuffer, (int32)BytesRead) : (int32)BytesRead;
+    const uint32 BytesToQueue = FMath::Min((uint32)BytesKept, MESSAGE_CACHE_SIZE - message_cache.Size());
+    FArduinoInputCounters::AddBytesRead(BytesToQueue);
+    if ((uint32)BytesKept > BytesToQueue)
+    {
+        FArduinoInputCounters::AddDroppedBytes((uint32)BytesKept - BytesToQueue);
+    }
+    if (BytesToQueue == 0)
+    {
+        return;
+    }
+
+    /** Stamp first so the consumer never sees chars without their read time */
+    FSerialBatchStamp Stamp;
+    Stamp.ReadCycles = ReadCycles;
+    Stamp.StreamEnd = m_producedPos + BytesToQueue;
+    batch_stamps.Push(Stamp);
+
+    m_producedPos += message_cache.Push(m_rxBuffer, BytesToQueue);
+
+    /** After the push, so a consumer woken here finds the chars */
+    FEvent* pInputEvent = m_pInputEvent.load(std::memory_order_acquire);
+    if (pInputEvent != nullptr)
+    {
+        pInputEvent->Trigger();
+    }
+}
+
+bool SerialPort::OpenListenThread()
+{
+    /** 检测线程是否已经开启了, or a SerialPortSet is already servicing this port */
+    if (m_pListenThread != nullptr || m_pOwnerSet != nullptr)
+    {
+        /** 线程已经开启 */
+        return false;
+    }
+
+    if (!OpenListenWakeup())
+    {
+        return false;
+    }
+
+    m_bExit = false;
+    /** 开启串口数据监听线程,优先级高于普通线程 */
+    m_pListener = new FSerialPortListener(this);
+    m_pListenThread = FRunnableThread::Create(m_pListener, TEXT("SerialPortListen"), 0, TPri_AboveNormal);
+    if (m_pListenThread == nullptr)
+    {
+        delete m_pListener;
+        m_pListener = nullptr;
+        CloseListenWakeup();
+        return false;
+    }
+
+    return true;
+}
+
+bool SerialPort::CloseListenTread()
+{
+    if (m_pListenThread != nullptr)
+    {
+        /** 通知线程退出并等待线程退出, Kill calls FSerialPortListener::Stop which wakes the thread at once */
+        m_pListenThread->Kill(true);
+        delete m_pListenThread;
+        m_pListenThread = nullptr;
+
+        delete m_pListener;
+        m_pListener = nullptr;
+        CloseListenWakeup();
+    }
+    return true;
+}
+
+bool SerialPort::ReturnNextCharFromQueue(char& cReturn) {
+    return message_cache.Peek(cReturn);
+}
+
+bool SerialPort::RemoveNextCharFromQueue() {
+	return RemoveCharsFromQueue(1) == 1;
+}
+
+int SerialPort::SizeOfMessageQueue() {
+	return (int)message_cache.Size();
+}
+
+int SerialPort::PeekContiguousFromQueue(const char*& pData) {
+	return (int)message_cache.PeekContiguous(pData);
+}
+
+int SerialPort::PeekContiguousFromQueue(const char*& pData, uint64& readCycles) {
+	readCycles = 0;
+	int count = (int)message_cache.PeekContiguous(pData);
+	if (count == 0) {
+		return 0;
+	}
+
+	/** Skip stamps of blocks already consumed. If the stamp queue overflowed, the next block's time is used */
+	FSerialBatchStamp stamp;
+	while (batch_stamps.Peek(stamp)) {
+		const int32 remaining = (int32)(stamp.StreamEnd - m_consumedPos);
+		if (remaining > 0) {
+			readCycles = stamp.ReadCycles;
+			count = FMath::Min(count, (int)remaining);
+			break;
+		}
+		batch_stamps.Pop();
+	}
+	return count;
+}
+
+int SerialPort::RemoveCharsFromQueue(int count) {
+	const int removed = count > 0 ? (int)message_cache.Consume((uint32)count) : 0;
+	m_consumedPos += (uint32)removed;
+	return removed;
+}
+
+#if PLATFORM_WINDOWS
+
+/** 当串口无数据时,sleep至下次查询间隔的时间,单位:毫秒 */
+const UINT SLEEP_TIME_INTERVAL = 5;
+
+SerialPort::SerialPort() : m_bExit(false), m_pOwnerSet(nullptr), m_pListenThread(nullptr), m_pListener(nullptr), m_pWakeEvent(nullptr), m_parity('N'), m_databits(8), m_stopsbits(1), m_bStripPadding(true), m_producedPos(0), m_consumedPos(0), m_pRecorder(nullptr), m_bLost(false), m_pInputEvent(nullptr)
+{
+    m_hComm = INVALID_HANDLE_VALUE;
+
+    InitializeCriticalSection(&m_csCommunicationSync);
+    InitializeCriticalSection(&m_csWriteSync);
+}
+
+SerialPort::~SerialPort()
+{
+    if (m_pOwnerSet != nullptr)
+    {
+        m_pOwnerSet->RemovePort(this);
+    }
+    CloseListenTread();
+    ClosePort();
+    DeleteCriticalSection(&m_csCommunicationSync);
+    DeleteCriticalSection(&m_csWriteSync);
+}
+
+bool SerialPort::configurePort(uint32 baud, char parity, uint32 databits, uint32 stopsbits)
+{
+
+    /** 临时变量,将制定参数转化为字符串形式,以构造DCB结构 */
+    char szDCBparam[50];
+    sprintf_s(szDCBparam, "baud=%d parity=%c data=%d stop=%d", baud, parity, databits, stopsbits);
+
+    /** 进入临界段 */
+    EnterCriticalSection(&m_csCommunicationSync);
+
+    /** 是否有错误发生 */
+    BOOL bIsSuccess = TRUE;
+
+    /** 在此可以设置输入输出的缓冲区大小,如果不设置,则系统会设置默认值.
+    *  自己设置缓冲区大小时,要注意设置稍大一些,避免缓冲区溢出
+    */
+    /*if (bIsSuccess )
+    {
+    bIsSuccess = SetupComm(m_hComm,10,10);
+    }*/
+
+    /** 设置串口的超时时间,均设为0,表示不使用超时限制 */
+    COMMTIMEOUTS  CommTimeouts;
+    CommTimeouts.ReadIntervalTimeout = 0;
+    CommTimeouts.ReadTotalTimeoutMultiplier = 0;
+    CommTimeouts.ReadTotalTimeoutConstant = 0;
+    CommTimeouts.WriteTotalTimeoutMultiplier = 0;
+    CommTimeouts.WriteTotalTimeoutConstant = 0;
+    if (bIsSuccess)
+    {
+        bIsSuccess = SetCommTimeouts(m_hComm, &CommTimeouts);
+    }
+
+    DCB  dcb;
+    if (bIsSuccess)
+    {
+        // 将ANSI字符串转换为UNICODE字符串   
+        DWORD dwNum = MultiByteToWideChar(CP_ACP, 0, szDCBparam, -1, NULL, 0);
+        wchar_t* pwText = new wchar_t[dwNum];
+        if (!MultiByteToWideChar(CP_ACP, 0, szDCBparam, -1, pwText, dwNum))
+        {
+            bIsSuccess = TRUE;
+        }
+
+        /** 获取当前串口配置参数,并且构造串口DCB参数 */
+        bIsSuccess = GetCommState(m_hComm, &dcb) && BuildCommDCB(pwText, &dcb);
+        /** 开启RTS flow控制 */
+        dcb.fRtsControl = RTS_CONTROL_ENABLE;
+
+        /** 释放内存空间 */
+        delete[] pwText;
+    }
+
+    if (bIsSuccess)
+    {
+        /** 使用DCB参数配置串口状态 */
+        bIsSuccess = SetCommState(m_hComm, &dcb);
+    }
+
+    /**  清空串口缓冲区 */
+    PurgeComm(m_hComm, PURGE_RXCLEAR | PURGE_TXCLEAR | PURGE_RXABORT | PURGE_TXABORT);
+
+    /** 离开临界段 */
+    LeaveCriticalSection(&m_csCommunicationSync);
+
+    return bIsSuccess == TRUE;
+}
+
+bool SerialPort::InitPort(UINT portNo, const LPDCB& plDCB)
+{
+    /** 打开指定串口,该函数内部已经有临界区保护,上面请不要加保护 */
+    if (!openPort(portNo))
+    {
+        return false;
+    }
+
+    /** 进入临界段 */
+    EnterCriticalSection(&m_csCommunicationSync);
+
+    /** 配置串口参数 */
+    if (!SetCommState(m_hComm, plDCB))
+    {
+        return false;
+    }
+
+    /**  清空串口缓冲区 */
+    PurgeComm(m_hComm, PURGE_RXCLEAR | PURGE_TXCLEAR | PURGE_RXABORT | PURGE_TXABORT);
+
+    /** 离开临界段 */
+    LeaveCriticalSection(&m_csCommunicationSync);
+
+    return true;
+}
+
+void SerialPort::ClosePort()
+{
+    /** 如果有串口被打开，关闭它 */
+    if (m_hComm != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_hComm);
+        m_hComm = INVALID_HANDLE_VALUE;
+    }
+}
+
+void SerialPort::FormatPortName(uint32 portNo, char* szPort, uint32 size)
+{
+    sprintf_s(szPort, size, "COM%d", portNo);
+}
+
+bool SerialPort::IsOpen() const
+{
+    return m_hComm != INVALID_HANDLE_VALUE;
+}
+
+bool SerialPort::openPort(uint32 portNo)
+{
+    /** 把串口的编号转换为设备名 */
+    char szPort[50];
+    FormatPortName(portNo, szPort, sizeof(szPort));
+
+    return openPort(szPort);
+}
+
+bool SerialPort::openPort(const char* szPort)
+{
+    /** 进入临界段 */
+    EnterCriticalSection(&m_csCommunicationSync);
+
+    /** 打开指定的串口 */
+    m_hComm = CreateFileA(szPort,  /** 设备名,COM1,COM2等 */
+        GENERIC_READ | GENERIC_WRITE, /** 访问模式,可同时读写 */
+        0,                            /** 共享模式,0表示不共享 */
+        NULL,                         /** 安全性设置,一般使用NULL */
+        OPEN_EXISTING,                /** 该参数表示设备必须存在,否则创建失败 */
+        0,
+        0);
+
+    /** 如果打开失败，释放资源并返回 */
+    if (m_hComm == INVALID_HANDLE_VALUE)
+    {
+        LeaveCriticalSection(&m_csCommunicationSync);
+        return false;
+    }
+    m_bLost = false;
+
+    /** 退出临界区 */
+    LeaveCriticalSection(&m_csCommunicationSync);
+
+    return true;
+}
+
+bool SerialPort::OpenListenWakeup()
+{
+    m_pWakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+    return m_pWakeEvent != nullptr;
+}
+
+void SerialPort::CloseListenWakeup()
+{
+    if (m_pWakeEvent != nullptr)
+    {
+        FPlatformProcess::ReturnSynchEventToPool(m_pWakeEvent);
+        m_pWakeEvent = nullptr;
+    }
+}
+
+void SerialPort::WakeListenThread()
+{
+    m_pWakeEvent->Trigger();
+}
+
+uint32 SerialPort::GetBytesInCOM()
+{
+    DWORD dwError = 0;  /** 错误码 */
+    COMSTAT  comstat;   /** COMSTAT结构体,记录通信设备的状态信息 */
+    memset(&comstat, 0, sizeof(COMSTAT));
+
+    UINT BytesInQue = 0;
+    /** 在调用ReadFile和WriteFile之前,通过本函数清除以前遗留的错误标志 */
+    if (ClearCommError(m_hComm, &dwError, &comstat))
+    {
+        BytesInQue = comstat.cbInQue; /** 获取在输入缓冲区中的字节数 */
+    }
+
+    return BytesInQue;
+}
+
+void SerialPort::ListenLoop()
+{
+    // 线程循环,轮询方式读取串口数据   
+    while (!m_bExit)
+    {
+        UINT BytesInQue = GetBytesInCOM();
+        /** 如果串口输入缓冲区中无数据,则休息一会再查询, WakeListenThread cuts the wait short */
+        if (BytesInQue == 0)
+        {
+            m_pWakeEvent->Wait(SLEEP_TIME_INTERVAL);
+            continue;
+        }
+
+        /** 读取输入缓冲区中的数据 */
+        DrainInput(BytesInQue);
+    }
+}
+
+bool SerialPort::ReadChar(char& cRecved)
+{
+    BOOL  bResult = TRUE;
+    DWORD BytesRead = 0;
+    if (m_hComm == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    /** 临界区保护 */
+    EnterCriticalSection(&m_csCommunicationSync);
+
+    /** 从缓冲区读取一个字节的数据 */
+    bResult = ReadFile(m_hComm, &cRecved, 1, &BytesRead, NULL);
+    if ((!bResult))
+    {
+        /** 获取错误码,可以根据该错误码查出错误原因 */
+        DWORD dwError = GetLastError();
+
+        /** 清空串口缓冲区 */
+        PurgeComm(m_hComm, PURGE_RXCLEAR | PURGE_RXABORT);
+        LeaveCriticalSection(&m_csCommunicationSync);
+
+        return false;
+    }
+
+    /** 离开临界区 */
+    LeaveCriticalSection(&m_csCommunicationSync);
+
+    return (BytesRead == 1);
+
+}
+
+bool SerialPort::ReadBlock(char* pData, uint32 length, uint32& bytesRead)
+{
+    BOOL  bResult = TRUE;
+    DWORD BytesRead = 0;
+    bytesRead = 0;
+    if (m_hComm == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    /** 临界区保护 */
+    EnterCriticalSection(&m_csCommunicationSync);
+
+    /** 从缓冲区读取length个字节的数据 */
+    bResult = ReadFile(m_hComm, pData, length, &BytesRead, NULL);
+    if ((!bResult))
+    {
+        /** 清空串口缓冲区 */
+        PurgeComm(m_hComm, PURGE_RXCLEAR | PURGE_RXABORT);
+        LeaveCriticalSection(&m_csCommunicationSync);
+
+        return false;
+    }
+
+    /** 离开临界区 */
+    LeaveCriticalSection(&m_csCommunicationSync);
+
+    bytesRead = BytesRead;
+    return true;
+}
+
+bool SerialPort::WriteData(char* pData, unsigned int length)
+{
+    BOOL   bResult = TRUE;
+    DWORD  BytesToSend = 0;
+    if (m_hComm == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    /** 临界区保护 */
+    EnterCriticalSection(&m_csWriteSync);
+
+    /** 向缓冲区写入指定量的数据 */
+    bResult = WriteFile(m_hComm, pData, length, &BytesToSend, NULL);
+    if (!bResult)
+    {
+        DWORD dwError = GetLastError();
+        /** 清空串口发送缓冲区, the receive side belongs to the reader */
+        PurgeComm(m_hComm, PURGE_TXCLEAR | PURGE_TXABORT);
+        LeaveCriticalSection(&m_csWriteSync);
+
+        return false;
+    }
+
+    /** 离开临界区 */
+    LeaveCriticalSection(&m_csWriteSync);
+
+    return true;
+}
+
+#endif // PLATFORM_WINDOWS
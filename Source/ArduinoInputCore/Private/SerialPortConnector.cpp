@@ -0,0 +1,263 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SerialPortConnector.h"
+#include "ArduinoInputStats.h"
+#include "SerialPort.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/RunnableThread.h"
+
+#if PLATFORM_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FSerialPortConnector::FSerialPortConnector()
+	: Port(nullptr)
+	, Thread(nullptr)
+	, bStopping(false)
+	, bConnected(false)
+	, ConnectCount(0)
+#if PLATFORM_LINUX
+	, InotifyFd(-1)
+	, DeviceFileName(nullptr)
+#else
+	, WakeEvent(nullptr)
+#endif
+{
+	DevicePath[0] = 0;
+#if PLATFORM_LINUX
+	WakePipe[0] = WakePipe[1] = -1;
+#endif
+}
+
+FSerialPortConnector::~FSerialPortConnector()
+{
+	Close();
+}
+
+bool FSerialPortConnector::Start(SerialPort& InPort, const FSerialPortConnectSettings& InSettings, FOnOpened InOnOpened, FOnLost InOnLost)
+{
+	if (Thread != nullptr)
+	{
+		return false;
+	}
+
+	Port = &InPort;
+	Settings = InSettings;
+	Settings.InitialRetrySeconds = FMath::Max(Settings.InitialRetrySeconds, 0.01f);
+	Settings.MaxRetrySeconds = FMath::Max(Settings.MaxRetrySeconds, Settings.InitialRetrySeconds);
+	OnOpened = MoveTemp(InOnOpened);
+	OnLost = MoveTemp(InOnLost);
+	if (Settings.DeviceName.IsEmpty())
+	{
+		SerialPort::FormatPortName(Settings.PortNumber, DevicePath, sizeof(DevicePath));
+	}
+	else
+	{
+		FCStringAnsi::Strncpy(DevicePath, TCHAR_TO_ANSI(*Settings.DeviceName), sizeof(DevicePath));
+	}
+
+#if PLATFORM_LINUX
+	if (pipe2(WakePipe, O_CLOEXEC | O_NONBLOCK) != 0)
+	{
+		WakePipe[0] = WakePipe[1] = -1;
+		return false;
+	}
+
+	// Without the watch (directory missing, e.g. /dev/serial/by-id with nothing plugged) the backoff alone still works
+	char DeviceDirectory[sizeof(DevicePath)];
+	FCStringAnsi::Strncpy(DeviceDirectory, DevicePath, sizeof(DeviceDirectory));
+	char* LastSlash = strrchr(DeviceDirectory, '/');
+	DeviceFileName = strrchr(DevicePath, '/') != nullptr ? strrchr(DevicePath, '/') + 1 : DevicePath;
+	InotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (InotifyFd != -1)
+	{
+		if (LastSlash != nullptr)
+		{
+			*LastSlash = 0;
+		}
+		// IN_ATTRIB too: udev fixes the node's permissions only after creating it
+		if (inotify_add_watch(InotifyFd, LastSlash != nullptr ? DeviceDirectory : ".", IN_CREATE | IN_ATTRIB | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) == -1)
+		{
+			close(InotifyFd);
+			InotifyFd = -1;
+		}
+	}
+#else
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+#endif
+
+	bStopping = false;
+	Thread = FRunnableThread::Create(this, TEXT("SerialPortConnector"), 0, TPri_BelowNormal);
+	if (Thread == nullptr)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void FSerialPortConnector::Close()
+{
+	if (Thread != nullptr)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	// The thread is gone, so finishing the connection here cannot race it
+	Disconnect();
+
+#if PLATFORM_LINUX
+	if (InotifyFd != -1)
+	{
+		close(InotifyFd);
+		InotifyFd = -1;
+	}
+	for (int& Fd : WakePipe)
+	{
+		if (Fd != -1)
+		{
+			close(Fd);
+			Fd = -1;
+		}
+	}
+#else
+	if (WakeEvent != nullptr)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+		WakeEvent = nullptr;
+	}
+#endif
+}
+
+bool FSerialPortConnector::TryOpen()
+{
+	if (!Port->InitPort(DevicePath, Settings.BaudRate, 'N', 8, 1, EV_RXCHAR))
+	{
+		// InitPort can fail after opening (bad settings), do not leak the handle to the next attempt
+		Port->ClosePort();
+		return false;
+	}
+	if (OnOpened && !OnOpened(*Port))
+	{
+		Port->ClosePort();
+		return false;
+	}
+
+	if (ConnectCount.fetch_add(1, std::memory_order_relaxed) > 0)
+	{
+		FArduinoInputCounters::AddReconnect();
+	}
+	bConnected.store(true, std::memory_order_release);
+	return true;
+}
+
+void FSerialPortConnector::Disconnect()
+{
+	if (!bConnected.load(std::memory_order_acquire))
+	{
+		return;
+	}
+	if (OnLost)
+	{
+		OnLost(*Port);
+	}
+	Port->ClosePort();
+	bConnected.store(false, std::memory_order_release);
+}
+
+uint32 FSerialPortConnector::Run()
+{
+	float RetrySeconds = Settings.InitialRetrySeconds;
+	bool bLoggedWaiting = false;
+	while (!bStopping.load(std::memory_order_acquire))
+	{
+		if (!bConnected.load(std::memory_order_acquire))
+		{
+			if (TryOpen())
+			{
+				UE_LOG(LogTemp, Log, TEXT("%s connected"), ANSI_TO_TCHAR(DevicePath));
+				RetrySeconds = Settings.InitialRetrySeconds;
+				bLoggedWaiting = false;
+				continue;
+			}
+
+			// One line per outage, not one per attempt
+			if (!bLoggedWaiting)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("%s not available, retrying in the background"), ANSI_TO_TCHAR(DevicePath));
+				bLoggedWaiting = true;
+			}
+			WaitForDeviceChange(RetrySeconds);
+			RetrySeconds = FMath::Min(RetrySeconds * 2.0f, Settings.MaxRetrySeconds);
+		}
+		else
+		{
+			const bool bRemoved = WaitForDeviceChange(LostCheckSeconds);
+			if (bRemoved || Port->IsLost())
+			{
+				UE_LOG(LogTemp, Warning, TEXT("%s disconnected"), ANSI_TO_TCHAR(DevicePath));
+				Disconnect();
+			}
+		}
+	}
+	return 0;
+}
+
+void FSerialPortConnector::Stop()
+{
+	bStopping.store(true, std::memory_order_release);
+#if PLATFORM_LINUX
+	const char Wake = 0;
+	while (write(WakePipe[1], &Wake, 1) == -1 && errno == EINTR)
+	{
+	}
+#else
+	WakeEvent->Trigger();
+#endif
+}
+
+bool FSerialPortConnector::WaitForDeviceChange(float Seconds)
+{
+#if PLATFORM_LINUX
+	pollfd Fds[2];
+	Fds[0].fd = WakePipe[0];
+	Fds[0].events = POLLIN;
+	Fds[1].fd = InotifyFd;
+	Fds[1].events = POLLIN;
+	Fds[0].revents = Fds[1].revents = 0;
+	if (poll(Fds, InotifyFd != -1 ? 2 : 1, (int)(Seconds * 1000.0f)) <= 0 || Fds[1].revents == 0)
+	{
+		return false;
+	}
+
+	// Every event is a reason to retry now. Report a removal of our device so a connected port is dropped at once
+	bool bRemoved = false;
+	alignas(inotify_event) char Events[4096];
+	ssize_t Length;
+	while ((Length = read(InotifyFd, Events, sizeof(Events))) > 0)
+	{
+		for (ssize_t Offset = 0; Offset < Length;)
+		{
+			const inotify_event* Event = reinterpret_cast<const inotify_event*>(Events + Offset);
+			if (Event->len > 0 && strcmp(Event->name, DeviceFileName) == 0 && (Event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0)
+			{
+				bRemoved = true;
+			}
+			Offset += sizeof(inotify_event) + Event->len;
+		}
+	}
+	return bRemoved;
+#else
+	WakeEvent->Wait((uint32)(Seconds * 1000.0f));
+	return false;
+#endif
+}
@@ -0,0 +1,280 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SerialPortDiscovery.h"
+#include "ArduinoProtocol.h"
+#include "SerialPort.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+
+#if !PLATFORM_WINDOWS
+#include <dirent.h>
+#include <string.h>
+#endif
+
+/** Probes one port on a thread of its own */
+class FSerialPortDiscovery::FProbeRunnable : public FRunnable
+{
+public:
+	FProbeRunnable(FSerialPortDiscovery& InOwner, int32 InIndex, const FSerialProbeSettings& InSettings)
+		: Owner(InOwner)
+		, Index(InIndex)
+		, Settings(InSettings)
+		, Thread(nullptr)
+	{
+	}
+
+	virtual ~FProbeRunnable()
+	{
+		Join();
+	}
+
+	bool Start()
+	{
+		Thread = FRunnableThread::Create(this, TEXT("SerialProbe"), 0, TPri_BelowNormal);
+		return Thread != nullptr;
+	}
+
+	void Join()
+	{
+		if (Thread != nullptr)
+		{
+			Thread->WaitForCompletion();
+			delete Thread;
+			Thread = nullptr;
+		}
+	}
+
+	virtual uint32 Run() override
+	{
+		Owner.Probes[Index] = ProbePort(Owner.Probes[Index].DeviceName, Settings);
+		Owner.FinishProbe();
+		return 0;
+	}
+
+private:
+	FSerialPortDiscovery& Owner;
+	const int32 Index;
+	const FSerialProbeSettings Settings;
+	FRunnableThread* Thread;
+};
+
+namespace
+{
+	/** Send Hello at the port's current rate and listen for ProbeSeconds. Fills the match fields of OutResult and returns true on an answer */
+	bool ProbeAtCurrentRate(SerialPort& Port, const FSerialProbeSettings& Settings, FSerialProbeResult& OutResult)
+	{
+		const uint8 NoPayload = 0;
+		uint8 Hello[ArduinoProtocol::MaxEncodedFrame + 1];
+		const int32 HelloLength = FArduinoFrameParser::BuildFrame(0, EArduinoFrameType::Hello, &NoPayload, 0, Hello);
+		if (!Port.WriteData(reinterpret_cast<char*>(Hello), (unsigned int)HelloLength))
+		{
+			return false;
+		}
+
+		// Nothing reads the port but us, so poll it like NegotiateBinaryLink does
+		FArduinoFrameParser Parser;
+		TArray<FArduinoFrame> Frames;
+		int32 GestureChars = 0;
+		char Rx[256];
+		const double Deadline = FPlatformTime::Seconds() + Settings.ProbeSeconds;
+		while (FPlatformTime::Seconds() < Deadline)
+		{
+			const uint32 Available = Port.GetBytesInCOM();
+			uint32 Read = 0;
+			if (Available == 0 || !Port.ReadBlock(Rx, FMath::Min<uint32>(Available, sizeof(Rx)), Read) || Read == 0)
+			{
+				FPlatformProcess::Sleep(0.002f);
+				continue;
+			}
+
+			Frames.Reset();
+			Parser.Parse(Rx, (int32)Read, Frames);
+			for (const FArduinoFrame& Frame : Frames)
+			{
+				if (Frame.Type == EArduinoFrameType::Hello && Frame.PayloadLength >= 3)
+				{
+					OutResult.Match = ESerialProbeMatch::Hello;
+					OutResult.ProtocolVersion = Frame.Payload[0];
+					OutResult.FirmwareId = (uint16)Frame.ReadInt16(1);
+					return true;
+				}
+			}
+
+			// At a wrong rate old firmware's letters arrive as noise. Letters in a row count, a stray byte from the rate switch only restarts them
+			for (uint32 i = 0; i < Read; ++i)
+			{
+				const char Char = Rx[i];
+				if (Char == 'L' || Char == 'R' || Char == 'J')
+				{
+					++GestureChars;
+				}
+				else if (Char != '\r' && Char != '\n' && Char != ' ' && Char != '\t')
+				{
+					GestureChars = 0;
+				}
+			}
+			if (GestureChars >= Settings.MinGestureChars)
+			{
+				OutResult.Match = ESerialProbeMatch::GestureTraffic;
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+FSerialPortDiscovery::FSerialPortDiscovery()
+	: ProbesLeft(0)
+	, bFinished(false)
+{
+}
+
+FSerialPortDiscovery::~FSerialPortDiscovery()
+{
+	Wait();
+}
+
+bool FSerialPortDiscovery::Start(const TArray<FString>& DeviceNames, const FSerialProbeSettings& InSettings, FOnFinished InOnFinished)
+{
+	if (Runnables.Num() > 0 || bFinished)
+	{
+		return false;
+	}
+
+	OnFinished = MoveTemp(InOnFinished);
+	Probes.SetNum(DeviceNames.Num());
+	for (int32 Index = 0; Index < DeviceNames.Num(); ++Index)
+	{
+		Probes[Index].DeviceName = DeviceNames[Index];
+	}
+	if (DeviceNames.Num() == 0)
+	{
+		FinishProbe();
+		return true;
+	}
+
+	// Counted up front, so a fast probe cannot finish the discovery while the others are still being started
+	ProbesLeft.store(DeviceNames.Num(), std::memory_order_release);
+	for (int32 Index = 0; Index < DeviceNames.Num(); ++Index)
+	{
+		TUniquePtr<FProbeRunnable>& Runnable = Runnables.Add_GetRef(MakeUnique<FProbeRunnable>(*this, Index, InSettings));
+		if (!Runnable->Start())
+		{
+			// No thread to spare: probe it here, the total time grows but nothing is missed
+			Probes[Index] = ProbePort(DeviceNames[Index], InSettings);
+			FinishProbe();
+		}
+	}
+	return true;
+}
+
+void FSerialPortDiscovery::FinishProbe()
+{
+	if (Probes.Num() > 0 && ProbesLeft.fetch_sub(1, std::memory_order_acq_rel) != 1)
+	{
+		return;
+	}
+
+	// Last one out: every entry of Probes is written
+	Boards.Reset();
+	for (const FSerialProbeResult& Probe : Probes)
+	{
+		if (Probe.Match != ESerialProbeMatch::None)
+		{
+			Boards.Add(Probe);
+		}
+	}
+	Boards.Sort([](const FSerialProbeResult& A, const FSerialProbeResult& B) { return A.DeviceName < B.DeviceName; });
+	bFinished.store(true, std::memory_order_release);
+	if (OnFinished)
+	{
+		OnFinished();
+	}
+}
+
+const TArray<FSerialProbeResult>& FSerialPortDiscovery::Wait()
+{
+	for (TUniquePtr<FProbeRunnable>& Runnable : Runnables)
+	{
+		Runnable->Join();
+	}
+	return Boards;
+}
+
+TArray<FString> FSerialPortDiscovery::ListCandidatePorts()
+{
+	TArray<FString> Candidates;
+#if PLATFORM_WINDOWS
+	// Opening a missing COM port fails at once, cheaper than asking SetupAPI
+	for (int32 Number = 1; Number <= 32; ++Number)
+	{
+		Candidates.Add(FString::Printf(TEXT("COM%d"), Number));
+	}
+#else
+	DIR* Directory = opendir("/dev");
+	if (Directory == nullptr)
+	{
+		return Candidates;
+	}
+	static const char* const Prefixes[] = { "ttyACM", "ttyUSB", "cu.usbmodem", "cu.usbserial" };
+	while (const dirent* Entry = readdir(Directory))
+	{
+		for (const char* Prefix : Prefixes)
+		{
+			if (strncmp(Entry->d_name, Prefix, strlen(Prefix)) == 0)
+			{
+				Candidates.Add(FString(TEXT("/dev/")) + ANSI_TO_TCHAR(Entry->d_name));
+				break;
+			}
+		}
+	}
+	closedir(Directory);
+	Candidates.Sort();
+#endif
+	return Candidates;
+}
+
+FSerialProbeResult FSerialPortDiscovery::ProbePort(const FString& DeviceName, const FSerialProbeSettings& Settings)
+{
+	FSerialProbeResult Result;
+	Result.DeviceName = DeviceName;
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	SerialPort Port;
+	bool bOpened = false;
+	for (uint32 BaudRate : Settings.BaudRates)
+	{
+		if (!bOpened)
+		{
+			const bool bConfigured = Port.InitPort(TCHAR_TO_ANSI(*DeviceName), BaudRate, 'N', 8, 1, EV_RXCHAR);
+			// Missing, busy (another board's connector holds it) or not a tty: nothing to find here
+			if (!Port.IsOpen())
+			{
+				break;
+			}
+			bOpened = true;
+			// Open, but this rate is not one the port takes: the next one may be
+			if (!bConfigured)
+			{
+				continue;
+			}
+		}
+		else if (!Port.SetBaudRate(BaudRate))
+		{
+			continue;
+		}
+
+		if (ProbeAtCurrentRate(Port, Settings, Result))
+		{
+			Result.BaudRate = BaudRate;
+			break;
+		}
+	}
+	Port.ClosePort();
+
+	Result.Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+	return Result;
+}
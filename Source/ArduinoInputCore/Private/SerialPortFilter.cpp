@@ -0,0 +1,105 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SerialPortFilter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SERIALPORTFILTER_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SERIALPORTFILTER_NEON 1
+#include <arm_neon.h>
+#endif
+
+int32 SerialPortFilter::StripIgnoredCharsScalar(char* pData, int32 length)
+{
+    int32 kept = 0;
+    for (int32 i = 0; i < length; ++i)
+    {
+        const char c = pData[i];
+        pData[kept] = c;
+        kept += IsIgnoredChar(c) ? 0 : 1;
+    }
+    return kept;
+}
+
+int32 SerialPortFilter::StripIgnoredChars(char* pData, int32 length)
+{
+    int32 kept = 0;
+    int32 i = 0;
+
+#if SERIALPORTFILTER_SSE2
+    const __m128i newLine = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+
+    for (; i + 16 <= length; i += 16)
+    {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData + i));
+        const __m128i ignored = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, newLine), _mm_cmpeq_epi8(block, carriageReturn)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)));
+        const uint32 dropMask = (uint32)_mm_movemask_epi8(ignored);
+
+        if (dropMask == 0)
+        {
+            /** Common case, nothing to drop: move the whole block. kept <= i so this never runs ahead of the reader */
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pData + kept), block);
+            kept += 16;
+        }
+        else if (dropMask != 0xFFFF)
+        {
+            alignas(16) char lanes[16];
+            _mm_store_si128(reinterpret_cast<__m128i*>(lanes), block);
+            uint32 keepMask = ~dropMask & 0xFFFF;
+            while (keepMask != 0)
+            {
+                pData[kept++] = lanes[FPlatformMath::CountTrailingZeros(keepMask)];
+                keepMask &= keepMask - 1;
+            }
+        }
+    }
+#elif SERIALPORTFILTER_NEON
+    const uint8x16_t newLine = vdupq_n_u8('\n');
+    const uint8x16_t carriageReturn = vdupq_n_u8('\r');
+    const uint8x16_t space = vdupq_n_u8(' ');
+    const uint8x16_t tab = vdupq_n_u8('\t');
+
+    for (; i + 16 <= length; i += 16)
+    {
+        const uint8x16_t block = vld1q_u8(reinterpret_cast<const uint8*>(pData + i));
+        const uint8x16_t ignored = vorrq_u8(
+            vorrq_u8(vceqq_u8(block, newLine), vceqq_u8(block, carriageReturn)),
+            vorrq_u8(vceqq_u8(block, space), vceqq_u8(block, tab)));
+        const uint64x2_t ignoredWords = vreinterpretq_u64_u8(ignored);
+
+        if ((vgetq_lane_u64(ignoredWords, 0) | vgetq_lane_u64(ignoredWords, 1)) == 0)
+        {
+            vst1q_u8(reinterpret_cast<uint8*>(pData + kept), block);
+            kept += 16;
+        }
+        else
+        {
+            alignas(16) uint8 lanes[16];
+            alignas(16) uint8 drop[16];
+            vst1q_u8(lanes, block);
+            vst1q_u8(drop, ignored);
+            for (int32 lane = 0; lane < 16; ++lane)
+            {
+                pData[kept] = (char)lanes[lane];
+                kept += drop[lane] ? 0 : 1;
+            }
+        }
+    }
+#endif
+
+    /** Tail shorter than a vector, or the whole buffer without SIMD */
+    for (; i < length; ++i)
+    {
+        const char c = pData[i];
+        pData[kept] = c;
+        kept += IsIgnoredChar(c) ? 0 : 1;
+    }
+    return kept;
+}
@@ -0,0 +1,393 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SerialPort.h"
+#include "SerialPortSet.h"
+
+#if !PLATFORM_WINDOWS
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/** Map a numeric baud rate onto the termios speed constant, B0 when unsupported */
+static speed_t SerialPortPosixBaudToSpeed(uint32 baud)
+{
+    switch (baud)
+    {
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B460800
+    case 460800: return B460800;
+#endif
+#ifdef B500000
+    case 500000: return B500000;
+#endif
+#ifdef B921600
+    case 921600: return B921600;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+#ifdef B2000000
+    case 2000000: return B2000000;
+#endif
+    default: return B0;
+    }
+}
+
+SerialPort::SerialPort() : m_bExit(false), m_pOwnerSet(nullptr), m_pListenThread(nullptr), m_pListener(nullptr), m_fdComm(-1), m_parity('N'), m_databits(8), m_stopsbits(1), m_bStripPadding(true), m_producedPos(0), m_consumedPos(0), m_pRecorder(nullptr), m_bLost(false), m_pInputEvent(nullptr)
+{
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+
+    pthread_mutex_init(&m_csCommunicationSync, nullptr);
+    pthread_mutex_init(&m_csWriteSync, nullptr);
+}
+
+SerialPort::~SerialPort()
+{
+    if (m_pOwnerSet != nullptr)
+    {
+        m_pOwnerSet->RemovePort(this);
+    }
+    CloseListenTread();
+    ClosePort();
+    pthread_mutex_destroy(&m_csCommunicationSync);
+    pthread_mutex_destroy(&m_csWriteSync);
+}
+
+bool SerialPort::configurePort(uint32 baud, char parity, uint32 databits, uint32 stopsbits)
+{
+    const speed_t speed = SerialPortPosixBaudToSpeed(baud);
+    if (speed == B0)
+    {
+        return false;
+    }
+
+    /** 进入临界段 */
+    pthread_mutex_lock(&m_csCommunicationSync);
+
+    termios tty;
+    bool bIsSuccess = tcgetattr(m_fdComm, &tty) == 0;
+    if (bIsSuccess)
+    {
+        /** Raw mode: no line discipline, no echo, no CR/LF translation */
+        cfmakeraw(&tty);
+        cfsetispeed(&tty, speed);
+        cfsetospeed(&tty, speed);
+
+        tty.c_cflag |= CLOCAL | CREAD;
+
+        tty.c_cflag &= ~CSIZE;
+        switch (databits)
+        {
+        case 5: tty.c_cflag |= CS5; break;
+        case 6: tty.c_cflag |= CS6; break;
+        case 7: tty.c_cflag |= CS7; break;
+        default: tty.c_cflag |= CS8; break;
+        }
+
+        tty.c_cflag &= ~(PARENB | PARODD);
+        if (parity == 'E' || parity == 'e' || parity == 'Y' || parity == 'y')
+        {
+            tty.c_cflag |= PARENB;
+        }
+        else if (parity == 'O' || parity == 'o')
+        {
+            tty.c_cflag |= PARENB | PARODD;
+        }
+
+        if (stopsbits == 2)
+        {
+            tty.c_cflag |= CSTOPB;
+        }
+        else
+        {
+            tty.c_cflag &= ~CSTOPB;
+        }
+
+        /** read() returns whatever is available, poll() does the waiting */
+        tty.c_cc[VMIN] = 0;
+        tty.c_cc[VTIME] = 0;
+
+        bIsSuccess = tcsetattr(m_fdComm, TCSANOW, &tty) == 0;
+    }
+
+    if (bIsSuccess)
+    {
+        /** 开启RTS, same as RTS_CONTROL_ENABLE on Windows. Fails harmlessly on a pty */
+        int modemBits = TIOCM_RTS;
+        ioctl(m_fdComm, TIOCMBIS, &modemBits);
+    }
+
+    /**  清空串口缓冲区 */
+    tcflush(m_fdComm, TCIOFLUSH);
+
+    /** 离开临界段 */
+    pthread_mutex_unlock(&m_csCommunicationSync);
+
+    return bIsSuccess;
+}
+
+void SerialPort::ClosePort()
+{
+    /** 如果有串口被打开，关闭它 */
+    if (m_fdComm != -1)
+    {
+        close(m_fdComm);
+        m_fdComm = -1;
+    }
+}
+
+void SerialPort::FormatPortName(uint32 portNo, char* szPort, uint32 size)
+{
+    /** Arduino boards show up as CDC-ACM devices */
+    snprintf(szPort, size, "/dev/ttyACM%u", portNo);
+}
+
+bool SerialPort::IsOpen() const
+{
+    return m_fdComm != -1;
+}
+
+bool SerialPort::openPort(uint32 portNo)
+{
+    /** 把串口的编号转换为设备名 */
+    char szPort[50];
+    FormatPortName(portNo, szPort, sizeof(szPort));
+
+    return openPort(szPort);
+}
+
+bool SerialPort::openPort(const char* szPort)
+{
+    /** 进入临界段 */
+    pthread_mutex_lock(&m_csCommunicationSync);
+
+    /** 打开指定的串口, non-blocking so a missing carrier never stalls open() or read() */
+    m_fdComm = open(szPort, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+    /** 如果打开失败，释放资源并返回 */
+    if (m_fdComm == -1)
+    {
+        pthread_mutex_unlock(&m_csCommunicationSync);
+        return false;
+    }
+
+    /** 共享模式,不共享, like dwShareMode = 0 on Windows */
+    ioctl(m_fdComm, TIOCEXCL);
+    m_bLost = false;
+
+    /** 退出临界区 */
+    pthread_mutex_unlock(&m_csCommunicationSync);
+
+    return true;
+}
+
+bool SerialPort::OpenListenWakeup()
+{
+    if (pipe(m_wakePipe) != 0)
+    {
+        m_wakePipe[0] = m_wakePipe[1] = -1;
+        return false;
+    }
+    fcntl(m_wakePipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(m_wakePipe[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+void SerialPort::CloseListenWakeup()
+{
+    close(m_wakePipe[0]);
+    close(m_wakePipe[1]);
+    m_wakePipe[0] = m_wakePipe[1] = -1;
+}
+
+void SerialPort::WakeListenThread()
+{
+    const char wake = 0;
+    while (write(m_wakePipe[1], &wake, 1) == -1 && errno == EINTR)
+    {
+    }
+}
+
+uint32 SerialPort::GetBytesInCOM()
+{
+    int BytesInQue = 0;
+    if (m_fdComm == -1 || ioctl(m_fdComm, FIONREAD, &BytesInQue) != 0 || BytesInQue < 0)
+    {
+        return 0;
+    }
+
+    return (uint32)BytesInQue;
+}
+
+void SerialPort::ListenLoop()
+{
+    pollfd fds[2];
+    fds[0].fd = m_fdComm;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_wakePipe[0];
+    fds[1].events = POLLIN;
+
+    // 线程循环, block until the port has data or CloseListenTread wakes us
+    while (!m_bExit)
+    {
+        fds[0].revents = 0;
+        fds[1].revents = 0;
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[1].revents != 0)
+        {
+            break;
+        }
+
+        /** Device unplugged or descriptor closed, nothing more will arrive */
+        if ((fds[0].revents & (POLLERR | POLLNVAL)) != 0)
+        {
+            m_bLost = true;
+            break;
+        }
+
+        uint32 BytesInQue = GetBytesInCOM();
+        if (BytesInQue == 0)
+        {
+            /** POLLHUP without pending data: the other end is gone (pty master closed, USB removed) */
+            if ((fds[0].revents & POLLHUP) != 0)
+            {
+                m_bLost = true;
+                break;
+            }
+            continue;
+        }
+
+        /** 读取输入缓冲区中的数据 */
+        DrainInput(BytesInQue);
+    }
+}
+
+bool SerialPort::ReadChar(char& cRecved)
+{
+    if (m_fdComm == -1)
+    {
+        return false;
+    }
+
+    /** 临界区保护 */
+    pthread_mutex_lock(&m_csCommunicationSync);
+
+    /** 从缓冲区读取一个字节的数据 */
+    ssize_t BytesRead = read(m_fdComm, &cRecved, 1);
+    if (BytesRead < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        /** 清空串口缓冲区 */
+        tcflush(m_fdComm, TCIFLUSH);
+        pthread_mutex_unlock(&m_csCommunicationSync);
+
+        return false;
+    }
+
+    /** 离开临界区 */
+    pthread_mutex_unlock(&m_csCommunicationSync);
+
+    return (BytesRead == 1);
+}
+
+bool SerialPort::ReadBlock(char* pData, uint32 length, uint32& bytesRead)
+{
+    bytesRead = 0;
+    if (m_fdComm == -1)
+    {
+        return false;
+    }
+
+    /** 临界区保护 */
+    pthread_mutex_lock(&m_csCommunicationSync);
+
+    /** 从缓冲区读取length个字节的数据 */
+    ssize_t BytesRead = read(m_fdComm, pData, length);
+    if (BytesRead < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        /** 清空串口缓冲区 */
+        tcflush(m_fdComm, TCIFLUSH);
+        pthread_mutex_unlock(&m_csCommunicationSync);
+
+        return false;
+    }
+
+    /** 离开临界区 */
+    pthread_mutex_unlock(&m_csCommunicationSync);
+
+    bytesRead = BytesRead > 0 ? (uint32)BytesRead : 0;
+    return true;
+}
+
+bool SerialPort::WriteData(char* pData, unsigned int length)
+{
+    if (m_fdComm == -1)
+    {
+        return false;
+    }
+
+    /** 临界区保护 */
+    pthread_mutex_lock(&m_csWriteSync);
+
+    /** 向缓冲区写入指定量的数据, the port is non-blocking so wait for room with poll() */
+    unsigned int BytesSent = 0;
+    while (BytesSent < length)
+    {
+        ssize_t Result = write(m_fdComm, pData + BytesSent, length - BytesSent);
+        if (Result > 0)
+        {
+            BytesSent += (unsigned int)Result;
+            continue;
+        }
+        if (Result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (Result < 0 && errno == EAGAIN)
+        {
+            pollfd fd;
+            fd.fd = m_fdComm;
+            fd.events = POLLOUT;
+            fd.revents = 0;
+            if (poll(&fd, 1, -1) > 0 && (fd.revents & POLLOUT) != 0)
+            {
+                continue;
+            }
+        }
+
+        /** 清空串口发送缓冲区, the receive side belongs to the reader */
+        tcflush(m_fdComm, TCOFLUSH);
+        pthread_mutex_unlock(&m_csWriteSync);
+
+        return false;
+    }
+
+    /** 离开临界区 */
+    pthread_mutex_unlock(&m_csWriteSync);
+
+    return true;
+}
+
+#endif // !PLATFORM_WINDOWS
@@ -0,0 +1,354 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SerialPortSet.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/ScopeLock.h"
+
+#if !PLATFORM_WINDOWS
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+/** Windows only: longest wait between two checks of the ports, 单位:毫秒 */
+static const uint32 SERIALPORTSET_POLL_INTERVAL = 5;
+
+/** Runs SerialPortSet::ServicePorts on an FRunnableThread, see StartIOThread */
+class FSerialPortSetWorker : public FRunnable
+{
+public:
+    explicit FSerialPortSetWorker(SerialPortSet* pSet) : m_pSet(pSet)
+    {
+    }
+
+    virtual uint32 Run() override
+    {
+        m_pSet->ServicePorts();
+        return 0;
+    }
+
+    /** Called by FRunnableThread::Kill before it waits for Run to return */
+    virtual void Stop() override
+    {
+        m_pSet->m_bExit = true;
+        m_pSet->WakeIOThread();
+    }
+
+private:
+    SerialPortSet* m_pSet;
+};
+
+SerialPortSet::SerialPortSet()
+    : m_generation(0), m_bExit(false), m_pIOThread(nullptr), m_pWorker(nullptr)
+{
+#if PLATFORM_WINDOWS
+    m_pWakeEvent = nullptr;
+#else
+    m_wakePipe[0] = -1;
+    m_wakePipe[1] = -1;
+#endif
+}
+
+SerialPortSet::~SerialPortSet()
+{
+    FScopeLock MembershipLock(&m_csMembership);
+
+    StopIOThread();
+    for (SerialPort* pPort : m_ports)
+    {
+        pPort->m_pOwnerSet = nullptr;
+    }
+    m_ports.Reset();
+}
+
+SerialPortSet& SerialPortSet::Get()
+{
+    static SerialPortSet Instance;
+    return Instance;
+}
+
+bool SerialPortSet::AddPort(SerialPort* pPort)
+{
+    FScopeLock MembershipLock(&m_csMembership);
+
+    if (pPort == nullptr || pPort->m_pOwnerSet != nullptr)
+    {
+        return false;
+    }
+    if (pPort->m_pListenThread != nullptr)
+    {
+        return false;
+    }
+
+    {
+        FScopeLock PortsLock(&m_csPorts);
+        m_ports.Add(pPort);
+        ++m_generation;
+        pPort->m_pOwnerSet = this;
+    }
+
+    if (m_pIOThread == nullptr && !StartIOThread())
+    {
+        FScopeLock PortsLock(&m_csPorts);
+        m_ports.Remove(pPort);
+        ++m_generation;
+        pPort->m_pOwnerSet = nullptr;
+        return false;
+    }
+
+    WakeIOThread();
+    return true;
+}
+
+bool SerialPortSet::RemovePort(SerialPort* pPort)
+{
+    FScopeLock MembershipLock(&m_csMembership);
+
+    bool bRemoved = false;
+    bool bEmpty = false;
+    {
+        /** The I/O thread holds m_csPorts while reading, so once we own it pPort is not in use */
+        FScopeLock PortsLock(&m_csPorts);
+        bRemoved = m_ports.Remove(pPort) > 0;
+        if (bRemoved)
+        {
+            ++m_generation;
+            pPort->m_pOwnerSet = nullptr;
+        }
+        bEmpty = m_ports.Num() == 0;
+    }
+
+    if (bEmpty)
+    {
+        StopIOThread();
+    }
+    else if (bRemoved)
+    {
+        WakeIOThread();
+    }
+    return bRemoved;
+}
+
+int32 SerialPortSet::NumPorts()
+{
+    FScopeLock PortsLock(&m_csPorts);
+    return m_ports.Num();
+}
+
+bool SerialPortSet::StartIOThread()
+{
+    if (!OpenIOWakeup())
+    {
+        return false;
+    }
+
+    m_bExit = false;
+    m_pWorker = new FSerialPortSetWorker(this);
+    m_pIOThread = FRunnableThread::Create(m_pWorker, TEXT("SerialPortSetIO"), 0, TPri_AboveNormal);
+    if (m_pIOThread == nullptr)
+    {
+        delete m_pWorker;
+        m_pWorker = nullptr;
+        CloseIOWakeup();
+        return false;
+    }
+    return true;
+}
+
+void SerialPortSet::StopIOThread()
+{
+    if (m_pIOThread == nullptr)
+    {
+        return;
+    }
+    /** Kill calls FSerialPortSetWorker::Stop, which wakes the thread at once, then joins it */
+    m_pIOThread->Kill(true);
+    delete m_pIOThread;
+    m_pIOThread = nullptr;
+
+    delete m_pWorker;
+    m_pWorker = nullptr;
+    CloseIOWakeup();
+}
+
+#if PLATFORM_WINDOWS
+
+bool SerialPortSet::OpenIOWakeup()
+{
+    m_pWakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+    return m_pWakeEvent != nullptr;
+}
+
+void SerialPortSet::CloseIOWakeup()
+{
+    if (m_pWakeEvent != nullptr)
+    {
+        FPlatformProcess::ReturnSynchEventToPool(m_pWakeEvent);
+        m_pWakeEvent = nullptr;
+    }
+}
+
+void SerialPortSet::WakeIOThread()
+{
+    if (m_pWakeEvent != nullptr)
+    {
+        m_pWakeEvent->Trigger();
+    }
+}
+
+void SerialPortSet::ServicePorts()
+{
+    while (!m_bExit)
+    {
+        bool bAnyData = false;
+        {
+            FScopeLock PortsLock(&m_csPorts);
+            for (SerialPort* pPort : m_ports)
+            {
+                const uint32 BytesInQue = pPort->GetBytesInCOM();
+                if (BytesInQue > 0)
+                {
+                    pPort->DrainInput(BytesInQue);
+                    bAnyData = true;
+                }
+            }
+        }
+
+        /** Go straight back to the ports while data is flowing, otherwise wait for the next interval or a wakeup */
+        if (!bAnyData)
+        {
+            m_pWakeEvent->Wait(SERIALPORTSET_POLL_INTERVAL);
+        }
+    }
+}
+
+#else
+
+bool SerialPortSet::OpenIOWakeup()
+{
+    if (pipe(m_wakePipe) != 0)
+    {
+        m_wakePipe[0] = m_wakePipe[1] = -1;
+        return false;
+    }
+    for (int fd : m_wakePipe)
+    {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return true;
+}
+
+void SerialPortSet::CloseIOWakeup()
+{
+    if (m_wakePipe[0] != -1)
+    {
+        close(m_wakePipe[0]);
+        close(m_wakePipe[1]);
+        m_wakePipe[0] = m_wakePipe[1] = -1;
+    }
+}
+
+void SerialPortSet::WakeIOThread()
+{
+    if (m_wakePipe[1] == -1)
+    {
+        return;
+    }
+    /** A full pipe already guarantees a wakeup, so EAGAIN is fine */
+    const char wake = 0;
+    while (write(m_wakePipe[1], &wake, 1) == -1 && errno == EINTR)
+    {
+    }
+}
+
+void SerialPortSet::ServicePorts()
+{
+    /** Slot 0 is the wakeup pipe, slot i+1 is polledPorts[i] */
+    TArray<pollfd> fds;
+    TArray<SerialPort*> polledPorts;
+    uint32 polledGeneration = 0;
+    bool bHavePollList = false;
+
+    while (!m_bExit)
+    {
+        {
+            FScopeLock PortsLock(&m_csPorts);
+            if (!bHavePollList || polledGeneration != m_generation)
+            {
+                fds.Reset();
+                polledPorts = m_ports;
+
+                pollfd wake;
+                wake.fd = m_wakePipe[0];
+                wake.events = POLLIN;
+                wake.revents = 0;
+                fds.Add(wake);
+                for (SerialPort* pPort : polledPorts)
+                {
+                    pollfd port;
+                    port.fd = pPort->m_fdComm;
+                    port.events = POLLIN;
+                    port.revents = 0;
+                    fds.Add(port);
+                }
+                polledGeneration = m_generation;
+                bHavePollList = true;
+            }
+        }
+
+        if (poll(fds.GetData(), fds.Num(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        if (fds[0].revents != 0)
+        {
+            char drain[64];
+            while (read(m_wakePipe[0], drain, sizeof(drain)) > 0)
+            {
+            }
+            continue;
+        }
+
+        FScopeLock PortsLock(&m_csPorts);
+        /** A port was added or removed while we waited: our list may point at a removed port */
+        if (polledGeneration != m_generation)
+        {
+            continue;
+        }
+
+        for (int32 i = 1; i < fds.Num(); ++i)
+        {
+            const short revents = fds[i].revents;
+            if (revents == 0)
+            {
+                continue;
+            }
+
+            SerialPort* pPort = polledPorts[i - 1];
+            const uint32 BytesInQue = pPort->GetBytesInCOM();
+            if (BytesInQue > 0)
+            {
+                pPort->DrainInput(BytesInQue);
+            }
+            else if ((revents & (POLLERR | POLLHUP | POLLNVAL)) != 0)
+            {
+                /** Device gone: stop polling it so it does not spin the thread, the owner will notice and remove it */
+                fds[i].fd = -1;
+                pPort->m_bLost = true;
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,364 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SerialSession.h"
+#include "SerialPort.h"
+#include "Async/MappedFileHandle.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static const char SerialSessionMagic[8] = { 'T', 'C', 'S', 'E', 'R', 'R', 'E', 'C' };
+
+static void WriteLE32(uint8* pOut, uint32 value)
+{
+	pOut[0] = (uint8)value;
+	pOut[1] = (uint8)(value >> 8);
+	pOut[2] = (uint8)(value >> 16);
+	pOut[3] = (uint8)(value >> 24);
+}
+
+static uint32 ReadLE32(const uint8* pData)
+{
+	return (uint32)pData[0] | ((uint32)pData[1] << 8) | ((uint32)pData[2] << 16) | ((uint32)pData[3] << 24);
+}
+
+FString SerialSession::ResolvePath(const FString& Filename)
+{
+	return FPaths::IsRelative(Filename) ? FPaths::ProjectSavedDir() / TEXT("Arduino") / Filename : Filename;
+}
+
+FSerialSessionRecorder::FSerialSessionRecorder()
+	: File(nullptr)
+	, Thread(nullptr)
+	, WakeEvent(nullptr)
+	, bStopping(false)
+	, StartCycles(0)
+	, LastMicros(0)
+	, DroppedBytes(0)
+{
+}
+
+FSerialSessionRecorder::~FSerialSessionRecorder()
+{
+	Close();
+}
+
+bool FSerialSessionRecorder::Open(const FString& Filename, uint32 Flags)
+{
+	if (IsOpen())
+	{
+		return false;
+	}
+
+	const FString Path = SerialSession::ResolvePath(Filename);
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*FPaths::GetPath(Path));
+	File = PlatformFile.OpenWrite(*Path);
+	if (File == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Cannot create serial session file %s"), *Path);
+		return false;
+	}
+
+	uint8 Header[SerialSession::HeaderSize];
+	FMemory::Memcpy(Header, SerialSessionMagic, sizeof(SerialSessionMagic));
+	WriteLE32(Header + 8, SerialSession::Version);
+	WriteLE32(Header + 12, Flags);
+	if (!File->Write(Header, sizeof(Header)))
+	{
+		delete File;
+		File = nullptr;
+		return false;
+	}
+
+	StartCycles = FPlatformTime::Cycles64();
+	LastMicros = 0;
+	DroppedBytes = 0;
+	bStopping = false;
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = FRunnableThread::Create(this, TEXT("ArduinoSessionRecorder"), 0, TPri_BelowNormal);
+	if (Thread == nullptr)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+		WakeEvent = nullptr;
+		delete File;
+		File = nullptr;
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Recording serial session to %s"), *Path);
+	return true;
+}
+
+void FSerialSessionRecorder::Close()
+{
+	if (Thread == nullptr)
+	{
+		return;
+	}
+
+	// Kill calls Stop and waits for Run to write what is left
+	Thread->Kill(true);
+	delete Thread;
+	Thread = nullptr;
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+	delete File;
+	File = nullptr;
+
+	if (GetDroppedBytes() > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Serial session recorder dropped %llu bytes"), GetDroppedBytes());
+	}
+}
+
+void FSerialSessionRecorder::Append(uint64 ReadCycles, const char* pData, uint32 Length)
+{
+	if (Length == 0 || Length > MAX_uint16)
+	{
+		return;
+	}
+
+	// Only the I/O thread pushes, so the free space can only grow between this check and the pushes
+	if (Pending.GetCapacity() - Pending.Size() < SerialSession::RecordHeaderSize + Length)
+	{
+		DroppedBytes.fetch_add(Length, std::memory_order_relaxed);
+		return;
+	}
+
+	// Deltas come from the absolute time since Open, so rounding never accumulates over a long session
+	const uint64 Micros = ReadCycles > StartCycles ? (uint64)(FPlatformTime::ToSeconds64(ReadCycles - StartCycles) * 1000000.0) : 0;
+	const uint64 Delta = Micros > LastMicros ? Micros - LastMicros : 0;
+	LastMicros += Delta;
+
+	uint8 RecordHeader[SerialSession::RecordHeaderSize];
+	WriteLE32(RecordHeader, (uint32)FMath::Min<uint64>(Delta, MAX_uint32));
+	RecordHeader[4] = (uint8)Length;
+	RecordHeader[5] = (uint8)(Length >> 8);
+	Pending.Push(RecordHeader, sizeof(RecordHeader));
+	Pending.Push(reinterpret_cast<const uint8*>(pData), Length);
+}
+
+bool FSerialSessionRecorder::WritePending()
+{
+	const uint8* pData = nullptr;
+	uint32 Count;
+	while ((Count = Pending.PeekContiguous(pData)) > 0)
+	{
+		if (!File->Write(pData, Count))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Serial session write failed, recording stops"));
+			return false;
+		}
+		Pending.Consume(Count);
+	}
+	return true;
+}
+
+uint32 FSerialSessionRecorder::Run()
+{
+	bool bWriteOk = true;
+	while (bWriteOk && !bStopping.load(std::memory_order_acquire))
+	{
+		WakeEvent->Wait(WriteIntervalMs);
+		bWriteOk = WritePending();
+	}
+
+	if (bWriteOk && WritePending())
+	{
+		File->Flush();
+	}
+	return 0;
+}
+
+void FSerialSessionRecorder::Stop()
+{
+	bStopping.store(true, std::memory_order_release);
+	WakeEvent->Trigger();
+}
+
+FSerialSessionReplay::FSerialSessionReplay()
+	: MappedFile(nullptr)
+	, MappedRegion(nullptr)
+	, Data(nullptr)
+	, DataSize(0)
+	, Flags(0)
+	, Target(nullptr)
+	, Speed(ESerialReplaySpeed::OriginalTiming)
+	, Thread(nullptr)
+	, WakeEvent(nullptr)
+	, bStopping(false)
+	, bFinished(false)
+{
+}
+
+FSerialSessionReplay::~FSerialSessionReplay()
+{
+	Close();
+}
+
+bool FSerialSessionReplay::Open(const FString& Filename, SerialPort& InTarget, ESerialReplaySpeed InSpeed)
+{
+	if (Thread != nullptr)
+	{
+		return false;
+	}
+
+	const FString Path = SerialSession::ResolvePath(Filename);
+	MappedFile = FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path);
+	if (MappedFile != nullptr)
+	{
+		MappedRegion = MappedFile->MapRegion(0, MappedFile->GetFileSize());
+	}
+	if (MappedRegion != nullptr)
+	{
+		Data = MappedRegion->GetMappedPtr();
+		DataSize = MappedRegion->GetMappedSize();
+	}
+	else
+	{
+		delete MappedFile;
+		MappedFile = nullptr;
+		if (!FFileHelper::LoadFileToArray(LoadedFile, *Path))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Cannot open serial session file %s"), *Path);
+			return false;
+		}
+		Data = LoadedFile.GetData();
+		DataSize = LoadedFile.Num();
+	}
+
+	if (DataSize < SerialSession::HeaderSize
+		|| FMemory::Memcmp(Data, SerialSessionMagic, sizeof(SerialSessionMagic)) != 0
+		|| ReadLE32(Data + 8) != SerialSession::Version)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("%s is not a serial session file"), *Path);
+		Close();
+		return false;
+	}
+	Flags = ReadLE32(Data + 12);
+
+	// Binary sessions were read with padding stripping off, set it before the replay thread starts producing
+	InTarget.SetStripPadding((Flags & SerialSession::FlagBinaryProtocol) == 0);
+	Target = &InTarget;
+	Speed = InSpeed;
+	bStopping = false;
+	bFinished = false;
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = FRunnableThread::Create(this, TEXT("ArduinoSessionReplay"), 0, TPri_AboveNormal);
+	if (Thread == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("Replaying serial session %s"), *Path);
+	return true;
+}
+
+void FSerialSessionReplay::Close()
+{
+	if (Thread != nullptr)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+	if (WakeEvent != nullptr)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+		WakeEvent = nullptr;
+	}
+
+	delete MappedRegion;
+	MappedRegion = nullptr;
+	delete MappedFile;
+	MappedFile = nullptr;
+	LoadedFile.Empty();
+	Data = nullptr;
+	DataSize = 0;
+	Target = nullptr;
+}
+
+bool FSerialSessionReplay::WaitUntil(uint64 TargetCycles)
+{
+	for (;;)
+	{
+		if (bStopping.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		const uint64 Now = FPlatformTime::Cycles64();
+		if (Now >= TargetCycles)
+		{
+			return true;
+		}
+
+		// Sleep through most of the gap, then yield so the block lands within a few microseconds of its time
+		const double RemainingMs = FPlatformTime::ToMilliseconds64(TargetCycles - Now);
+		if (RemainingMs > 2.0)
+		{
+			WakeEvent->Wait((uint32)(RemainingMs - 1.0));
+		}
+		else
+		{
+			FPlatformProcess::YieldThread();
+		}
+	}
+}
+
+uint32 FSerialSessionReplay::Run()
+{
+	const double CyclesPerMicro = 0.000001 / FPlatformTime::GetSecondsPerCycle64();
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	uint64 RecordMicros = 0;
+
+	int64 Offset = SerialSession::HeaderSize;
+	while (!bStopping.load(std::memory_order_acquire) && Offset + SerialSession::RecordHeaderSize <= DataSize)
+	{
+		const uint32 Delta = ReadLE32(Data + Offset);
+		const uint32 Length = (uint32)Data[Offset + 4] | ((uint32)Data[Offset + 5] << 8);
+		Offset += SerialSession::RecordHeaderSize;
+		if (Offset + Length > DataSize)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Serial session ends with a truncated record"));
+			break;
+		}
+
+		RecordMicros += Delta;
+		if (Speed == ESerialReplaySpeed::OriginalTiming && !WaitUntil(StartCycles + (uint64)(RecordMicros * CyclesPerMicro)))
+		{
+			break;
+		}
+
+		// Never drop replayed bytes: wait for the game to drain the queue instead
+		const char* pBlock = reinterpret_cast<const char*>(Data + Offset);
+		uint32 Queued = 0;
+		while (!bStopping.load(std::memory_order_acquire))
+		{
+			Queued += Target->InjectInput(pBlock + Queued, Length - Queued, FPlatformTime::Cycles64());
+			if (Queued == Length)
+			{
+				break;
+			}
+			WakeEvent->Wait(1);
+		}
+		Offset += Length;
+	}
+
+	bFinished.store(true, std::memory_order_release);
+	return 0;
+}
+
+void FSerialSessionReplay::Stop()
+{
+	bStopping.store(true, std::memory_order_release);
+	WakeEvent->Trigger();
+}
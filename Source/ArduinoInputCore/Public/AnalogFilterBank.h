@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/** Filter chain settings, shared by every channel of a bank */
+struct FAnalogFilterSettings
+{
+	/** Moving average length in samples, 1 turns it off */
+	int32 MovingAverageWindow = 4;
+
+	/** Exponential smoothing factor applied after the moving average, 1 turns it off */
+	float SmoothingAlpha = 0.25f;
+
+	/** Hysteresis: a channel becomes pressed above PressThreshold and released below ReleaseThreshold */
+	float PressThreshold = 0.6f;
+	float ReleaseThreshold = 0.4f;
+
+	/** A pressed/released change only counts once it held for this many consecutive samples */
+	int32 DebounceSamples = 3;
+};
+
+/** Filters for multi-channel analog sensor streams
+*
+* Every channel goes through the same chain: moving average, exponential
+* smoothing, hysteresis threshold, then debounce. Sample sets are batched
+* as rows of channels and the chain runs four channels per SSE2/NEON
+* instruction, with each piece of filter state kept in an array of its
+* own, so adding channels adds lanes rather than branches.
+*
+* AddSampleSet and Process belong to one thread (the parse thread);
+* GetValue and IsPressed can be called from any thread and return what
+* the last Process published.
+*/
+class ARDUINOINPUTCORE_API FAnalogFilterBank
+{
+public:
+	static const int32 MaxChannels = 16;
+	static const int32 MaxWindow = 32;
+
+	/** Sample sets held before Process must run, AddSampleSet processes by itself when full */
+	static const int32 BatchCapacity = 256;
+
+	FAnalogFilterBank();
+
+	/** Set the channel count and settings, and forget all state */
+	void Configure(int32 NumChannels, const FAnalogFilterSettings& Settings);
+
+	int32 GetNumChannels() const
+	{
+		return m_numChannels;
+	}
+
+	/** Queue one sample set, Values holds GetNumChannels() floats */
+	void AddSampleSet(const float* Values);
+
+	/** Run the queued sample sets through the filters and publish the results */
+	void Process();
+
+	/** One channel at a time reference version of Process, same results */
+	void ProcessScalar();
+
+	/** Filtered value of a channel, 0 for a channel out of range */
+	float GetValue(int32 Channel) const;
+
+	/** Debounced pressed state of a channel */
+	bool IsPressed(int32 Channel) const;
+
+	/** Channel samples ever processed, for throughput measurements */
+	uint64 GetSamplesProcessed() const
+	{
+		return m_samplesProcessed.load(std::memory_order_relaxed);
+	}
+
+private:
+	/** First sample set seen: fill the average and smoothing state with it so the output does not ramp up from 0 */
+	void Prime(const float* Row);
+
+	void Publish();
+
+	int32 m_numChannels;
+	/** m_numChannels rounded up to whole vectors */
+	int32 m_numLanes;
+	int32 m_window;
+	float m_invWindow;
+	float m_alpha;
+	int32 m_debounceSamples;
+	bool m_bPrimed;
+
+	alignas(16) float m_batch[BatchCapacity][MaxChannels];
+	int32 m_batchCount;
+
+	/** Last m_window sample sets, m_historyPos is the oldest */
+	alignas(16) float m_history[MaxWindow][MaxChannels];
+	int32 m_historyPos;
+
+	alignas(16) float m_sum[MaxChannels];
+	alignas(16) float m_smoothed[MaxChannels];
+	alignas(16) float m_pressThreshold[MaxChannels];
+	alignas(16) float m_releaseThreshold[MaxChannels];
+	/** Masks, all ones when set */
+	alignas(16) uint32 m_hysteresis[MaxChannels];
+	alignas(16) uint32 m_debounced[MaxChannels];
+	/** Consecutive samples the hysteresis output disagreed with m_debounced */
+	alignas(16) int32 m_debounceCount[MaxChannels];
+
+	std::atomic<float> m_publishedValue[MaxChannels];
+	std::atomic<bool> m_publishedPressed[MaxChannels];
+	std::atomic<uint64> m_samplesProcessed;
+};
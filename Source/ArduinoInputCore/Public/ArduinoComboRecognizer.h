@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ArduinoCommand.h"
+
+/** One combo: a symbol sequence from the legacy stream, how fast it has to be entered and what it produces */
+struct FArduinoComboPattern
+{
+	/** Symbols in the order the board sends them, e.g. "L,R,L,R". ',' and ' ' only separate and are ignored */
+	FString Sequence;
+
+	/** Longest time from the read of the first symbol to the read of the last, 0 for no limit */
+	double WindowSeconds = 0.0;
+
+	EArduinoOpcode Opcode = EArduinoOpcode::Combo;
+
+	/** Passed on in FArduinoCommand::Payload */
+	int16 Payload = 0;
+};
+
+/** A combo recognized by FArduinoComboRecognizer::Parse */
+struct FArduinoComboMatch
+{
+	EArduinoOpcode Opcode;
+	int16 Payload;
+};
+
+/** Incremental matcher for a set of combos, the data-driven successor of GestureParser
+*
+* Compile turns the patterns into an Aho-Corasick automaton and flattens it
+* into a full transition table, so Parse does one table lookup per byte and
+* then checks only the patterns ending in the new state. That is at most one
+* per distinct pattern length (MaxPatternLength), never the whole set, so
+* the cost per byte does not grow with the number of combos.
+*
+* Bytes no pattern uses break every sequence in progress, as they did in
+* GestureParser. Patterns producing the same opcode and payload never share
+* a symbol: "LR" and "RL" both being a run step, "LRL" is one step and the
+* trailing 'L' waits for its partner.
+*/
+class ARDUINOINPUTCORE_API FArduinoComboRecognizer
+{
+public:
+	/** Longest sequence Compile accepts, also the size of the timestamp history */
+	static const int32 MaxPatternLength = 32;
+
+	/** Recognizes nothing until Compile */
+	FArduinoComboRecognizer();
+
+	/** Build the automaton for Patterns, replacing the previous one
+	*
+	*
+	* @param: const TArray<FArduinoComboPattern> & Patterns empty sequences are skipped
+	* @param: FString * OutError why compiling failed, may be null
+	* @return: bool false if a sequence is longer than MaxPatternLength or not ASCII. The recognizer is then left empty
+	* @note: costs O(total symbols * distinct symbols), meant for load time, not for the parse thread
+	* @see: MakeDefaultPatterns
+	*/
+	bool Compile(const TArray<FArduinoComboPattern>& Patterns, FString* OutError = nullptr);
+
+	/** Feed received chars to the automaton
+	*
+	*
+	* @param: const char * pData chars taken from SerialPort's queue
+	* @param: int32 length number of chars in pData
+	* @param: uint64 readCycles FPlatformTime::Cycles64() when pData was read, 0 if unknown (time windows then always pass)
+	* @param: TArray<FArduinoComboMatch> & outMatches recognized combos are appended, in stream order
+	* @return: int32 number of combos appended
+	* @note: all chars are consumed, a partial sequence is kept for the next call
+	* @see:
+	*/
+	int32 Parse(const char* pData, int32 length, uint64 readCycles, TArray<FArduinoComboMatch>& outMatches);
+
+	/** Forget partial sequences, e.g. after the port was reopened */
+	void Reset();
+
+	int32 GetNumPatterns() const { return m_patterns.Num(); }
+	int32 GetNumStates() const { return m_numStates; }
+
+	/** The rules GestureParser hard-codes, with StepWindowSeconds (0 for none) between the two feet of a run step */
+	static TArray<FArduinoComboPattern> MakeDefaultPatterns(double StepWindowSeconds);
+
+private:
+	struct FCompiledPattern
+	{
+		uint64 WindowCycles;
+		int32 Length;
+		int32 Result;
+	};
+
+	struct FResult
+	{
+		EArduinoOpcode Opcode;
+		int16 Payload;
+	};
+
+	/** Byte to symbol class, class 0 is every byte no pattern uses */
+	uint8 m_classOf[256];
+	int32 m_numClasses;
+	int32 m_numStates;
+	/** Next state, indexed by state * m_numClasses + class */
+	TArray<int32> m_next;
+	/** Patterns ending in each state (its own and those of its suffix states): m_outputs[m_outputStart[state]..m_outputStart[state + 1]) */
+	TArray<int32> m_outputStart;
+	TArray<int32> m_outputs;
+	TArray<FCompiledPattern> m_patterns;
+	TArray<FResult> m_results;
+
+	int32 m_state;
+	/** Symbols parsed so far, the index of the latest one */
+	uint64 m_symbolCount;
+	/** Read time of the latest MaxPatternLength symbols, by symbol index */
+	uint64 m_symbolCycles[MaxPatternLength];
+	/** Per result, index of the last symbol of its latest match, 0 for none */
+	TArray<uint64> m_resultEnd;
+};
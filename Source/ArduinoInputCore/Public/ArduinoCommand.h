@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SpmcEventLog.h"
+
+/** What an Arduino command asks the character to do */
+enum class EArduinoOpcode : uint8
+{
+	None,
+	/** One running step ("LR" or "RL") */
+	Run,
+	/** A jump ("J") */
+	Jump,
+	/** A designer-defined combo, Payload is its index in the combo set */
+	Combo,
+
+	/** The highest opcode, move it along when adding one: net frames size their opcode field on it */
+	Last = Combo,
+};
+
+/** One recognized input, as passed from UArduinoInput to its consumers
+*
+* Plain 16-byte value type: queued by copy into preallocated storage, so
+* handing an input to the game thread never allocates. Use ToString only
+* where text is really needed (logs, Blueprint).
+*/
+struct FArduinoCommand
+{
+	/** FPlatformTime::Cycles64() when the bytes completing the command were read from the port, 0 if unknown */
+	uint64 TimestampCycles;
+
+	/** Cycles from TimestampCycles until the command was recognized, saturated */
+	uint32 ParseDelayCycles;
+
+	/** Opcode-specific value, 0 when unused */
+	int16 Payload;
+
+	EArduinoOpcode Opcode;
+
+	/** Which board sent it, see UArduinoInput::DeviceId */
+	uint8 DeviceId;
+
+	FArduinoCommand()
+		: TimestampCycles(0), ParseDelayCycles(0), Payload(0), Opcode(EArduinoOpcode::None), DeviceId(0)
+	{
+	}
+
+	FArduinoCommand(EArduinoOpcode InOpcode, uint8 InDeviceId, uint64 InTimestampCycles, int16 InPayload = 0)
+		: TimestampCycles(InTimestampCycles), ParseDelayCycles(0), Payload(InPayload), Opcode(InOpcode), DeviceId(InDeviceId)
+	{
+	}
+
+	/** FPlatformTime::Cycles64() when the command was recognized, 0 if unknown */
+	uint64 GetParseCycles() const
+	{
+		return TimestampCycles != 0 ? TimestampCycles + ParseDelayCycles : 0;
+	}
+
+	/** The legacy one-letter token: "W" for a run step, "J" for a jump, "C" for a combo */
+	static const TCHAR* OpcodeToString(EArduinoOpcode InOpcode)
+	{
+		switch (InOpcode)
+		{
+		case EArduinoOpcode::Run: return TEXT("W");
+		case EArduinoOpcode::Jump: return TEXT("J");
+		case EArduinoOpcode::Combo: return TEXT("C");
+		default: return TEXT("");
+		}
+	}
+
+	const TCHAR* ToString() const
+	{
+		return OpcodeToString(Opcode);
+	}
+};
+
+static_assert(sizeof(FArduinoCommand) == 16, "FArduinoCommand is meant to stay a compact POD");
+
+/** Recognized commands of one board, published once by its parser and read in place by every subscriber */
+typedef TSpmcEventLog<FArduinoCommand, 1024> FArduinoCommandLog;
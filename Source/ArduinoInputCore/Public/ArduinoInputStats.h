@@ -0,0 +1,61 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+
+#if defined(__has_include)
+#if __has_include("ProfilingDebugging/CpuProfilerTrace.h")
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#endif
+#endif
+
+/** "stat ArduinoInput": where the Arduino input path spends its time, and how much input it moves
+*
+* Rates and totals come from FArduinoInputCounters, which any thread bumps
+* with relaxed atomics; the module publishes them to the stat system once
+* per frame from the core ticker.
+*/
+DECLARE_STATS_GROUP(TEXT("ArduinoInput"), STATGROUP_ArduinoInput, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Read input (I/O thread)"), STAT_ArduinoReadInput, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("AnalyzeInput"), STAT_ArduinoAnalyzeInput, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Input device events"), STAT_ArduinoCharacterInput, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Write output"), STAT_ArduinoWriteOutput, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Bytes/s"), STAT_ArduinoBytesPerSecond, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Gestures/s"), STAT_ArduinoGesturesPerSecond, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Queue depth (chars)"), STAT_ArduinoQueueDepth, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Dropped bytes"), STAT_ArduinoDroppedBytes, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+DECLARE_DWORD_ACCUMULATOR_STAT_EXTERN(TEXT("Reconnects"), STAT_ArduinoReconnects, STATGROUP_ArduinoInput, ARDUINOINPUTCORE_API);
+
+/** Insights spans of the Arduino input path, all named Arduino*
+*
+* They ride on the CPU trace channel, so "-trace=cpu" records them next to
+* the engine's own scopes and they cost nothing while it is off.
+*/
+#if defined(CPUPROFILERTRACE_ENABLED) && CPUPROFILERTRACE_ENABLED
+#define ARDUINO_TRACE_SCOPE(Name) TRACE_CPUPROFILER_EVENT_SCOPE(Name)
+#else
+#define ARDUINO_TRACE_SCOPE(Name)
+#endif
+
+/** Process-wide input totals behind the per-second stats */
+class ARDUINOINPUTCORE_API FArduinoInputCounters
+{
+public:
+	static void AddBytesRead(uint32 Count);
+	static void AddGestures(uint32 Count);
+	static void AddDroppedBytes(uint32 Count);
+	/** A board came back after it was lost, not its first connection */
+	static void AddReconnect();
+	/** Game thread time spent handing commands out: dispatch to subscribers and input device events */
+	static void AddGameThreadCycles(uint64 Cycles);
+
+	/** Total of AddGameThreadCycles so far, sample it every frame for a per-frame cost */
+	static uint64 GetGameThreadCycles();
+
+	/** Game thread, once per frame: turn the totals into stat values */
+	static void PublishStats(float DeltaSeconds);
+};
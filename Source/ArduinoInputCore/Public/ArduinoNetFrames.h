@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ArduinoCommand.h"
+
+/** A command as replicated: its age rather than its timestamp, which means nothing on another machine */
+struct FArduinoNetCommand
+{
+	/** Milliseconds from the command's bytes being read from the board to the packet being sent */
+	uint32 AgeMs = 0;
+	int16 Payload = 0;
+	EArduinoOpcode Opcode = EArduinoOpcode::None;
+	uint8 DeviceId = 0;
+};
+
+/** The commands one client sent together */
+struct FArduinoNetFrame
+{
+	/** Counts the frames of one sender, wrapping */
+	uint16 Sequence = 0;
+	TArray<FArduinoNetCommand, TInlineAllocator<4>> Commands;
+};
+
+/** What one unreliable RPC carries: the newest frame and the few before it, oldest first, so that a lost packet is made up for by the next
+*
+* Bit-packed, a frame of one command in 12 to 20 bits:
+*   16 bits   sequence of the newest frame, the others follow it without gaps
+*    3 bits   frame count - 1
+*   per frame, per command a 1 bit, then a 0 bit after the last one
+*   per command:
+*     2 bits  opcode
+*     1 bit   same board as the command before, else 8 bits of DeviceId
+*     1 bit   the opcode's usual payload (1 for Run, 0 otherwise), else the payload as a varint
+*     varint  age: milliseconds younger than the command before, the first one its whole age
+* A varint takes 4 bits at a time, each followed by a bit telling whether more follow.
+*/
+struct ARDUINOINPUTCORE_API FArduinoNetPacket
+{
+	static const int32 MaxFrames = 8;
+	static const int32 MaxCommandsPerFrame = 64;
+
+	TArray<FArduinoNetFrame, TInlineAllocator<4>> Frames;
+
+	/** Pack into a saving Ar, unpack from a loading one. False if what was loaded is malformed, the packet is left empty then.
+	* OutBits gets the size as a bit archive stores it */
+	bool Serialize(FArchive& Ar, int32* OutBits = nullptr);
+};
+
+/** Client side: turns dispatched commands into frames and packs each frame into Redundancy + 1 packets
+*
+* Every frame stays in the packets until Redundancy newer frames have been
+* sent, and HasPendingSends asks for packets until the newest frame has
+* been in Redundancy + 1 of them, so a frame only misses the server if that
+* many packets in a row are lost.
+*/
+class ARDUINOINPUTCORE_API FArduinoNetFrameSender
+{
+public:
+	explicit FArduinoNetFrameSender(int32 InRedundancy = 3);
+
+	/** Older frames sent again in every packet, 0 to FArduinoNetPacket::MaxFrames - 1 */
+	void SetRedundancy(int32 InRedundancy);
+
+	/** Start a frame holding Commands. More than MaxCommandsPerFrame start more frames */
+	void AddFrame(const FArduinoCommand* Commands, int32 Num);
+
+	/** True while the newest frame has been in fewer than Redundancy + 1 packets */
+	bool HasPendingSends() const;
+
+	/** The newest frames, ages taken at NowCycles, and count the send */
+	void MakePacket(uint64 NowCycles, FArduinoNetPacket& OutPacket);
+
+	void Reset();
+
+private:
+	struct FPendingFrame
+	{
+		uint16 Sequence = 0;
+		TArray<FArduinoCommand, TInlineAllocator<4>> Commands;
+	};
+
+	/** Oldest first, at most Redundancy + 1 */
+	TArray<FPendingFrame> Frames;
+	int32 Redundancy;
+	uint16 NextSequence;
+	/** Packets the newest frame has been in */
+	int32 NewestSends;
+};
+
+/** Server side: keeps the frames of a packet that are new, in sequence order
+*
+* A frame older than the newest one taken is dropped even if it was never
+* seen, so commands are applied in the order the client sent them.
+*/
+class ARDUINOINPUTCORE_API FArduinoNetFrameReceiver
+{
+public:
+	FArduinoNetFrameReceiver();
+
+	/** Append the frames of Packet not taken before to OutFrames, oldest first. Returns how many */
+	int32 Accept(const FArduinoNetPacket& Packet, TArray<const FArduinoNetFrame*>& OutFrames);
+
+	void Reset();
+
+	uint64 GetFramesTaken() const { return FramesTaken; }
+	/** Taken from a packet of a newer frame: every packet where they were the newest was lost or late */
+	uint64 GetFramesRecovered() const { return FramesRecovered; }
+	/** Skipped in the sequence, lost in every packet that held them */
+	uint64 GetFramesLost() const { return FramesLost; }
+
+private:
+	uint16 LastSequence;
+	bool bHasSequence;
+	uint64 FramesTaken;
+	uint64 FramesRecovered;
+	uint64 FramesLost;
+};
@@ -0,0 +1,125 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "ArduinoProtocol.h"
+#include "InputLatencyStats.h"
+#include "SpscRingBuffer.h"
+#include <atomic>
+
+class IArduinoTransport;
+class FRunnableThread;
+class FEvent;
+
+/** One output command that is sent as posted, never merged with another */
+struct FArduinoOutputEvent
+{
+	EArduinoFrameType Type;
+	uint8 Payload[4];
+	/** FPlatformTime::Cycles64() when it was posted */
+	uint64 PostCycles;
+};
+
+/** Non-blocking feedback output (LEDs, rumble) to a board on the binary protocol
+*
+* Posting never touches the port. State updates (an LED colour, a motor's
+* strength) go to one slot per LED or motor: posting again before the
+* writer got to it replaces the value, so only the latest one is sent.
+* One-shot events (rumble pulses) go through a lock-free ring and are all
+* sent, in order.
+*
+* A writer thread of its own wakes on a post, packs every pending frame
+* into one buffer and sends it with a single WriteData, which on a serial
+* port takes its write lock only and so never waits for the reader.
+*
+* State setters can be called from any thread; PostPulse has a single
+* producer, normally the game thread.
+*/
+class ARDUINOINPUTCORE_API FArduinoOutputQueue : public FRunnable
+{
+public:
+	static const int32 MaxLeds = 48;
+	static const int32 MaxMotors = 16;
+
+	FArduinoOutputQueue();
+	virtual ~FArduinoOutputQueue();
+
+	/** Start the writer thread on an open port or socket. FirstSequence continues the host's frame numbering */
+	bool Start(IArduinoTransport& InPort, uint8 FirstSequence);
+
+	/** Send what is pending and stop the writer thread. State posted later is sent by the next Start, pulses are dropped */
+	void Close();
+
+	bool IsRunning() const { return Thread != nullptr; }
+
+	/** Set an LED's colour, replaces a colour not sent yet. Returns false if Led is out of range */
+	bool SetLedColor(int32 Led, uint8 R, uint8 G, uint8 B);
+
+	/** Set a motor's continuous strength (0 stops it), replaces a strength not sent yet */
+	bool SetRumble(int32 Motor, uint8 Strength);
+
+	/** Run a motor at Strength for DurationMs, then stop it. Returns false if the event ring is full */
+	bool PostPulse(int32 Motor, uint8 Strength, uint16 DurationMs);
+
+	/** Bytes handed to the port, and the WriteData calls they took */
+	uint64 GetBytesWritten() const { return BytesWritten.load(std::memory_order_relaxed); }
+	uint64 GetWriteCalls() const { return WriteCalls.load(std::memory_order_relaxed); }
+	uint64 GetFramesWritten() const { return FramesWritten.load(std::memory_order_relaxed); }
+
+	/** State updates replaced before they were sent */
+	uint64 GetCoalesced() const { return Coalesced.load(std::memory_order_relaxed); }
+
+	/** Pulses posted while closed or with the event ring full, and frames of failed writes */
+	uint64 GetDropped() const { return Dropped.load(std::memory_order_relaxed); }
+
+	/** Post -> WriteData returned, in microseconds */
+	const FLatencyHistogram& GetQueueLatency() const { return QueueLatency; }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	static const int32 SlotCount = MaxLeds + MaxMotors;
+	static_assert(SlotCount <= 64, "Slot dirty bits live in one uint64");
+
+	/** Frames of one WriteData call. A 4 byte payload frame encodes to 10 bytes with its delimiter */
+	static const int32 BatchBytes = 1024;
+	static const int32 MaxBatchFrames = BatchBytes / 8;
+
+	void SetSlot(int32 Slot, uint32 Payload);
+
+	/** Send every dirty slot and queued event */
+	void Flush();
+	void AppendFrame(EArduinoFrameType Type, const uint8* Payload, uint64 PostCycles);
+	void WriteBatch();
+
+	IArduinoTransport* Port;
+	FRunnableThread* Thread;
+	FEvent* WakeEvent;
+	std::atomic<bool> bStopping;
+
+	/** Latest payload of every LED (slots 0..MaxLeds-1) and motor, with the time it was posted */
+	std::atomic<uint32> SlotPayload[SlotCount];
+	std::atomic<uint64> SlotPostCycles[SlotCount];
+	/** Bit per slot posted since the writer last sent it */
+	std::atomic<uint64> DirtySlots;
+
+	TSpscRingBuffer<FArduinoOutputEvent, 256> Events;
+
+	/** Owned by the writer thread */
+	uint8 Sequence;
+	uint8 Batch[BatchBytes];
+	int32 BatchUsed;
+	uint64 BatchPostCycles[MaxBatchFrames];
+	int32 BatchFrames;
+
+	std::atomic<uint64> BytesWritten;
+	std::atomic<uint64> WriteCalls;
+	std::atomic<uint64> FramesWritten;
+	std::atomic<uint64> Coalesced;
+	std::atomic<uint64> Dropped;
+	FLatencyHistogram QueueLatency;
+};
@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Binary wire protocol for newer Arduino firmware
+*
+* Every frame is COBS-encoded and terminated by a 0x00 byte, so a receiver
+* that lost sync only has to wait for the next 0x00. Decoded layout:
+*
+*   [seq:u8] [type:u8] [payload: 0..MaxPayload bytes] [crc16:u16 little endian]
+*
+* The CRC is CRC-16/CCITT-FALSE over seq, type and payload. Multi-byte
+* payload fields are little endian.
+*/
+namespace ArduinoProtocol
+{
+	/** Largest payload in one frame */
+	static const int32 MaxPayload = 32;
+
+	/** seq + type + payload + crc */
+	static const int32 MaxDecodedFrame = 2 + MaxPayload + 2;
+
+	/** COBS adds one byte per 254 plus the leading code byte */
+	static const int32 MaxEncodedFrame = MaxDecodedFrame + 2;
+
+	/** Baud rates the host may ask binary firmware to switch to */
+	static const uint32 MinBinaryBaudRate = 115200;
+	static const uint32 MaxBinaryBaudRate = 2000000;
+
+	uint16 Crc16(const uint8* pData, int32 length, uint16 crc = 0xFFFF);
+
+	/** COBS-encode pData into pOut, without the trailing 0x00. pOut needs length + length / 254 + 1 bytes. Returns the encoded size */
+	int32 CobsEncode(const uint8* pData, int32 length, uint8* pOut);
+
+	/** COBS-decode one frame (without its 0x00) into pOut. Returns the decoded size, or -1 if the encoding is invalid */
+	int32 CobsDecode(const uint8* pData, int32 length, uint8* pOut, int32 outCapacity);
+}
+
+/** Frame types carried by the binary protocol */
+enum class EArduinoFrameType : uint8
+{
+	/** Device -> host. Payload: [opcode:u8 EArduinoOpcode] [value:i16] */
+	Gesture = 0x01,
+	/** Device -> host, sent after reset and in reply to Hello. Payload: [protocol version:u8] [firmware id:u16] */
+	Hello = 0x02,
+	/** Host -> device. Payload: [baud:u32]. The device answers BaudAck at the old rate, then both sides switch */
+	BaudRequest = 0x03,
+	/** Device -> host. Payload: [baud:u32], 0 if the rate is refused */
+	BaudAck = 0x04,
+	/** Device -> host. Payload: [first channel:u8] [sample:i16] x up to 15, one sample per channel scaled to -32767..32767.
+	 *  Boards with more channels send the rest in a second frame starting at the next channel */
+	AnalogSamples = 0x05,
+	/** Host -> device. Payload: [led:u8] [r:u8] [g:u8] [b:u8] */
+	LedColor = 0x06,
+	/** Host -> device. Payload: [motor:u8] [strength:u8] [duration ms:u16], 0 ms keeps the strength until the next Rumble */
+	Rumble = 0x07,
+};
+
+/** One decoded, CRC-checked frame */
+struct FArduinoFrame
+{
+	uint8 Sequence;
+	EArduinoFrameType Type;
+	uint8 PayloadLength;
+	uint8 Payload[ArduinoProtocol::MaxPayload];
+
+	int16 ReadInt16(int32 offset) const
+	{
+		return (int16)(Payload[offset] | (Payload[offset + 1] << 8));
+	}
+
+	uint32 ReadUInt32(int32 offset) const
+	{
+		return (uint32)Payload[offset] | ((uint32)Payload[offset + 1] << 8) | ((uint32)Payload[offset + 2] << 16) | ((uint32)Payload[offset + 3] << 24);
+	}
+};
+
+/** Frame error counters of one link */
+struct FArduinoFrameStats
+{
+	/** Frames that passed every check */
+	uint32 FramesOk = 0;
+	/** Frames whose CRC did not match */
+	uint32 CrcErrors = 0;
+	/** Frames with an invalid COBS encoding or shorter than a header and CRC */
+	uint32 FramingErrors = 0;
+	/** Frames longer than MaxEncodedFrame, dropped up to the next delimiter */
+	uint32 OversizeErrors = 0;
+	/** Frames missing according to the sequence numbers */
+	uint32 SequenceGaps = 0;
+};
+
+/** Incremental receiver for the binary protocol
+*
+* Bytes can be fed in any split. A corrupt frame costs only itself: the
+* receiver drops what it collected and starts over at the next 0x00, so
+* resynchronizing never needs to look back.
+*/
+class ARDUINOINPUTCORE_API FArduinoFrameParser
+{
+public:
+	FArduinoFrameParser();
+
+	/** Feed received bytes, decoded frames are appended to outFrames. Returns the number of frames appended */
+	int32 Parse(const char* pData, int32 length, TArray<FArduinoFrame>& outFrames);
+
+	/** Drop any partial frame and forget the last sequence number */
+	void Reset();
+
+	const FArduinoFrameStats& GetStats() const
+	{
+		return m_stats;
+	}
+
+	void ResetStats()
+	{
+		m_stats = FArduinoFrameStats();
+	}
+
+	/** Build a complete frame, delimiter included, into pOut (MaxEncodedFrame + 1 bytes). Returns the frame size, 0 if the payload is too long */
+	static int32 BuildFrame(uint8 sequence, EArduinoFrameType type, const uint8* pPayload, int32 payloadLength, uint8* pOut);
+
+private:
+	void FinishFrame(TArray<FArduinoFrame>& outFrames);
+
+	uint8 m_encoded[ArduinoProtocol::MaxEncodedFrame];
+	int32 m_encodedLength;
+
+	/** Set after an oversize frame, everything up to the next delimiter is skipped */
+	bool m_bDiscarding;
+
+	bool m_bHaveSequence;
+	uint8 m_lastSequence;
+
+	FArduinoFrameStats m_stats;
+};
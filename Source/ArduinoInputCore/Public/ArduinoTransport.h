@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FEvent;
+
+/** Where a board's bytes come from and its feedback goes: a serial port, a socket
+*
+* Only the consumer side is shared. How bytes are received (a listen
+* thread, SerialPortSet, a socket thread) stays the transport's business,
+* and so does opening it. The parsers walk received bytes in place, one
+* read block at a time, together with the time the block was read.
+*
+* A single consumer thread peeks and removes, WriteData may be called
+* from one other thread.
+*/
+class ARDUINOINPUTCORE_API IArduinoTransport
+{
+public:
+	virtual ~IArduinoTransport() {}
+
+	/** Longest run of received chars that were read in the same block as the front one, in place
+	* @param: pData set to the front char
+	* @param: readCycles FPlatformTime::Cycles64() when the block was read, 0 if unknown
+	* @return: number of chars readable at pData, 0 if nothing is queued */
+	virtual int PeekContiguousFromQueue(const char*& pData, uint64& readCycles) = 0;
+
+	/** Remove count chars from the front, returns how many were */
+	virtual int RemoveCharsFromQueue(int count) = 0;
+
+	/** Chars received and not removed yet */
+	virtual int SizeOfMessageQueue() = 0;
+
+	/** Send length bytes of pData to the board as one block. False if they could not be */
+	virtual bool WriteData(char* pData, unsigned int length) = 0;
+
+	/** True once the link is useless and has to be reopened */
+	virtual bool IsLost() const = 0;
+
+	/** Trigger pEvent every time chars were queued, so the consumer can wait for input instead of polling for it. nullptr for none
+	* Set it before the transport starts receiving, clear it once it stopped */
+	virtual void SetInputEvent(FEvent* pEvent) = 0;
+};
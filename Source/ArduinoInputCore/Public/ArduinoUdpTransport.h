@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "ArduinoTransport.h"
+#include <atomic>
+
+class FRunnableThread;
+
+/** Where FArduinoUdpTransport listens */
+struct FArduinoUdpSettings
+{
+	/** Local UDP port the board sends to, 0 for any free port (see GetBoundPort) */
+	uint16 Port = 4210;
+
+	/** Local IPv4 address to bind, empty for every interface */
+	FString BindAddress;
+
+	/** Only take datagrams from this IPv4 address, empty for any. Feedback goes to whoever sent last */
+	FString BoardAddress;
+
+	/** Drop '\n', '\r', ' ' and '\t', as SerialPort does for the ASCII gesture protocol. Off for binary frames */
+	bool bStripPadding = true;
+};
+
+/** A board on Wi-Fi, or a local stand-in: its bytes come in UDP datagrams
+*
+* A receive thread of its own blocks in poll() until datagrams arrive, then
+* takes up to BatchSize of them with one recvmmsg() call, straight into a
+* ring of preallocated slots, one datagram per slot. The slots are
+* published once per call, and the consumer parses each datagram where the
+* kernel wrote it: PeekContiguousFromQueue hands out the slot itself, so a
+* datagram is copied once, by the kernel, and never again.
+*
+* When every slot is taken the receive thread stops reading the socket:
+* the datagrams wait in the kernel buffer, sized for a whole ring, until
+* the consumer frees a slot and wakes it. Only once that buffer overflows
+* does the kernel drop datagrams, and the parser resynchronizes like after
+* a serial overflow. Where
+* recvmmsg() does not exist (Windows, Mac) datagrams are taken one
+* recvfrom() at a time, into the same slots.
+*/
+class ARDUINOINPUTCORE_API FArduinoUdpTransport : public IArduinoTransport, public FRunnable
+{
+public:
+	/** Datagrams one recvmmsg() call can take */
+	static const int32 BatchSize = 32;
+	/** Receive slots, a power of two */
+	static const int32 SlotCount = 256;
+	/** Largest datagram kept, what fits an Ethernet frame. Longer ones are dropped */
+	static const int32 SlotBytes = 1472;
+
+	FArduinoUdpTransport();
+	virtual ~FArduinoUdpTransport();
+
+	/** Bind the socket and start the receive thread. False if the address is taken or the thread could not start */
+	bool Open(const FArduinoUdpSettings& InSettings);
+
+	/** Stop the receive thread and close the socket. Queued datagrams are dropped */
+	void Close();
+
+	bool IsOpen() const { return Thread != nullptr; }
+
+	/** The port actually bound, what FArduinoUdpSettings::Port = 0 picked */
+	uint16 GetBoundPort() const { return BoundPort; }
+
+	/** True once a datagram came from the board, WriteData has nowhere to go before */
+	bool HasPeer() const { return PeerAddress.load(std::memory_order_acquire) != 0; }
+
+	/** Datagrams queued, the receive calls they took, and datagrams dropped (too long, wrong sender). What the kernel drops is not seen here */
+	uint64 GetDatagramsReceived() const { return DatagramsReceived.load(std::memory_order_relaxed); }
+	uint64 GetReceiveCalls() const { return ReceiveCalls.load(std::memory_order_relaxed); }
+	uint64 GetDatagramsDropped() const { return DatagramsDropped.load(std::memory_order_relaxed); }
+
+	// IArduinoTransport
+	virtual int PeekContiguousFromQueue(const char*& pData, uint64& readCycles) override;
+	virtual int RemoveCharsFromQueue(int count) override;
+	virtual int SizeOfMessageQueue() override;
+	virtual bool WriteData(char* pData, unsigned int length) override;
+	virtual bool IsLost() const override { return bLost.load(std::memory_order_acquire); }
+	virtual void SetInputEvent(FEvent* pEvent) override { InputEvent.store(pEvent, std::memory_order_release); }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	/** One datagram, written by the receive thread, then read in place by the consumer */
+	struct FSlot
+	{
+		/** FPlatformTime::Cycles64() right after the receive call returned */
+		uint64 ReadCycles;
+		/** Bytes kept, 0 for a datagram that was dropped or all padding */
+		int32 Length;
+		char Data[SlotBytes];
+	};
+
+	/** Receive what the socket holds into free slots and publish them, as many calls as it takes. False once the socket failed */
+	bool ReceiveBatch();
+	void WakeReceiveThread();
+	void CloseSocket();
+
+	FArduinoUdpSettings Settings;
+	/** Host order, 0 for any board */
+	uint32 BoardAddress;
+	uint16 BoundPort;
+
+	/** SlotCount slots */
+	TArray<FSlot> Slots;
+	/** Slots ever published (receive thread) and freed (consumer), wrapping */
+	std::atomic<uint32> ProducedSlots;
+	std::atomic<uint32> ConsumedSlots;
+	/** Bytes ever published and removed, for SizeOfMessageQueue */
+	std::atomic<uint32> ProducedBytes;
+	std::atomic<uint32> ConsumedBytes;
+	/** Consumer only: chars of the front slot already removed */
+	int32 FrontOffset;
+
+	/** Who sent last: IPv4 address in the high 32 bits, port in the low 16, both host order. 0 until the first datagram */
+	std::atomic<uint64> PeerAddress;
+
+	FRunnableThread* Thread;
+	std::atomic<bool> bExit;
+	std::atomic<bool> bLost;
+	/** Set by the receive thread on a full ring, cleared by the consumer once it freed a slot */
+	std::atomic<bool> bWaitingForSlot;
+	/** See SetInputEvent, triggered after every batch that queued chars */
+	std::atomic<FEvent*> InputEvent;
+
+	std::atomic<uint64> DatagramsReceived;
+	std::atomic<uint64> ReceiveCalls;
+	std::atomic<uint64> DatagramsDropped;
+
+#if PLATFORM_WINDOWS
+	/** A SOCKET, kept as an integer so this header needs no winsock */
+	UPTRINT Socket;
+#else
+	int Socket;
+	/** Self-pipe that wakes the receive thread out of poll() on Close */
+	int WakePipe[2];
+#endif
+};
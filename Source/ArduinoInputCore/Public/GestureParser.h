@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ArduinoCommand.h"
+
+/** Incremental parser for the Arduino gesture stream
+*
+* A three-state machine (idle, left foot seen, right foot seen) driven by a
+* transition table that is generated at compile time. Parse consumes every
+* byte it is given and keeps a lone trailing 'L'/'R' as state for the next
+* call, so a gesture split across two reads is still recognized.
+*/
+class ARDUINOINPUTCORE_API GestureParser
+{
+public:
+	GestureParser();
+
+	/** Feed received chars to the state machine
+	*
+	*
+	* @param: const char * pData chars taken from SerialPort's queue
+	* @param: int32 length number of chars in pData
+	* @param: TArray<EArduinoOpcode> & outGestures recognized gestures are appended, in stream order
+	* @return: int32 number of gestures appended
+	* @note: all chars are consumed, there is never anything to put back
+	* @see:
+	*/
+	int32 Parse(const char* pData, int32 length, TArray<EArduinoOpcode>& outGestures);
+
+	/** Forget a half-seen gesture, e.g. after the port was reopened */
+	void Reset();
+
+private:
+	uint8 m_state;
+};
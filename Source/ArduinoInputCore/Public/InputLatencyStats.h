@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/** Lock-free latency histogram
+*
+* Log-linear buckets (8 per power of two, so within 12.5%) over
+* microseconds, from 1 us to about 4 hours. Record is a few relaxed atomic
+* adds, so any thread can record while another one reads percentiles; a
+* reading taken during recording can miss the samples in flight, nothing
+* worse.
+*/
+class ARDUINOINPUTCORE_API FLatencyHistogram
+{
+public:
+	FLatencyHistogram();
+
+	void Record(uint64 Microseconds);
+	void Reset();
+
+	uint64 GetCount() const;
+	uint64 GetMax() const;
+	double GetMean() const;
+
+	/** Upper bound of the bucket holding the given percentile (0-100), in microseconds. 0 when empty */
+	uint64 GetPercentile(double Percentile) const;
+
+	/** Samples in bucket Index, which holds values up to GetBucketUpperBound(Index) microseconds */
+	uint64 GetBucketCount(int32 Index) const;
+	static uint64 GetBucketUpperBound(int32 Index) { return BucketUpperBound(Index); }
+	static int32 GetNumBuckets() { return BucketCount; }
+
+private:
+	static const int32 SubBucketBits = 3;
+	static const int32 SubBucketCount = 1 << SubBucketBits;
+	static const int32 BucketCount = 32 * SubBucketCount;
+
+	static int32 BucketIndex(uint64 Microseconds);
+	static uint64 BucketUpperBound(int32 Index);
+
+	std::atomic<uint64> Buckets[BucketCount];
+	std::atomic<uint64> Count;
+	std::atomic<uint64> Sum;
+	std::atomic<uint64> Max;
+};
+
+/** Stages of the Arduino input path, from serial read to character action */
+enum class EInputLatencyStage : uint8
+{
+	/** Bytes read by the I/O thread -> gesture recognized by AnalyzeInput */
+	ReadToParse,
+	/** Gesture recognized -> command dequeued by the character */
+	ParseToDequeue,
+	/** Command dequeued -> Jump()/run applied */
+	DequeueToAction,
+	/** Whole path, bytes read -> action */
+	ReadToAction,
+	/** Bytes read on a client -> command broadcast by the server, the network part estimated as half the ping */
+	ReadToServer,
+	Count,
+};
+
+/** Process-wide latency histograms for the Arduino input path
+*
+* Console commands:
+*   Arduino.Latency.Dump             log count/p50/p99/max per stage
+*   Arduino.Latency.Reset            clear all histograms
+*   Arduino.Latency.WriteCSV [file]  write per-stage summary, then the non-empty buckets, default Saved/Profiling/ArduinoLatency.csv
+*/
+class ARDUINOINPUTCORE_API FInputLatencyStats
+{
+public:
+	static FInputLatencyStats& Get();
+
+	/** Record the time between two FPlatformTime::Cycles64() stamps. Ignored if From is 0 (unknown) */
+	void RecordCycles(EInputLatencyStage Stage, uint64 FromCycles, uint64 ToCycles);
+
+	const FLatencyHistogram& GetHistogram(EInputLatencyStage Stage) const;
+
+	void Dump() const;
+	void Reset();
+	bool WriteCSV(const FString& Filename) const;
+
+	static const TCHAR* GetStageName(EInputLatencyStage Stage);
+
+private:
+	FLatencyHistogram Histograms[(int32)EInputLatencyStage::Count];
+};
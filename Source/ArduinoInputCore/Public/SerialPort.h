@@ -0,0 +1,476 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#if PLATFORM_WINDOWS
+#include "Windows/MinWindows.h"
+#else
+#include <pthread.h>
+#endif
+#include "ArduinoTransport.h"
+#include "SpscRingBuffer.h"
+#include <atomic>
+
+#if !PLATFORM_WINDOWS
+/** Win32 serial constants used as default arguments, mirrored for the POSIX backend */
+#ifndef CBR_9600
+#define CBR_9600 9600
+#endif
+#ifndef EV_RXCHAR
+#define EV_RXCHAR 0x0001
+#endif
+#endif
+
+/** 串口通信类
+*
+* 本类实现了对串口的基本操作
+* 例如监听发到指定串口的数据、发送指定数据到串口
+*
+* On Windows the port is a COMn handle. On Linux/Mac the port is a /dev/tty*
+* node configured through termios, and the listen thread blocks in poll()
+* until bytes arrive instead of sleeping between queries.
+*
+* The listen thread is an FRunnableThread. CloseListenTread wakes it at
+* once (wakeup pipe, or an FEvent on Windows) and joins it, so closing is
+* fast and the thread never outlives the port.
+*/
+
+class SerialPortSet;
+class FSerialSessionRecorder;
+class FSerialPortListener;
+class FRunnableThread;
+class FEvent;
+
+/** Read time of one block of queued chars, see PeekContiguousFromQueue */
+struct FSerialBatchStamp
+{
+    /** FPlatformTime::Cycles64() right after the block was read */
+    uint64 ReadCycles;
+    /** Stream position just past the block's last queued char */
+    uint32 StreamEnd;
+};
+
+/**
+ * Every SerialPort owns its handle, queue and exit flag, so several boards
+ * can be open at once. A port is serviced either by its own listen thread
+ * (OpenListenThread) or by a shared SerialPortSet I/O thread, never both.
+ * Its queue is what UArduinoDevice reads through IArduinoTransport.
+ */
+class ARDUINOINPUTCORE_API SerialPort : public IArduinoTransport
+{
+    friend class SerialPortSet;
+    friend class FSerialPortListener;
+
+public:
+    SerialPort();
+    ~SerialPort();
+
+public:
+
+    /** 初始化串口函数
+    *
+    * @param: uint32 portNo 串口编号,默认值为1,即COM1,注意,尽量不要大于9 (POSIX: /dev/ttyACM<portNo>)
+    * @param: uint32 baud 波特率,默认为9600
+    * @param: char parity 是否进行奇偶校验,'Y'表示需要奇偶校验,'N'表示不需要奇偶校验
+    * @param: uint32 databits 数据位的个数,默认值为8个数据位
+    * @param: uint32 stopsbits 停止位使用格式,默认值为1
+    * @param: uint32 dwCommEvents 默认为EV_RXCHAR,即只要收发任意一个字符,则产生一个事件
+    * @return: bool 初始化是否成功
+    * @note: 在使用其他本类提供的函数前,请先调用本函数进行串口的初始化
+    *　　　　　 /n本函数提供了一些常用的串口参数设置,若需要自行设置详细的DCB参数,可使用重载函数
+    * /n本串口类析构时会自动关闭串口,无需额外执行关闭串口
+    * @see:
+    */
+    bool InitPort(uint32 portNo = 1, uint32 baud = CBR_9600, char parity = 'N', uint32 databits = 8, uint32 stopsbits = 1, uint32 dwCommEvents = EV_RXCHAR);
+
+    /** Initialize a serial port by device name
+    *
+    * Same as above, but opens the given device directly instead of numbering it
+    * @param: const char * szPort device name, e.g. "COM12" or "/dev/ttyUSB0" (a pty slave works too)
+    * @return: bool 初始化是否成功
+    * @note: useful for boards that do not enumerate as COMn / ttyACMn, and for driving the class from a pty pair
+    * @see:
+    */
+    bool InitPort(const char* szPort, uint32 baud = CBR_9600, char parity = 'N', uint32 databits = 8, uint32 stopsbits = 1, uint32 dwCommEvents = EV_RXCHAR);
+
+    /** Change the baud rate of the opened port
+    *
+    * Keeps parity, data bits and stop bits from InitPort
+    * @param: uint32 baud 新的波特率
+    * @return: bool 配置是否成功
+    * @note: pending input is discarded, like after InitPort
+    * @see:
+    */
+    bool SetBaudRate(uint32 baud);
+
+    /** Choose whether the listen thread drops '\n', '\r', ' ' and '\t'
+    *
+    * On by default for the ASCII gesture protocol. Turn it off for binary
+    * protocols, where those values are ordinary data
+    * @param: bool bStrip
+    * @return: void
+    * @note: call before the port is serviced by a listen thread or SerialPortSet
+    * @see: SerialPortFilter
+    */
+    void SetStripPadding(bool bStrip);
+
+    /** Copy every raw block read from the port to a session recorder
+    *
+    * Blocks are handed over before padding is stripped, so a replay goes
+    * through exactly the same filtering as the live session did
+    * @param: FSerialSessionRecorder * pRecorder nullptr to stop recording
+    * @return: void
+    * @note: the recorder must outlive the port's reads, clear it before closing the recorder
+    * @see: FSerialSessionRecorder
+    */
+    void SetRecorder(FSerialSessionRecorder* pRecorder);
+
+    /** Trigger an event after every block queued by DrainInput or InjectInput
+    *
+    *
+    * @param: FEvent * pEvent nullptr to stop
+    * @return: void
+    * @note: the event must outlive the port's reads, clear it before returning it
+    * @see: IArduinoTransport::SetInputEvent
+    */
+    virtual void SetInputEvent(FEvent* pEvent) override;
+
+    /** Queue chars as if they had just been read from the port
+    *
+    * Used by FSerialSessionReplay to drive the port without hardware. The
+    * chars go through the same filtering and stamping as DrainInput
+    * @param: const char * pData chars to queue
+    * @param: uint32 length number of chars
+    * @param: uint64 readCycles time stamp handed to PeekContiguousFromQueue
+    * @return: uint32 number of chars consumed from pData, less than length when the queue is full
+    * @note: the caller becomes the queue's producer, never call it while a listen thread or SerialPortSet services the port
+    * @see: FSerialSessionReplay
+    */
+    uint32 InjectInput(const char* pData, uint32 length, uint64 readCycles);
+
+#if PLATFORM_WINDOWS
+    /** 串口初始化函数
+    *
+    * 本函数提供直接根据DCB参数设置串口参数
+    * @param: UINT portNo
+    * @param: const LPDCB & plDCB
+    * @return: bool 初始化是否成功
+    * @note: 本函数提供用户自定义地串口初始化参数
+    * @see:
+    */
+    bool InitPort(UINT portNo, const LPDCB& plDCB);
+#endif
+
+    /** 关闭串口
+    *
+    *
+    * @return: void 操作是否成功
+    * @note: stop the listen thread or remove the port from its SerialPortSet first
+    * @see: FSerialPortConnector
+    */
+    void ClosePort();
+
+    /** Whether a port is currently open */
+    bool IsOpen() const;
+
+    /** Whether the reading side saw the device go away (hang-up or read error) since the last InitPort
+    *
+    *
+    * @return: bool true once the port is useless and should be closed and reopened
+    * @note: set by the listen thread or SerialPortSet, readable from any thread
+    * @see: FSerialPortConnector
+    */
+    virtual bool IsLost() const override;
+
+    /** 把串口的编号转换为设备名, COM<n> on Windows and /dev/ttyACM<n> elsewhere
+    *
+    *
+    * @param: uint32 portNo 串口设备号
+    * @param: char * szPort receives the device name
+    * @param: uint32 size size of szPort
+    * @return: void
+    * @note:
+    * @see:
+    */
+    static void FormatPortName(uint32 portNo, char* szPort, uint32 size);
+
+    /** 开启监听线程
+    *
+    * 本监听线程完成对串口数据的监听,并将接收到的数据打印到屏幕输出
+    * @return: bool 操作是否成功
+    * @note: 当线程已经处于开启状态时,返回flase
+    * @see:
+    */
+    bool OpenListenThread();
+
+    /** 关闭监听线程
+    *
+    * Wakes the thread and waits until it exited, no fixed sleep
+    * @return: bool 操作是否成功
+    * @note: 调用本函数后,监听串口的线程将会被关闭, and no longer touches this port
+    * @see:
+    */
+    bool CloseListenTread();
+
+    /** 向串口写数据
+    *
+    * 将缓冲区中的数据写入到串口
+    * @param: unsigned char * pData 指向需要写入串口的数据缓冲区
+    * @param: unsigned int length 需要写入的数据长度
+    * @return: bool 操作是否成功
+    * @note: length不要大于pData所指向缓冲区的大小
+    *        takes a write lock of its own, a writer thread never contends with the listen thread. See FArduinoOutputQueue
+    * @see:
+    */
+    virtual bool WriteData(char* pData, unsigned int length) override;
+
+    /** 获取串口缓冲区中的字节数
+    *
+    *
+    * @return: uint32 操作是否成功
+    * @note: 当串口缓冲区中无数据时,返回0
+    * @see:
+    */
+    uint32 GetBytesInCOM();
+
+    /** 读取串口接收缓冲区中一个字节的数据
+    *
+    *
+    * @param: char & cRecved 存放读取数据的字符变量
+    * @return: bool 读取是否成功
+    * @note:
+    * @see:
+    */
+    bool ReadChar(char& cRecved);
+
+    /** 读取串口接收缓冲区中的一块数据
+    *
+    * One ReadFile/read() call and one lock for the whole block instead of one per byte
+    * @param: char * pData 存放读取数据的缓冲区
+    * @param: uint32 length 最多读取的字节数, normally what GetBytesInCOM reported
+    * @param: uint32 & bytesRead 实际读取的字节数
+    * @return: bool 读取是否成功
+    * @note:
+    * @see: ReadChar
+    */
+    bool ReadBlock(char* pData, uint32 length, uint32& bytesRead);
+
+    /** Peek the front char from the queue
+    *
+    *
+    * @param: char & cReturn store the front char
+    * @return: bool whether there are more inputs
+    * @note:
+    * @see:
+    */
+    bool ReturnNextCharFromQueue(char& cReturn);
+
+	/** Remove the front char from the queue
+	*
+	*
+	* @param: void
+	* @return: bool whether there are more inputs
+	* @note:
+	* @see:
+	*/
+	bool RemoveNextCharFromQueue();
+
+	/** Get the size of message queue
+	*
+	*
+	* @param: void
+	* @return: int the size of messageQueue
+	* @note:
+	* @see:
+	*/
+	virtual int SizeOfMessageQueue() override;
+
+	/** Get the longest contiguous run of queued chars
+	*
+	* Lets the consumer walk the queue in place, with no copy and no lock
+	* @param: const char *& pData set to the front char
+	* @return: int number of chars readable at pData, 0 if the queue is empty
+	* @note: the queue may hold more chars after the wrap point, call again after RemoveCharsFromQueue
+	* @see: RemoveCharsFromQueue
+	*/
+	int PeekContiguousFromQueue(const char*& pData);
+
+	/** Get the queued chars that were read in the same block as the front char
+	*
+	* Same as above, but the run is cut at the end of the block the front
+	* char came in, and that block's read time is returned with it
+	* @param: const char *& pData set to the front char
+	* @param: uint64 & readCycles FPlatformTime::Cycles64() when the block was read, 0 if unknown
+	* @return: int number of chars readable at pData, 0 if the queue is empty
+	* @note:
+	* @see: RemoveCharsFromQueue
+	*/
+	virtual int PeekContiguousFromQueue(const char*& pData, uint64& readCycles) override;
+
+	/** Remove several chars from the front of the queue
+	*
+	*
+	* @param: int count number of chars to remove
+	* @return: int number of chars actually removed
+	* @note:
+	* @see: PeekContiguousFromQueue
+	*/
+	virtual int RemoveCharsFromQueue(int count) override;
+
+private:
+
+    /** 打开串口
+    *
+    *
+    * @param: uint32 portNo 串口设备号
+    * @return: bool 打开是否成功
+    * @note:
+    * @see:
+    */
+    bool openPort(uint32 portNo);
+
+    /** 打开串口
+    *
+    *
+    * @param: const char * szPort 串口设备名
+    * @return: bool 打开是否成功
+    * @note:
+    * @see:
+    */
+    bool openPort(const char* szPort);
+
+    /** Apply baud/parity/databits/stopbits to the opened port
+    *
+    *
+    * @return: bool 配置是否成功
+    * @note: called by both InitPort overloads once openPort succeeded
+    * @see:
+    */
+    bool configurePort(uint32 baud, char parity, uint32 databits, uint32 stopsbits);
+
+    /** Read everything the port reported and queue it
+    *
+    * Reads in RX_BUFFER_SIZE blocks into m_rxBuffer, strips padding characters
+    * with SerialPortFilter and pushes the rest to message_cache
+    * @param: uint32 BytesInQue 输入缓冲区中的字节数
+    * @return: void
+    * @note: only called from the listen thread
+    * @see:
+    */
+    void DrainInput(uint32 BytesInQue);
+
+    /** Filter, stamp and queue the first BytesRead chars of m_rxBuffer
+    *
+    *
+    * @param: uint32 BytesRead chars in m_rxBuffer
+    * @param: uint64 ReadCycles when they were read
+    * @return: void
+    * @note: producer side only, shared by DrainInput and InjectInput
+    * @see:
+    */
+    void QueueReceived(uint32 BytesRead, uint64 ReadCycles);
+
+    /** 串口监听线程
+    *
+    * 监听来自串口的数据和信息, until m_bExit is set
+    * @return: void
+    * @note: the POSIX version blocks in poll() on the port and a wakeup pipe, so it costs no CPU while idle.
+    *        The Windows version polls the port and waits on m_pWakeEvent in between
+    * @see: FSerialPortListener
+    */
+    void ListenLoop();
+
+    /** Create and destroy what WakeListenThread signals
+    *
+    *
+    * @return: bool 操作是否成功
+    * @note: only called by OpenListenThread and CloseListenTread
+    * @see:
+    */
+    bool OpenListenWakeup();
+    void CloseListenWakeup();
+
+    /** Make ListenLoop check m_bExit right away
+    *
+    *
+    * @return: void
+    * @note: called from FSerialPortListener::Stop, on the closing thread
+    * @see:
+    */
+    void WakeListenThread();
+
+private:
+
+    /** 线程退出标志变量 */
+    std::atomic<bool> m_bExit;
+
+    /** The set servicing this port, nullptr when it is not in one */
+    SerialPortSet* m_pOwnerSet;
+
+    /** 监听线程, nullptr when not listening */
+    FRunnableThread* m_pListenThread;
+    FSerialPortListener* m_pListener;
+
+#if PLATFORM_WINDOWS
+    /** 串口句柄 */
+    HANDLE m_hComm;
+
+    /** Triggered to cut the wait between two port queries short */
+    FEvent* m_pWakeEvent;
+
+    /** 同步互斥,临界区保护 */
+    CRITICAL_SECTION m_csCommunicationSync; //!< 互斥操作串口
+
+    /** Serializes WriteData only, so writers never wait for the reader */
+    CRITICAL_SECTION m_csWriteSync;
+#else
+    /** 串口文件描述符, -1 when closed */
+    int m_fdComm;
+
+    /** Self-pipe used to wake the listen thread out of poll() on close */
+    int m_wakePipe[2];
+
+    /** 同步互斥 */
+    pthread_mutex_t m_csCommunicationSync; //!< 互斥操作串口
+
+    /** Serializes WriteData only, so writers never wait for the reader */
+    pthread_mutex_t m_csWriteSync;
+#endif
+
+    /** Line settings from the last InitPort, reused by SetBaudRate */
+    char m_parity;
+    uint32 m_databits;
+    uint32 m_stopsbits;
+
+    /** See SetStripPadding */
+    bool m_bStripPadding;
+
+    /** Size of the reusable block read buffer */
+    static const uint32 RX_BUFFER_SIZE = 4096;
+
+    /** Block read buffer, reused by every DrainInput call so reads never allocate */
+    char m_rxBuffer[RX_BUFFER_SIZE];
+
+    /** Capacity of message_cache, in chars */
+    static const uint32 MESSAGE_CACHE_SIZE = 1 << 14;
+
+    /** 保存串口消息, filled by the I/O thread and drained by the game thread */
+    TSpscRingBuffer<char, MESSAGE_CACHE_SIZE> message_cache;
+
+    /** One stamp per block pushed to message_cache, published before the block's chars */
+    TSpscRingBuffer<FSerialBatchStamp, 1024> batch_stamps;
+
+    /** Chars ever pushed (I/O thread) and removed (consumer), wrapping */
+    uint32 m_producedPos;
+    uint32 m_consumedPos;
+
+    /** See SetRecorder, read by the I/O thread on every block */
+    std::atomic<FSerialSessionRecorder*> m_pRecorder;
+
+    /** See IsLost */
+    std::atomic<bool> m_bLost;
+
+    /** See SetInputEvent, triggered by the I/O thread on every block */
+    std::atomic<FEvent*> m_pInputEvent;
+};
@@ -0,0 +1,95 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "Templates/Function.h"
+#include <atomic>
+
+class SerialPort;
+class FRunnableThread;
+class FEvent;
+
+/** Where and how FSerialPortConnector opens its port */
+struct FSerialPortConnectSettings
+{
+	/** Device to open, e.g. "/dev/ttyUSB0". Empty to use PortNumber */
+	FString DeviceName;
+	uint32 PortNumber = 1;
+	uint32 BaudRate = 9600;
+
+	/** First retry delay after a failed open, doubled on every failure up to MaxRetrySeconds */
+	float InitialRetrySeconds = 0.1f;
+	float MaxRetrySeconds = 5.0f;
+};
+
+/** Opens a serial port in the background and reopens it when it comes back
+*
+* A connector thread retries InitPort with exponential backoff, so nothing
+* on the game thread ever waits for a board. Once the port is open it
+* watches for the board going away (SerialPort::IsLost) and starts over.
+* On Linux it also watches the device's directory with inotify, so a board
+* plugged in or removed is noticed at once instead of at the next retry.
+*
+* The callbacks run on the connector thread: OnOpened prepares the open
+* port and starts whatever reads it, OnLost stops that reading again.
+*/
+class ARDUINOINPUTCORE_API FSerialPortConnector : public FRunnable
+{
+public:
+	/** Return false to close the port and retry later, e.g. when a handshake failed */
+	typedef TFunction<bool(SerialPort&)> FOnOpened;
+	typedef TFunction<void(SerialPort&)> FOnLost;
+
+	FSerialPortConnector();
+	virtual ~FSerialPortConnector();
+
+	/** Start connecting Port in the background. Returns at once */
+	bool Start(SerialPort& InPort, const FSerialPortConnectSettings& InSettings, FOnOpened InOnOpened, FOnLost InOnLost);
+
+	/** Stop the connector thread. If the port is connected, OnLost runs (on the calling thread) and the port is closed */
+	void Close();
+
+	bool IsConnected() const { return bConnected.load(std::memory_order_acquire); }
+
+	/** Successful opens so far, reconnects included */
+	uint32 GetConnectCount() const { return ConnectCount.load(std::memory_order_relaxed); }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	bool TryOpen();
+	void Disconnect();
+
+	/** Sleep up to Seconds, or less if stopped or the device node changed. Returns true when the device was removed */
+	bool WaitForDeviceChange(float Seconds);
+
+	/** How often a connected port is checked for IsLost when no device event comes */
+	static constexpr float LostCheckSeconds = 0.25f;
+
+	SerialPort* Port;
+	FSerialPortConnectSettings Settings;
+	/** DeviceName, or the name PortNumber maps to */
+	char DevicePath[256];
+
+	FOnOpened OnOpened;
+	FOnLost OnLost;
+
+	FRunnableThread* Thread;
+	std::atomic<bool> bStopping;
+	std::atomic<bool> bConnected;
+	std::atomic<uint32> ConnectCount;
+
+#if PLATFORM_LINUX
+	/** inotify on the device's directory, and a pipe to wake the poll() on Stop */
+	int InotifyFd;
+	int WakePipe[2];
+	/** Device file name within its directory, what inotify events carry */
+	const char* DeviceFileName;
+#else
+	FEvent* WakeEvent;
+#endif
+};
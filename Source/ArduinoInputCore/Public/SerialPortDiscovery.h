@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Function.h"
+#include "Templates/UniquePtr.h"
+#include <atomic>
+
+/** How FSerialPortDiscovery probes a port */
+struct FSerialProbeSettings
+{
+	/** Tried in order, the first rate that gets an answer wins */
+	TArray<uint32> BaudRates = { 9600, 115200 };
+
+	/** How long to wait at each rate for a Hello reply or gesture traffic */
+	float ProbeSeconds = 0.3f;
+
+	/** Gesture letters (L, R, J) in a row, padding aside, that make old firmware, which has no handshake */
+	int32 MinGestureChars = 4;
+};
+
+/** How a probed port turned out to be our firmware */
+enum class ESerialProbeMatch : uint8
+{
+	None,
+	/** Answered a Hello frame: binary-capable firmware */
+	Hello,
+	/** Sent only gesture letters: old ASCII firmware */
+	GestureTraffic,
+};
+
+/** What probing one port found */
+struct FSerialProbeResult
+{
+	FString DeviceName;
+	ESerialProbeMatch Match = ESerialProbeMatch::None;
+	/** The rate that got the answer, 0 if none did */
+	uint32 BaudRate = 0;
+	/** From the Hello reply, 0 for old firmware */
+	uint8 ProtocolVersion = 0;
+	uint16 FirmwareId = 0;
+	/** Time the probe took, opening included */
+	double Seconds = 0.0;
+};
+
+/** Finds our boards among all serial ports, whatever order USB enumerated them in
+*
+* Every candidate port is probed at once on a thread of its own, so the
+* whole discovery takes as long as the slowest probe, not the sum of them.
+* A probe opens the port and, for each baud rate in turn, sends a Hello
+* frame and listens: binary firmware answers Hello, old firmware is told by
+* its traffic being gesture letters only. A port that is busy, silent or
+* talking anything else is skipped.
+*
+* Probing writes one Hello frame to every candidate, harmless to old
+* firmware, which ignores bytes it does not understand. An idle board on
+* old firmware sends nothing and is only found once a player moves.
+*/
+class ARDUINOINPUTCORE_API FSerialPortDiscovery
+{
+public:
+	/** Runs on the probe thread that finished last, the results are ready. Must not destroy the discovery */
+	typedef TFunction<void()> FOnFinished;
+
+	FSerialPortDiscovery();
+	/** Waits for the probes still running */
+	~FSerialPortDiscovery();
+
+	/** Start probing DeviceNames, one thread each. Returns at once, false if already started */
+	bool Start(const TArray<FString>& DeviceNames, const FSerialProbeSettings& InSettings, FOnFinished InOnFinished = FOnFinished());
+
+	/** Wait for every probe, then return the boards found, sorted by device name */
+	const TArray<FSerialProbeResult>& Wait();
+
+	bool IsFinished() const { return bFinished.load(std::memory_order_acquire); }
+
+	/** Every probe, boards or not, in DeviceNames order. Valid once IsFinished */
+	const TArray<FSerialProbeResult>& GetProbes() const { return Probes; }
+
+	/** /dev/ttyACM* and /dev/ttyUSB* on Linux, COM1 to COM32 on Windows, sorted */
+	static TArray<FString> ListCandidatePorts();
+
+	/** Probe one port on the calling thread */
+	static FSerialProbeResult ProbePort(const FString& DeviceName, const FSerialProbeSettings& Settings);
+
+private:
+	class FProbeRunnable;
+
+	/** Called once per finished probe, the last call collects Boards and runs OnFinished */
+	void FinishProbe();
+
+	/** Probe threads, each writing its entry of Probes */
+	TArray<TUniquePtr<FProbeRunnable>> Runnables;
+	TArray<FSerialProbeResult> Probes;
+	TArray<FSerialProbeResult> Boards;
+	FOnFinished OnFinished;
+	std::atomic<int32> ProbesLeft;
+	std::atomic<bool> bFinished;
+};
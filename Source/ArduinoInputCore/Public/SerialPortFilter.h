@@ -0,0 +1,42 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/** Filtering of raw bytes read from the serial port
+*
+* The Arduino firmware pads its gesture letters with '\n', '\r', ' ' and '\t',
+* none of which mean anything to the parser. These helpers remove them from a
+* buffer in place so the listen thread can queue a whole read at once.
+*/
+namespace SerialPortFilter
+{
+    /** Remove ignored characters from a buffer in place
+    *
+    * Uses SSE2 or NEON when available, 16 bytes per step
+    * @param: char * pData buffer to compact
+    * @param: int32 length number of valid bytes in pData
+    * @return: int32 number of bytes kept, they are packed at the front of pData in their original order
+    * @note:
+    * @see: StripIgnoredCharsScalar
+    */
+    ARDUINOINPUTCORE_API int32 StripIgnoredChars(char* pData, int32 length);
+
+    /** Byte-at-a-time reference version of StripIgnoredChars
+    *
+    *
+    * @param: char * pData buffer to compact
+    * @param: int32 length number of valid bytes in pData
+    * @return: int32 number of bytes kept
+    * @note: also used for the tail that does not fill a whole vector
+    * @see: StripIgnoredChars
+    */
+    ARDUINOINPUTCORE_API int32 StripIgnoredCharsScalar(char* pData, int32 length);
+
+    /** Whether a received byte is padding rather than input */
+    FORCEINLINE bool IsIgnoredChar(char c)
+    {
+        return c == '\n' || c == '\r' || c == ' ' || c == '\t';
+    }
+}
@@ -0,0 +1,95 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "SerialPort.h"
+#include <atomic>
+
+class FSerialPortSetWorker;
+class FRunnableThread;
+class FEvent;
+
+/** Services several serial ports from one I/O thread
+*
+* Instead of one listen thread per board, every port added here is read by
+* a single thread. On POSIX that thread blocks in one poll() over all port
+* descriptors, so its cost grows with the bytes received and not with the
+* number of boards. On Windows it checks every port and then waits up to
+* SERIALPORTSET_POLL_INTERVAL on a wakeup event.
+*
+* The thread is an FRunnableThread, started by the first AddPort and
+* stopped by the last RemovePort: Kill wakes it at once and joins it.
+*/
+class ARDUINOINPUTCORE_API SerialPortSet
+{
+    friend class FSerialPortSetWorker;
+
+public:
+    SerialPortSet();
+    ~SerialPortSet();
+
+    /** The process-wide set used by UArduinoInput */
+    static SerialPortSet& Get();
+
+    /** Start servicing an opened port
+    *
+    *
+    * @param: SerialPort * pPort port already set up with InitPort
+    * @return: bool false if the port already has its own listen thread or belongs to a set
+    * @note: the port must be removed (or destroyed) before its memory goes away
+    * @see: RemovePort
+    */
+    bool AddPort(SerialPort* pPort);
+
+    /** Stop servicing a port
+    *
+    *
+    * @param: SerialPort * pPort port previously added
+    * @return: bool false if the port was not in this set
+    * @note: once this returns the I/O thread no longer touches pPort
+    * @see: AddPort
+    */
+    bool RemovePort(SerialPort* pPort);
+
+    /** Number of ports currently serviced */
+    int32 NumPorts();
+
+private:
+
+    bool StartIOThread();
+    void StopIOThread();
+
+    /** Create and destroy what WakeIOThread signals: a pipe on POSIX, a pooled FEvent on Windows */
+    bool OpenIOWakeup();
+    void CloseIOWakeup();
+    void WakeIOThread();
+    /** The I/O thread's loop, returns once m_bExit is set */
+    void ServicePorts();
+
+private:
+
+    /** Serializes AddPort/RemovePort, including thread start and stop */
+    FCriticalSection m_csMembership;
+
+    /** Guards m_ports and m_generation against the I/O thread */
+    FCriticalSection m_csPorts;
+
+    TArray<SerialPort*> m_ports;
+
+    /** Bumped on every membership change so the I/O thread rebuilds its wait list */
+    uint32 m_generation;
+
+    std::atomic<bool> m_bExit;
+
+    /** Both null while no port is serviced */
+    FRunnableThread* m_pIOThread;
+    FSerialPortSetWorker* m_pWorker;
+
+#if PLATFORM_WINDOWS
+    FEvent* m_pWakeEvent;
+#else
+    int m_wakePipe[2];
+#endif
+};
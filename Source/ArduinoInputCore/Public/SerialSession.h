@@ -0,0 +1,153 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "SpscRingBuffer.h"
+#include <atomic>
+
+class SerialPort;
+class FRunnableThread;
+class FEvent;
+class IFileHandle;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/** Recorded serial session file
+*
+* A 16 byte header followed by one record per block read from the port:
+*
+*   header: [magic:8 "TCSERREC"] [version:u32] [flags:u32]
+*   record: [delta us since previous record:u32] [length:u16] [raw bytes: length]
+*
+* All fields are little endian. Bytes are stored as read, before padding is
+* stripped, so replaying them through SerialPort::InjectInput reproduces the
+* live session's queue exactly.
+*/
+namespace SerialSession
+{
+	static const uint32 Version = 1;
+
+	/** Header flag: the session ran the binary protocol (COBS frames), not legacy ASCII */
+	static const uint32 FlagBinaryProtocol = 1 << 0;
+
+	static const int32 HeaderSize = 16;
+	static const int32 RecordHeaderSize = 6;
+
+	/** Relative names are resolved under Saved/Arduino */
+	FString ResolvePath(const FString& Filename);
+}
+
+/** Writes everything a SerialPort reads to a session file
+*
+* Append runs on the port's I/O thread and only copies into a lock-free
+* ring; a writer thread of its own moves the ring to disk, so recording
+* never adds file I/O to the read path. When the writer falls behind the
+* block is dropped and counted instead of stalling the reader.
+*/
+class ARDUINOINPUTCORE_API FSerialSessionRecorder : public FRunnable
+{
+public:
+	FSerialSessionRecorder();
+	virtual ~FSerialSessionRecorder();
+
+	/** Create the file, write the header and start the writer thread */
+	bool Open(const FString& Filename, uint32 Flags);
+
+	/** Flush what is pending, stop the writer thread and close the file. Clear the port's recorder first */
+	void Close();
+
+	bool IsOpen() const { return Thread != nullptr; }
+
+	/** I/O thread: record one raw block. Never blocks */
+	void Append(uint64 ReadCycles, const char* pData, uint32 Length);
+
+	/** Bytes lost because the writer could not keep up */
+	uint64 GetDroppedBytes() const { return DroppedBytes.load(std::memory_order_relaxed); }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	/** Write the ring's content to the file, returns false on a write error */
+	bool WritePending();
+
+	/** How often the writer wakes up to flush the ring */
+	static const uint32 WriteIntervalMs = 20;
+
+	/** Append -> writer hand-off, 1 MB holds seconds of input even at 2 Mbaud */
+	TSpscRingBuffer<uint8, 1 << 20> Pending;
+
+	IFileHandle* File;
+	FRunnableThread* Thread;
+	FEvent* WakeEvent;
+	std::atomic<bool> bStopping;
+
+	/** Owned by the I/O thread once recording started */
+	uint64 StartCycles;
+	uint64 LastMicros;
+
+	std::atomic<uint64> DroppedBytes;
+};
+
+/** How fast FSerialSessionReplay feeds the recorded blocks */
+enum class ESerialReplaySpeed : uint8
+{
+	/** Keep the recorded gaps between blocks */
+	OriginalTiming,
+	/** Feed each block as soon as the port queue has room for it */
+	AsFastAsPossible,
+};
+
+/** Feeds a recorded session into a SerialPort, no hardware needed
+*
+* The file is memory mapped and walked in place by a replay thread, which
+* becomes the port's producer through SerialPort::InjectInput. A block is
+* retried until it fits, so every recorded byte reaches the queue in
+* order and the same session always yields the same commands.
+*/
+class ARDUINOINPUTCORE_API FSerialSessionReplay : public FRunnable
+{
+public:
+	FSerialSessionReplay();
+	virtual ~FSerialSessionReplay();
+
+	/** Map the file, check its header and start feeding Target, with padding stripping set to match the session. Target must not have a listen thread nor be in a SerialPortSet */
+	bool Open(const FString& Filename, SerialPort& Target, ESerialReplaySpeed Speed);
+
+	/** Stop feeding and unmap the file */
+	void Close();
+
+	/** Header flags of the opened session, see SerialSession::FlagBinaryProtocol */
+	uint32 GetFlags() const { return Flags; }
+
+	/** True once every record was queued, or the replay stopped on a truncated record */
+	bool IsFinished() const { return bFinished.load(std::memory_order_acquire); }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	/** Wait until the given FPlatformTime::Cycles64() time, returns false if stopped meanwhile */
+	bool WaitUntil(uint64 TargetCycles);
+
+	IMappedFileHandle* MappedFile;
+	IMappedFileRegion* MappedRegion;
+	/** Used instead of the mapping on platforms that cannot map files */
+	TArray<uint8> LoadedFile;
+
+	const uint8* Data;
+	int64 DataSize;
+	uint32 Flags;
+
+	SerialPort* Target;
+	ESerialReplaySpeed Speed;
+
+	FRunnableThread* Thread;
+	FEvent* WakeEvent;
+	std::atomic<bool> bStopping;
+	std::atomic<bool> bFinished;
+};
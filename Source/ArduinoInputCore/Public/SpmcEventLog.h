@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/** Fixed-capacity single-producer event log read by any number of subscribers
+*
+* One thread publishes (the parse thread). Every subscriber keeps a cursor
+* of its own and reads the events in place, so adding a subscriber costs
+* one cursor and no copy, and subscribers never wait for each other or
+* hold the producer back: the log never fills up, the oldest events are
+* simply overwritten. A subscriber falling Capacity events or more behind
+* skips what it missed, and the slot the producer writes next, and counts
+* them in its cursor.
+*
+* Events are read where they lie, so the producer may overwrite them
+* while a slow subscriber is still looking at them; Consume tells whether
+* that happened.
+*
+* @param: T event type, should be trivially copyable
+* @param: Capacity number of events kept, must be a power of two
+*/
+template <typename T, uint32 Capacity>
+class TSpmcEventLog
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "TSpmcEventLog capacity must be a power of two");
+
+public:
+    /** One subscriber's read position, owned by that subscriber's thread */
+    struct FCursor
+    {
+        /** Sequence number of the next event to read */
+        uint64 position = 0;
+
+        /** Events overwritten before this subscriber read them */
+        uint64 lost = 0;
+    };
+
+    TSpmcEventLog()
+        : m_head(0)
+    {
+    }
+
+    TSpmcEventLog(const TSpmcEventLog&) = delete;
+    TSpmcEventLog& operator=(const TSpmcEventLog&) = delete;
+
+    /** Producer: append one event, overwriting the oldest one once the log is full */
+    void Publish(const T& value)
+    {
+        const uint64 head = m_head.load(std::memory_order_relaxed);
+        // The previous publish (head) must be visible before this slot changes, see Consume
+        std::atomic_thread_fence(std::memory_order_release);
+        m_items[head & Mask] = value;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    /** Sequence number of the next event to be published */
+    uint64 GetHead() const
+    {
+        return m_head.load(std::memory_order_acquire);
+    }
+
+    /** Subscriber: a cursor that reads what is published from now on */
+    FCursor MakeCursor() const
+    {
+        FCursor cursor;
+        cursor.position = GetHead();
+        return cursor;
+    }
+
+    /** Subscriber: get the longest contiguous run of unread events, in place
+    *
+    * A full drain takes at most two calls, one before and one after the wrap point.
+    * @param: FCursor & cursor moved past overwritten events, if any
+    * @param: const T *& outData set to the first unread event
+    * @return: uint32 number of events readable at outData, 0 when up to date
+    */
+    uint32 Peek(FCursor& cursor, const T*& outData) const
+    {
+        const uint64 head = m_head.load(std::memory_order_acquire);
+        // Capacity behind, the oldest slot is the next one Publish writes: skip it as well, as Consume would count it lost
+        if (head - cursor.position >= Capacity)
+        {
+            cursor.lost += head - Capacity + 1 - cursor.position;
+            cursor.position = head - Capacity + 1;
+        }
+        const uint32 start = (uint32)(cursor.position & Mask);
+        outData = &m_items[start];
+        return (uint32)FMath::Min<uint64>(head - cursor.position, Capacity - start);
+    }
+
+    /** Subscriber: move past events previously read through Peek
+    *
+    * @return: bool false if the producer overwrote some of them meanwhile, they are counted as lost
+    */
+    bool Consume(FCursor& cursor, uint32 count) const
+    {
+        // Pairs with the fence in Publish: if anything read above was overwritten, the head read here shows it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64 head = m_head.load(std::memory_order_relaxed);
+        const bool bIntact = head - cursor.position < Capacity;
+        if (!bIntact)
+        {
+            cursor.lost += count;
+        }
+        cursor.position += count;
+        return bIntact;
+    }
+
+    /** Events a cursor can still read, at most Capacity - 1 */
+    uint32 Pending(const FCursor& cursor) const
+    {
+        return (uint32)FMath::Min<uint64>(GetHead() - cursor.position, Capacity - 1);
+    }
+
+    static constexpr uint32 GetCapacity()
+    {
+        return Capacity;
+    }
+
+private:
+    static const uint32 Mask = Capacity - 1;
+
+    alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> m_head;
+
+    alignas(PLATFORM_CACHE_LINE_SIZE) T m_items[Capacity];
+};
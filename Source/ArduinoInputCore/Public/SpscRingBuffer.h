@@ -0,0 +1,177 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/** Fixed-capacity single-producer/single-consumer ring buffer
+*
+* One thread pushes (the serial listen thread), one thread pops (the game
+* thread). Indices are free-running counters published with release stores
+* and read with acquire loads, so no locks are taken and nothing is
+* allocated after construction. Producer and consumer state live on
+* separate cache lines, and each side keeps a cached copy of the other
+* side's index so the shared line is only touched when the cache runs out.
+*
+* @param: T element type, should be trivially copyable
+* @param: Capacity number of slots, must be a power of two
+*/
+template <typename T, uint32 Capacity>
+class TSpscRingBuffer
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "TSpscRingBuffer capacity must be a power of two");
+
+public:
+    TSpscRingBuffer()
+        : m_head(0), m_cachedTail(0), m_tail(0), m_cachedHead(0)
+    {
+    }
+
+    TSpscRingBuffer(const TSpscRingBuffer&) = delete;
+    TSpscRingBuffer& operator=(const TSpscRingBuffer&) = delete;
+
+    /** Producer: append one element
+    *
+    * @return: bool false when the buffer is full, the element is not stored
+    */
+    bool Push(const T& value)
+    {
+        const uint32 tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead == Capacity)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if (tail - m_cachedHead == Capacity)
+            {
+                return false;
+            }
+        }
+        m_items[tail & Mask] = value;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Producer: append up to count elements with a single publish
+    *
+    * @return: uint32 number of elements stored, less than count when the buffer filled up
+    */
+    uint32 Push(const T* pData, uint32 count)
+    {
+        const uint32 tail = m_tail.load(std::memory_order_relaxed);
+        uint32 freeSlots = Capacity - (tail - m_cachedHead);
+        if (freeSlots < count)
+        {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            freeSlots = Capacity - (tail - m_cachedHead);
+        }
+        const uint32 toWrite = FMath::Min(count, freeSlots);
+
+        /** At most two contiguous copies: up to the end of storage, then from the start */
+        const uint32 start = tail & Mask;
+        const uint32 firstPart = FMath::Min(toWrite, Capacity - start);
+        for (uint32 i = 0; i < firstPart; ++i)
+        {
+            m_items[start + i] = pData[i];
+        }
+        for (uint32 i = firstPart; i < toWrite; ++i)
+        {
+            m_items[i - firstPart] = pData[i];
+        }
+
+        m_tail.store(tail + toWrite, std::memory_order_release);
+        return toWrite;
+    }
+
+    /** Consumer: look at the oldest element without removing it
+    *
+    * @return: bool false when the buffer is empty
+    */
+    bool Peek(T& outValue)
+    {
+        const uint32 head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if (head == m_cachedTail)
+            {
+                return false;
+            }
+        }
+        outValue = m_items[head & Mask];
+        return true;
+    }
+
+    /** Consumer: remove the oldest element
+    *
+    * @return: bool false when the buffer was already empty
+    */
+    bool Pop()
+    {
+        return Consume(1) == 1;
+    }
+
+    /** Consumer: get the longest contiguous run of readable elements
+    *
+    * The span stays valid until Consume is called. A full drain takes at
+    * most two calls, one before and one after the wrap point.
+    * @param: const T *& outData set to the first readable element
+    * @return: uint32 number of elements readable at outData, 0 when empty
+    */
+    uint32 PeekContiguous(const T*& outData)
+    {
+        const uint32 head = m_head.load(std::memory_order_relaxed);
+        m_cachedTail = m_tail.load(std::memory_order_acquire);
+        const uint32 start = head & Mask;
+        outData = &m_items[start];
+        return FMath::Min(m_cachedTail - head, Capacity - start);
+    }
+
+    /** Consumer: release elements previously read through Peek/PeekContiguous
+    *
+    * @return: uint32 number of elements actually released
+    */
+    uint32 Consume(uint32 count)
+    {
+        const uint32 head = m_head.load(std::memory_order_relaxed);
+        uint32 available = m_cachedTail - head;
+        if (available < count)
+        {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            available = m_cachedTail - head;
+        }
+        const uint32 toRelease = FMath::Min(count, available);
+        m_head.store(head + toRelease, std::memory_order_release);
+        return toRelease;
+    }
+
+    /** Number of stored elements, exact from either thread at the moment of the call */
+    uint32 Size() const
+    {
+        const uint32 head = m_head.load(std::memory_order_acquire);
+        const uint32 tail = m_tail.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    bool IsEmpty() const
+    {
+        return Size() == 0;
+    }
+
+    static constexpr uint32 GetCapacity()
+    {
+        return Capacity;
+    }
+
+private:
+    static const uint32 Mask = Capacity - 1;
+
+    /** Consumer side: read index and the consumer's view of the write index */
+    alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> m_head;
+    uint32 m_cachedTail;
+
+    /** Producer side: write index and the producer's view of the read index */
+    alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint32> m_tail;
+    uint32 m_cachedHead;
+
+    alignas(PLATFORM_CACHE_LINE_SIZE) T m_items[Capacity];
+};
@@ -0,0 +1,17 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+
+public class ArduinoInputDevice : ModuleRules
+{
+	public ArduinoInputDevice(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
+
+		// IInputDevice plumbing only: what a board reads comes from ArduinoInputCore,
+		// the key events go out through the engine's message handler
+		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "InputCore", "InputDevice", "ArduinoInputCore" });
+
+		PrivateDependencyModuleNames.AddRange(new string[] { "ApplicationCore" });
+	}
+}
@@ -0,0 +1,188 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoInputDevice.h"
+#include "ArduinoInputStats.h"
+#include "InputLatencyStats.h"
+#include "GenericPlatform/GenericApplicationMessageHandler.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ConfigCacheIni.h"
+
+FArduinoInputDevice::FArduinoInputDevice()
+{
+	float RunDuration = 0.8f;
+	bExtendRunOnStep = true;
+	bCoalesceJumps = true;
+	GConfig->GetFloat(TEXT("ArduinoInputDevice"), TEXT("RunDuration"), RunDuration, GInputIni);
+	GConfig->GetBool(TEXT("ArduinoInputDevice"), TEXT("bExtendRunOnStep"), bExtendRunOnStep, GInputIni);
+	GConfig->GetBool(TEXT("ArduinoInputDevice"), TEXT("bCoalesceJumps"), bCoalesceJumps, GInputIni);
+	RunDurationCycles = (uint64)(FMath::Max(RunDuration, 0.0f) / FPlatformTime::GetSecondsPerCycle64());
+}
+
+void FArduinoInputDevice::AddSource(const FArduinoInputSource& Source)
+{
+	check(Source.Commands != nullptr);
+	FBoard& Board = Boards.AddDefaulted_GetRef();
+	Board.Source = Source;
+	Board.Cursor = Source.Commands->MakeCursor();
+	FMemory::Memzero(Board.AnalogValues, sizeof(Board.AnalogValues));
+}
+
+void FArduinoInputDevice::RemoveSource(const FArduinoCommandLog* Commands)
+{
+	for (int32 Index = Boards.Num() - 1; Index >= 0; --Index)
+	{
+		if (Boards[Index].Source.Commands == Commands)
+		{
+			ReleaseBoardKeys(Boards[Index]);
+			Boards.RemoveAtSwap(Index);
+		}
+	}
+}
+
+void FArduinoInputDevice::SetMessageHandler(const TSharedRef<FGenericApplicationMessageHandler>& InMessageHandler)
+{
+	MessageHandler = InMessageHandler;
+}
+
+void FArduinoInputDevice::SendControllerEvents()
+{
+	if (!MessageHandler.IsValid() || Boards.Num() == 0)
+	{
+		return;
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_ArduinoCharacterInput);
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	for (FBoard& Board : Boards)
+	{
+		SendBoardEvents(Board);
+	}
+	FArduinoInputCounters::AddGameThreadCycles(FPlatformTime::Cycles64() - StartCycles);
+}
+
+void FArduinoInputDevice::SendBoardEvents(FBoard& Board)
+{
+	const int32 ControllerId = Board.Source.ControllerId;
+	FInputLatencyStats& LatencyStats = FInputLatencyStats::Get();
+
+	// A jump is held for one frame: pressed and released in the same frame, StopJumping would undo Jump before it is applied
+	if (Board.bJumpDown)
+	{
+		MessageHandler->OnControllerButtonReleased(FArduinoKeys::Jump.GetFName(), ControllerId, false);
+		Board.bJumpDown = false;
+	}
+
+	const uint64 DequeueCycles = FPlatformTime::Cycles64();
+	const FArduinoCommand* Commands = nullptr;
+	uint32 Count;
+	while ((Count = Board.Source.Commands->Peek(Board.Cursor, Commands)) > 0)
+	{
+		// Copied out of the log, then checked like UArduinoInput::ReturnAllCommandsInQueue: a span the parse thread
+		// overwrote meanwhile is dropped whole, Consume counts it in the cursor's lost
+		CommandsRead.Reset();
+		CommandsRead.Append(Commands, (int32)Count);
+		if (!Board.Source.Commands->Consume(Board.Cursor, Count))
+		{
+			continue;
+		}
+
+		for (const FArduinoCommand& Command : CommandsRead)
+		{
+			ARDUINO_TRACE_SCOPE(ArduinoCommand);
+			LatencyStats.RecordCycles(EInputLatencyStage::ParseToDequeue, Command.GetParseCycles(), DequeueCycles);
+			if (Command.Opcode == EArduinoOpcode::Jump)
+			{
+				++Board.PendingJumps;
+			}
+			else if (Command.Opcode == EArduinoOpcode::Run)
+			{
+				// Timed from when the step's bytes were read, so a step lasts as long whichever frame it lands in
+				const uint64 StepCycles = Command.TimestampCycles != 0 ? Command.TimestampCycles : DequeueCycles;
+				if (bExtendRunOnStep || StepCycles >= Board.RunEndCycles)
+				{
+					Board.RunEndCycles = FMath::Max(Board.RunEndCycles, StepCycles + RunDurationCycles);
+				}
+				MessageHandler->OnControllerButtonPressed(FArduinoKeys::Step.GetFName(), ControllerId, false);
+				MessageHandler->OnControllerButtonReleased(FArduinoKeys::Step.GetFName(), ControllerId, false);
+			}
+
+			const uint64 ActionCycles = FPlatformTime::Cycles64();
+			LatencyStats.RecordCycles(EInputLatencyStage::DequeueToAction, DequeueCycles, ActionCycles);
+			LatencyStats.RecordCycles(EInputLatencyStage::ReadToAction, Command.TimestampCycles, ActionCycles);
+		}
+	}
+
+	// One press per frame. Either fold a burst into it, or play the extra jumps out one per frame
+	if (Board.PendingJumps > 0)
+	{
+		MessageHandler->OnControllerButtonPressed(FArduinoKeys::Jump.GetFName(), ControllerId, false);
+		Board.bJumpDown = true;
+		Board.PendingJumps = bCoalesceJumps ? 0 : Board.PendingJumps - 1;
+	}
+
+	// Axis keys keep their last value, so only changes are sent
+	const bool bRunning = FPlatformTime::Cycles64() < Board.RunEndCycles;
+	if (bRunning != Board.bRunning)
+	{
+		MessageHandler->OnControllerAnalog(FArduinoKeys::Run.GetFName(), ControllerId, bRunning ? 1.0f : 0.0f);
+		Board.bRunning = bRunning;
+	}
+
+	// Already filtered on the parse thread, this only reads what it published
+	const FAnalogFilterBank* AnalogFilters = Board.Source.AnalogFilters;
+	const int32 NumChannels = AnalogFilters != nullptr ? AnalogFilters->GetNumChannels() : 0;
+	for (int32 Channel = 0; Channel < NumChannels; ++Channel)
+	{
+		const float Value = AnalogFilters->GetValue(Channel);
+		if (Value != Board.AnalogValues[Channel])
+		{
+			MessageHandler->OnControllerAnalog(FArduinoKeys::Analog(Channel).GetFName(), ControllerId, Value);
+			Board.AnalogValues[Channel] = Value;
+		}
+
+		const uint32 Bit = 1u << Channel;
+		const bool bPressed = AnalogFilters->IsPressed(Channel);
+		if (bPressed != ((Board.AnalogPressed & Bit) != 0))
+		{
+			if (bPressed)
+			{
+				MessageHandler->OnControllerButtonPressed(FArduinoKeys::AnalogButton(Channel).GetFName(), ControllerId, false);
+			}
+			else
+			{
+				MessageHandler->OnControllerButtonReleased(FArduinoKeys::AnalogButton(Channel).GetFName(), ControllerId, false);
+			}
+			Board.AnalogPressed ^= Bit;
+		}
+	}
+}
+
+void FArduinoInputDevice::ReleaseBoardKeys(FBoard& Board)
+{
+	if (!MessageHandler.IsValid())
+	{
+		return;
+	}
+
+	const int32 ControllerId = Board.Source.ControllerId;
+	if (Board.bJumpDown)
+	{
+		MessageHandler->OnControllerButtonReleased(FArduinoKeys::Jump.GetFName(), ControllerId, false);
+	}
+	if (Board.bRunning)
+	{
+		MessageHandler->OnControllerAnalog(FArduinoKeys::Run.GetFName(), ControllerId, 0.0f);
+	}
+	for (int32 Channel = 0; Channel < FAnalogFilterBank::MaxChannels; ++Channel)
+	{
+		if (Board.AnalogValues[Channel] != 0.0f)
+		{
+			MessageHandler->OnControllerAnalog(FArduinoKeys::Analog(Channel).GetFName(), ControllerId, 0.0f);
+		}
+		if ((Board.AnalogPressed & (1u << Channel)) != 0)
+		{
+			MessageHandler->OnControllerButtonReleased(FArduinoKeys::AnalogButton(Channel).GetFName(), ControllerId, false);
+		}
+	}
+}
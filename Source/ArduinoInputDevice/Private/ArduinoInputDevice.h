@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "IInputDevice.h"
+#include "ArduinoInputDeviceModule.h"
+
+/** The IInputDevice behind FArduinoInputDeviceModule, see there. Game thread only */
+class FArduinoInputDevice : public IInputDevice
+{
+public:
+	FArduinoInputDevice();
+
+	void AddSource(const FArduinoInputSource& Source);
+	void RemoveSource(const FArduinoCommandLog* Commands);
+
+	// IInputDevice
+	virtual void Tick(float DeltaTime) override {}
+	virtual void SendControllerEvents() override;
+	virtual void SetMessageHandler(const TSharedRef<FGenericApplicationMessageHandler>& InMessageHandler) override;
+	virtual bool Exec(UWorld* InWorld, const TCHAR* Cmd, FOutputDevice& Ar) override { return false; }
+	virtual void SetChannelValue(int32 ControllerId, FForceFeedbackChannelType ChannelType, float Value) override {}
+	virtual void SetChannelValues(int32 ControllerId, const FForceFeedbackValues& Values) override {}
+
+private:
+	/** A registered source, and what its keys currently report */
+	struct FBoard
+	{
+		FArduinoInputSource Source;
+		FArduinoCommandLog::FCursor Cursor;
+		/** FPlatformTime::Cycles64() at which the current run ends */
+		uint64 RunEndCycles = 0;
+		bool bRunning = false;
+		/** Jumps not sent yet, more than one only while bCoalesceJumps is off */
+		int32 PendingJumps = 0;
+		/** Jump was pressed last frame and is released this one */
+		bool bJumpDown = false;
+		float AnalogValues[FAnalogFilterBank::MaxChannels];
+		/** Bit per analog channel reported pressed */
+		uint32 AnalogPressed = 0;
+	};
+
+	void SendBoardEvents(FBoard& Board);
+	/** Release every key a board holds, so nothing stays down after it goes away */
+	void ReleaseBoardKeys(FBoard& Board);
+
+	/** Null until the engine creates the device */
+	TSharedPtr<FGenericApplicationMessageHandler> MessageHandler;
+	TArray<FBoard> Boards;
+	/** Scratch copy of the span SendBoardEvents is reading, reused so it only allocates while it grows */
+	TArray<FArduinoCommand> CommandsRead;
+
+	/** [ArduinoInputDevice] settings, see FArduinoInputDeviceModule */
+	uint64 RunDurationCycles;
+	bool bExtendRunOnStep;
+	bool bCoalesceJumps;
+};
@@ -0,0 +1,77 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "ArduinoInputDeviceModule.h"
+#include "ArduinoInputDevice.h"
+#include "Features/IModularFeatures.h"
+#include "Modules/ModuleManager.h"
+
+#define LOCTEXT_NAMESPACE "ArduinoInputDevice"
+
+const FKey FArduinoKeys::Jump("ArduinoJump");
+const FKey FArduinoKeys::Step("ArduinoStep");
+const FKey FArduinoKeys::Run("ArduinoRun");
+
+namespace
+{
+	const FName ArduinoCategory("Arduino");
+
+	/** Filled by StartupModule, the names are built from the channel number */
+	FKey AnalogKeys[FAnalogFilterBank::MaxChannels];
+	FKey AnalogButtonKeys[FAnalogFilterBank::MaxChannels];
+}
+
+FKey FArduinoKeys::Analog(int32 Channel)
+{
+	return Channel >= 0 && Channel < FAnalogFilterBank::MaxChannels ? AnalogKeys[Channel] : FKey();
+}
+
+FKey FArduinoKeys::AnalogButton(int32 Channel)
+{
+	return Channel >= 0 && Channel < FAnalogFilterBank::MaxChannels ? AnalogButtonKeys[Channel] : FKey();
+}
+
+void FArduinoInputDeviceModule::StartupModule()
+{
+	// Registers us with the engine's input device list
+	IInputDeviceModule::StartupModule();
+
+	EKeys::AddMenuCategoryDisplayInfo(ArduinoCategory, LOCTEXT("ArduinoSubCategory", "Arduino"), TEXT("GraphEditor.PadEvent_16x"));
+	EKeys::AddKey(FKeyDetails(FArduinoKeys::Jump, LOCTEXT("ArduinoJump", "Arduino Jump"), FKeyDetails::GamepadKey, ArduinoCategory));
+	EKeys::AddKey(FKeyDetails(FArduinoKeys::Step, LOCTEXT("ArduinoStep", "Arduino Run Step"), FKeyDetails::GamepadKey, ArduinoCategory));
+	EKeys::AddKey(FKeyDetails(FArduinoKeys::Run, LOCTEXT("ArduinoRun", "Arduino Run"), FKeyDetails::GamepadKey | FKeyDetails::FloatAxis, ArduinoCategory));
+	for (int32 Channel = 0; Channel < FAnalogFilterBank::MaxChannels; ++Channel)
+	{
+		AnalogKeys[Channel] = FKey(*FString::Printf(TEXT("ArduinoAnalog%d"), Channel));
+		AnalogButtonKeys[Channel] = FKey(*FString::Printf(TEXT("ArduinoAnalog%d_Button"), Channel));
+		EKeys::AddKey(FKeyDetails(AnalogKeys[Channel], FText::Format(LOCTEXT("ArduinoAnalog", "Arduino Analog {0}"), FText::AsNumber(Channel)), FKeyDetails::GamepadKey | FKeyDetails::FloatAxis, ArduinoCategory));
+		EKeys::AddKey(FKeyDetails(AnalogButtonKeys[Channel], FText::Format(LOCTEXT("ArduinoAnalogButton", "Arduino Analog {0} Button"), FText::AsNumber(Channel)), FKeyDetails::GamepadKey, ArduinoCategory));
+	}
+
+	Device = MakeShared<FArduinoInputDevice>();
+}
+
+void FArduinoInputDeviceModule::ShutdownModule()
+{
+	IModularFeatures::Get().UnregisterModularFeature(GetModularFeatureName(), this);
+	Device.Reset();
+}
+
+TSharedPtr<IInputDevice> FArduinoInputDeviceModule::CreateInputDevice(const TSharedRef<FGenericApplicationMessageHandler>& InMessageHandler)
+{
+	Device->SetMessageHandler(InMessageHandler);
+	return Device;
+}
+
+void FArduinoInputDeviceModule::AddSource(const FArduinoInputSource& Source)
+{
+	Device->AddSource(Source);
+}
+
+void FArduinoInputDeviceModule::RemoveSource(const FArduinoCommandLog* Commands)
+{
+	Device->RemoveSource(Commands);
+}
+
+#undef LOCTEXT_NAMESPACE
+
+IMPLEMENT_MODULE( FArduinoInputDeviceModule, ArduinoInputDevice );
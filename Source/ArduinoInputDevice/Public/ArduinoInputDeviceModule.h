@@ -0,0 +1,84 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "IInputDeviceModule.h"
+#include "InputCoreTypes.h"
+#include "AnalogFilterBank.h"
+#include "ArduinoCommand.h"
+
+class FArduinoInputDevice;
+
+/** Keys of the Arduino boards, usable in action and axis mappings and in Blueprint like any gamepad key */
+struct ARDUINOINPUTDEVICE_API FArduinoKeys
+{
+	/** Button, pressed for one frame per jump gesture */
+	static const FKey Jump;
+
+	/** Button, tapped once per run step */
+	static const FKey Step;
+
+	/** Axis, 1 while the last run step is less than RunDuration old, 0 otherwise */
+	static const FKey Run;
+
+	/** Axis following a filtered analog channel (about -1..1), ArduinoAnalog<Channel>. Invalid key out of range */
+	static FKey Analog(int32 Channel);
+
+	/** Button following an analog channel's debounced pressed state, ArduinoAnalog<Channel>_Button */
+	static FKey AnalogButton(int32 Channel);
+};
+
+/** One board as the input device reads it. Whoever reads the board owns everything pointed to */
+struct FArduinoInputSource
+{
+	/** Controller id of the board's key events, so board N drives the player using controller N */
+	int32 ControllerId = 0;
+
+	/** Read through a cursor of the input device's own, from the moment the source is added */
+	const FArduinoCommandLog* Commands = nullptr;
+
+	/** Read only, null for a board without analog channels */
+	const FAnalogFilterBank* AnalogFilters = nullptr;
+};
+
+/** Turns Arduino gestures and analog channels into engine key events
+*
+* The device reads every registered board once per frame, when the engine
+* polls its input devices, and injects the FArduinoKeys through the
+* application's message handler. From there on a gesture takes the same
+* path as a gamepad button: input mappings in DefaultInput.ini, remapping,
+* Blueprint key events.
+*
+* Gesture timing is set in the [ArduinoInputDevice] section of the input
+* config: RunDuration, bExtendRunOnStep and bCoalesceJumps.
+*/
+class ARDUINOINPUTDEVICE_API FArduinoInputDeviceModule : public IInputDeviceModule
+{
+public:
+	static FArduinoInputDeviceModule& Get()
+	{
+		return FModuleManager::LoadModuleChecked<FArduinoInputDeviceModule>("ArduinoInputDevice");
+	}
+
+	static bool IsAvailable()
+	{
+		return FModuleManager::Get().IsModuleLoaded("ArduinoInputDevice");
+	}
+
+	virtual void StartupModule() override;
+	virtual void ShutdownModule() override;
+
+	/** Called by the engine the first time it polls input devices */
+	virtual TSharedPtr<class IInputDevice> CreateInputDevice(const TSharedRef<FGenericApplicationMessageHandler>& InMessageHandler) override;
+
+	/** Game thread: start turning a board's input into key events. Sources can be added before the engine creates the device */
+	void AddSource(const FArduinoInputSource& Source);
+
+	/** Game thread: stop reading the board whose command log this is, and release whatever keys it held */
+	void RemoveSource(const FArduinoCommandLog* Commands);
+
+private:
+	/** Created at startup so sources have somewhere to go, handed to the engine by CreateInputDevice */
+	TSharedPtr<FArduinoInputDevice> Device;
+};
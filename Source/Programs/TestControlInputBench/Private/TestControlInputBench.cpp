@@ -0,0 +1,1562 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "RequiredProgramMainCPPInclude.h"
+#include "AnalogFilterBank.h"
+#include "ArduinoCommand.h"
+#include "ArduinoComboRecognizer.h"
+#include "ArduinoNetFrames.h"
+#include "ArduinoOutputQueue.h"
+#include "ArduinoUdpTransport.h"
+#include "GestureParser.h"
+#include "InputLatencyStats.h"
+#include "SerialPort.h"
+#include "SerialPortDiscovery.h"
+#include "SerialPortFilter.h"
+#include "SerialPortSet.h"
+#include "SpscRingBuffer.h"
+#include "VirtualArduino.h"
+#include "HAL/MemoryBase.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTLS.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Containers/Queue.h"
+#include "Serialization/BitReader.h"
+#include "Serialization/BitWriter.h"
+
+#include <dirent.h>
+
+DEFINE_LOG_CATEGORY_STATIC(LogInputBench, Log, All);
+
+IMPLEMENT_APPLICATION(TestControlInputBench, "TestControlInputBench");
+
+/** Headless benchmark of the Arduino input path, no editor and no board needed
+*
+*   TestControlInputBench [-Duration=5] [-Rate=500] [-Burst=1] [-JumpRatio=0.25] [-NoPadding]
+*                         [-TickHz=1000] [-Baud=115200] [-OwnThread] [-ParserMB=64] [-Seed=1]
+*                         [-AnalogSets=1000000] [-OpenCloseCycles=2000] [-OutputHz=2000] [-OutputLeds=16]
+*                         [-ComboPatterns=500] [-DiscoveryBoards=8] [-NetSeconds=60] [-TransportSeconds=2]
+*                         [-SpscItems=50000000] [-Csv=<file>] [-MaxP99Us=<us>]
+*
+* Parser: in-memory throughput of SerialPortFilter and GestureParser. The
+* filter is also timed byte at a time, StripIgnoredCharsScalar, and as the
+* old listen loop did it, one locked ReadChar and push per char. Fails if
+* the vector filter keeps other bytes than the scalar one.
+* Legacy parser: GestureParser against the rules of the old nested-if
+* AnalyzeInput, on hand-made reads that split gestures and on a random
+* stream cut into random reads. Reports gestures a second for both, fails
+* if they find different gestures.
+* Allocations: the same gestures handed to the game thread the old way,
+* an FString each through a TQueue, and as FArduinoCommand through the
+* command log, counting GMalloc calls on the main thread. Fails if the
+* command path allocates once it is warm.
+* SPSC: SpscItems sequence numbers from a producer thread to the main
+* thread through TSpscRingBuffer, pushed one at a time and in batches,
+* drained with PeekContiguous and Consume. Fails on a gap or reordering.
+* Combo: FArduinoComboRecognizer throughput with the default gestures only,
+* then with 10, 100 and ComboPatterns random combos on top. Fails if the
+* default gestures do not find what GestureParser finds.
+* Analog: FAnalogFilterBank samples per second on one core, for 4, 8 and
+* 16 channels, vector and scalar. Fails if the two disagree.
+* Open/close: opens the port, starts and stops its listen thread and closes
+* it again OpenCloseCycles times, timing CloseListenTread. Fails if file
+* descriptors leak.
+* Output: posts OutputLeds LED colours OutputHz times a second, plus a
+* rumble pulse every tenth round, through FArduinoOutputQueue to the virtual
+* Arduino. Reports write throughput, coalescing and post-to-write latency,
+* and fails if a written frame does not arrive.
+* Discovery: DiscoveryBoards fake boards on ptys, binary and old firmware
+* at different rates plus silent devices, found by FSerialPortDiscovery.
+* Fails if a board is missed or misread, or if the discovery takes clearly
+* longer than its slowest probe.
+* Net frames: NetSeconds of one player running, jumping and doing combos,
+* packed by FArduinoNetFrameSender at 60 packets a second and sent through
+* a simulated link with 20 ms one way and 0, 10 and 30% loss. Reports bytes
+* a second per player and the latency the batching and lost packets add.
+* Fails if a command arrives changed or out of order, or is lost without
+* packet loss.
+* Transport: the same gesture streams through SerialPort on a pty and
+* through FArduinoUdpTransport on loopback, both read through
+* IArduinoTransport. First the paced stream (Rate, Burst, Duration) for
+* write-to-read latency, then TransportSeconds of unpaced bursts of 256
+* gestures for throughput. A pty has no baud rate, so the serial numbers
+* are the best a USB board could do. Fails if the paced stream loses a
+* gesture; a flood may lose datagrams, that is reported, not failed.
+* Pipeline: a virtual Arduino on a pty feeds SerialPort, the main thread
+* drains it TickHz times a second like UArduinoInput does once per frame,
+* and reports queue depth and latency percentiles. The exit code is 1 when
+* a gesture was lost or the write-to-parse p99 exceeds -MaxP99Us.
+*/
+namespace InputBench
+{
+	struct FSettings
+	{
+		FSyntheticStreamSettings Stream;
+		double TickHz = 1000.0;
+		int32 BaudRate = 115200;
+		bool bSharedIOThread = true;
+		int32 ParserMegaBytes = 64;
+		int32 SpscItems = 50000000;
+		int32 ComboPatterns = 500;
+		int32 AnalogSampleSets = 1000000;
+		int32 OpenCloseCycles = 2000;
+		double OutputRoundsPerSecond = 2000.0;
+		int32 OutputLeds = 16;
+		int32 DiscoveryBoards = 8;
+		double NetSeconds = 60.0;
+		double TransportSeconds = 2.0;
+		FString CsvFile;
+		double MaxP99Micros = 0.0;
+	};
+
+	/** Every result as "name,value", logged as it is added and optionally saved for CI */
+	struct FReport
+	{
+		FString Csv = TEXT("metric,value\n");
+
+		void Add(const TCHAR* Name, double Value)
+		{
+			UE_LOG(LogInputBench, Display, TEXT("  %-32s %.2f"), Name, Value);
+			Csv += FString::Printf(TEXT("%s,%.3f\n"), Name, Value);
+		}
+
+		void AddHistogram(const TCHAR* Name, const FLatencyHistogram& Histogram)
+		{
+			Add(*FString::Printf(TEXT("%s.p50"), Name), (double)Histogram.GetPercentile(50.0));
+			Add(*FString::Printf(TEXT("%s.p99"), Name), (double)Histogram.GetPercentile(99.0));
+			Add(*FString::Printf(TEXT("%s.p999"), Name), (double)Histogram.GetPercentile(99.9));
+			Add(*FString::Printf(TEXT("%s.max"), Name), (double)Histogram.GetMax());
+		}
+	};
+
+	static uint64 CyclesToMicros(uint64 Cycles)
+	{
+		return (uint64)(FPlatformTime::ToMilliseconds64(Cycles) * 1000.0);
+	}
+
+	static FSettings ParseSettings(const TCHAR* CommandLine)
+	{
+		FSettings Settings;
+		FParse::Value(CommandLine, TEXT("Duration="), Settings.Stream.DurationSeconds);
+		FParse::Value(CommandLine, TEXT("Rate="), Settings.Stream.GesturesPerSecond);
+		FParse::Value(CommandLine, TEXT("Burst="), Settings.Stream.BurstSize);
+		FParse::Value(CommandLine, TEXT("JumpRatio="), Settings.Stream.JumpRatio);
+		FParse::Value(CommandLine, TEXT("Seed="), Settings.Stream.RandomSeed);
+		Settings.Stream.bPadding = !FParse::Param(CommandLine, TEXT("NoPadding"));
+		FParse::Value(CommandLine, TEXT("TickHz="), Settings.TickHz);
+		FParse::Value(CommandLine, TEXT("Baud="), Settings.BaudRate);
+		Settings.bSharedIOThread = !FParse::Param(CommandLine, TEXT("OwnThread"));
+		FParse::Value(CommandLine, TEXT("ParserMB="), Settings.ParserMegaBytes);
+		FParse::Value(CommandLine, TEXT("SpscItems="), Settings.SpscItems);
+		FParse::Value(CommandLine, TEXT("ComboPatterns="), Settings.ComboPatterns);
+		FParse::Value(CommandLine, TEXT("AnalogSets="), Settings.AnalogSampleSets);
+		FParse::Value(CommandLine, TEXT("OpenCloseCycles="), Settings.OpenCloseCycles);
+		FParse::Value(CommandLine, TEXT("OutputHz="), Settings.OutputRoundsPerSecond);
+		FParse::Value(CommandLine, TEXT("OutputLeds="), Settings.OutputLeds);
+		FParse::Value(CommandLine, TEXT("DiscoveryBoards="), Settings.DiscoveryBoards);
+		FParse::Value(CommandLine, TEXT("NetSeconds="), Settings.NetSeconds);
+		FParse::Value(CommandLine, TEXT("TransportSeconds="), Settings.TransportSeconds);
+		FParse::Value(CommandLine, TEXT("Csv="), Settings.CsvFile);
+		FParse::Value(CommandLine, TEXT("MaxP99Us="), Settings.MaxP99Micros);
+		Settings.TickHz = FMath::Clamp(Settings.TickHz, 1.0, 100000.0);
+		Settings.SpscItems = FMath::Max(Settings.SpscItems, 1);
+		Settings.OutputRoundsPerSecond = FMath::Clamp(Settings.OutputRoundsPerSecond, 1.0, 1000000.0);
+		Settings.OutputLeds = FMath::Clamp(Settings.OutputLeds, 1, FArduinoOutputQueue::MaxLeds);
+		Settings.DiscoveryBoards = FMath::Clamp(Settings.DiscoveryBoards, 1, 64);
+		Settings.NetSeconds = FMath::Clamp(Settings.NetSeconds, 1.0, 3600.0);
+		Settings.TransportSeconds = FMath::Clamp(Settings.TransportSeconds, 0.1, 600.0);
+		return Settings;
+	}
+
+	/** Filter and parse a synthetic stream held in memory, in the same 4 KB blocks the I/O thread reads */
+	static bool RunParserBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		const int32 StreamSize = FMath::Max(Settings.ParserMegaBytes, 1) * 1024 * 1024;
+		TArray<char> Stream;
+		Stream.SetNumUninitialized(StreamSize + 4);
+
+		FRandomStream Random(Settings.Stream.RandomSeed);
+		int32 Length = 0;
+		int64 ExpectedGestures = 0;
+		while (Length < StreamSize)
+		{
+			Length += FVirtualArduino::AppendGesture(Random, Settings.Stream.JumpRatio, Stream.GetData() + Length);
+			++ExpectedGestures;
+			if (Settings.Stream.bPadding)
+			{
+				Stream[Length++] = '\r';
+				Stream[Length++] = '\n';
+			}
+		}
+
+		// The vector and scalar filters both work in place, the old per-char loop reads the stream as it came
+		const TArray<char> Received(Stream.GetData(), Length);
+		TArray<char> ScalarStream(Received);
+		TArray<char> PerCharStream;
+		PerCharStream.SetNumUninitialized(Length);
+
+		const int32 BlockSize = 4096;
+		const uint64 FilterStart = FPlatformTime::Cycles64();
+		int32 Kept = 0;
+		for (int32 Offset = 0; Offset < Length; Offset += BlockSize)
+		{
+			const int32 BlockLength = FMath::Min(BlockSize, Length - Offset);
+			const int32 BlockKept = SerialPortFilter::StripIgnoredChars(Stream.GetData() + Offset, BlockLength);
+			FMemory::Memmove(Stream.GetData() + Kept, Stream.GetData() + Offset, BlockKept);
+			Kept += BlockKept;
+		}
+		const double FilterSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - FilterStart);
+
+		const uint64 ScalarStart = FPlatformTime::Cycles64();
+		int32 ScalarKept = 0;
+		for (int32 Offset = 0; Offset < Length; Offset += BlockSize)
+		{
+			const int32 BlockLength = FMath::Min(BlockSize, Length - Offset);
+			const int32 BlockKept = SerialPortFilter::StripIgnoredCharsScalar(ScalarStream.GetData() + Offset, BlockLength);
+			FMemory::Memmove(ScalarStream.GetData() + ScalarKept, ScalarStream.GetData() + Offset, BlockKept);
+			ScalarKept += BlockKept;
+		}
+		const double ScalarSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - ScalarStart);
+
+		// What the listen thread did before blocks: a locked one-char ReadChar, the padding test, one push per char. Port I/O aside
+		FCriticalSection ReadLock;
+		const uint64 PerCharStart = FPlatformTime::Cycles64();
+		int32 PerCharKept = 0;
+		for (int32 Index = 0; Index < Length; ++Index)
+		{
+			char Char;
+			{
+				FScopeLock Lock(&ReadLock);
+				Char = Received[Index];
+			}
+			if (!SerialPortFilter::IsIgnoredChar(Char))
+			{
+				PerCharStream[PerCharKept++] = Char;
+			}
+		}
+		const double PerCharSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - PerCharStart);
+
+		// Vector and scalar agree on the whole stream, and on short odd blocks that end in the scalar tail
+		bool bFilterAgrees = ScalarKept == Kept && PerCharKept == Kept
+			&& FMemory::Memcmp(ScalarStream.GetData(), Stream.GetData(), Kept) == 0
+			&& FMemory::Memcmp(PerCharStream.GetData(), Stream.GetData(), Kept) == 0;
+		for (int32 Offset = 0; bFilterAgrees && Offset < FMath::Min(Length, 1024 * 1024); )
+		{
+			const int32 BlockLength = FMath::Min(Random.RandRange(1, 100), Length - Offset);
+			char Vector[100];
+			char Scalar[100];
+			FMemory::Memcpy(Vector, Received.GetData() + Offset, BlockLength);
+			FMemory::Memcpy(Scalar, Received.GetData() + Offset, BlockLength);
+			const int32 VectorKept = SerialPortFilter::StripIgnoredChars(Vector, BlockLength);
+			bFilterAgrees = VectorKept == SerialPortFilter::StripIgnoredCharsScalar(Scalar, BlockLength) && FMemory::Memcmp(Vector, Scalar, VectorKept) == 0;
+			Offset += BlockLength;
+		}
+
+		GestureParser Parser;
+		TArray<EArduinoOpcode> Gestures;
+		int64 ParsedGestures = 0;
+		const uint64 ParseStart = FPlatformTime::Cycles64();
+		for (int32 Offset = 0; Offset < Kept; Offset += BlockSize)
+		{
+			Gestures.Reset();
+			ParsedGestures += Parser.Parse(Stream.GetData() + Offset, FMath::Min(BlockSize, Kept - Offset), Gestures);
+		}
+		const double ParseSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - ParseStart);
+
+		UE_LOG(LogInputBench, Display, TEXT("Parser, %.1f MB in memory:"), Length / (1024.0 * 1024.0));
+		Report.Add(TEXT("filter.mb_per_s"), Length / (1024.0 * 1024.0) / FMath::Max(FilterSeconds, 1e-9));
+		Report.Add(TEXT("filter.scalar_mb_per_s"), Length / (1024.0 * 1024.0) / FMath::Max(ScalarSeconds, 1e-9));
+		Report.Add(TEXT("filter.per_char_mb_per_s"), Length / (1024.0 * 1024.0) / FMath::Max(PerCharSeconds, 1e-9));
+		Report.Add(TEXT("parser.mb_per_s"), Kept / (1024.0 * 1024.0) / FMath::Max(ParseSeconds, 1e-9));
+		Report.Add(TEXT("parser.gestures_per_s"), ParsedGestures / FMath::Max(ParseSeconds, 1e-9));
+
+		bool bPassed = true;
+		if (!bFilterAgrees)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("StripIgnoredChars kept something else than StripIgnoredCharsScalar or the per-char loop"));
+			bPassed = false;
+		}
+		if (ParsedGestures != ExpectedGestures)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Parser found %lld gestures, expected %lld"), ParsedGestures, ExpectedGestures);
+			bPassed = false;
+		}
+		return bPassed;
+	}
+
+	/** What UArduinoInput::AnalyzeInput did before GestureParser, on a plain char queue
+	* Each call looked at the front of the queue, took at most one gesture and waited with a lone foot at the end */
+	struct FLegacyGestureQueue
+	{
+		TArray<char> Chars;
+		int32 Head = 0;
+
+		void Append(const char* pData, int32 Length)
+		{
+			if (Head > 4096 && Head * 2 > Chars.Num())
+			{
+				Chars.RemoveAt(0, Head, false);
+				Head = 0;
+			}
+			Chars.Append(pData, Length);
+		}
+
+		/** One AnalyzeInput call, false when it left the queue as it was */
+		bool AnalyzeInput(TArray<EArduinoOpcode>& OutGestures)
+		{
+			const int32 Size = Chars.Num() - Head;
+			if (Size == 0)
+			{
+				return false;
+			}
+			const char Front = Chars[Head];
+			if (Front == 'L' || Front == 'R')
+			{
+				if (Size <= 1)
+				{
+					return false;
+				}
+				const char Next = Chars[++Head];
+				if (Next == (Front == 'L' ? 'R' : 'L'))
+				{
+					++Head;
+					OutGestures.Add(EArduinoOpcode::Run);
+				}
+				else if (Next == 'J')
+				{
+					++Head;
+					OutGestures.Add(EArduinoOpcode::Jump);
+				}
+				return true;
+			}
+			++Head;
+			if (Front == 'J')
+			{
+				OutGestures.Add(EArduinoOpcode::Jump);
+			}
+			return true;
+		}
+	};
+
+	/** Feed Blocks to both parsers, returns false with a message when their gestures differ */
+	static bool CompareGestureParsers(const TArray<FString>& Blocks, const TArray<EArduinoOpcode>* Expected)
+	{
+		GestureParser Parser;
+		FLegacyGestureQueue Legacy;
+		TArray<EArduinoOpcode> TableGestures;
+		TArray<EArduinoOpcode> LegacyGestures;
+		FString Joined;
+		for (const FString& Block : Blocks)
+		{
+			const FTCHARToUTF8 Chars(*Block);
+			Parser.Parse(Chars.Get(), Chars.Length(), TableGestures);
+			Legacy.Append(Chars.Get(), Chars.Length());
+			while (Legacy.AnalyzeInput(LegacyGestures))
+			{
+			}
+			Joined += Joined.IsEmpty() ? Block : TEXT("|") + Block;
+		}
+		if (TableGestures != LegacyGestures || (Expected != nullptr && TableGestures != *Expected))
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Blocks %s: GestureParser found %d gestures, the old AnalyzeInput %d"), *Joined, TableGestures.Num(), LegacyGestures.Num());
+			return false;
+		}
+		return true;
+	}
+
+	/** GestureParser against the old AnalyzeInput rules, on random streams cut at random places */
+	static bool RunLegacyParserBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		const EArduinoOpcode Run = EArduinoOpcode::Run;
+		const EArduinoOpcode Jump = EArduinoOpcode::Jump;
+		struct FSplitCase
+		{
+			TArray<FString> Blocks;
+			TArray<EArduinoOpcode> Gestures;
+		};
+		// A foot alone at the end of a read has to wait for the next one, whatever comes in it
+		const FSplitCase Cases[] = {
+			{ { TEXT("L"), TEXT("R") }, { Run } },
+			{ { TEXT("R"), TEXT("L") }, { Run } },
+			{ { TEXT("LRL"), TEXT("R") }, { Run, Run } },
+			{ { TEXT("R"), TEXT("J") }, { Jump } },
+			{ { TEXT("L"), TEXT("L"), TEXT("R") }, { Run } },
+			{ { TEXT("L"), TEXT("XR") }, {} },
+			{ { TEXT("JL") }, { Jump } },
+			{ { TEXT("RJ"), TEXT("L"), TEXT(""), TEXT("RR") }, { Jump, Run } },
+		};
+		bool bPassed = true;
+		for (const FSplitCase& Case : Cases)
+		{
+			bPassed = CompareGestureParsers(Case.Blocks, &Case.Gestures) && bPassed;
+		}
+
+		// Mostly feet and jumps, some stray bytes, cut into reads of 1 to 64 chars and now and then a whole 4 KB
+		FRandomStream Random(Settings.Stream.RandomSeed);
+		const int32 StreamSize = FMath::Min(FMath::Max(Settings.ParserMegaBytes, 1), 8) * 1024 * 1024;
+		TArray<char> Stream;
+		Stream.SetNumUninitialized(StreamSize);
+		for (char& Char : Stream)
+		{
+			Char = "LRLRLRJX"[Random.RandHelper(8)];
+		}
+		TArray<int32> Splits;
+		for (int32 Offset = 0; Offset < StreamSize; )
+		{
+			const int32 Length = FMath::Min(Random.RandHelper(16) == 0 ? 4096 : Random.RandRange(1, 64), StreamSize - Offset);
+			Splits.Add(Length);
+			Offset += Length;
+		}
+
+		GestureParser Parser;
+		TArray<EArduinoOpcode> TableGestures;
+		TableGestures.Reserve(StreamSize / 2);
+		const uint64 TableStart = FPlatformTime::Cycles64();
+		for (int32 Offset = 0, Split = 0; Split < Splits.Num(); Offset += Splits[Split++])
+		{
+			Parser.Parse(Stream.GetData() + Offset, Splits[Split], TableGestures);
+		}
+		const double TableSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - TableStart);
+
+		FLegacyGestureQueue Legacy;
+		TArray<EArduinoOpcode> LegacyGestures;
+		LegacyGestures.Reserve(StreamSize / 2);
+		const uint64 LegacyStart = FPlatformTime::Cycles64();
+		for (int32 Offset = 0, Split = 0; Split < Splits.Num(); Offset += Splits[Split++])
+		{
+			Legacy.Append(Stream.GetData() + Offset, Splits[Split]);
+			while (Legacy.AnalyzeInput(LegacyGestures))
+			{
+			}
+		}
+		const double LegacySeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - LegacyStart);
+
+		UE_LOG(LogInputBench, Display, TEXT("Parser against the old AnalyzeInput, %.1f MB in %d reads:"), StreamSize / (1024.0 * 1024.0), Splits.Num());
+		Report.Add(TEXT("parser.split_gestures_per_s"), TableGestures.Num() / FMath::Max(TableSeconds, 1e-9));
+		Report.Add(TEXT("parser.legacy_gestures_per_s"), LegacyGestures.Num() / FMath::Max(LegacySeconds, 1e-9));
+
+		if (TableGestures != LegacyGestures)
+		{
+			int32 First = 0;
+			while (First < TableGestures.Num() && First < LegacyGestures.Num() && TableGestures[First] == LegacyGestures[First])
+			{
+				++First;
+			}
+			UE_LOG(LogInputBench, Error, TEXT("GestureParser found %d gestures, the old AnalyzeInput %d, the first difference at gesture %d"),
+				TableGestures.Num(), LegacyGestures.Num(), First);
+			bPassed = false;
+		}
+		return bPassed;
+	}
+
+	/** Forwards to the allocator it replaces and counts the calls made from one thread */
+	class FCountingMalloc : public FMalloc
+	{
+	public:
+		explicit FCountingMalloc(FMalloc* InInner)
+			: Inner(InInner)
+			, CountedThreadId(FPlatformTLS::GetCurrentThreadId())
+			, Calls(0)
+		{
+		}
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountCall();
+			return Inner->Malloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			CountCall();
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override
+		{
+			if (Original != nullptr)
+			{
+				CountCall();
+			}
+			Inner->Free(Original);
+		}
+
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+		virtual const TCHAR* GetDescriptiveName() override { return TEXT("InputBenchCounting"); }
+
+		/** Malloc, Realloc and Free calls from the thread that made this so far */
+		uint64 GetCalls() const { return Calls.load(std::memory_order_relaxed); }
+
+	private:
+		void CountCall()
+		{
+			if (FPlatformTLS::GetCurrentThreadId() == CountedThreadId)
+			{
+				Calls.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		FMalloc* Inner;
+		uint32 CountedThreadId;
+		std::atomic<uint64> Calls;
+	};
+
+	/** Allocator calls of one run of Work on this thread, with every GMalloc call going through FCountingMalloc meanwhile */
+	template <typename FunctorType>
+	static uint64 CountAllocations(FunctorType&& Work)
+	{
+		// Blocks made before or after are the inner allocator's own, the counting one only forwards
+		FMalloc* Inner = GMalloc;
+		FCountingMalloc Counting(Inner);
+		GMalloc = &Counting;
+		Work();
+		GMalloc = Inner;
+		return Counting.GetCalls();
+	}
+
+	/** One frame's worth of gestures to the game thread and a character that reacts to them, before and after FArduinoCommand */
+	static bool RunAllocationBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		const int32 Frames = 10000;
+		FRandomStream Random(Settings.Stream.RandomSeed);
+		TArray<EArduinoOpcode> FrameGestures[16];
+		int32 Gestures = 0;
+		for (TArray<EArduinoOpcode>& FrameList : FrameGestures)
+		{
+			const int32 Count = Random.RandRange(0, 8);
+			for (int32 Index = 0; Index < Count; ++Index)
+			{
+				FrameList.Add(Random.FRand() < Settings.Stream.JumpRatio ? EArduinoOpcode::Jump : EArduinoOpcode::Run);
+			}
+		}
+		for (int32 Frame = 0; Frame < Frames; ++Frame)
+		{
+			Gestures += FrameGestures[Frame % ARRAY_COUNT(FrameGestures)].Num();
+		}
+
+		// Old: the parse side enqueued an FString token, the game thread dequeued all of them and compared strings
+		TQueue<FString> InputQueue;
+		TArray<FString> Inputs;
+		int32 LegacySteps = 0;
+		auto LegacyFrame = [&](int32 Frame)
+		{
+			for (EArduinoOpcode Gesture : FrameGestures[Frame % ARRAY_COUNT(FrameGestures)])
+			{
+				FString Instruction = Gesture == EArduinoOpcode::Jump ? TEXT("J") : TEXT("W");
+				InputQueue.Enqueue(Instruction);
+			}
+			Inputs.Reset();
+			FString Input;
+			while (InputQueue.Dequeue(Input))
+			{
+				Inputs.Add(MoveTemp(Input));
+			}
+			for (const FString& Token : Inputs)
+			{
+				LegacySteps += Token == TEXT("W");
+			}
+		};
+
+		// New: commands published to the board's log, read in place by the subscriber and switched on
+		TUniquePtr<FArduinoCommandLog> CommandLog = MakeUnique<FArduinoCommandLog>();
+		FArduinoCommandLog::FCursor Cursor = CommandLog->MakeCursor();
+		TArray<FArduinoCommand> Commands;
+		int32 CommandSteps = 0;
+		auto CommandFrame = [&](int32 Frame)
+		{
+			const uint64 Now = FPlatformTime::Cycles64();
+			for (EArduinoOpcode Gesture : FrameGestures[Frame % ARRAY_COUNT(FrameGestures)])
+			{
+				CommandLog->Publish(FArduinoCommand(Gesture, 0, Now, Gesture == EArduinoOpcode::Run ? 1 : 0));
+			}
+			Commands.Reset();
+			const FArduinoCommand* pCommands = nullptr;
+			uint32 Count;
+			while ((Count = CommandLog->Peek(Cursor, pCommands)) > 0)
+			{
+				Commands.Append(pCommands, (int32)Count);
+				CommandLog->Consume(Cursor, Count);
+			}
+			for (const FArduinoCommand& Command : Commands)
+			{
+				CommandSteps += Command.Opcode == EArduinoOpcode::Run;
+			}
+		};
+
+		// A first frame of each grows the lists to their steady size, as the first frames of a game would
+		LegacyFrame(0);
+		CommandFrame(0);
+		const uint64 LegacyAllocations = CountAllocations([&]()
+		{
+			for (int32 Frame = 1; Frame <= Frames; ++Frame)
+			{
+				LegacyFrame(Frame);
+			}
+		});
+		const uint64 CommandAllocations = CountAllocations([&]()
+		{
+			for (int32 Frame = 1; Frame <= Frames; ++Frame)
+			{
+				CommandFrame(Frame);
+			}
+		});
+
+		UE_LOG(LogInputBench, Display, TEXT("Allocations, %d frames, %d gestures:"), Frames, Gestures);
+		Report.Add(TEXT("alloc.fstring_queue_calls"), (double)LegacyAllocations);
+		Report.Add(TEXT("alloc.command_log_calls"), (double)CommandAllocations);
+		Report.Add(TEXT("alloc.fstring_queue_calls_per_gesture"), LegacyAllocations / (double)FMath::Max(Gestures, 1));
+
+		bool bPassed = true;
+		if (LegacySteps != CommandSteps)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("The FString path ran %d steps, the command path %d"), LegacySteps, CommandSteps);
+			bPassed = false;
+		}
+		if (CommandAllocations != 0)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("The command path made %llu allocator calls once warm"), CommandAllocations);
+			bPassed = false;
+		}
+		return bPassed;
+	}
+
+	/** Producer side of the SPSC pass: sequence numbers, one at a time or in batches of up to 64, spinning while the ring is full */
+	class FSpscProducer : public FRunnable
+	{
+	public:
+		typedef TSpscRingBuffer<uint32, 4096> FRing;
+
+		FSpscProducer(FRing& InRing, uint32 InCount, int32 InRandomSeed)
+			: Ring(InRing)
+			, Count(InCount)
+			, RandomSeed(InRandomSeed)
+		{
+		}
+
+		virtual uint32 Run() override
+		{
+			FRandomStream Random(RandomSeed);
+			uint32 Batch[64];
+			uint32 Next = 0;
+			while (Next < Count)
+			{
+				const uint32 BatchSize = FMath::Min((uint32)Random.RandRange(1, 64), Count - Next);
+				if (BatchSize == 1)
+				{
+					while (!Ring.Push(Next))
+					{
+						FPlatformProcess::YieldThread();
+					}
+					++Next;
+					continue;
+				}
+
+				for (uint32 i = 0; i < BatchSize; ++i)
+				{
+					Batch[i] = Next + i;
+				}
+				for (uint32 Pushed = 0; Pushed < BatchSize; )
+				{
+					const uint32 Stored = Ring.Push(Batch + Pushed, BatchSize - Pushed);
+					if (Stored == 0)
+					{
+						FPlatformProcess::YieldThread();
+					}
+					Pushed += Stored;
+				}
+				Next += BatchSize;
+			}
+			return 0;
+		}
+
+	private:
+		FRing& Ring;
+		uint32 Count;
+		int32 RandomSeed;
+	};
+
+	/** TSpscRingBuffer between two threads: every number arrives, once and in order */
+	static bool RunSpscBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		TUniquePtr<FSpscProducer::FRing> Ring = MakeUnique<FSpscProducer::FRing>();
+		const uint32 Count = (uint32)Settings.SpscItems;
+		FSpscProducer Producer(*Ring, Count, Settings.Stream.RandomSeed);
+
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		FRunnableThread* Thread = FRunnableThread::Create(&Producer, TEXT("SpscProducer"), 0, TPri_Normal);
+		if (Thread == nullptr)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Cannot start the SPSC producer thread"));
+			return false;
+		}
+
+		// On the first wrong number stop checking, but keep draining so the producer can finish
+		uint32 Expected = 0;
+		uint32 FirstWrong = 0;
+		uint32 WrongValue = 0;
+		bool bInOrder = true;
+		uint64 EmptyPeeks = 0;
+		while (Expected < Count)
+		{
+			const uint32* pItems = nullptr;
+			const uint32 Readable = Ring->PeekContiguous(pItems);
+			if (Readable == 0)
+			{
+				++EmptyPeeks;
+				FPlatformProcess::YieldThread();
+				continue;
+			}
+			for (uint32 i = 0; bInOrder && i < Readable; ++i)
+			{
+				if (pItems[i] != Expected + i)
+				{
+					bInOrder = false;
+					FirstWrong = Expected + i;
+					WrongValue = pItems[i];
+				}
+			}
+			Expected += Ring->Consume(Readable);
+		}
+		const double Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+		Thread->WaitForCompletion();
+		delete Thread;
+
+		UE_LOG(LogInputBench, Display, TEXT("SPSC ring, %u items through %u slots, two threads:"), Count, FSpscProducer::FRing::GetCapacity());
+		Report.Add(TEXT("spsc.items_per_s"), Count / FMath::Max(Seconds, 1e-9));
+		Report.Add(TEXT("spsc.empty_peeks"), (double)EmptyPeeks);
+
+		bool bPassed = true;
+		if (!bInOrder)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("SPSC ring gave %u where %u was due"), WrongValue, FirstWrong);
+			bPassed = false;
+		}
+		if (!Ring->IsEmpty())
+		{
+			UE_LOG(LogInputBench, Error, TEXT("SPSC ring holds %u items after all %u were read"), Ring->Size(), Count);
+			bPassed = false;
+		}
+		return bPassed;
+	}
+
+	/** Feed Stream to Recognizer in 4 KB blocks, each stamped as if read at BaudRate. Returns the seconds spent */
+	static double TimeComboRecognizer(FArduinoComboRecognizer& Recognizer, const TArray<char>& Stream, int32 BaudRate, int64& OutMatches)
+	{
+		const int32 BlockSize = 4096;
+		const uint64 BlockCycles = (uint64)(BlockSize * 10.0 / FMath::Max(BaudRate, 1) / FPlatformTime::GetSecondsPerCycle64());
+		TArray<FArduinoComboMatch> Matches;
+		OutMatches = 0;
+		const uint64 Start = FPlatformTime::Cycles64();
+		for (int32 Offset = 0, Block = 1; Offset < Stream.Num(); Offset += BlockSize, ++Block)
+		{
+			Matches.Reset();
+			OutMatches += Recognizer.Parse(Stream.GetData() + Offset, FMath::Min(BlockSize, Stream.Num() - Offset), Block * BlockCycles, Matches);
+		}
+		return FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - Start);
+	}
+
+	/** The same stream through combo sets of growing size: the cost per byte has to stay flat */
+	static bool RunComboBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		const int32 StreamSize = FMath::Max(Settings.ParserMegaBytes, 1) * 1024 * 1024;
+		TArray<char> Stream;
+		Stream.SetNumUninitialized(StreamSize + 4);
+		FRandomStream Random(Settings.Stream.RandomSeed);
+		int32 Length = 0;
+		while (Length < StreamSize)
+		{
+			Length += FVirtualArduino::AppendGesture(Random, Settings.Stream.JumpRatio, Stream.GetData() + Length);
+		}
+		Stream.SetNum(Length);
+
+		UE_LOG(LogInputBench, Display, TEXT("Combo recognizer, %.1f MB in memory:"), Length / (1024.0 * 1024.0));
+
+		// Without time windows the default gestures are exactly GestureParser
+		GestureParser Parser;
+		TArray<EArduinoOpcode> Gestures;
+		Parser.Parse(Stream.GetData(), Stream.Num(), Gestures);
+		FArduinoComboRecognizer Defaults;
+		Defaults.Compile(FArduinoComboRecognizer::MakeDefaultPatterns(0.0));
+		int64 DefaultMatches = 0;
+		TimeComboRecognizer(Defaults, Stream, Settings.BaudRate, DefaultMatches);
+		bool bPassed = true;
+		if (DefaultMatches != Gestures.Num())
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Default combos found %lld gestures, GestureParser %d"), DefaultMatches, Gestures.Num());
+			bPassed = false;
+		}
+
+		const int32 ExtraCounts[] = { 0, 10, 100, FMath::Max(Settings.ComboPatterns, 0) };
+		double BaseNanosPerByte = 0.0;
+		double NanosPerByte = 0.0;
+		for (int32 Extra : ExtraCounts)
+		{
+			TArray<FArduinoComboPattern> Patterns = FArduinoComboRecognizer::MakeDefaultPatterns(0.5);
+			for (int32 Index = 0; Index < Extra; ++Index)
+			{
+				FArduinoComboPattern& Pattern = Patterns.AddDefaulted_GetRef();
+				const int32 PatternLength = Random.RandRange(2, 8);
+				for (int32 Symbol = 0; Symbol < PatternLength; ++Symbol)
+				{
+					Pattern.Sequence.AppendChar(TEXT("LRJ")[Random.RandHelper(3)]);
+				}
+				Pattern.WindowSeconds = Random.FRandRange(0.2f, 2.0f);
+				Pattern.Payload = (int16)Index;
+			}
+
+			FArduinoComboRecognizer Recognizer;
+			const uint64 CompileStart = FPlatformTime::Cycles64();
+			Recognizer.Compile(Patterns);
+			const double CompileSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - CompileStart);
+			int64 Matches = 0;
+			const double Seconds = TimeComboRecognizer(Recognizer, Stream, Settings.BaudRate, Matches);
+			NanosPerByte = Seconds * 1e9 / FMath::Max(Length, 1);
+			if (Extra == 0)
+			{
+				BaseNanosPerByte = NanosPerByte;
+			}
+
+			const int32 Count = Patterns.Num();
+			Report.Add(*FString::Printf(TEXT("combo.%d.ns_per_byte"), Count), NanosPerByte);
+			Report.Add(*FString::Printf(TEXT("combo.%d.matches_per_mb"), Count), Matches / (Length / (1024.0 * 1024.0)));
+			Report.Add(*FString::Printf(TEXT("combo.%d.states"), Count), Recognizer.GetNumStates());
+			Report.Add(*FString::Printf(TEXT("combo.%d.compile_ms"), Count), CompileSeconds * 1000.0);
+		}
+		// Last and largest set against the defaults alone, about 1 when matching does not depend on the number of combos
+		Report.Add(TEXT("combo.cost_vs_defaults"), NanosPerByte / FMath::Max(BaseNanosPerByte, 1e-9));
+		return bPassed;
+	}
+
+	/** Run one bank over SampleSets noisy sample sets, feeding it in parse-thread sized batches. Returns the seconds spent */
+	static double TimeAnalogFilters(FAnalogFilterBank& Bank, int32 SampleSets, bool bScalar, int32 RandomSeed)
+	{
+		FRandomStream Random(RandomSeed);
+		float Row[FAnalogFilterBank::MaxChannels];
+		double Seconds = 0.0;
+		for (int32 Set = 0; Set < SampleSets; ++Set)
+		{
+			// Square wave between 0.1 and 0.9 with noise, so the thresholds and debounce really switch
+			const float Level = ((Set / 500) & 1) ? 0.9f : 0.1f;
+			for (int32 Channel = 0; Channel < Bank.GetNumChannels(); ++Channel)
+			{
+				Row[Channel] = Level + Random.FRandRange(-0.25f, 0.25f);
+			}
+			Bank.AddSampleSet(Row);
+
+			// Only the filtering is timed, not the sample generation
+			if ((Set & 63) == 63 || Set == SampleSets - 1)
+			{
+				const uint64 Start = FPlatformTime::Cycles64();
+				bScalar ? Bank.ProcessScalar() : Bank.Process();
+				Seconds += FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - Start);
+			}
+		}
+		return Seconds;
+	}
+
+	static bool RunAnalogBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		UE_LOG(LogInputBench, Display, TEXT("Analog filters, %d sample sets, one core:"), Settings.AnalogSampleSets);
+		bool bPassed = true;
+		for (int32 Channels = 4; Channels <= FAnalogFilterBank::MaxChannels; Channels *= 2)
+		{
+			FAnalogFilterBank Vector;
+			FAnalogFilterBank Scalar;
+			Vector.Configure(Channels, FAnalogFilterSettings());
+			Scalar.Configure(Channels, FAnalogFilterSettings());
+			const double VectorSeconds = TimeAnalogFilters(Vector, Settings.AnalogSampleSets, false, Settings.Stream.RandomSeed);
+			const double ScalarSeconds = TimeAnalogFilters(Scalar, Settings.AnalogSampleSets, true, Settings.Stream.RandomSeed);
+
+			Report.Add(*FString::Printf(TEXT("analog.%dch.samples_per_s"), Channels), Vector.GetSamplesProcessed() / FMath::Max(VectorSeconds, 1e-9));
+			Report.Add(*FString::Printf(TEXT("analog.%dch.scalar_samples_per_s"), Channels), Scalar.GetSamplesProcessed() / FMath::Max(ScalarSeconds, 1e-9));
+
+			for (int32 Channel = 0; Channel < Channels; ++Channel)
+			{
+				if (Vector.GetValue(Channel) != Scalar.GetValue(Channel) || Vector.IsPressed(Channel) != Scalar.IsPressed(Channel))
+				{
+					UE_LOG(LogInputBench, Error, TEXT("Vector and scalar analog filters disagree on channel %d of %d"), Channel, Channels);
+					bPassed = false;
+					break;
+				}
+			}
+		}
+		return bPassed;
+	}
+
+	/** Open file descriptors of this process, -1 if unknown */
+	static int32 CountOpenFiles()
+	{
+		DIR* Directory = opendir("/proc/self/fd");
+		if (Directory == nullptr)
+		{
+			return -1;
+		}
+		int32 Count = 0;
+		while (readdir(Directory) != nullptr)
+		{
+			++Count;
+		}
+		closedir(Directory);
+		return Count;
+	}
+
+	/** Open a port, start and stop its listen thread and close it, over and over */
+	static bool RunOpenCloseBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		FVirtualArduino Arduino;
+		if (!Arduino.Open())
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Cannot create a pseudo-terminal"));
+			return false;
+		}
+
+		FLatencyHistogram CloseMicros;
+		const int32 FilesBefore = CountOpenFiles();
+		for (int32 Cycle = 0; Cycle < Settings.OpenCloseCycles; ++Cycle)
+		{
+			SerialPort Port;
+			if (!Port.InitPort(Arduino.GetDevicePath(), (uint32)Settings.BaudRate, 'N', 8, 1, EV_RXCHAR) || !Port.OpenListenThread())
+			{
+				UE_LOG(LogInputBench, Error, TEXT("Cannot open and listen to %s, cycle %d"), ANSI_TO_TCHAR(Arduino.GetDevicePath()), Cycle);
+				return false;
+			}
+
+			const uint64 StartCycles = FPlatformTime::Cycles64();
+			Port.CloseListenTread();
+			CloseMicros.Record(CyclesToMicros(FPlatformTime::Cycles64() - StartCycles));
+			Port.ClosePort();
+		}
+		const int32 FilesAfter = CountOpenFiles();
+		Arduino.Close();
+
+		UE_LOG(LogInputBench, Display, TEXT("Open/close, %d cycles:"), Settings.OpenCloseCycles);
+		Report.AddHistogram(TEXT("listen.close_us"), CloseMicros);
+		Report.Add(TEXT("listen.leaked_files"), (double)(FilesAfter - FilesBefore));
+		if (FilesAfter != FilesBefore)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("%d file descriptors leaked over %d open/close cycles"), FilesAfter - FilesBefore, Settings.OpenCloseCycles);
+			return false;
+		}
+		return true;
+	}
+
+	/** Game-thread style posting -> FArduinoOutputQueue -> SerialPort -> pty -> virtual Arduino */
+	static bool RunOutputBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		FVirtualArduino Arduino;
+		SerialPort Port;
+		FArduinoOutputQueue Queue;
+		if (!Arduino.Open() || !Port.InitPort(Arduino.GetDevicePath(), (uint32)Settings.BaudRate, 'N', 8, 1, EV_RXCHAR) || !Queue.Start(Port, 0))
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Cannot open the output path on a pseudo-terminal"));
+			return false;
+		}
+
+		uint8 Received[4096];
+		uint64 ReceivedFrames = 0;
+		uint64 Posts = 0;
+		const uint64 RoundCycles = (uint64)(1.0 / (Settings.OutputRoundsPerSecond * FPlatformTime::GetSecondsPerCycle64()));
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		const uint64 EndCycles = StartCycles + (uint64)(Settings.Stream.DurationSeconds / FPlatformTime::GetSecondsPerCycle64());
+		uint64 NextRound = StartCycles;
+		for (uint32 Round = 0; FPlatformTime::Cycles64() < EndCycles; ++Round)
+		{
+			for (int32 Led = 0; Led < Settings.OutputLeds; ++Led)
+			{
+				Queue.SetLedColor(Led, (uint8)Round, (uint8)(Round >> 8), (uint8)Led);
+			}
+			Posts += Settings.OutputLeds;
+			if (Round % 10 == 0)
+			{
+				Queue.PostPulse(0, 255, 100);
+				++Posts;
+			}
+
+			// Drain the board side in between, frames end with a 0x00
+			NextRound += RoundCycles;
+			do
+			{
+				const int32 Count = Arduino.ReadFromHost(Received, sizeof(Received), 0);
+				for (int32 i = 0; i < Count; ++i)
+				{
+					ReceivedFrames += Received[i] == 0;
+				}
+			} while (FPlatformTime::Cycles64() < NextRound);
+		}
+		Queue.Close();
+		const double Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		// Close flushed the last batch, give it a moment to come through
+		int32 Count;
+		while ((Count = Arduino.ReadFromHost(Received, sizeof(Received), 100)) > 0)
+		{
+			for (int32 i = 0; i < Count; ++i)
+			{
+				ReceivedFrames += Received[i] == 0;
+			}
+		}
+		Port.ClosePort();
+		Arduino.Close();
+
+		UE_LOG(LogInputBench, Display, TEXT("Output, %d LEDs %.0f times a second for %.1f s:"), Settings.OutputLeds, Settings.OutputRoundsPerSecond, Settings.Stream.DurationSeconds);
+		Report.Add(TEXT("output.posts_per_s"), Posts / FMath::Max(Seconds, 1e-9));
+		Report.Add(TEXT("output.frames_per_s"), Queue.GetFramesWritten() / FMath::Max(Seconds, 1e-9));
+		Report.Add(TEXT("output.bytes_per_s"), Queue.GetBytesWritten() / FMath::Max(Seconds, 1e-9));
+		Report.Add(TEXT("output.frames_per_write"), Queue.GetFramesWritten() / (double)FMath::Max<uint64>(Queue.GetWriteCalls(), 1));
+		Report.Add(TEXT("output.coalesced"), (double)Queue.GetCoalesced());
+		Report.Add(TEXT("output.dropped"), (double)Queue.GetDropped());
+		Report.AddHistogram(TEXT("latency.post_to_write_us"), Queue.GetQueueLatency());
+
+		if (ReceivedFrames != Queue.GetFramesWritten())
+		{
+			UE_LOG(LogInputBench, Error, TEXT("The board received %llu frames, %llu were written"), ReceivedFrames, Queue.GetFramesWritten());
+			return false;
+		}
+		return true;
+	}
+
+	/** Fake boards of every kind on ptys, all probed at once */
+	static bool RunDiscoveryBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		FSerialProbeSettings ProbeSettings;
+		ProbeSettings.BaudRates = { 9600, 19200, 57600, 115200 };
+		ProbeSettings.ProbeSeconds = 0.2f;
+
+		// Binary and old firmware at every rate, and every fourth device not ours
+		TArray<TUniquePtr<FVirtualArduino>> Boards;
+		TArray<FVirtualFirmwareSettings> Firmwares;
+		TArray<FString> DeviceNames;
+		for (int32 Index = 0; Index < Settings.DiscoveryBoards; ++Index)
+		{
+			FVirtualFirmwareSettings Firmware;
+			Firmware.BaudRate = ProbeSettings.BaudRates[Index % ProbeSettings.BaudRates.Num()];
+			Firmware.bBinary = (Index % 4) < 2;
+			Firmware.bSilent = (Index % 4) == 3;
+			Firmware.FirmwareId = (uint16)(100 + Index);
+
+			TUniquePtr<FVirtualArduino>& Board = Boards.Add_GetRef(MakeUnique<FVirtualArduino>());
+			if (!Board->Open() || !Board->StartFirmware(Firmware))
+			{
+				UE_LOG(LogInputBench, Error, TEXT("Cannot start fake board %d on a pseudo-terminal"), Index);
+				return false;
+			}
+			Firmwares.Add(Firmware);
+			DeviceNames.Add(ANSI_TO_TCHAR(Board->GetDevicePath()));
+		}
+
+		FSerialPortDiscovery Discovery;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		Discovery.Start(DeviceNames, ProbeSettings);
+		const TArray<FSerialProbeResult>& Found = Discovery.Wait();
+		const double TotalSeconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		bool bPassed = true;
+		double SlowestSeconds = 0.0;
+		double SumSeconds = 0.0;
+		for (int32 Index = 0; Index < Discovery.GetProbes().Num(); ++Index)
+		{
+			const FSerialProbeResult& Probe = Discovery.GetProbes()[Index];
+			const FVirtualFirmwareSettings& Firmware = Firmwares[Index];
+			SlowestSeconds = FMath::Max(SlowestSeconds, Probe.Seconds);
+			SumSeconds += Probe.Seconds;
+
+			const ESerialProbeMatch Expected = Firmware.bSilent ? ESerialProbeMatch::None : Firmware.bBinary ? ESerialProbeMatch::Hello : ESerialProbeMatch::GestureTraffic;
+			const bool bRightRate = Firmware.bSilent || Probe.BaudRate == Firmware.BaudRate;
+			const bool bRightId = Expected != ESerialProbeMatch::Hello || Probe.FirmwareId == Firmware.FirmwareId;
+			if (Probe.Match != Expected || !bRightRate || !bRightId)
+			{
+				UE_LOG(LogInputBench, Error, TEXT("%s: found match %d at %u baud, id %u, expected match %d at %u baud, id %u"),
+					*Probe.DeviceName, (int32)Probe.Match, Probe.BaudRate, Probe.FirmwareId, (int32)Expected, Firmware.BaudRate, Firmware.FirmwareId);
+				bPassed = false;
+			}
+		}
+		for (TUniquePtr<FVirtualArduino>& Board : Boards)
+		{
+			Board->Close();
+		}
+
+		UE_LOG(LogInputBench, Display, TEXT("Discovery, %d devices, %d rates:"), Settings.DiscoveryBoards, ProbeSettings.BaudRates.Num());
+		Report.Add(TEXT("discovery.boards_found"), Found.Num());
+		Report.Add(TEXT("discovery.total_ms"), TotalSeconds * 1000.0);
+		Report.Add(TEXT("discovery.slowest_probe_ms"), SlowestSeconds * 1000.0);
+		Report.Add(TEXT("discovery.sum_of_probes_ms"), SumSeconds * 1000.0);
+
+		// Thread start-up and scheduling aside, probing in parallel costs the slowest probe
+		if (TotalSeconds > SlowestSeconds * 1.25 + 0.05)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Discovery took %.0f ms, its slowest probe %.0f ms"), TotalSeconds * 1000.0, SlowestSeconds * 1000.0);
+			bPassed = false;
+		}
+		return bPassed;
+	}
+
+	/** One player's commands through FArduinoNetFrameSender, a lossy link and FArduinoNetFrameReceiver, in simulated time */
+	static bool RunNetFramesBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		const double FrameSeconds = 1.0 / 60.0;
+		const double OneWaySeconds = 0.020;
+		const int32 Redundancy = 3;
+		const double CyclesPerSecond = 1.0 / FPlatformTime::GetSecondsPerCycle64();
+		const int32 NumFrames = (int32)(Settings.NetSeconds / FrameSeconds);
+
+		// Four steps a second, a jump every two and a combo every five
+		const EArduinoOpcode Opcodes[] = { EArduinoOpcode::Run, EArduinoOpcode::Jump, EArduinoOpcode::Combo };
+		const double Periods[] = { 0.25, 2.0, 5.0 };
+
+		UE_LOG(LogInputBench, Display, TEXT("Net frames, %.0f s of play, %.0f packets/s, %d redundant frames, %.0f ms one way:"),
+			Settings.NetSeconds, 1.0 / FrameSeconds, Redundancy, OneWaySeconds * 1000.0);
+
+		bool bPassed = true;
+		for (const int32 LossPercent : { 0, 10, 30 })
+		{
+			struct FInFlight
+			{
+				double ArrivalSeconds;
+				TArray<uint8> Bits;
+				int64 NumBits;
+			};
+
+			FRandomStream Random(Settings.Stream.RandomSeed + LossPercent);
+			FArduinoNetFrameSender Sender(Redundancy);
+			FArduinoNetFrameReceiver Receiver;
+			TArray<FArduinoCommand> Sent;
+			TArray<double> DispatchSeconds;
+			/** Index in Sent of each frame's first command, plus the end */
+			TArray<int32> FrameStarts;
+			TArray<FInFlight> InFlight;
+			TArray<FArduinoCommand> Pending;
+			TArray<const FArduinoNetFrame*> Frames;
+			FLatencyHistogram AddedLatency;
+			double NextCommand[] = { 0.0, 1.0, 2.5 };
+			int64 PacketBits = 0;
+			int32 Packets = 0;
+			int32 LastFrame = -1;
+			for (int32 Frame = 0; Frame < NumFrames || InFlight.Num() > 0 || Sender.HasPendingSends(); ++Frame)
+			{
+				// Read up to 8 ms before the frame that dispatches them
+				const double Now = Frame * FrameSeconds;
+				Pending.Reset();
+				for (int32 Kind = 0; Kind < ARRAY_COUNT(Opcodes); ++Kind)
+				{
+					while (Frame < NumFrames && NextCommand[Kind] <= Now)
+					{
+						const double ReadSeconds = FMath::Max(Now - Random.FRandRange(0.0f, 0.008f), 0.0);
+						const int16 Payload = Kind == 0 ? 1 : Kind == 2 ? (int16)Random.RandHelper(12) : 0;
+						Pending.Add(FArduinoCommand(Opcodes[Kind], 0, 1 + (uint64)(ReadSeconds * CyclesPerSecond), Payload));
+						NextCommand[Kind] += Periods[Kind];
+					}
+				}
+				if (Pending.Num() > 0)
+				{
+					FrameStarts.Add(Sent.Num());
+					Sent.Append(Pending);
+					DispatchSeconds.Add(Now);
+					Sender.AddFrame(Pending.GetData(), Pending.Num());
+				}
+
+				// As UArduinoInput does with NetSendRateHz at the frame rate
+				if (Sender.HasPendingSends())
+				{
+					FArduinoNetPacket Packet;
+					Sender.MakePacket(1 + (uint64)(Now * CyclesPerSecond), Packet);
+					FBitWriter Writer(0, true);
+					Packet.Serialize(Writer);
+					PacketBits += Writer.GetNumBits();
+					++Packets;
+					if (Random.RandHelper(100) >= LossPercent)
+					{
+						InFlight.Add({ Now + OneWaySeconds, *Writer.GetBuffer(), Writer.GetNumBits() });
+					}
+				}
+
+				while (InFlight.Num() > 0 && InFlight[0].ArrivalSeconds <= Now)
+				{
+					FBitReader Reader(InFlight[0].Bits.GetData(), InFlight[0].NumBits);
+					const double ArrivalSeconds = InFlight[0].ArrivalSeconds;
+					InFlight.RemoveAt(0, 1, false);
+					FArduinoNetPacket Packet;
+					if (!Packet.Serialize(Reader))
+					{
+						UE_LOG(LogInputBench, Error, TEXT("A packet did not unpack"));
+						return false;
+					}
+
+					Frames.Reset();
+					Receiver.Accept(Packet, Frames);
+					for (const FArduinoNetFrame* NetFrame : Frames)
+					{
+						// Sequences wrap, frame indices do not
+						const int32 FrameIndex = LastFrame + (int16)(uint16)(NetFrame->Sequence - (uint16)LastFrame);
+						const int32 First = FrameStarts.IsValidIndex(FrameIndex) ? FrameStarts[FrameIndex] : 0;
+						const int32 End = FrameStarts.IsValidIndex(FrameIndex + 1) ? FrameStarts[FrameIndex + 1] : Sent.Num();
+						bool bSame = FrameIndex > LastFrame && FrameStarts.IsValidIndex(FrameIndex) && End - First == NetFrame->Commands.Num();
+						for (int32 Index = 0; bSame && Index < NetFrame->Commands.Num(); ++Index)
+						{
+							bSame = Sent[First + Index].Opcode == NetFrame->Commands[Index].Opcode && Sent[First + Index].Payload == NetFrame->Commands[Index].Payload;
+						}
+						if (!bSame)
+						{
+							UE_LOG(LogInputBench, Error, TEXT("%d%% loss: frame %d arrived changed or out of order"), LossPercent, (int32)NetFrame->Sequence);
+							return false;
+						}
+						LastFrame = FrameIndex;
+						for (int32 Index = First; Index < End; ++Index)
+						{
+							AddedLatency.Record((uint64)((ArrivalSeconds - DispatchSeconds[FrameIndex] - OneWaySeconds) * 1e6));
+						}
+					}
+				}
+			}
+
+			const uint64 Arrived = AddedLatency.GetCount();
+			const FString Prefix = FString::Printf(TEXT("net.loss%d"), LossPercent);
+			Report.Add(*(Prefix + TEXT(".bytes_per_s")), PacketBits / 8.0 / Settings.NetSeconds);
+			Report.Add(*(Prefix + TEXT(".packets_per_s")), Packets / Settings.NetSeconds);
+			Report.Add(*(Prefix + TEXT(".bits_per_packet")), PacketBits / (double)FMath::Max(Packets, 1));
+			Report.Add(*(Prefix + TEXT(".commands_delivered_pct")), 100.0 * Arrived / FMath::Max(Sent.Num(), 1));
+			Report.Add(*(Prefix + TEXT(".frames_recovered")), (double)Receiver.GetFramesRecovered());
+			Report.AddHistogram(*(Prefix + TEXT(".added_latency_us")), AddedLatency);
+			if (LossPercent == 0 && Arrived != (uint64)Sent.Num())
+			{
+				UE_LOG(LogInputBench, Error, TEXT("%llu of %d commands arrived without packet loss"), Arrived, Sent.Num());
+				bPassed = false;
+			}
+		}
+		return bPassed;
+	}
+
+	/** What one stream did through one transport */
+	struct FTransportRun
+	{
+		uint64 GesturesSent = 0;
+		uint64 GesturesParsed = 0;
+		uint64 BytesParsed = 0;
+		/** First write to the last byte parsed */
+		double Seconds = 0.0;
+		/** FArduinoUdpTransport only */
+		uint64 Datagrams = 0;
+		uint64 ReceiveCalls = 0;
+		FLatencyHistogram WriteToRead;
+		FLatencyHistogram WriteToParse;
+	};
+
+	/** Stream Settings from a fresh virtual Arduino through SerialPort on a pty, or FArduinoUdpTransport on loopback, and parse it all
+	* Without bMeasureLatency the write stamps are thrown away unread: a flood loses datagrams, and their stamps would be paired with the wrong gestures */
+	static bool RunTransportStream(bool bUdp, const FSettings& Settings, const FSyntheticStreamSettings& Stream, bool bMeasureLatency, FTransportRun& Run)
+	{
+		FVirtualArduino Arduino;
+		SerialPort Port;
+		FArduinoUdpTransport Udp;
+		IArduinoTransport* Transport = nullptr;
+		if (bUdp)
+		{
+			FArduinoUdpSettings UdpSettings;
+			UdpSettings.Port = 0;
+			UdpSettings.BindAddress = TEXT("127.0.0.1");
+			if (!Udp.Open(UdpSettings) || !Arduino.OpenUdp(Udp.GetBoundPort()))
+			{
+				UE_LOG(LogInputBench, Error, TEXT("Cannot open a loopback UDP port"));
+				return false;
+			}
+			Transport = &Udp;
+		}
+		else
+		{
+			if (!Arduino.Open() || !Port.InitPort(Arduino.GetDevicePath(), (uint32)Settings.BaudRate, 'N', 8, 1, EV_RXCHAR))
+			{
+				UE_LOG(LogInputBench, Error, TEXT("Cannot open a pseudo-terminal"));
+				return false;
+			}
+			if (!(Settings.bSharedIOThread ? SerialPortSet::Get().AddPort(&Port) : Port.OpenListenThread()))
+			{
+				UE_LOG(LogInputBench, Error, TEXT("Cannot start reading %s"), ANSI_TO_TCHAR(Arduino.GetDevicePath()));
+				return false;
+			}
+			Transport = &Port;
+		}
+		if (!Arduino.Start(Stream))
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Cannot start the virtual Arduino"));
+			SerialPortSet::Get().RemovePort(&Port);
+			return false;
+		}
+
+		// Parse as soon as anything is there, this measures the transport and not a frame rate
+		GestureParser Parser;
+		TArray<EArduinoOpcode> Gestures;
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		uint64 LastParseCycles = StartCycles;
+		uint64 DrainDeadline = 0;
+		for (;;)
+		{
+			if (!bMeasureLatency)
+			{
+				while (Arduino.SentCycles.Pop())
+				{
+				}
+			}
+
+			const char* pData = nullptr;
+			uint64 ReadCycles = 0;
+			int Count;
+			bool bParsed = false;
+			while ((Count = Transport->PeekContiguousFromQueue(pData, ReadCycles)) > 0)
+			{
+				Gestures.Reset();
+				Parser.Parse(pData, Count, Gestures);
+				Transport->RemoveCharsFromQueue(Count);
+				LastParseCycles = FPlatformTime::Cycles64();
+				Run.BytesParsed += Count;
+				Run.GesturesParsed += Gestures.Num();
+				bParsed = true;
+
+				uint64 SentCycles = 0;
+				for (int32 i = 0; i < Gestures.Num() && bMeasureLatency && Arduino.SentCycles.Peek(SentCycles); ++i)
+				{
+					Arduino.SentCycles.Pop();
+					Run.WriteToParse.Record(CyclesToMicros(LastParseCycles - SentCycles));
+					if (ReadCycles >= SentCycles)
+					{
+						Run.WriteToRead.Record(CyclesToMicros(ReadCycles - SentCycles));
+					}
+				}
+			}
+
+			// Once the writer is done, give the last bytes up to a second to come through. Lost datagrams never do
+			const uint64 Now = FPlatformTime::Cycles64();
+			if (Arduino.IsFinished())
+			{
+				if (DrainDeadline == 0)
+				{
+					DrainDeadline = Now + (uint64)(1.0 / FPlatformTime::GetSecondsPerCycle64());
+				}
+				if (Run.GesturesParsed >= Arduino.GetGesturesSent() || Now > DrainDeadline)
+				{
+					break;
+				}
+			}
+			if (!bParsed)
+			{
+				FPlatformProcess::YieldThread();
+			}
+		}
+		Run.Seconds = FPlatformTime::ToSeconds64(LastParseCycles - StartCycles);
+		Run.GesturesSent = Arduino.GetGesturesSent();
+		Run.Datagrams = Udp.GetDatagramsReceived();
+		Run.ReceiveCalls = Udp.GetReceiveCalls();
+
+		SerialPortSet::Get().RemovePort(&Port);
+		Port.CloseListenTread();
+		Udp.Close();
+		Arduino.Close();
+		return true;
+	}
+
+	/** Serial on a pty against UDP on loopback, paced and then flooded */
+	static bool RunTransportBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		FSyntheticStreamSettings Flood = Settings.Stream;
+		Flood.GesturesPerSecond = 1e9;
+		Flood.BurstSize = 256;
+		Flood.DurationSeconds = Settings.TransportSeconds;
+
+		bool bPassed = true;
+		for (int32 Index = 0; Index < 2; ++Index)
+		{
+			const bool bUdp = Index == 1;
+			const TCHAR* Name = bUdp ? TEXT("udp") : TEXT("serial");
+			FTransportRun Paced;
+			FTransportRun Flooded;
+			if (!RunTransportStream(bUdp, Settings, Settings.Stream, true, Paced) || !RunTransportStream(bUdp, Settings, Flood, false, Flooded))
+			{
+				bPassed = false;
+				continue;
+			}
+
+			UE_LOG(LogInputBench, Display, TEXT("Transport %s, %.0f gestures/s in bursts of %d, then %.1f s flooded:"),
+				bUdp ? TEXT("UDP on loopback") : TEXT("serial on a pty"), Settings.Stream.GesturesPerSecond, Settings.Stream.BurstSize, Settings.TransportSeconds);
+			const FString Prefix = FString::Printf(TEXT("transport.%s"), Name);
+			Report.Add(*(Prefix + TEXT(".gestures_per_s")), Paced.GesturesParsed / FMath::Max(Paced.Seconds, 1e-9));
+			Report.AddHistogram(*(Prefix + TEXT(".write_to_read_us")), Paced.WriteToRead);
+			Report.AddHistogram(*(Prefix + TEXT(".write_to_parse_us")), Paced.WriteToParse);
+			Report.Add(*(Prefix + TEXT(".flood_mb_per_s")), Flooded.BytesParsed / FMath::Max(Flooded.Seconds, 1e-9) / (1024.0 * 1024.0));
+			Report.Add(*(Prefix + TEXT(".flood_gestures_per_s")), Flooded.GesturesParsed / FMath::Max(Flooded.Seconds, 1e-9));
+			Report.Add(*(Prefix + TEXT(".flood_delivered_pct")), 100.0 * Flooded.GesturesParsed / FMath::Max<uint64>(Flooded.GesturesSent, 1));
+			if (bUdp)
+			{
+				Report.Add(*(Prefix + TEXT(".flood_datagrams_per_call")), (double)Flooded.Datagrams / FMath::Max<uint64>(Flooded.ReceiveCalls, 1));
+			}
+
+			if (Paced.GesturesParsed != Paced.GesturesSent)
+			{
+				UE_LOG(LogInputBench, Error, TEXT("%s lost %lld gestures of the paced stream"), Name, (int64)Paced.GesturesSent - (int64)Paced.GesturesParsed);
+				bPassed = false;
+			}
+		}
+		return bPassed;
+	}
+
+	/** Virtual Arduino -> pty -> SerialPort -> GestureParser, drained at TickHz */
+	static bool RunPipelineBenchmark(const FSettings& Settings, FReport& Report)
+	{
+		FVirtualArduino Arduino;
+		if (!Arduino.Open())
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Cannot create a pseudo-terminal"));
+			return false;
+		}
+
+		SerialPort Port;
+		if (!Port.InitPort(Arduino.GetDevicePath(), (uint32)Settings.BaudRate, 'N', 8, 1, EV_RXCHAR))
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Cannot open %s"), ANSI_TO_TCHAR(Arduino.GetDevicePath()));
+			return false;
+		}
+		const bool bReading = Settings.bSharedIOThread ? SerialPortSet::Get().AddPort(&Port) : Port.OpenListenThread();
+		if (!bReading || !Arduino.Start(Settings.Stream))
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Cannot start reading %s"), ANSI_TO_TCHAR(Arduino.GetDevicePath()));
+			SerialPortSet::Get().RemovePort(&Port);
+			return false;
+		}
+
+		// Depth is in chars, the histogram does not care about the unit
+		FLatencyHistogram QueueDepth;
+		FLatencyHistogram WriteToRead;
+		FLatencyHistogram ReadToParse;
+		FLatencyHistogram WriteToParse;
+		GestureParser Parser;
+		TArray<EArduinoOpcode> Gestures;
+		uint64 ParsedGestures = 0;
+
+		const uint64 TickCycles = (uint64)(1.0 / (Settings.TickHz * FPlatformTime::GetSecondsPerCycle64()));
+		const uint64 StartCycles = FPlatformTime::Cycles64();
+		uint64 NextTick = StartCycles;
+		uint64 DrainDeadline = 0;
+		for (;;)
+		{
+			const uint64 Now = FPlatformTime::Cycles64();
+			if (Now < NextTick)
+			{
+				FPlatformProcess::Sleep(FMath::Max(0.0f, (float)FPlatformTime::ToSeconds64(NextTick - Now) - 0.0005f));
+				continue;
+			}
+			NextTick += TickCycles;
+
+			QueueDepth.Record((uint64)Port.SizeOfMessageQueue());
+
+			const char* pData = nullptr;
+			uint64 ReadCycles = 0;
+			int Count;
+			while ((Count = Port.PeekContiguousFromQueue(pData, ReadCycles)) > 0)
+			{
+				Gestures.Reset();
+				Parser.Parse(pData, Count, Gestures);
+				Port.RemoveCharsFromQueue(Count);
+
+				const uint64 ParseCycles = FPlatformTime::Cycles64();
+				for (int32 i = 0; i < Gestures.Num(); ++i)
+				{
+					uint64 SentCycles = 0;
+					if (Arduino.SentCycles.Peek(SentCycles))
+					{
+						Arduino.SentCycles.Pop();
+						WriteToParse.Record(CyclesToMicros(ParseCycles - SentCycles));
+						if (ReadCycles >= SentCycles)
+						{
+							WriteToRead.Record(CyclesToMicros(ReadCycles - SentCycles));
+						}
+					}
+					if (ReadCycles != 0)
+					{
+						ReadToParse.Record(CyclesToMicros(ParseCycles - ReadCycles));
+					}
+				}
+				ParsedGestures += Gestures.Num();
+			}
+
+			// Once the writer is done, give the last bytes up to a second to come through
+			if (Arduino.IsFinished())
+			{
+				if (DrainDeadline == 0)
+				{
+					DrainDeadline = Now + (uint64)(1.0 / FPlatformTime::GetSecondsPerCycle64());
+				}
+				if (ParsedGestures >= Arduino.GetGesturesSent() || Now > DrainDeadline)
+				{
+					break;
+				}
+			}
+		}
+		const double Seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+
+		SerialPortSet::Get().RemovePort(&Port);
+		Port.CloseListenTread();
+		Arduino.Close();
+
+		const uint64 SentGestures = Arduino.GetGesturesSent();
+		UE_LOG(LogInputBench, Display, TEXT("Pipeline, %.1f s at %.0f gestures/s, bursts of %d, drained at %.0f Hz, %s:"),
+			Settings.Stream.DurationSeconds, Settings.Stream.GesturesPerSecond, Settings.Stream.BurstSize, Settings.TickHz,
+			Settings.bSharedIOThread ? TEXT("shared I/O thread") : TEXT("own listen thread"));
+		Report.Add(TEXT("pipeline.gestures_sent"), (double)SentGestures);
+		Report.Add(TEXT("pipeline.gestures_parsed"), (double)ParsedGestures);
+		Report.Add(TEXT("pipeline.gestures_per_s"), ParsedGestures / FMath::Max(Seconds, 1e-9));
+		Report.Add(TEXT("pipeline.bytes_per_s"), Arduino.GetBytesSent() / FMath::Max(Seconds, 1e-9));
+		Report.AddHistogram(TEXT("pipeline.queue_depth_chars"), QueueDepth);
+		Report.AddHistogram(TEXT("latency.write_to_read_us"), WriteToRead);
+		Report.AddHistogram(TEXT("latency.read_to_parse_us"), ReadToParse);
+		Report.AddHistogram(TEXT("latency.write_to_parse_us"), WriteToParse);
+
+		bool bPassed = true;
+		if (ParsedGestures != SentGestures)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Lost %lld gestures"), (int64)SentGestures - (int64)ParsedGestures);
+			bPassed = false;
+		}
+		if (Settings.MaxP99Micros > 0.0 && WriteToParse.GetPercentile(99.0) > Settings.MaxP99Micros)
+		{
+			UE_LOG(LogInputBench, Error, TEXT("Write to parse p99 of %llu us is over the %.0f us limit"), WriteToParse.GetPercentile(99.0), Settings.MaxP99Micros);
+			bPassed = false;
+		}
+		return bPassed;
+	}
+}
+
+INT32_MAIN_INT32_ARGC_TCHAR_ARGV()
+{
+	GEngineLoop.PreInit(ArgC, ArgV);
+
+	const InputBench::FSettings Settings = InputBench::ParseSettings(FCommandLine::Get());
+	InputBench::FReport Report;
+
+	bool bPassed = InputBench::RunParserBenchmark(Settings, Report);
+	bPassed = InputBench::RunLegacyParserBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunSpscBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunAllocationBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunComboBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunAnalogBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunOpenCloseBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunOutputBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunDiscoveryBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunNetFramesBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunTransportBenchmark(Settings, Report) && bPassed;
+	bPassed = InputBench::RunPipelineBenchmark(Settings, Report) && bPassed;
+
+	if (!Settings.CsvFile.IsEmpty() && !FFileHelper::SaveStringToFile(Report.Csv, *Settings.CsvFile))
+	{
+		UE_LOG(LogInputBench, Error, TEXT("Cannot write %s"), *Settings.CsvFile);
+		bPassed = false;
+	}
+
+	FEngineLoop::AppExit();
+	return bPassed ? 0 : 1;
+}
@@ -0,0 +1,336 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#include "VirtualArduino.h"
+#include "ArduinoProtocol.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/RunnableThread.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pty.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+FVirtualArduino::FVirtualArduino()
+	: MasterFd(-1)
+	, SlaveFd(-1)
+	, UdpFd(-1)
+	, bFirmware(false)
+	, Thread(nullptr)
+	, bStopping(false)
+	, bFinished(false)
+	, GesturesSent(0)
+	, BytesSent(0)
+{
+	DevicePath[0] = 0;
+}
+
+FVirtualArduino::~FVirtualArduino()
+{
+	Close();
+}
+
+bool FVirtualArduino::Open()
+{
+	// Keep the slave open for the whole run, otherwise the master sees a hang-up between SerialPort opens
+	if (openpty(&MasterFd, &SlaveFd, DevicePath, nullptr, nullptr) != 0)
+	{
+		MasterFd = SlaveFd = -1;
+		return false;
+	}
+	return true;
+}
+
+bool FVirtualArduino::OpenUdp(uint16 Port)
+{
+	UdpFd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (UdpFd == -1)
+	{
+		return false;
+	}
+
+	// Connected, so a burst is a plain send() and goes nowhere else
+	sockaddr_in To;
+	memset(&To, 0, sizeof(To));
+	To.sin_family = AF_INET;
+	To.sin_port = htons(Port);
+	To.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(UdpFd, (const sockaddr*)&To, sizeof(To)) != 0)
+	{
+		close(UdpFd);
+		UdpFd = -1;
+		return false;
+	}
+	return true;
+}
+
+int32 FVirtualArduino::ReadFromHost(uint8* Out, int32 Capacity, int32 TimeoutMs)
+{
+	pollfd Fd;
+	Fd.fd = MasterFd;
+	Fd.events = POLLIN;
+	Fd.revents = 0;
+	if (MasterFd == -1 || poll(&Fd, 1, TimeoutMs) <= 0 || (Fd.revents & POLLIN) == 0)
+	{
+		return 0;
+	}
+	const ssize_t Result = read(MasterFd, Out, Capacity);
+	return Result > 0 ? (int32)Result : 0;
+}
+
+bool FVirtualArduino::Start(const FSyntheticStreamSettings& InSettings)
+{
+	if ((MasterFd == -1 && UdpFd == -1) || Thread != nullptr)
+	{
+		return false;
+	}
+
+	Settings = InSettings;
+	Settings.GesturesPerSecond = FMath::Max(Settings.GesturesPerSecond, 1.0);
+	Settings.BurstSize = FMath::Max(Settings.BurstSize, 1);
+	bFirmware = false;
+	bStopping = false;
+	bFinished = false;
+	Thread = FRunnableThread::Create(this, TEXT("VirtualArduino"), 0, TPri_AboveNormal);
+	return Thread != nullptr;
+}
+
+bool FVirtualArduino::StartFirmware(const FVirtualFirmwareSettings& InFirmware)
+{
+	if (MasterFd == -1 || Thread != nullptr)
+	{
+		return false;
+	}
+
+	Firmware = InFirmware;
+	bFirmware = true;
+	bStopping = false;
+	bFinished = false;
+	Thread = FRunnableThread::Create(this, TEXT("VirtualFirmware"), 0, TPri_AboveNormal);
+	return Thread != nullptr;
+}
+
+void FVirtualArduino::Close()
+{
+	if (Thread != nullptr)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+	if (MasterFd != -1)
+	{
+		close(MasterFd);
+		MasterFd = -1;
+	}
+	if (SlaveFd != -1)
+	{
+		close(SlaveFd);
+		SlaveFd = -1;
+	}
+	if (UdpFd != -1)
+	{
+		close(UdpFd);
+		UdpFd = -1;
+	}
+}
+
+int32 FVirtualArduino::AppendGesture(FRandomStream& Random, double JumpRatio, char* Out)
+{
+	if (Random.GetFraction() < JumpRatio)
+	{
+		Out[0] = 'J';
+		return 1;
+	}
+
+	// Either foot may land first, the parser accepts both orders
+	const bool bLeftFirst = Random.GetFraction() < 0.5f;
+	Out[0] = bLeftFirst ? 'L' : 'R';
+	Out[1] = bLeftFirst ? 'R' : 'L';
+	return 2;
+}
+
+uint32 FVirtualArduino::Run()
+{
+	if (bFirmware)
+	{
+		return RunFirmware();
+	}
+
+	FRandomStream Random(Settings.RandomSeed);
+	TArray<char> Burst;
+	Burst.SetNumUninitialized(Settings.BurstSize * 2 + 2);
+
+	const double SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+	const double BurstInterval = Settings.BurstSize / Settings.GesturesPerSecond;
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	double NextBurst = 0.0;
+
+	while (!bStopping.load(std::memory_order_acquire) && NextBurst < Settings.DurationSeconds)
+	{
+		// Sleep through most of the gap and yield for the rest, so bursts stay on schedule at high rates
+		const double Now = (FPlatformTime::Cycles64() - StartCycles) * SecondsPerCycle;
+		if (Now >= Settings.DurationSeconds)
+		{
+			// Behind schedule, a flood always is: the stream lasts DurationSeconds, not the bursts it had planned
+			break;
+		}
+		if (Now < NextBurst)
+		{
+			if (NextBurst - Now > 0.002)
+			{
+				FPlatformProcess::Sleep((float)(NextBurst - Now - 0.001));
+			}
+			else
+			{
+				FPlatformProcess::YieldThread();
+			}
+			continue;
+		}
+
+		int32 Length = 0;
+		for (int32 i = 0; i < Settings.BurstSize; ++i)
+		{
+			Length += AppendGesture(Random, Settings.JumpRatio, Burst.GetData() + Length);
+		}
+		if (Settings.bPadding)
+		{
+			Burst[Length++] = '\r';
+			Burst[Length++] = '\n';
+		}
+
+		// Wait for the consumer if it is 64k gestures behind rather than lose a stamp
+		while (SentCycles.GetCapacity() - SentCycles.Size() < (uint32)Settings.BurstSize && !bStopping.load(std::memory_order_acquire))
+		{
+			FPlatformProcess::Sleep(0.001f);
+		}
+		const uint64 WriteCycles = FPlatformTime::Cycles64();
+		for (int32 i = 0; i < Settings.BurstSize; ++i)
+		{
+			SentCycles.Push(WriteCycles);
+		}
+
+		// A datagram is sent whole or not at all. One the host had no room for is lost, like on a real network
+		if (UdpFd != -1)
+		{
+			while (send(UdpFd, Burst.GetData(), Length, 0) < 0 && errno == EINTR)
+			{
+			}
+		}
+
+		int32 Written = UdpFd != -1 ? Length : 0;
+		while (Written < Length)
+		{
+			const ssize_t Result = write(MasterFd, Burst.GetData() + Written, Length - Written);
+			if (Result > 0)
+			{
+				Written += (int32)Result;
+			}
+			else if (Result < 0 && errno != EINTR && errno != EAGAIN)
+			{
+				bStopping = true;
+				break;
+			}
+		}
+
+		GesturesSent.fetch_add(Settings.BurstSize, std::memory_order_release);
+		BytesSent.fetch_add(Length, std::memory_order_release);
+		NextBurst += BurstInterval;
+	}
+
+	bFinished.store(true, std::memory_order_release);
+	return 0;
+}
+
+bool FVirtualArduino::IsAtFirmwareRate() const
+{
+	// The master reports the slave's termios, so this is the rate SerialPort configured
+	termios Tty;
+	if (tcgetattr(MasterFd, &Tty) != 0)
+	{
+		return false;
+	}
+	switch (Firmware.BaudRate)
+	{
+	case 9600: return cfgetospeed(&Tty) == B9600;
+	case 19200: return cfgetospeed(&Tty) == B19200;
+	case 57600: return cfgetospeed(&Tty) == B57600;
+	case 115200: return cfgetospeed(&Tty) == B115200;
+	case 230400: return cfgetospeed(&Tty) == B230400;
+	case 1000000: return cfgetospeed(&Tty) == B1000000;
+	default: return false;
+	}
+}
+
+void FVirtualArduino::WriteAll(const uint8* Data, int32 Length)
+{
+	int32 Written = 0;
+	while (Written < Length)
+	{
+		const ssize_t Result = write(MasterFd, Data + Written, Length - Written);
+		if (Result > 0)
+		{
+			Written += (int32)Result;
+		}
+		else if (Result < 0 && errno != EINTR && errno != EAGAIN)
+		{
+			return;
+		}
+	}
+}
+
+uint32 FVirtualArduino::RunFirmware()
+{
+	FArduinoFrameParser Parser;
+	TArray<FArduinoFrame> Frames;
+	uint8 Rx[256];
+	uint8 Sequence = 0;
+	double NextGesture = FPlatformTime::Seconds();
+	while (!bStopping.load(std::memory_order_acquire))
+	{
+		const int32 Read = ReadFromHost(Rx, sizeof(Rx), 5);
+		const bool bAtRate = IsAtFirmwareRate();
+		if (Firmware.bSilent)
+		{
+			continue;
+		}
+
+		// At a wrong rate the host's bytes are garbled, there is nothing to answer
+		if (Firmware.bBinary && Read > 0 && bAtRate)
+		{
+			Frames.Reset();
+			Parser.Parse(reinterpret_cast<const char*>(Rx), Read, Frames);
+			for (const FArduinoFrame& Frame : Frames)
+			{
+				if (Frame.Type == EArduinoFrameType::Hello)
+				{
+					const uint8 Payload[3] = { 1, (uint8)Firmware.FirmwareId, (uint8)(Firmware.FirmwareId >> 8) };
+					uint8 Reply[ArduinoProtocol::MaxEncodedFrame + 1];
+					WriteAll(Reply, FArduinoFrameParser::BuildFrame(Sequence++, EArduinoFrameType::Hello, Payload, sizeof(Payload), Reply));
+				}
+			}
+		}
+
+		// Old firmware talks whenever a player moves, which here is every 20 ms
+		if (!Firmware.bBinary && FPlatformTime::Seconds() >= NextGesture)
+		{
+			NextGesture += 0.02;
+			static const uint8 Step[] = { 'L', 'R', '\r', '\n' };
+			// What 9600 baud letters look like to a UART at another rate
+			static const uint8 Noise[] = { 0xf8, 0x80, 0x00, 0xfe };
+			WriteAll(bAtRate ? Step : Noise, 4);
+		}
+	}
+	bFinished.store(true, std::memory_order_release);
+	return 0;
+}
+
+void FVirtualArduino::Stop()
+{
+	bStopping.store(true, std::memory_order_release);
+}
@@ -0,0 +1,124 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "Math/RandomStream.h"
+#include "SpscRingBuffer.h"
+#include <atomic>
+
+class FRunnableThread;
+
+/** Shape of the synthetic gesture stream */
+struct FSyntheticStreamSettings
+{
+	/** Average gestures per second */
+	double GesturesPerSecond = 500.0;
+
+	/** Gestures written together in one write(), bursts are spaced to keep the average rate */
+	int32 BurstSize = 1;
+
+	/** Share of gestures that are jumps, the rest are run steps ("LR" or "RL") */
+	double JumpRatio = 0.25;
+
+	/** Follow each burst with "\r\n" like the firmware's Serial.println */
+	bool bPadding = true;
+
+	/** Stop after this many seconds */
+	double DurationSeconds = 5.0;
+
+	int32 RandomSeed = 1;
+};
+
+/** How a fake board answers discovery probes, see FVirtualArduino::StartFirmware */
+struct FVirtualFirmwareSettings
+{
+	/** The only rate the fake understands. At any other rate it hears noise and sends noise, like a real board */
+	uint32 BaudRate = 9600;
+
+	/** Answer Hello frames like binary firmware. Otherwise stream gesture letters like old firmware */
+	bool bBinary = true;
+
+	/** Reported in the Hello reply */
+	uint16 FirmwareId = 1;
+
+	/** Send nothing and answer nothing, like a serial device that is not ours */
+	bool bSilent = false;
+};
+
+/** Fake Arduino on a pseudo-terminal
+*
+* Open creates a pty pair; SerialPort opens the slave side by name exactly
+* like a real /dev/ttyACM device, while a writer thread plays the board on
+* the master side. The write time of every gesture is queued in order, so
+* the consumer can pop one per parsed gesture and get the end-to-end
+* latency without any timestamp on the wire.
+*
+* OpenUdp plays a board on Wi-Fi instead: every burst goes out as one
+* datagram to a local UDP port.
+*/
+class FVirtualArduino : public FRunnable
+{
+public:
+	FVirtualArduino();
+	virtual ~FVirtualArduino();
+
+	/** Create the pty pair. Returns false if the platform has no ptys */
+	bool Open();
+
+	/** Send the stream to 127.0.0.1:Port, one datagram per burst, instead of opening a pty. Start only, no firmware */
+	bool OpenUdp(uint16 Port);
+
+	/** Device path SerialPort should open, valid after Open */
+	const char* GetDevicePath() const { return DevicePath; }
+
+	/** Read what the host wrote to the board, waiting up to TimeoutMs for the first byte. Returns the number of bytes */
+	int32 ReadFromHost(uint8* Out, int32 Capacity, int32 TimeoutMs);
+
+	/** Start writing the stream on a thread of its own */
+	bool Start(const FSyntheticStreamSettings& InSettings);
+
+	/** Play a board being probed instead, on a thread of its own, until Close */
+	bool StartFirmware(const FVirtualFirmwareSettings& InFirmware);
+
+	/** Wait for the writer to finish (or stop it early) and close the pty */
+	void Close();
+
+	bool IsFinished() const { return bFinished.load(std::memory_order_acquire); }
+	uint64 GetGesturesSent() const { return GesturesSent.load(std::memory_order_acquire); }
+	uint64 GetBytesSent() const { return BytesSent.load(std::memory_order_acquire); }
+
+	/** FPlatformTime::Cycles64() right before each gesture was written, in stream order */
+	TSpscRingBuffer<uint64, 1 << 16> SentCycles;
+
+	/** Append one random gesture (and nothing else) to Out, returns the number of chars */
+	static int32 AppendGesture(FRandomStream& Random, double JumpRatio, char* Out);
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+private:
+	/** Thread body of StartFirmware */
+	uint32 RunFirmware();
+	/** True while the host has the pty set to Firmware.BaudRate */
+	bool IsAtFirmwareRate() const;
+	void WriteAll(const uint8* Data, int32 Length);
+
+	FSyntheticStreamSettings Settings;
+	FVirtualFirmwareSettings Firmware;
+	bool bFirmware;
+
+	int MasterFd;
+	int SlaveFd;
+	/** Connected UDP socket of OpenUdp, -1 on a pty */
+	int UdpFd;
+	char DevicePath[64];
+
+	FRunnableThread* Thread;
+	std::atomic<bool> bStopping;
+	std::atomic<bool> bFinished;
+	std::atomic<uint64> GesturesSent;
+	std::atomic<uint64> BytesSent;
+};
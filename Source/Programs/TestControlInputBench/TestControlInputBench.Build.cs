@@ -0,0 +1,17 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+
+public class TestControlInputBench : ModuleRules
+{
+	public TestControlInputBench(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PublicIncludePaths.Add("Runtime/Launch/Public");
+		PrivateIncludePaths.Add("Runtime/Launch/Private");
+
+		PrivateDependencyModuleNames.AddRange(new string[] { "Core", "Projects", "ArduinoInputCore" });
+
+		// openpty() for the virtual Arduino
+		PublicAdditionalLibraries.Add("util");
+	}
+}
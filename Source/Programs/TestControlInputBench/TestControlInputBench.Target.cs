@@ -0,0 +1,24 @@
+// Copyright 1998-2019 Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+using System.Collections.Generic;
+
+[SupportedPlatforms("Linux")]
+public class TestControlInputBenchTarget : TargetRules
+{
+	public TestControlInputBenchTarget(TargetInfo Target) : base(Target)
+	{
+		Type = TargetType.Program;
+		LinkType = TargetLinkType.Monolithic;
+		LaunchModuleName = "TestControlInputBench";
+
+		// Headless console tool: Core and ArduinoInputCore only, no engine, no UObjects
+		bBuildDeveloperTools = false;
+		bCompileAgainstEngine = false;
+		bCompileAgainstCoreUObject = false;
+		bCompileAgainstApplicationCore = false;
+		bCompileICU = false;
+		bCompileWithPluginSupport = false;
+		bIsBuildingConsoleApplication = true;
+	}
+}
@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoComboSet.h"
+
+TArray<FArduinoComboPattern> UArduinoComboSet::MakePatterns() const {
+	TArray<FArduinoComboPattern> patterns;
+	patterns.Reserve(Combos.Num());
+	for (int32 index = 0; index < Combos.Num(); ++index) {
+		const FArduinoComboDefinition& combo = Combos[index];
+		FArduinoComboPattern& pattern = patterns.AddDefaulted_GetRef();
+		pattern.Sequence = combo.Sequence;
+		pattern.WindowSeconds = combo.WithinSeconds;
+		switch (combo.Action) {
+		case EArduinoComboAction::RunStep:
+			pattern.Opcode = EArduinoOpcode::Run;
+			pattern.Payload = 1;
+			break;
+		case EArduinoComboAction::Jump:
+			pattern.Opcode = EArduinoOpcode::Jump;
+			break;
+		default:
+			pattern.Opcode = EArduinoOpcode::Combo;
+			pattern.Payload = (int16)index;
+			break;
+		}
+	}
+	return patterns;
+}
@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "ArduinoComboRecognizer.h"
+#include "ArduinoComboSet.generated.h"
+
+/** What a recognized combo turns into */
+UENUM(BlueprintType)
+enum class EArduinoComboAction : uint8
+{
+	/** UArduinoInput::OnCombo with the combo's Name */
+	Event,
+	/** One running step, like "LR" */
+	RunStep,
+	/** A jump, like "J" */
+	Jump,
+};
+
+USTRUCT(BlueprintType)
+struct FArduinoComboDefinition
+{
+	GENERATED_BODY()
+
+	/** Passed to UArduinoInput::OnCombo */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Combo")
+	FName Name;
+
+	/** Letters in the order the board sends them, e.g. "L,R,L,R" for a sprint or "L,R,J" for a jump while running */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Combo")
+	FString Sequence;
+
+	/** Longest time from the first letter to the last, 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Combo", meta = (ClampMin = "0"))
+	float WithinSeconds = 0.6f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Combo")
+	EArduinoComboAction Action = EArduinoComboAction::Event;
+};
+
+/** Combos recognized in the legacy gesture stream, edited by designers and compiled when the board is opened */
+UCLASS(BlueprintType)
+class TESTCONTROL_API UArduinoComboSet : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	/** Also recognize the built-in run step ("LR"/"RL" within UArduinoInput::StepWindowSeconds) and jump ("J") */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Combo")
+	bool bIncludeDefaultGestures = true;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Combo")
+	TArray<FArduinoComboDefinition> Combos;
+
+	/** Combos as FArduinoComboRecognizer patterns. Event combos carry their index in Combos as payload */
+	TArray<FArduinoComboPattern> MakePatterns() const;
+};
@@ -0,0 +1,549 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoDevice.h"
+#include "ArduinoInputDeviceModule.h"
+#include "ArduinoInputStats.h"
+#include "InputLatencyStats.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Parse.h"
+
+/** Runs UArduinoDevice::AnalyzeInput when the transport queued bytes, so gestures are recognized independently of the frame rate
+*
+* The thread sleeps on the transport's input event while the board is idle,
+* and runs at most RateHz passes a second while bytes keep coming.
+*/
+class FArduinoParseThread : public FRunnable
+{
+public:
+	FArduinoParseThread(UArduinoDevice* InOwner, FEvent* InInputEvent, int32 RateHz)
+		: Owner(InOwner)
+		, InputEvent(InInputEvent)
+		, PeriodCycles((uint64)(1.0 / (FMath::Clamp(RateHz, 1, 10000) * FPlatformTime::GetSecondsPerCycle64())))
+		, Thread(nullptr)
+		, bStopping(false)
+	{
+	}
+
+	virtual ~FArduinoParseThread()
+	{
+		if (Thread != nullptr) {
+			Thread->Kill(true);
+			delete Thread;
+		}
+	}
+
+	bool Start()
+	{
+		Thread = FRunnableThread::Create(this, TEXT("ArduinoParse"), 0, TPri_AboveNormal);
+		return Thread != nullptr;
+	}
+
+	virtual uint32 Run() override
+	{
+		// The first pass takes what was queued before the event was set
+		while (!bStopping) {
+			Owner->AnalyzeInput();
+			const uint64 pass_cycles = FPlatformTime::Cycles64();
+
+			// Auto-reset: bytes queued during the pass leave it triggered, so nothing is missed
+			InputEvent->Wait();
+			if (bStopping) {
+				break;
+			}
+
+			// Only a cap: bytes arriving faster than PeriodCycles are parsed together by the next pass
+			const uint64 elapsed_cycles = FPlatformTime::Cycles64() - pass_cycles;
+			if (elapsed_cycles < PeriodCycles) {
+				FPlatformProcess::Sleep((float)FPlatformTime::ToSeconds64(PeriodCycles - elapsed_cycles));
+			}
+		}
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopping = true;
+		InputEvent->Trigger();
+	}
+
+private:
+	UArduinoDevice* Owner;
+	/** Owned by UArduinoDevice, triggered by the transports */
+	FEvent* InputEvent;
+	const uint64 PeriodCycles;
+	FRunnableThread* Thread;
+	std::atomic<bool> bStopping;
+};
+
+FString FArduinoDeviceSettings::GetDeviceKey() const
+{
+	if (bScripted) {
+		return FString::Printf(TEXT("script:%d"), DeviceId);
+	}
+	const FString replay_file = GetReplayFile();
+	if (!replay_file.IsEmpty()) {
+		return TEXT("replay:") + replay_file;
+	}
+	if (UdpPort > 0) {
+		return FString::Printf(TEXT("udp:%d"), UdpPort);
+	}
+	if (bAutoDiscover) {
+		return FString::Printf(TEXT("auto:%d"), DeviceId);
+	}
+	return DeviceName.IsEmpty() ? FString::Printf(TEXT("port:%d"), Port) : DeviceName;
+}
+
+FString FArduinoDeviceSettings::GetReplayFile() const
+{
+	FString replay_file = ReplayFile;
+	FParse::Value(FCommandLine::Get(), TEXT("ArduinoReplay="), replay_file);
+	return replay_file;
+}
+
+void UArduinoDevice::Start(const FArduinoDeviceSettings& InSettings)
+{
+	check(!bStarted);
+	bStarted = true;
+	settings = InSettings;
+	analog_filters.Configure(settings.AnalogChannels, settings.AnalogFilters);
+	FMemory::Memzero(analog_row, sizeof(analog_row));
+	FString combo_error;
+	if (!combo_recognizer.Compile(settings.Combos, &combo_error)) {
+		UE_LOG(LogTemp, Warning, TEXT("%s, using the default gestures !"), *combo_error);
+		combo_recognizer.Compile(FArduinoComboRecognizer::MakeDefaultPatterns(0.5));
+	}
+
+	if (settings.bSendToInputDevice) {
+		FArduinoInputSource source;
+		source.ControllerId = settings.DeviceId;
+		source.Commands = &command_log;
+		source.AnalogFilters = &analog_filters;
+		FArduinoInputDeviceModule::Get().AddSource(source);
+	}
+
+	// Set before anything receives, whichever transport StartReading picks wakes the parse thread
+	if (settings.bParseOnInputThread) {
+		input_event = FPlatformProcess::GetSynchEventFromPool(false);
+		mySerialPort.SetInputEvent(input_event);
+		udp_transport.SetInputEvent(input_event);
+	}
+
+	// Without a port yet the parse thread sleeps until BindBoard
+	bWaitingForBoard = settings.WaitsForDiscovery();
+	if (!bWaitingForBoard) {
+		StartReading();
+	}
+
+	// Parse on our own thread as bytes arrive, the subsystem's ticker is only kept as the fallback
+	if (input_event != nullptr) {
+		parse_thread = new FArduinoParseThread(this, input_event, settings.ParseRateHz);
+		if (!parse_thread->Start()) {
+			UE_LOG(LogTemp, Warning, TEXT("parse thread fail, parsing every frame !"));
+			delete parse_thread;
+			parse_thread = nullptr;
+		}
+	}
+}
+
+void UArduinoDevice::BindBoard(const FSerialProbeResult& Board)
+{
+	if (!bStarted || !bWaitingForBoard) {
+		return;
+	}
+	bWaitingForBoard = false;
+
+	// Nothing reads these two yet: the parse thread only needs the port once the connector opened it
+	settings.DeviceName = Board.DeviceName;
+	settings.BaudRate = (int32)Board.BaudRate;
+	UE_LOG(LogTemp, Warning, TEXT("Arduino %d bound to %s at %d baud !"), settings.DeviceId, *settings.DeviceName, settings.BaudRate);
+	StartReading();
+}
+
+void UArduinoDevice::Stop()
+{
+	if (!bStarted) {
+		return;
+	}
+	bStarted = false;
+
+	// The input device reads command_log and analog_filters until then
+	if (settings.bSendToInputDevice && FArduinoInputDeviceModule::IsAvailable()) {
+		FArduinoInputDeviceModule::Get().RemoveSource(&command_log);
+	}
+
+	// The parse thread consumes the port queue, stop it before the producers
+	delete parse_thread;
+	parse_thread = nullptr;
+
+	// Stop reading before the device goes away, the I/O thread holds a pointer to mySerialPort
+	session_replay.Reset();
+	port_connector.Close();
+	SerialPortSet::Get().RemovePort(&mySerialPort);
+	mySerialPort.CloseListenTread();
+	output_queue.Close();
+	udp_transport.Close();
+
+	// No thread reads the port any more, so nobody is left to call the recorder or trigger the event
+	mySerialPort.SetRecorder(nullptr);
+	session_recorder.Reset();
+	mySerialPort.SetInputEvent(nullptr);
+	udp_transport.SetInputEvent(nullptr);
+	if (input_event != nullptr) {
+		FPlatformProcess::ReturnSynchEventToPool(input_event);
+		input_event = nullptr;
+	}
+}
+
+void UArduinoDevice::BeginDestroy()
+{
+	Stop();
+
+	Super::BeginDestroy();
+}
+
+void UArduinoDevice::StartReading()
+{
+	// Fed by InjectInput alone
+	if (settings.bScripted) {
+		return;
+	}
+
+	const FString replay_file = settings.GetReplayFile();
+	if (!replay_file.IsEmpty()) {
+		if (StartReplay(replay_file)) {
+			return;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("replay fail, opening the board !"));
+	}
+
+	if (settings.UdpPort > 0) {
+		StartUdp();
+		return;
+	}
+
+	// The board may be missing or unplugged at any time, the connector keeps (re)opening it off the game thread
+	FSerialPortConnectSettings connect_settings;
+	connect_settings.DeviceName = settings.DeviceName;
+	connect_settings.PortNumber = (uint32)settings.Port;
+	connect_settings.BaudRate = (uint32)settings.BaudRate;
+	connect_settings.MaxRetrySeconds = settings.ReconnectMaxSeconds;
+	if (!port_connector.Start(mySerialPort, connect_settings,
+		[this](SerialPort&) { return OnPortOpened(); },
+		[this](SerialPort&) { OnPortLost(); })) {
+		UE_LOG(LogTemp, Warning, TEXT("port connector fail !"));
+	}
+}
+
+bool UArduinoDevice::OnPortOpened() {
+	UE_LOG(LogTemp, Warning, TEXT("initPort success !"));
+	bBinaryLinkActive = false;
+	mySerialPort.SetStripPadding(true);
+	if (settings.Protocol == EArduinoProtocol::Binary) {
+		if (NegotiateBinaryLink()) {
+			UE_LOG(LogTemp, Warning, TEXT("binary link at %d baud !"), settings.BinaryBaudRate);
+		}
+		else {
+			UE_LOG(LogTemp, Warning, TEXT("binary link refused, staying on ASCII at %d baud !"), settings.BaudRate);
+		}
+	}
+	bResetParsers = true;
+
+	// Start recording on the first connection, so the file only holds bytes of the negotiated protocol
+	FString record_file = settings.RecordFile;
+	FParse::Value(FCommandLine::Get(), TEXT("ArduinoRecord="), record_file);
+	if (!record_file.IsEmpty() && !session_recorder.IsValid()) {
+		session_recorder = MakeUnique<FSerialSessionRecorder>();
+		if (session_recorder->Open(record_file, bBinaryLinkActive ? SerialSession::FlagBinaryProtocol : 0)) {
+			mySerialPort.SetRecorder(session_recorder.Get());
+		}
+		else {
+			session_recorder.Reset();
+		}
+	}
+
+	if (settings.bUseSharedIOThread) {
+		if (!SerialPortSet::Get().AddPort(&mySerialPort)) {
+			UE_LOG(LogTemp, Warning, TEXT("AddPort fail !"));
+			return false;
+		}
+		UE_LOG(LogTemp, Warning, TEXT("AddPort success !"));
+	}
+	else if (!mySerialPort.OpenListenThread()) {
+		UE_LOG(LogTemp, Warning, TEXT("OpenListenThread fail !"));
+		return false;
+	}
+	else {
+		UE_LOG(LogTemp, Warning, TEXT("OpenListenThread success !"));
+	}
+
+	// Old firmware would read feedback frames as garbage
+	if (bBinaryLinkActive && !output_queue.Start(mySerialPort, tx_sequence)) {
+		UE_LOG(LogTemp, Warning, TEXT("output queue fail, no feedback !"));
+	}
+	return true;
+}
+
+void UArduinoDevice::OnPortLost() {
+	output_queue.Close();
+	SerialPortSet::Get().RemovePort(&mySerialPort);
+	mySerialPort.CloseListenTread();
+}
+
+void UArduinoDevice::SetLedColor(int32 Led, FColor Color) {
+	output_queue.SetLedColor(Led, Color.R, Color.G, Color.B);
+}
+
+void UArduinoDevice::SetRumble(int32 Motor, float Strength) {
+	output_queue.SetRumble(Motor, (uint8)(FMath::Clamp(Strength, 0.0f, 1.0f) * 255.0f));
+}
+
+void UArduinoDevice::PulseRumble(int32 Motor, float Strength, float Seconds) {
+	const uint16 duration_ms = (uint16)FMath::Clamp(Seconds * 1000.0f, 1.0f, 65535.0f);
+	output_queue.PostPulse(Motor, (uint8)(FMath::Clamp(Strength, 0.0f, 1.0f) * 255.0f), duration_ms);
+}
+
+int32 UArduinoDevice::InjectInput(const char* Data, int32 Length) {
+	if (!settings.bScripted || Length <= 0) {
+		return 0;
+	}
+	return (int32)mySerialPort.InjectInput(Data, (uint32)Length, FPlatformTime::Cycles64());
+}
+
+int32 UArduinoDevice::GetQueuedBytes() {
+	return transport->SizeOfMessageQueue();
+}
+
+bool UArduinoDevice::IsConnected() const {
+	// A board on UDP counts as there once it sent something
+	if (transport == &udp_transport) {
+		return udp_transport.HasPeer() && !udp_transport.IsLost();
+	}
+	return port_connector.IsConnected();
+}
+
+FName UArduinoDevice::GetComboName(int16 Payload) const {
+	return settings.ComboNames.IsValidIndex(Payload) ? settings.ComboNames[Payload] : NAME_None;
+}
+
+bool UArduinoDevice::StartUdp() {
+	FArduinoUdpSettings udp_settings;
+	udp_settings.Port = (uint16)FMath::Clamp(settings.UdpPort, 1, 65535);
+	udp_settings.BoardAddress = settings.UdpBoardAddress;
+	udp_settings.bStripPadding = settings.Protocol != EArduinoProtocol::Binary;
+	if (!udp_transport.Open(udp_settings)) {
+		UE_LOG(LogTemp, Warning, TEXT("UDP port %d fail !"), settings.UdpPort);
+		return false;
+	}
+	UE_LOG(LogTemp, Warning, TEXT("listening on UDP port %d !"), udp_transport.GetBoundPort());
+
+	// Nothing to negotiate: a board on Wi-Fi speaks its protocol from the first datagram.
+	// Nothing parses yet either, the parse thread starts after StartReading
+	transport = &udp_transport;
+	bBinaryLinkActive = settings.Protocol == EArduinoProtocol::Binary;
+	bResetParsers = true;
+
+	// Feedback frames are dropped until the board's first datagram tells where to send them
+	if (bBinaryLinkActive && !output_queue.Start(udp_transport, tx_sequence)) {
+		UE_LOG(LogTemp, Warning, TEXT("output queue fail, no feedback !"));
+	}
+	return true;
+}
+
+bool UArduinoDevice::StartReplay(const FString& filename) {
+	session_replay = MakeUnique<FSerialSessionReplay>();
+	const ESerialReplaySpeed speed = settings.bReplayAsFastAsPossible ? ESerialReplaySpeed::AsFastAsPossible : ESerialReplaySpeed::OriginalTiming;
+	if (!session_replay->Open(filename, mySerialPort, speed)) {
+		session_replay.Reset();
+		return false;
+	}
+
+	// Decode the way the recorded session did
+	bBinaryLinkActive = (session_replay->GetFlags() & SerialSession::FlagBinaryProtocol) != 0;
+	frame_parser.Reset();
+	combo_recognizer.Reset();
+	UE_LOG(LogTemp, Warning, TEXT("replaying %s !"), *filename);
+	return true;
+}
+
+bool UArduinoDevice::NegotiateBinaryLink() {
+	const uint32 baud = (uint32)FMath::Clamp<int32>(settings.BinaryBaudRate, ArduinoProtocol::MinBinaryBaudRate, ArduinoProtocol::MaxBinaryBaudRate);
+	const uint8 payload[4] = { (uint8)baud, (uint8)(baud >> 8), (uint8)(baud >> 16), (uint8)(baud >> 24) };
+	uint8 frame[ArduinoProtocol::MaxEncodedFrame + 1];
+	const int32 frame_length = FArduinoFrameParser::BuildFrame(tx_sequence++, EArduinoFrameType::BaudRequest, payload, sizeof(payload), frame);
+	if (!mySerialPort.WriteData(reinterpret_cast<char*>(frame), frame_length)) {
+		return false;
+	}
+
+	// No reader thread runs yet, so wait for the answer right here. Old firmware never answers
+	const double deadline = FPlatformTime::Seconds() + 0.5;
+	char rx[64];
+	FArduinoFrameParser reply_parser;
+	TArray<FArduinoFrame> replies;
+	while (FPlatformTime::Seconds() < deadline) {
+		const uint32 available = mySerialPort.GetBytesInCOM();
+		uint32 read = 0;
+		if (available == 0 || !mySerialPort.ReadBlock(rx, FMath::Min<uint32>(available, sizeof(rx)), read)) {
+			FPlatformProcess::Sleep(0.001f);
+			continue;
+		}
+
+		replies.Reset();
+		reply_parser.Parse(rx, (int32)read, replies);
+		for (const FArduinoFrame& reply : replies) {
+			if (reply.Type == EArduinoFrameType::BaudAck && reply.PayloadLength >= 4 && reply.ReadUInt32(0) == baud) {
+				if (!mySerialPort.SetBaudRate(baud)) {
+					return false;
+				}
+				mySerialPort.SetStripPadding(false);
+				bBinaryLinkActive = true;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+void UArduinoDevice::AnalyzeInput() {
+	SCOPE_CYCLE_COUNTER(STAT_ArduinoAnalyzeInput);
+	SET_DWORD_STAT(STAT_ArduinoQueueDepth, transport->SizeOfMessageQueue());
+	if (bResetParsers.exchange(false)) {
+		frame_parser.Reset();
+		frame_parser.ResetStats();
+		combo_recognizer.Reset();
+	}
+	if (bBinaryLinkActive) {
+		AnalyzeBinaryInput();
+	}
+	else {
+		AnalyzeLegacyInput();
+	}
+	if (command_log.GetHead() != published_head) {
+		published_head = command_log.GetHead();
+		ScheduleDispatch();
+	}
+}
+
+void UArduinoDevice::ScheduleDispatch() {
+	// One task covers everything queued until it runs
+	if (bDispatchScheduled.exchange(true)) {
+		return;
+	}
+	if (IsInGameThread()) {
+		DispatchCommands();
+		return;
+	}
+
+	// The device may be gone by the time the game thread gets to it
+	TWeakObjectPtr<UArduinoDevice> weak_this(this);
+	FFunctionGraphTask::CreateAndDispatchWhenReady([weak_this]() {
+		if (UArduinoDevice* device = weak_this.Get()) {
+			device->DispatchCommands();
+		}
+	}, TStatId(), nullptr, ENamedThreads::GameThread);
+}
+
+void UArduinoDevice::DispatchCommands() {
+	// Cleared before notifying, so commands published from here on schedule a new task instead of being missed
+	bDispatchScheduled = false;
+	const uint64 start_cycles = FPlatformTime::Cycles64();
+	OnCommandsPublished.Broadcast();
+	FArduinoInputCounters::AddGameThreadCycles(FPlatformTime::Cycles64() - start_cycles);
+}
+
+void UArduinoDevice::AnalyzeBinaryInput() {
+	const char* pData = nullptr;
+	uint64 read_cycles = 0;
+	int length;
+	while ((length = transport->PeekContiguousFromQueue(pData, read_cycles)) > 0) {
+		ARDUINO_TRACE_SCOPE(ArduinoParseBatch);
+		parsed_frames.Reset();
+		frame_parser.Parse(pData, length, parsed_frames);
+		transport->RemoveCharsFromQueue(length);
+
+		const uint64 parse_cycles = FPlatformTime::Cycles64();
+		for (const FArduinoFrame& frame : parsed_frames) {
+			if (frame.Type == EArduinoFrameType::AnalogSamples) {
+				AddAnalogSamples(frame);
+				continue;
+			}
+			if (frame.Type != EArduinoFrameType::Gesture || frame.PayloadLength < 3) {
+				continue;
+			}
+			const EArduinoOpcode opcode = (EArduinoOpcode)frame.Payload[0];
+			if (opcode != EArduinoOpcode::Run && opcode != EArduinoOpcode::Jump) {
+				continue;
+			}
+
+			FArduinoCommand command(opcode, settings.DeviceId, read_cycles, frame.ReadInt16(1));
+			if (read_cycles != 0) {
+				command.ParseDelayCycles = (uint32)FMath::Min<uint64>(parse_cycles - read_cycles, MAX_uint32);
+				FInputLatencyStats::Get().RecordCycles(EInputLatencyStage::ReadToParse, read_cycles, parse_cycles);
+			}
+			FArduinoInputCounters::AddGestures(1);
+			command_log.Publish(command);
+		}
+	}
+
+	// Filter everything this pass received in one batch
+	analog_filters.Process();
+}
+
+void UArduinoDevice::AddAnalogSamples(const FArduinoFrame& frame) {
+	const int32 num_channels = analog_filters.GetNumChannels();
+	const int32 first_channel = frame.PayloadLength > 0 ? frame.Payload[0] : num_channels;
+	const int32 sample_count = (frame.PayloadLength - 1) / 2;
+	for (int32 i = 0; i < sample_count && first_channel + i < num_channels; ++i) {
+		analog_row[first_channel + i] = frame.ReadInt16(1 + i * 2) / 32767.0f;
+	}
+
+	// A sample set is complete with the frame carrying the last channel
+	if (num_channels > 0 && first_channel < num_channels && first_channel + sample_count >= num_channels) {
+		analog_filters.AddSampleSet(analog_row);
+	}
+}
+
+float UArduinoDevice::GetAnalogValue(int32 Channel) const {
+	return analog_filters.GetValue(Channel);
+}
+
+bool UArduinoDevice::IsAnalogPressed(int32 Channel) const {
+	return analog_filters.IsPressed(Channel);
+}
+
+void UArduinoDevice::AnalyzeLegacyInput() {
+	// Drain the whole backlog, not just one gesture per frame. A partial combo (a lone 'L')
+	// stays in the recognizer and completes with the next bytes, if they come within its window
+	// Each span comes from a single read (a serial block, a datagram), so its commands share that read's timestamp
+	const char* pData = nullptr;
+	uint64 read_cycles = 0;
+	int length;
+	while ((length = transport->PeekContiguousFromQueue(pData, read_cycles)) > 0) {
+		ARDUINO_TRACE_SCOPE(ArduinoParseBatch);
+		parsed_combos.Reset();
+		combo_recognizer.Parse(pData, length, read_cycles, parsed_combos);
+		transport->RemoveCharsFromQueue(length);
+		if (parsed_combos.Num() == 0) {
+			continue;
+		}
+		FArduinoInputCounters::AddGestures((uint32)parsed_combos.Num());
+
+		const uint64 parse_cycles = FPlatformTime::Cycles64();
+		for (const FArduinoComboMatch& combo : parsed_combos) {
+			FArduinoCommand command(combo.Opcode, settings.DeviceId, read_cycles, combo.Payload);
+			if (read_cycles != 0) {
+				command.ParseDelayCycles = (uint32)FMath::Min<uint64>(parse_cycles - read_cycles, MAX_uint32);
+				FInputLatencyStats::Get().RecordCycles(EInputLatencyStage::ReadToParse, read_cycles, parse_cycles);
+			}
+			UE_LOG(LogTemp, Verbose, TEXT("%s"), command.ToString());
+			command_log.Publish(command);
+		}
+	}
+}
@@ -0,0 +1,201 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+#include "SerialPort.h"
+#include "SerialPortSet.h"
+#include "ArduinoUdpTransport.h"
+#include "ArduinoComboRecognizer.h"
+#include "ArduinoCommand.h"
+#include "ArduinoProtocol.h"
+#include "AnalogFilterBank.h"
+#include "SerialSession.h"
+#include "SerialPortConnector.h"
+#include "SerialPortDiscovery.h"
+#include "ArduinoOutputQueue.h"
+#include <atomic>
+#include "ArduinoDevice.generated.h"
+
+/** What the board sends over the serial link */
+UENUM(BlueprintType)
+enum class EArduinoProtocol : uint8
+{
+	/** Single gesture letters (L, R, J) at BaudRate, for old firmware */
+	LegacyAscii,
+	/** COBS-framed, CRC-checked binary frames at BinaryBaudRate. Falls back to LegacyAscii if the board does not answer */
+	Binary,
+};
+
+/** How a UArduinoDevice opens and reads its board, see the matching UArduinoInput properties */
+struct FArduinoDeviceSettings
+{
+	uint8 DeviceId = 0;
+	int32 Port = 3;
+	FString DeviceName;
+	int32 BaudRate = 9600;
+	float ReconnectMaxSeconds = 5.0f;
+	EArduinoProtocol Protocol = EArduinoProtocol::LegacyAscii;
+	int32 BinaryBaudRate = 1000000;
+	int32 AnalogChannels = 0;
+	FAnalogFilterSettings AnalogFilters;
+	bool bUseSharedIOThread = true;
+	bool bParseOnInputThread = true;
+	int32 ParseRateHz = 1000;
+	FString RecordFile;
+	FString ReplayFile;
+	bool bReplayAsFastAsPossible = false;
+	bool bSendToInputDevice = true;
+	/** What the legacy stream is matched against, see UArduinoComboSet. Invalid patterns fall back to the default gestures */
+	TArray<FArduinoComboPattern> Combos = FArduinoComboRecognizer::MakeDefaultPatterns(0.5);
+	/** Name of every combo set entry, by the payload of its EArduinoOpcode::Combo commands */
+	TArray<FName> ComboNames;
+	bool bAutoDiscover = false;
+	int32 FirmwareId = 0;
+	/** No board nor replay: the bytes come from UArduinoDevice::InjectInput, for perf runs and tools */
+	bool bScripted = false;
+	/** Datagrams on this local UDP port instead of a serial port, 0 for serial */
+	int32 UdpPort = 0;
+	FString UdpBoardAddress;
+	TArray<int32> DiscoveryBaudRates;
+
+	/** Settings with the same key are the same board: its device name or port number, "auto:<DeviceId>", "script:<DeviceId>", "udp:<UdpPort>" or the replayed file */
+	FString GetDeviceKey() const;
+	/** ReplayFile, or what -ArduinoReplay= overrides it with */
+	FString GetReplayFile() const;
+	/** True when the port is not known yet: UArduinoDeviceSubsystem finds it and calls BindBoard */
+	bool WaitsForDiscovery() const { return bAutoDiscover && UdpPort <= 0 && GetReplayFile().IsEmpty(); }
+};
+
+/** One Arduino board: the port, the parsers and the feedback output, opened once and shared
+*
+* Owned by UArduinoDeviceSubsystem, so it outlives pawns and levels. The
+* bytes are parsed once, on the parse thread, into a command log that
+* every subscriber (UArduinoInput components, the input device) reads
+* through a cursor of its own.
+*/
+UCLASS(BlueprintType)
+class TESTCONTROL_API UArduinoDevice : public UObject
+{
+	GENERATED_BODY()
+
+	friend class FArduinoParseThread;
+
+public:
+	/** Start the replay, or start connecting the board in the background, and start parsing. Never waits for the board */
+	void Start(const FArduinoDeviceSettings& InSettings);
+	/** Game thread: open the board discovery found for a device started with bAutoDiscover */
+	void BindBoard(const FSerialProbeResult& Board);
+	/** True from Start until BindBoard for a device started with bAutoDiscover */
+	bool IsWaitingForBoard() const { return bWaitingForBoard; }
+	/** Stop every thread and close the board. Safe to call twice */
+	void Stop();
+
+	virtual void BeginDestroy() override;
+
+	const FArduinoDeviceSettings& GetSettings() const { return settings; }
+
+	/** Every recognized command, read in place through a cursor */
+	const FArduinoCommandLog& GetCommandLog() const { return command_log; }
+
+	/** Broadcast on the game thread once new commands are in the log, at most once per game thread task */
+	FSimpleMulticastDelegate OnCommandsPublished;
+
+	/** True when the parse thread could not start, AnalyzeInput then has to run every frame on the game thread */
+	bool ParsesOnGameThread() const { return parse_thread == nullptr; }
+
+	/** Turn queued bytes into commands. Runs on the parse thread, or from the subsystem's ticker when there is none */
+	void AnalyzeInput();
+
+	/** True while the board is open, false while it is missing and being retried */
+	bool IsConnected() const;
+
+	/** Filtered value of an analog channel, about -1..1, what the parse thread last published */
+	float GetAnalogValue(int32 Channel) const;
+	bool IsAnalogPressed(int32 Channel) const;
+
+	/** Feedback output, see UArduinoInput */
+	void SetLedColor(int32 Led, FColor Color);
+	void SetRumble(int32 Motor, float Strength);
+	void PulseRumble(int32 Motor, float Strength, float Seconds);
+
+	/** Write counters and queue latency of the feedback output */
+	const FArduinoOutputQueue& GetOutputQueue() const { return output_queue; }
+
+	/** Name of the combo a EArduinoOpcode::Combo command stands for, NAME_None if unknown */
+	FName GetComboName(int16 Payload) const;
+
+	/** Game thread: queue bytes as if the board had sent them, read now. Only for a device started with bScripted, returns how many were queued */
+	int32 InjectInput(const char* Data, int32 Length);
+
+	/** Bytes read and not parsed yet */
+	int32 GetQueuedBytes();
+
+	/** Frame error counters of the binary link */
+	const FArduinoFrameStats& GetFrameStats() const { return frame_parser.GetStats(); }
+
+protected:
+	void StartReading();
+	/** Connector thread, the board was just opened: negotiate the protocol and start reading it. Returns false to retry later */
+	bool OnPortOpened();
+	/** Connector thread (or Stop), the board went away: stop reading it */
+	void OnPortLost();
+	/** Listen on settings.UdpPort instead of opening a serial port. Returns false if the port is taken */
+	bool StartUdp();
+	/** Feed the session file to mySerialPort instead of opening the board. Returns false if it cannot be read */
+	bool StartReplay(const FString& filename);
+	/** Ask the board to switch to the binary protocol at BinaryBaudRate. Returns false (link unchanged) if it does not acknowledge
+	* Runs before anything reads the port, with parsers of its own as the parse thread may be running */
+	bool NegotiateBinaryLink();
+	void AnalyzeLegacyInput();
+	void AnalyzeBinaryInput();
+	/** Store one AnalogSamples frame, and queue the sample set for filtering once all channels are in */
+	void AddAnalogSamples(const FArduinoFrame& frame);
+	/** Called by whoever parses once commands were published: get OnCommandsPublished broadcast on the game thread, at most once until it ran */
+	void ScheduleDispatch();
+	void DispatchCommands();
+
+	FArduinoDeviceSettings settings;
+	bool bStarted = false;
+	bool bWaitingForBoard = false;
+	SerialPort mySerialPort;
+	/** Used instead of mySerialPort when settings.UdpPort is set */
+	FArduinoUdpTransport udp_transport;
+	/** What the parsers read: mySerialPort, or udp_transport once StartUdp opened it */
+	IArduinoTransport* transport = &mySerialPort;
+	/** Gestures and combos of the legacy stream, compiled from settings.Combos */
+	FArduinoComboRecognizer combo_recognizer;
+	/** Scratch list reused by AnalyzeInput, so parsing does not allocate once it has grown */
+	TArray<FArduinoComboMatch> parsed_combos;
+	FArduinoFrameParser frame_parser;
+	/** Scratch list reused by AnalyzeBinaryInput */
+	TArray<FArduinoFrame> parsed_frames;
+	/** True once NegotiateBinaryLink succeeded. Written by the connector thread, read by whoever parses */
+	std::atomic<bool> bBinaryLinkActive{ false };
+	/** Set on every (re)connect, the parser drops half-read gestures and frames of the previous connection */
+	std::atomic<bool> bResetParsers{ false };
+	/** Sequence number of the next frame we send */
+	uint8 tx_sequence = 0;
+	/** Analog channels, fed and filtered by AnalyzeBinaryInput */
+	FAnalogFilterBank analog_filters;
+	/** Latest raw value of every channel, completed frame by frame */
+	float analog_row[FAnalogFilterBank::MaxChannels];
+	/** Recognized commands, published once for every subscriber. Fixed storage, publishing never allocates */
+	FArduinoCommandLog command_log;
+	/** Log head when AnalyzeInput last scheduled a dispatch, parse thread only */
+	uint64 published_head = 0;
+	/** True from ScheduleDispatch until DispatchCommands starts, so a burst costs one game thread task */
+	std::atomic<bool> bDispatchScheduled{ false };
+	/** Set while recording or replaying, heap allocated as the recorder carries a 1 MB ring */
+	TUniquePtr<FSerialSessionRecorder> session_recorder;
+	TUniquePtr<FSerialSessionReplay> session_replay;
+	/** Opens mySerialPort in the background and reopens it after the board is unplugged */
+	FSerialPortConnector port_connector;
+	/** LED and rumble frames to the board, running while a binary link is up */
+	FArduinoOutputQueue output_queue;
+	/** Set while parsing runs off the game thread. Everything AnalyzeInput touches belongs to it then */
+	class FArduinoParseThread* parse_thread = nullptr;
+	/** Triggered by the transports when bytes are queued, the parse thread waits on it. Pooled, from Start to Stop */
+	FEvent* input_event = nullptr;
+};
@@ -0,0 +1,156 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoDeviceSubsystem.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Containers/Ticker.h"
+
+void UArduinoDeviceSubsystem::Deinitialize()
+{
+	if (ticker_handle.IsValid()) {
+		FTicker::GetCoreTicker().RemoveTicker(ticker_handle);
+		ticker_handle.Reset();
+	}
+	// Waits for the probes still running, at most one probe's time
+	discovery.Reset();
+	waiting_devices.Reset();
+	unbound_boards.Reset();
+	for (UArduinoDevice* device : devices) {
+		device->Stop();
+	}
+	devices.Reset();
+	device_keys.Reset();
+
+	Super::Deinitialize();
+}
+
+UArduinoDevice* UArduinoDeviceSubsystem::AcquireDevice(const FArduinoDeviceSettings& Settings)
+{
+	const FString key = Settings.GetDeviceKey();
+	const int32 index = device_keys.IndexOfByKey(key);
+	if (index != INDEX_NONE) {
+		return devices[index];
+	}
+
+	UArduinoDevice* device = NewObject<UArduinoDevice>(this);
+	device->Start(Settings);
+	devices.Add(device);
+	device_keys.Add(key);
+
+	if (device->ParsesOnGameThread() && !ticker_handle.IsValid()) {
+		ticker_handle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UArduinoDeviceSubsystem::TickGameThreadParsing));
+	}
+
+	if (device->IsWaitingForBoard()) {
+		waiting_devices.Add(device);
+		StartDiscovery(Settings);
+		BindDiscoveredBoards();
+	}
+	return device;
+}
+
+UArduinoDevice* UArduinoDeviceSubsystem::FindDevice(int32 DeviceId) const
+{
+	for (UArduinoDevice* device : devices) {
+		if (device->GetSettings().DeviceId == DeviceId) {
+			return device;
+		}
+	}
+	return nullptr;
+}
+
+bool UArduinoDeviceSubsystem::TickGameThreadParsing(float DeltaTime)
+{
+	for (UArduinoDevice* device : devices) {
+		if (device->ParsesOnGameThread()) {
+			device->AnalyzeInput();
+		}
+	}
+	return true;
+}
+
+void UArduinoDeviceSubsystem::StartDiscovery(const FArduinoDeviceSettings& Settings)
+{
+	if (discovery.IsValid()) {
+		return;
+	}
+
+	// Ports named by a component belong to its device, probing them would only get in its connector's way
+	TArray<FString> candidates = FSerialPortDiscovery::ListCandidatePorts();
+	for (UArduinoDevice* device : devices) {
+		const FArduinoDeviceSettings& device_settings = device->GetSettings();
+		// Nor do boards that are not on a serial port at all
+		if (device_settings.bAutoDiscover || device_settings.bScripted || device_settings.UdpPort > 0) {
+			continue;
+		}
+		char port_name[256];
+		SerialPort::FormatPortName((uint32)device_settings.Port, port_name, sizeof(port_name));
+		candidates.Remove(device_settings.DeviceName.IsEmpty() ? FString(ANSI_TO_TCHAR(port_name)) : device_settings.DeviceName);
+	}
+
+	FSerialProbeSettings probe_settings;
+	if (Settings.DiscoveryBaudRates.Num() > 0) {
+		probe_settings.BaudRates.Reset();
+		for (int32 baud_rate : Settings.DiscoveryBaudRates) {
+			probe_settings.BaudRates.Add((uint32)baud_rate);
+		}
+	}
+
+	UE_LOG(LogTemp, Warning, TEXT("probing %d serial ports for Arduinos !"), candidates.Num());
+	discovery = MakeUnique<FSerialPortDiscovery>();
+	TWeakObjectPtr<UArduinoDeviceSubsystem> weak_this(this);
+	discovery->Start(candidates, probe_settings, [weak_this]() {
+		// The subsystem may be gone by the time the game thread gets to it
+		FFunctionGraphTask::CreateAndDispatchWhenReady([weak_this]() {
+			if (UArduinoDeviceSubsystem* subsystem = weak_this.Get()) {
+				subsystem->OnDiscoveryFinished();
+			}
+		}, TStatId(), nullptr, ENamedThreads::GameThread);
+	});
+}
+
+void UArduinoDeviceSubsystem::OnDiscoveryFinished()
+{
+	if (!discovery.IsValid() || bDiscoveryFinished) {
+		return;
+	}
+	bDiscoveryFinished = true;
+	unbound_boards = discovery->Wait();
+	for (const FSerialProbeResult& board : unbound_boards) {
+		UE_LOG(LogTemp, Warning, TEXT("found Arduino on %s at %u baud, firmware %u !"), *board.DeviceName, board.BaudRate, (uint32)board.FirmwareId);
+	}
+	BindDiscoveredBoards();
+}
+
+void UArduinoDeviceSubsystem::BindDiscoveredBoards()
+{
+	if (!bDiscoveryFinished) {
+		return;
+	}
+
+	// Devices asking for a firmware id first, so "any board" cannot take the one they need
+	for (const bool bSpecificFirmware : { true, false }) {
+		for (int32 index = 0; index < waiting_devices.Num();) {
+			UArduinoDevice* device = waiting_devices[index];
+			const int32 firmware_id = device->GetSettings().FirmwareId;
+			if ((firmware_id != 0) != bSpecificFirmware) {
+				++index;
+				continue;
+			}
+			const int32 board_index = unbound_boards.IndexOfByPredicate([firmware_id](const FSerialProbeResult& board) {
+				return firmware_id == 0 || board.FirmwareId == firmware_id;
+			});
+			if (board_index == INDEX_NONE) {
+				++index;
+				continue;
+			}
+			device->BindBoard(unbound_boards[board_index]);
+			unbound_boards.RemoveAt(board_index);
+			waiting_devices.RemoveAt(index);
+		}
+	}
+
+	for (UArduinoDevice* device : waiting_devices) {
+		UE_LOG(LogTemp, Warning, TEXT("no board found for Arduino %d !"), device->GetSettings().DeviceId);
+	}
+}
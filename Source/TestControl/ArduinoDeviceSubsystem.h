@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "ArduinoDevice.h"
+#include "ArduinoDeviceSubsystem.generated.h"
+
+/** Owns every Arduino board of the game, once per game instance
+*
+* A board is opened by the first UArduinoInput that asks for it and stays
+* open until the game instance shuts down, so pawn respawns and level
+* changes never reopen the port. Any number of components, widgets or
+* cameras can then read the same board: each one gets a cursor on the
+* board's command log, nothing is parsed or copied twice.
+*
+* Devices started with bAutoDiscover get their port from a discovery that
+* probes every serial port once, in the background, the first time one is
+* asked for. Boards are handed out in the order the devices were acquired,
+* those asking for a FirmwareId first.
+*/
+UCLASS()
+class TESTCONTROL_API UArduinoDeviceSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	/** The board these settings name, started with them the first time. Later callers share it as it was started */
+	UArduinoDevice* AcquireDevice(const FArduinoDeviceSettings& Settings);
+
+	/** The board started with this DeviceId, null if none */
+	UFUNCTION(BlueprintCallable, Category = "Arduino")
+	UArduinoDevice* FindDevice(int32 DeviceId) const;
+
+protected:
+	/** Parse the boards whose parse thread could not start, only registered while there is one */
+	bool TickGameThreadParsing(float DeltaTime);
+
+	/** Probe every serial port not opened by name, unless that already started */
+	void StartDiscovery(const FArduinoDeviceSettings& Settings);
+	/** Game thread, the probes are done */
+	void OnDiscoveryFinished();
+	/** Hand the boards found to the devices waiting for one */
+	void BindDiscoveredBoards();
+
+	UPROPERTY()
+	TArray<UArduinoDevice*> devices;
+
+	/** GetDeviceKey of every entry of devices */
+	TArray<FString> device_keys;
+
+	FDelegateHandle ticker_handle;
+
+	TUniquePtr<FSerialPortDiscovery> discovery;
+	bool bDiscoveryFinished = false;
+
+	/** Devices started with bAutoDiscover that have no board yet, in the order they were acquired */
+	UPROPERTY()
+	TArray<UArduinoDevice*> waiting_devices;
+
+	/** Boards found and not bound to a device yet */
+	TArray<FSerialProbeResult> unbound_boards;
+};
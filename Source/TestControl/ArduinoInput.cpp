@@ -2,15 +2,31 @@
 
 
 #include "ArduinoInput.h"
+#include "ArduinoComboSet.h"
+#include "ArduinoDeviceSubsystem.h"
+#include "InputLatencyStats.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "TimerManager.h"
+#include "UObject/UObjectIterator.h"
+
+bool FArduinoInputPacket::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess) {
+	bOutSuccess = Packet.Serialize(Ar, &NumBits);
+	return true;
+}
 
 // Sets default values for this component's properties
 UArduinoInput::UArduinoInput()
 {
-	// Set this component to be initialized when the game starts, and to be ticked every frame.  You can turn these features
-	// off to improve performance if you don't need them.
-	PrimaryComponentTick.bCanEverTick = true;
+	// The board is read by its UArduinoDevice, commands are pushed to us when they arrive
+	PrimaryComponentTick.bCanEverTick = false;
 
-	// ...
+	// Nothing replicated but ServerReceiveInputFrames
+	SetIsReplicated(true);
 }
 
 
@@ -19,88 +35,311 @@ void UArduinoInput::BeginPlay()
 {
 	Super::BeginPlay();
 
-	// ...
-	PortOpen();
-	if (!mySerialPort.OpenListenThread()) {
-		UE_LOG(LogTemp, Warning, TEXT("OpenListenThread fail !"));
-	}
-	else {
-		UE_LOG(LogTemp, Warning, TEXT("OpenListenThread success !"));
+	net_sender.SetRedundancy(NetRedundancy);
+	if (ShouldReadBoard()) {
+		AcquireDevice();
 	}
 }
 
-void UArduinoInput::PortOpen() {
-	if (!mySerialPort.InitPort(port, 9600, 'N', 8, 1, EV_RXCHAR))
-	{
-		UE_LOG(LogTemp, Warning, TEXT("initPort fail !"));
-		PortOpen();
+void UArduinoInput::AcquireDevice() {
+	if (device != nullptr) {
+		return;
 	}
-	else
-	{
-		UE_LOG(LogTemp, Warning, TEXT("initPort success !"));
+	UGameInstance* game_instance = GetWorld() != nullptr ? GetWorld()->GetGameInstance() : nullptr;
+	UArduinoDeviceSubsystem* subsystem = game_instance != nullptr ? game_instance->GetSubsystem<UArduinoDeviceSubsystem>() : nullptr;
+	if (subsystem == nullptr) {
+		UE_LOG(LogTemp, Warning, TEXT("no game instance, Arduino input disabled !"));
+		return;
 	}
+
+	// Opened by the first component on this board, a respawned pawn picks it up where it is
+	SetDevice(subsystem->AcquireDevice(MakeDeviceSettings()));
 }
 
+void UArduinoInput::SetDevice(UArduinoDevice* NewDevice) {
+	if (device != nullptr) {
+		device->OnCommandsPublished.Remove(published_handle);
+	}
+	device = NewDevice;
+	if (device != nullptr) {
+		cursor = device->GetCommandLog().MakeCursor();
+		published_handle = device->OnCommandsPublished.AddUObject(this, &UArduinoInput::DispatchCommands);
+	}
+}
 
-// Called every frame
-void UArduinoInput::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+// Called when the game ends or the owner is destroyed
+void UArduinoInput::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
-
-	// ...
-	// UINT BytesInQue = mySerialPort.GetBytesInCOM();
-	AnalyzeInput();
-	// Sleep(1000);
-}
-
-void UArduinoInput::AnalyzeInput() {
-	char temp;
-	FString instruction = "";
-	if (mySerialPort.ReturnNextCharFromQueue(temp)) {
-		if (temp == 'L') {
-			if (mySerialPort.SizeOfMessageQueue() > 1) {
-				mySerialPort.RemoveNextCharFromQueue();
-				mySerialPort.ReturnNextCharFromQueue(temp);
-				if (temp == 'R') {
-					mySerialPort.RemoveNextCharFromQueue();
-					instruction = "W";
-				}
-				else if (temp == 'J') {
-					mySerialPort.RemoveNextCharFromQueue();
-					instruction = "J";
-				}
-			}
-		}else if (temp == 'R') {
-			if (mySerialPort.SizeOfMessageQueue() > 1) {
-				mySerialPort.RemoveNextCharFromQueue();
-				mySerialPort.ReturnNextCharFromQueue(temp);
-				if (temp == 'L') {
-					mySerialPort.RemoveNextCharFromQueue();
-					instruction = "W";
-				}else if (temp == 'J') {
-					mySerialPort.RemoveNextCharFromQueue();
-					instruction = "J";
-				}
-			}
+	UWorld* world = GetWorld();
+	if (world != nullptr) {
+		world->GetTimerManager().ClearTimer(net_send_timer);
+	}
+
+	// The board stays open for the next subscriber
+	SetDevice(nullptr);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+FArduinoDeviceSettings UArduinoInput::MakeDeviceSettings() const {
+	FArduinoDeviceSettings settings;
+	settings.DeviceId = DeviceId;
+	settings.Port = Port;
+	settings.DeviceName = DeviceName;
+	settings.BaudRate = BaudRate;
+	settings.bAutoDiscover = bAutoDiscover;
+	settings.FirmwareId = FirmwareId;
+	settings.DiscoveryBaudRates = DiscoveryBaudRates;
+	settings.ReconnectMaxSeconds = ReconnectMaxSeconds;
+	settings.UdpPort = UdpPort;
+	settings.UdpBoardAddress = UdpBoardAddress;
+	settings.Protocol = Protocol;
+	settings.BinaryBaudRate = BinaryBaudRate;
+	settings.AnalogChannels = AnalogChannels;
+	settings.AnalogFilters.MovingAverageWindow = AnalogMovingAverageWindow;
+	settings.AnalogFilters.SmoothingAlpha = AnalogSmoothingAlpha;
+	settings.AnalogFilters.PressThreshold = AnalogPressThreshold;
+	settings.AnalogFilters.ReleaseThreshold = AnalogReleaseThreshold;
+	settings.AnalogFilters.DebounceSamples = AnalogDebounceSamples;
+	settings.bUseSharedIOThread = bUseSharedIOThread;
+	settings.bParseOnInputThread = bParseOnInputThread;
+	settings.ParseRateHz = ParseRateHz;
+	settings.RecordFile = RecordFile;
+	settings.ReplayFile = ReplayFile;
+	settings.bReplayAsFastAsPossible = bReplayAsFastAsPossible;
+	settings.bSendToInputDevice = bSendToInputDevice;
+	settings.Combos.Reset();
+	if (ComboSet == nullptr || ComboSet->bIncludeDefaultGestures) {
+		settings.Combos = FArduinoComboRecognizer::MakeDefaultPatterns(StepWindowSeconds);
+	}
+	if (ComboSet != nullptr) {
+		settings.Combos.Append(ComboSet->MakePatterns());
+		for (const FArduinoComboDefinition& combo : ComboSet->Combos) {
+			settings.ComboNames.Add(combo.Name);
+		}
+	}
+	return settings;
+}
+
+bool UArduinoInput::ShouldReadBoard() const {
+	// The board belongs to the player of this machine, copies of other players' pawns get their commands from the network
+	const APawn* pawn = Cast<APawn>(GetOwner());
+	return pawn == nullptr || GetNetMode() == NM_Standalone || pawn->IsLocallyControlled();
+}
+
+bool UArduinoInput::IsSendingToServer() const {
+	return bReplicateToServer && GetOwnerRole() == ROLE_AutonomousProxy;
+}
+
+void UArduinoInput::DispatchCommands() {
+	// Without a listener the commands stay in the log for ReturnAllCommandsInQueue
+	const bool send_to_server = IsSendingToServer();
+	if (!OnCommands.IsBound() && !OnCombo.IsBound() && !send_to_server) {
+		return;
+	}
+
+	dispatch_commands.Reset();
+	const uint64 dequeue_cycles = FPlatformTime::Cycles64();
+	if (ReturnAllCommandsInQueue(dispatch_commands) == 0) {
+		return;
+	}
+	FInputLatencyStats& latency_stats = FInputLatencyStats::Get();
+	for (const FArduinoCommand& command : dispatch_commands) {
+		latency_stats.RecordCycles(EInputLatencyStage::ParseToDequeue, command.GetParseCycles(), dequeue_cycles);
+	}
+
+	// Sent before the listeners run, one of them may end play
+	if (send_to_server) {
+		net_pending_commands.Append(dispatch_commands);
+		UWorld* world = GetWorld();
+		if (world == nullptr || !world->GetTimerManager().IsTimerActive(net_send_timer)) {
+			SendInputFrames();
+		}
+	}
+	BroadcastCommands(dispatch_commands, dequeue_cycles);
+}
+
+void UArduinoInput::BroadcastCommands(const TArray<FArduinoCommand>& Commands, uint64 DequeueCycles) {
+	OnCommands.Broadcast(Commands, DequeueCycles);
+
+	// A listener above may have ended play
+	if (!HasBegunPlay()) {
+		return;
+	}
+	for (const FArduinoCommand& command : Commands) {
+		if (command.Opcode == EArduinoOpcode::Combo) {
+			OnCombo.Broadcast(GetComboName(command.Payload));
+		}
+	}
+}
+
+FName UArduinoInput::GetComboName(int16 ComboIndex) const {
+	// The server has no board, the names come from our own combo set there
+	if (device != nullptr) {
+		return device->GetComboName(ComboIndex);
+	}
+	if (ComboSet != nullptr && ComboSet->Combos.IsValidIndex(ComboIndex)) {
+		return ComboSet->Combos[ComboIndex].Name;
+	}
+	return NAME_None;
+}
+
+void UArduinoInput::SendInputFrames() {
+	if (net_pending_commands.Num() > 0) {
+		net_sender.AddFrame(net_pending_commands.GetData(), net_pending_commands.Num());
+		net_pending_commands.Reset();
+	}
+
+	UWorld* world = GetWorld();
+	if (!net_sender.HasPendingSends()) {
+		if (world != nullptr) {
+			world->GetTimerManager().ClearTimer(net_send_timer);
 		}
-		else if (temp == 'J') {
-			mySerialPort.RemoveNextCharFromQueue();
-			instruction = "J";
+		return;
+	}
+
+	FArduinoInputPacket packet;
+	net_sender.MakePacket(FPlatformTime::Cycles64(), packet.Packet);
+	ServerReceiveInputFrames(packet);
+
+	// Runs while there is anything left to send, commands arriving meanwhile wait for it
+	if (world != nullptr && !world->GetTimerManager().IsTimerActive(net_send_timer)) {
+		world->GetTimerManager().SetTimer(net_send_timer, this, &UArduinoInput::SendInputFrames, 1.0f / FMath::Max(NetSendRateHz, 1.0f), true);
+	}
+}
+
+bool UArduinoInput::ServerReceiveInputFrames_Validate(const FArduinoInputPacket& Packet) {
+	return Packet.Packet.Frames.Num() <= FArduinoNetPacket::MaxFrames;
+}
+
+void UArduinoInput::ServerReceiveInputFrames_Implementation(const FArduinoInputPacket& Packet) {
+	const double now_seconds = FPlatformTime::Seconds();
+	if (net_window_start_seconds == 0.0) {
+		net_window_start_seconds = now_seconds;
+	}
+	net_window_bits += Packet.NumBits;
+
+	net_frames.Reset();
+	if (net_receiver.Accept(Packet.Packet, net_frames) > 0) {
+		// Ages are measured on the client, the way here is taken as half the round trip
+		const APawn* pawn = Cast<APawn>(GetOwner());
+		const APlayerState* player_state = pawn != nullptr ? pawn->GetPlayerState() : nullptr;
+		const double one_way_ms = player_state != nullptr ? player_state->ExactPing * 0.5 : 0.0;
+		const uint64 now_cycles = FPlatformTime::Cycles64();
+		FInputLatencyStats& latency_stats = FInputLatencyStats::Get();
+
+		net_commands.Reset();
+		for (const FArduinoNetFrame* frame : net_frames) {
+			for (const FArduinoNetCommand& net_command : frame->Commands) {
+				const double latency_ms = net_command.AgeMs + one_way_ms;
+				const uint64 latency_cycles = (uint64)(latency_ms * 0.001 / FPlatformTime::GetSecondsPerCycle64());
+				const uint64 read_cycles = now_cycles > latency_cycles ? now_cycles - latency_cycles : 0;
+				net_commands.Add(FArduinoCommand(net_command.Opcode, net_command.DeviceId, read_cycles, net_command.Payload));
+				latency_stats.RecordCycles(EInputLatencyStage::ReadToServer, read_cycles, now_cycles);
+				net_window_latency_ms += latency_ms;
+				++net_window_commands;
+			}
 		}
-		else {
-			mySerialPort.RemoveNextCharFromQueue();
+		if (net_commands.Num() > 0) {
+			BroadcastCommands(net_commands, now_cycles);
 		}
-		if (instruction != "") {
-			UE_LOG(LogTemp, Warning, TEXT("%s"), *instruction);
-			input_queue.Enqueue(instruction);
+	}
+
+	const double window_seconds = now_seconds - net_window_start_seconds;
+	if (window_seconds >= 1.0) {
+		net_bytes_per_second = (float)(net_window_bits / 8.0 / window_seconds);
+		if (net_window_commands > 0) {
+			net_latency_ms = (float)(net_window_latency_ms / net_window_commands);
 		}
+		net_window_start_seconds = now_seconds;
+		net_window_bits = 0;
+		net_window_latency_ms = 0.0;
+		net_window_commands = 0;
+	}
+}
+
+void UArduinoInput::SetLedColor(int32 Led, FColor Color) {
+	if (device != nullptr) {
+		device->SetLedColor(Led, Color);
+	}
+}
+
+void UArduinoInput::SetRumble(int32 Motor, float Strength) {
+	if (device != nullptr) {
+		device->SetRumble(Motor, Strength);
 	}
 }
 
+void UArduinoInput::PulseRumble(int32 Motor, float Strength, float Seconds) {
+	if (device != nullptr) {
+		device->PulseRumble(Motor, Strength, Seconds);
+	}
+}
+
+bool UArduinoInput::IsConnected() const {
+	return device != nullptr && device->IsConnected();
+}
+
+float UArduinoInput::GetAnalogValue(int32 Channel) const {
+	return device != nullptr ? device->GetAnalogValue(Channel) : 0.0f;
+}
+
+bool UArduinoInput::IsAnalogPressed(int32 Channel) const {
+	return device != nullptr && device->IsAnalogPressed(Channel);
+}
+
 bool UArduinoInput::ReturnNextInputInQueue(FString& return_value) {
-	if (!input_queue.IsEmpty()) {
-		input_queue.Dequeue(return_value);
-		return true;
+	if (device == nullptr) {
+		return false;
+	}
+	const FArduinoCommandLog& command_log = device->GetCommandLog();
+	const FArduinoCommand* commands = nullptr;
+	if (command_log.Peek(cursor, commands) > 0) {
+		const FArduinoCommand command = commands[0];
+		if (command_log.Consume(cursor, 1)) {
+			return_value = command.ToString();
+			return true;
+		}
 	}
 	return false;
-}
\ No newline at end of file
+}
+
+int32 UArduinoInput::ReturnAllCommandsInQueue(TArray<FArduinoCommand>& return_values) {
+	if (device == nullptr) {
+		return 0;
+	}
+	// Copied out of the log, then checked: what the parse thread overwrote meanwhile is dropped again
+	const FArduinoCommandLog& command_log = device->GetCommandLog();
+	const int32 start_num = return_values.Num();
+	const FArduinoCommand* commands = nullptr;
+	uint32 count;
+	while ((count = command_log.Peek(cursor, commands)) > 0) {
+		const int32 append_at = return_values.Num();
+		return_values.Append(commands, (int32)count);
+		if (!command_log.Consume(cursor, count)) {
+			return_values.SetNum(append_at, false);
+		}
+	}
+	return return_values.Num() - start_num;
+}
+
+
+static FAutoConsoleCommand GArduinoNetDumpCommand(
+	TEXT("Arduino.Net.Dump"),
+	TEXT("Log, for every player sending Arduino input to this server, its bytes/s, latency and lost frames"),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		for (TObjectIterator<UArduinoInput> it; it; ++it) {
+			const FArduinoNetFrameReceiver& receiver = it->GetNetReceiver();
+			if (receiver.GetFramesTaken() == 0 || it->GetOwner() == nullptr) {
+				continue;
+			}
+			UE_LOG(LogTemp, Display, TEXT("Arduino net %s: %.1f bytes/s, read to server %.1f ms, frames %llu taken %llu recovered %llu lost"),
+				*it->GetOwner()->GetName(),
+				it->GetNetBytesPerSecond(),
+				it->GetNetLatencyMs(),
+				receiver.GetFramesTaken(),
+				receiver.GetFramesRecovered(),
+				receiver.GetFramesLost());
+		}
+	}));
@@ -4,10 +4,40 @@
 
 #include "CoreMinimal.h"
 #include "Components/ActorComponent.h"
-#include "SerialPort.h"
-#include "Containers/Queue.h"
+#include "ArduinoDevice.h"
+#include "ArduinoNetFrames.h"
+#include "Engine/EngineTypes.h"
 #include "ArduinoInput.generated.h"
 
+class UArduinoComboSet;
+
+/** Commands received since the last broadcast, oldest first, and the FPlatformTime::Cycles64() they were dequeued at */
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnArduinoCommands, const TArray<FArduinoCommand>& /*Commands*/, uint64 /*DequeueCycles*/);
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnArduinoCombo, FName, ComboName);
+
+/** FArduinoNetPacket as an RPC parameter, bit-packed by NetSerialize */
+USTRUCT()
+struct FArduinoInputPacket
+{
+	GENERATED_BODY()
+
+	FArduinoNetPacket Packet;
+
+	/** Payload size, set when the packet is serialized */
+	int32 NumBits = 0;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FArduinoInputPacket> : public TStructOpsTypeTraitsBase2<FArduinoInputPacket>
+{
+	enum
+	{
+		WithNetSerializer = true,
+	};
+};
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
 class TESTCONTROL_API UArduinoInput : public UActorComponent
@@ -21,17 +51,235 @@ public:
 protected:
 	// Called when the game starts
 	virtual void BeginPlay() override;
-	void PortOpen();
-	void AnalyzeInput();
+	// Called when the game ends or the owner is destroyed
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	/** The settings below, as the device subsystem takes them */
+	FArduinoDeviceSettings MakeDeviceSettings() const;
+	/** Game thread, the device published commands: move them past our cursor into OnCommands, and to the server */
+	void DispatchCommands();
+	/** OnCommands, then OnCombo for the combos among Commands */
+	void BroadcastCommands(const TArray<FArduinoCommand>& Commands, uint64 DequeueCycles);
+	/** Whether this machine reads the board: not for the copies of other players' pawns in a networked game */
+	bool ShouldReadBoard() const;
+	/** Whether dispatched commands go to the server: on the client owning the pawn */
+	bool IsSendingToServer() const;
+	/** Timer at NetSendRateHz: the commands dispatched since the last packet as a new frame, and the frames still owed a redundant copy */
+	void SendInputFrames();
+
+	/** The owning client's frames, applied in order on the server as if its board were plugged in here */
+	UFUNCTION(Server, Unreliable, WithValidation)
+	void ServerReceiveInputFrames(const FArduinoInputPacket& Packet);
 	
 public:	
-	// Called every frame
-	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	/** Dequeue the next input as its one-letter token ("W"/"J"). Prefer ReturnAllCommandsInQueue, which does not build strings */
 	bool ReturnNextInputInQueue(FString&);
+	/** Move every command received since the last call into the array (appended, oldest first). Returns how many were added */
+	int32 ReturnAllCommandsInQueue(TArray<FArduinoCommand>&);
+
+	/** Broadcast on the game thread as soon as commands arrive, instead of polling ReturnAllCommandsInQueue every frame */
+	FOnArduinoCommands OnCommands;
+
+	/** Broadcast on the game thread for every Event combo of ComboSet, with its Name */
+	UPROPERTY(BlueprintAssignable, Category = "Arduino|Combo")
+	FOnArduinoCombo OnCombo;
+
+	/** Open (or share) the board now. BeginPlay does, except in a networked game for a pawn not yet controlled on this machine:
+	* its pawn calls this once a local player takes it. Does nothing if already open */
+	void AcquireDevice();
+
+	/** Read another device from now on, e.g. a scripted one in a perf run, null to read none. Commands it published before are skipped */
+	void SetDevice(UArduinoDevice* NewDevice);
+
+	/** Name of the Event combo with this index in ComboSet, None if there is no such combo */
+	FName GetComboName(int16 ComboIndex) const;
+
+	/** On a client, send the commands of the pawn's board to the server, which broadcasts them from its own copy of this component.
+	* Movement does not need it, CharacterMovement replicates that already; this is for what the server decides (combos, scoring...) */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Network")
+	bool bReplicateToServer = true;
+
+	/** Most packets a second, commands dispatched in between are batched into one frame. The first command after a pause goes at once */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Network", meta = (ClampMin = "1", ClampMax = "240"))
+	float NetSendRateHz = 60.0f;
+
+	/** Older frames repeated in every packet, so a frame is only lost when this many packets in a row after its own are */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Network", meta = (ClampMin = "0", ClampMax = "7"))
+	int32 NetRedundancy = 3;
+
+	/** Server: bytes of input frames a second from this player over the last second packets came in, RPC headers aside */
+	UFUNCTION(BlueprintCallable, Category = "Arduino|Network")
+	float GetNetBytesPerSecond() const { return net_bytes_per_second; }
+
+	/** Server: mean time from the board being read on the client to the command being broadcast here, in milliseconds.
+	* The network part is half the player's ping, the rest is measured on the client */
+	UFUNCTION(BlueprintCallable, Category = "Arduino|Network")
+	float GetNetLatencyMs() const { return net_latency_ms; }
+
+	/** Server: frames taken from this player, recovered from a redundant copy and lost */
+	const FArduinoNetFrameReceiver& GetNetReceiver() const { return net_receiver; }
+
+	/** The properties below describe the board. It is opened once, by the first component naming its port, and shared:
+	* other components on the same port read it as that first one set it up */
+
+	/** Send this board's gestures and analog channels to the Arduino input device, as key events (ArduinoJump, ArduinoRun...) for the
+	* input mappings, with DeviceId as controller id */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	bool bSendToInputDevice = true;
+
+	/** Stamped into every command from this board, to tell several boards apart */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	uint8 DeviceId = 0;
+
+	/** Serial port number, COM<Port> on Windows and /dev/ttyACM<Port> on Linux */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	int32 Port = 3;
+
+	/** Device name to open instead of Port, e.g. "/dev/ttyUSB0". Empty to use Port */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	FString DeviceName;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	int32 BaudRate = 9600;
+
+	/** Ignore Port, DeviceName and BaudRate: use a board found by probing every serial port at DiscoveryBaudRates.
+	* Boards are handed out in the order components start, DeviceId tells the boards apart afterwards */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Discovery")
+	bool bAutoDiscover = false;
+
+	/** With bAutoDiscover, only take a board whose firmware reports this id in its Hello reply. 0 for any board, old firmware included */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Discovery", meta = (ClampMin = "0", ClampMax = "65535"))
+	int32 FirmwareId = 0;
+
+	/** Rates tried on every port, in order. The first component to start discovery decides */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Discovery")
+	TArray<int32> DiscoveryBaudRates = { 9600, 115200 };
+
+	/** Longest wait between two attempts to open a missing board. Attempts start at 0.1 s and double up to this */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino", meta = (ClampMin = "0.1"))
+	float ReconnectMaxSeconds = 5.0f;
+
+	/** Ignore Port, DeviceName and discovery: take the board's bytes from datagrams sent to this local UDP port, for a board on
+	* Wi-Fi or a local stand-in. 0 for a serial board. Protocol is not negotiated, the board has to speak it from the start */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Udp", meta = (ClampMin = "0", ClampMax = "65535"))
+	int32 UdpPort = 0;
+
+	/** With UdpPort, only take datagrams from this IPv4 address. Empty for any sender */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Udp")
+	FString UdpBoardAddress;
+
+	/** True while the board is open, false while it is missing and being retried */
+	UFUNCTION(BlueprintCallable, Category = "Arduino")
+	bool IsConnected() const;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	EArduinoProtocol Protocol = EArduinoProtocol::LegacyAscii;
+
+	/** Combos to recognize in the legacy gesture stream. None for just the run step and the jump */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Combo")
+	UArduinoComboSet* ComboSet = nullptr;
+
+	/** Longest time between the two feet of a run step ("LR"/"RL"), 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Combo", meta = (ClampMin = "0"))
+	float StepWindowSeconds = 0.5f;
+
+	/** Baud rate requested once the board agrees to the binary protocol, 115200 to 2000000 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino", meta = (ClampMin = "115200", ClampMax = "2000000"))
+	int32 BinaryBaudRate = 1000000;
+
+	/** Analog sensor channels streamed by the board (binary protocol only), 0 for none */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Analog", meta = (ClampMin = "0", ClampMax = "16"))
+	int32 AnalogChannels = 0;
+
+	/** Moving average length in samples, 1 to turn it off */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Analog", meta = (ClampMin = "1", ClampMax = "32"))
+	int32 AnalogMovingAverageWindow = 4;
+
+	/** Exponential smoothing applied after the moving average, 1 to turn it off */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Analog", meta = (ClampMin = "0", ClampMax = "1"))
+	float AnalogSmoothingAlpha = 0.25f;
+
+	/** A channel counts as pressed above this value and released below AnalogReleaseThreshold */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Analog")
+	float AnalogPressThreshold = 0.6f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Analog")
+	float AnalogReleaseThreshold = 0.4f;
+
+	/** Consecutive samples a press or release has to hold before it counts */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Analog", meta = (ClampMin = "1"))
+	int32 AnalogDebounceSamples = 3;
+
+	/** Filtered value of an analog channel, about -1..1. Safe to call every frame, it only reads what the parse thread published */
+	UFUNCTION(BlueprintCallable, Category = "Arduino|Analog")
+	float GetAnalogValue(int32 Channel) const;
+
+	/** Debounced pressed state of an analog channel */
+	UFUNCTION(BlueprintCallable, Category = "Arduino|Analog")
+	bool IsAnalogPressed(int32 Channel) const;
+
+	/** Set an LED on the board (binary protocol only). Only the latest colour of an LED is sent, posting never waits for the port */
+	UFUNCTION(BlueprintCallable, Category = "Arduino|Feedback")
+	void SetLedColor(int32 Led, FColor Color);
+
+	/** Keep a rumble motor running at Strength (0..1), 0 stops it */
+	UFUNCTION(BlueprintCallable, Category = "Arduino|Feedback")
+	void SetRumble(int32 Motor, float Strength);
+
+	/** Run a rumble motor at Strength (0..1) for Seconds. Pulses are never merged */
+	UFUNCTION(BlueprintCallable, Category = "Arduino|Feedback")
+	void PulseRumble(int32 Motor, float Strength, float Seconds);
+
+	/** Read this board on the shared SerialPortSet I/O thread instead of a listen thread of its own */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	bool bUseSharedIOThread = true;
+
+	/** Recognize gestures on a thread of our own as soon as bytes arrive instead of once per frame, so input timing does not depend on the frame rate */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino")
+	bool bParseOnInputThread = true;
+
+	/** Most parse passes a second while bytes keep arriving. The parse thread sleeps while the board is idle */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino", meta = (ClampMin = "1", ClampMax = "10000"))
+	int32 ParseRateHz = 1000;
+
+	/** Record every byte read from the board to this file, relative names go under Saved/Arduino. Empty to not record. -ArduinoRecord=<file> overrides it */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Session")
+	FString RecordFile;
+
+	/** Replay this recorded session instead of opening the board. -ArduinoReplay=<file> overrides it */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Session")
+	FString ReplayFile;
+
+	/** Feed the replay as fast as the game drains it instead of at the recorded pace */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Arduino|Session")
+	bool bReplayAsFastAsPossible = false;
+
+	/** The shared board this component reads, null before BeginPlay */
+	UFUNCTION(BlueprintCallable, Category = "Arduino")
+	UArduinoDevice* GetDevice() const { return device; }
 
 protected:
-	SerialPort mySerialPort;
-	const int port = 3;
-	TQueue <FString> input_queue;
-		
+	/** Owned by UArduinoDeviceSubsystem, shared with every other component on the same board */
+	UPROPERTY(Transient)
+	UArduinoDevice* device = nullptr;
+	/** Our read position in the device's command log */
+	FArduinoCommandLog::FCursor cursor;
+	FDelegateHandle published_handle;
+	/** Scratch list reused by DispatchCommands */
+	TArray<FArduinoCommand> dispatch_commands;
+
+	/** Client: commands waiting for the next packet, and the frames already sent */
+	TArray<FArduinoCommand> net_pending_commands;
+	FArduinoNetFrameSender net_sender;
+	FTimerHandle net_send_timer;
+
+	/** Server: what this player sent, and the last second of it */
+	FArduinoNetFrameReceiver net_receiver;
+	TArray<const FArduinoNetFrame*> net_frames;
+	TArray<FArduinoCommand> net_commands;
+	double net_window_start_seconds = 0.0;
+	int64 net_window_bits = 0;
+	double net_window_latency_ms = 0.0;
+	int32 net_window_commands = 0;
+	float net_bytes_per_second = 0.0f;
+	float net_latency_ms = 0.0f;
 };
@@ -0,0 +1,444 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoPerfSubsystem.h"
+#include "ArduinoDeviceSubsystem.h"
+#include "ArduinoInput.h"
+#include "ArduinoInputStats.h"
+#include "TestControlCharacter.h"
+#include "Engine/Engine.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/DateTime.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	/** Value at Percentile (0-100) of unsorted Samples, 0 when empty */
+	float Percentile(TArray<float> Samples, double Percentile)
+	{
+		if (Samples.Num() == 0) {
+			return 0.0f;
+		}
+		Samples.Sort();
+		const int32 index = FMath::Clamp((int32)(Percentile / 100.0 * Samples.Num()), 0, Samples.Num() - 1);
+		return Samples[index];
+	}
+
+	/** Steps of the run phase, one "LR" each */
+	const double StepSeconds = 0.25;
+}
+
+void UArduinoPerfSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	if (!FParse::Param(FCommandLine::Get(), TEXT("ArduinoPerf"))) {
+		return;
+	}
+	TArray<int32> rates = FrameRates;
+	FString rates_list;
+	if (FParse::Value(FCommandLine::Get(), TEXT("ArduinoPerfFps="), rates_list, false)) {
+		TArray<FString> items;
+		rates_list.ParseIntoArray(items, TEXT(","));
+		rates.Reset();
+		for (const FString& item : items) {
+			rates.Add(FCString::Atoi(*item));
+		}
+	}
+	FString report;
+	FParse::Value(FCommandLine::Get(), TEXT("ArduinoPerfReport="), report);
+	StartRun(rates, report, true);
+}
+
+void UArduinoPerfSubsystem::Deinitialize()
+{
+	if (IsRunning()) {
+		UE_LOG(LogTemp, Warning, TEXT("game instance shut down, Arduino perf run stopped !"));
+		FinishRun();
+	}
+
+	Super::Deinitialize();
+}
+
+TStatId UArduinoPerfSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UArduinoPerfSubsystem, STATGROUP_Tickables);
+}
+
+bool UArduinoPerfSubsystem::StartRun(const TArray<int32>& Rates, const FString& ReportFile, bool bQuitWhenDone)
+{
+	if (IsRunning()) {
+		return false;
+	}
+	frame_rates.Reset();
+	for (int32 rate : Rates) {
+		if (rate > 0) {
+			frame_rates.Add(rate);
+		}
+	}
+	if (frame_rates.Num() == 0) {
+		UE_LOG(LogTemp, Warning, TEXT("no frame rate to run the Arduino perf run at !"));
+		return false;
+	}
+	report_file = ReportFile.IsEmpty() ? FPaths::ProfilingDir() / TEXT("ArduinoInputPerf.json") : ReportFile;
+	bQuit = bQuitWhenDone;
+	results.Reset();
+	bCompleted = false;
+	failures.Reset();
+	warnings.Reset();
+
+	// Frame rate smoothing would cap the rates above its range
+	IConsoleVariable* max_fps = IConsoleManager::Get().FindConsoleVariable(TEXT("t.MaxFPS"));
+	previous_max_fps = max_fps != nullptr ? max_fps->GetFloat() : 0.0f;
+	bPreviousSmoothFrameRate = GEngine != nullptr && GEngine->bSmoothFrameRate;
+	if (GEngine != nullptr) {
+		GEngine->bSmoothFrameRate = false;
+	}
+	bPreviousUseFixedTimeStep = FApp::UseFixedTimeStep();
+	previous_fixed_delta_time = FApp::GetFixedDeltaTime();
+
+	phase = EPhase::Attach;
+	game_seconds = 0.0;
+	phase_start_seconds = 0.0;
+	return true;
+}
+
+void UArduinoPerfSubsystem::BeginRate(int32 Index)
+{
+	rate_index = Index;
+	FRateResult& result = results.AddDefaulted_GetRef();
+	result.TargetFps = frame_rates[Index];
+	// Every frame is 1/fps of game time however long it really takes, t.MaxFPS only keeps real time close to it
+	FApp::SetUseFixedTimeStep(true);
+	FApp::SetFixedDeltaTime(1.0 / result.TargetFps);
+	if (IConsoleVariable* max_fps = IConsoleManager::Get().FindConsoleVariable(TEXT("t.MaxFPS"))) {
+		max_fps->Set((float)result.TargetFps);
+	}
+	UE_LOG(LogTemp, Display, TEXT("Arduino perf run at %d fps"), result.TargetFps);
+
+	phase = EPhase::Settle;
+	phase_frames = 0;
+	phase_start_seconds = game_seconds;
+	rate_start_real_seconds = FPlatformTime::Seconds();
+	last_input_cycles = FArduinoInputCounters::GetGameThreadCycles();
+}
+
+void UArduinoPerfSubsystem::Tick(float DeltaTime)
+{
+	game_seconds += DeltaTime;
+	const double now = game_seconds;
+	if (phase == EPhase::Attach) {
+		UWorld* world = GetGameInstance()->GetWorld();
+		ATestControlCharacter* player = world != nullptr ? Cast<ATestControlCharacter>(UGameplayStatics::GetPlayerCharacter(world, 0)) : nullptr;
+		UArduinoDeviceSubsystem* devices = GetGameInstance()->GetSubsystem<UArduinoDeviceSubsystem>();
+		if (player == nullptr || devices == nullptr) {
+			if (now - phase_start_seconds > 10.0) {
+				UE_LOG(LogTemp, Warning, TEXT("no ATestControlCharacter to drive, Arduino perf run stopped !"));
+				FinishRun();
+			}
+			return;
+		}
+
+		// Same DeviceId, so the input device hands the scripted board's keys to the same player
+		UArduinoInput* input = player->GetArduinoInput();
+		FArduinoDeviceSettings settings;
+		settings.bScripted = true;
+		settings.DeviceId = input->DeviceId;
+		scripted_device = devices->AcquireDevice(settings);
+		previous_device = input->GetDevice();
+		input->SetDevice(scripted_device);
+		character = player;
+		start_location = player->GetActorLocation();
+		start_rotation = player->GetActorRotation();
+		BeginRate(0);
+		return;
+	}
+
+	ATestControlCharacter* player = character.Get();
+	if (player == nullptr) {
+		UE_LOG(LogTemp, Warning, TEXT("character gone, Arduino perf run stopped !"));
+		FinishRun();
+		return;
+	}
+	SampleFrame(DeltaTime);
+	++phase_frames;
+	FRateResult& result = results.Last();
+
+	switch (phase) {
+	case EPhase::Settle:
+		// Half a second for the new time step and t.MaxFPS to take hold
+		if (now - phase_start_seconds >= 0.5 && !IsCharacterFalling()) {
+			phase = EPhase::Jump;
+			phase_frames = 0;
+			bJumpInjected = false;
+		}
+		break;
+
+	case EPhase::Jump:
+		if (bJumpInjected) {
+			if (IsCharacterFalling()) {
+				result.FramesToJump.Add(phase_frames);
+				bJumpInjected = false;
+				phase_frames = 0;
+			}
+			else if (phase_frames > result.TargetFps) {
+				// A second on the ground, the jump was lost
+				++result.MissedJumps;
+				bJumpInjected = false;
+				phase_frames = 0;
+			}
+		}
+		else if (IsCharacterFalling()) {
+			// Counted from the landing
+			phase_frames = 0;
+		}
+		else if (phase_frames >= 5) {
+			if (result.FramesToJump.Num() + result.MissedJumps < JumpTrials) {
+				InjectGesture("J");
+				bJumpInjected = true;
+				phase_frames = 0;
+			}
+			else {
+				// Every rate runs from the same spot in the same direction
+				player->SetActorLocationAndRotation(start_location, start_rotation, false, nullptr, ETeleportType::TeleportPhysics);
+				player->GetCharacterMovement()->StopMovementImmediately();
+				phase = EPhase::Run;
+				phase_start_seconds = now;
+				next_step_seconds = now;
+			}
+		}
+		break;
+
+	case EPhase::Run:
+		if (now - phase_start_seconds >= RunSeconds) {
+			phase = EPhase::RunOut;
+			phase_start_seconds = now;
+		}
+		else if (now >= next_step_seconds) {
+			InjectGesture("LR");
+			next_step_seconds += StepSeconds;
+		}
+		break;
+
+	case EPhase::RunOut:
+		// The run key stays down for the input device's RunDuration after the last step, then the character slows down
+		if ((now - phase_start_seconds >= 0.5 && player->GetVelocity().Size2D() < 1.0f) || now - phase_start_seconds > 5.0) {
+			result.RunDistance = FVector::Dist2D(player->GetActorLocation(), start_location);
+			player->SetActorLocationAndRotation(start_location, start_rotation, false, nullptr, ETeleportType::TeleportPhysics);
+			result.RealSeconds = FPlatformTime::Seconds() - rate_start_real_seconds;
+			if (rate_index + 1 < frame_rates.Num()) {
+				BeginRate(rate_index + 1);
+			}
+			else {
+				bCompleted = true;
+				FinishRun();
+			}
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+void UArduinoPerfSubsystem::SampleFrame(float DeltaTime)
+{
+	FRateResult& result = results.Last();
+	++result.Frames;
+	result.Seconds += DeltaTime;
+	if (scripted_device != nullptr) {
+		result.MaxBacklog = FMath::Max(result.MaxBacklog, scripted_device->GetQueuedBytes());
+	}
+	const uint64 input_cycles = FArduinoInputCounters::GetGameThreadCycles();
+	result.InputCpuMicros.Add((float)(FPlatformTime::ToMilliseconds64(input_cycles - last_input_cycles) * 1000.0));
+	last_input_cycles = input_cycles;
+}
+
+void UArduinoPerfSubsystem::InjectGesture(const char* Gesture)
+{
+	if (scripted_device != nullptr) {
+		scripted_device->InjectInput(Gesture, FCStringAnsi::Strlen(Gesture));
+	}
+}
+
+bool UArduinoPerfSubsystem::IsRealTime(const FRateResult& Result) const
+{
+	const double real_fps = Result.Frames / FMath::Max(Result.RealSeconds, 1e-6);
+	return FMath::Abs(real_fps / Result.TargetFps - 1.0) <= MaxRealTimeDeviation;
+}
+
+bool UArduinoPerfSubsystem::IsCharacterFalling() const
+{
+	const ATestControlCharacter* player = character.Get();
+	return player != nullptr && player->GetCharacterMovement()->IsFalling();
+}
+
+void UArduinoPerfSubsystem::FinishRun()
+{
+	const FString report = MakeReport();
+	const bool passed = failures.Num() == 0;
+	if (FFileHelper::SaveStringToFile(report, *report_file)) {
+		UE_LOG(LogTemp, Display, TEXT("Arduino perf run %s, report written to %s"), passed ? TEXT("passed") : TEXT("failed"), *report_file);
+	}
+	else {
+		UE_LOG(LogTemp, Warning, TEXT("could not write the Arduino perf report to %s !"), *report_file);
+	}
+
+	if (IConsoleVariable* max_fps = IConsoleManager::Get().FindConsoleVariable(TEXT("t.MaxFPS"))) {
+		max_fps->Set(previous_max_fps);
+	}
+	if (GEngine != nullptr) {
+		GEngine->bSmoothFrameRate = bPreviousSmoothFrameRate;
+	}
+	FApp::SetUseFixedTimeStep(bPreviousUseFixedTimeStep);
+	FApp::SetFixedDeltaTime(previous_fixed_delta_time);
+	if (ATestControlCharacter* player = character.Get()) {
+		player->GetArduinoInput()->SetDevice(previous_device);
+	}
+	character.Reset();
+	scripted_device = nullptr;
+	previous_device = nullptr;
+	phase = EPhase::Idle;
+
+	if (bQuit) {
+		// Non-zero exit code on a failed limit, so a CI job can gate on it
+		FPlatformMisc::RequestExitWithStatus(false, passed ? 0 : 1);
+	}
+}
+
+FString UArduinoPerfSubsystem::MakeReport()
+{
+	failures.Reset();
+	warnings.Reset();
+	if (!bCompleted) {
+		// The rate it stopped in has no full measurement
+		results.SetNum(FMath::Max(results.Num() - 1, 0));
+		failures.Add(FString::Printf(TEXT("stopped after %d of %d rates"), results.Num(), frame_rates.Num()));
+	}
+
+	// Run distances are compared with their mean over the rates that kept up with real time, they should not depend on the frame rate
+	double mean_distance = 0.0;
+	int32 distance_rates = 0;
+	for (const FRateResult& result : results) {
+		if (IsRealTime(result)) {
+			mean_distance += result.RunDistance;
+			++distance_rates;
+		}
+	}
+	mean_distance /= FMath::Max(distance_rates, 1);
+
+	FString rates;
+	for (const FRateResult& result : results) {
+		TArray<FString> rate_failures;
+		TArray<FString> rate_warnings;
+		int32 max_frames_to_jump = 0;
+		double mean_frames_to_jump = 0.0;
+		for (int32 frames : result.FramesToJump) {
+			max_frames_to_jump = FMath::Max(max_frames_to_jump, frames);
+			mean_frames_to_jump += (double)frames / result.FramesToJump.Num();
+		}
+		const double deviation = mean_distance > 0.0 ? FMath::Abs(result.RunDistance - mean_distance) / mean_distance : 1.0;
+		const float cpu_p99 = Percentile(result.InputCpuMicros, 99.0);
+
+		if (result.MissedJumps > 0 || result.FramesToJump.Num() < JumpTrials) {
+			rate_failures.Add(FString::Printf(TEXT("%d of %d jumps missed"), JumpTrials - result.FramesToJump.Num(), JumpTrials));
+		}
+		if (max_frames_to_jump > MaxFramesToJump) {
+			rate_failures.Add(FString::Printf(TEXT("a jump took %d frames, more than %d"), max_frames_to_jump, MaxFramesToJump));
+		}
+		if (!IsRealTime(result)) {
+			// The run key is held for real time, a distance run off real time says nothing about the input path
+			rate_warnings.Add(FString::Printf(TEXT("frames ran at %.1f fps real time, the run distance is not compared"), result.Frames / FMath::Max(result.RealSeconds, 1e-6)));
+		}
+		else if (distance_rates > 1 && deviation > MaxRunDistanceDeviation) {
+			rate_failures.Add(FString::Printf(TEXT("ran %.0f cm, %.1f%% off the mean of every rate"), result.RunDistance, deviation * 100.0));
+		}
+		if (result.MaxBacklog > MaxBacklogBytes) {
+			rate_failures.Add(FString::Printf(TEXT("%d bytes queued, more than %d"), result.MaxBacklog, MaxBacklogBytes));
+		}
+		if (cpu_p99 > MaxInputCpuMicros) {
+			rate_failures.Add(FString::Printf(TEXT("input path p99 %.0f us a frame, more than %.0f"), cpu_p99, MaxInputCpuMicros));
+		}
+		for (const FString& failure : rate_failures) {
+			UE_LOG(LogTemp, Warning, TEXT("Arduino perf run at %d fps: %s !"), result.TargetFps, *failure);
+			failures.Add(FString::Printf(TEXT("%d fps: %s"), result.TargetFps, *failure));
+		}
+		for (const FString& warning : rate_warnings) {
+			UE_LOG(LogTemp, Warning, TEXT("Arduino perf run at %d fps: %s"), result.TargetFps, *warning);
+			warnings.Add(FString::Printf(TEXT("%d fps: %s"), result.TargetFps, *warning));
+		}
+
+		FString failures_list;
+		for (const FString& failure : rate_failures) {
+			failures_list += FString::Printf(TEXT("%s\"%s\""), failures_list.IsEmpty() ? TEXT("") : TEXT(", "), *failure);
+		}
+		FString warnings_list;
+		for (const FString& warning : rate_warnings) {
+			warnings_list += FString::Printf(TEXT("%s\"%s\""), warnings_list.IsEmpty() ? TEXT("") : TEXT(", "), *warning);
+		}
+		rates += FString::Printf(TEXT("%s\t\t{\n"), rates.IsEmpty() ? TEXT("") : TEXT(",\n"));
+		rates += FString::Printf(TEXT("\t\t\t\"target_fps\": %d,\n"), result.TargetFps);
+		rates += FString::Printf(TEXT("\t\t\t\"frames\": %d,\n"), result.Frames);
+		rates += FString::Printf(TEXT("\t\t\t\"game_seconds\": %.3f,\n"), result.Seconds);
+		rates += FString::Printf(TEXT("\t\t\t\"real_time_fps\": %.2f,\n"), result.Frames / FMath::Max(result.RealSeconds, 1e-6));
+		rates += FString::Printf(TEXT("\t\t\t\"frames_to_jump_mean\": %.2f,\n"), mean_frames_to_jump);
+		rates += FString::Printf(TEXT("\t\t\t\"frames_to_jump_max\": %d,\n"), max_frames_to_jump);
+		rates += FString::Printf(TEXT("\t\t\t\"missed_jumps\": %d,\n"), JumpTrials - result.FramesToJump.Num());
+		rates += FString::Printf(TEXT("\t\t\t\"run_distance_cm\": %.1f,\n"), result.RunDistance);
+		rates += FString::Printf(TEXT("\t\t\t\"run_distance_deviation\": %.4f,\n"), deviation);
+		rates += FString::Printf(TEXT("\t\t\t\"backlog_max_bytes\": %d,\n"), result.MaxBacklog);
+		rates += FString::Printf(TEXT("\t\t\t\"input_cpu_us_p50\": %.1f,\n"), Percentile(result.InputCpuMicros, 50.0));
+		rates += FString::Printf(TEXT("\t\t\t\"input_cpu_us_p99\": %.1f,\n"), cpu_p99);
+		rates += FString::Printf(TEXT("\t\t\t\"input_cpu_us_max\": %.1f,\n"), Percentile(result.InputCpuMicros, 100.0));
+		rates += FString::Printf(TEXT("\t\t\t\"failures\": [%s],\n"), *failures_list);
+		rates += FString::Printf(TEXT("\t\t\t\"warnings\": [%s],\n"), *warnings_list);
+		rates += FString::Printf(TEXT("\t\t\t\"passed\": %s\n"), rate_failures.Num() == 0 ? TEXT("true") : TEXT("false"));
+		rates += TEXT("\t\t}");
+	}
+
+	FString json = TEXT("{\n");
+	json += FString::Printf(TEXT("\t\"engine_version\": \"%s\",\n"), *FEngineVersion::Current().ToString());
+	json += FString::Printf(TEXT("\t\"changelist\": %u,\n"), FEngineVersion::Current().GetChangelist());
+	json += FString::Printf(TEXT("\t\"build_version\": \"%s\",\n"), FApp::GetBuildVersion());
+	json += FString::Printf(TEXT("\t\"build_configuration\": \"%s\",\n"), EBuildConfigurations::ToString(FApp::GetBuildConfiguration()));
+	json += FString::Printf(TEXT("\t\"platform\": \"%s\",\n"), ANSI_TO_TCHAR(FPlatformProperties::IniPlatformName()));
+	json += FString::Printf(TEXT("\t\"time\": \"%s\",\n"), *FDateTime::UtcNow().ToIso8601());
+	json += FString::Printf(TEXT("\t\"completed\": %s,\n"), bCompleted ? TEXT("true") : TEXT("false"));
+	json += FString::Printf(TEXT("\t\"passed\": %s,\n"), failures.Num() == 0 ? TEXT("true") : TEXT("false"));
+	json += FString::Printf(TEXT("\t\"rates\": [\n%s\n\t]\n"), *rates);
+	json += TEXT("}\n");
+	return json;
+}
+
+static FAutoConsoleCommandWithWorldAndArgs GArduinoPerfRunCommand(
+	TEXT("Arduino.Perf.Run"),
+	TEXT("Drive the player's character with a scripted Arduino at each frame rate and write Saved/Profiling/ArduinoInputPerf.json. Arduino.Perf.Run [fps...], default FrameRates from Game.ini"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		UGameInstance* game_instance = World != nullptr ? World->GetGameInstance() : nullptr;
+		UArduinoPerfSubsystem* perf = game_instance != nullptr ? game_instance->GetSubsystem<UArduinoPerfSubsystem>() : nullptr;
+		if (perf == nullptr) {
+			UE_LOG(LogTemp, Warning, TEXT("no game instance, no Arduino perf run !"));
+			return;
+		}
+		TArray<int32> rates;
+		for (const FString& arg : Args) {
+			rates.Add(FCString::Atoi(*arg));
+		}
+		if (rates.Num() == 0) {
+			rates = perf->FrameRates;
+		}
+		if (!perf->StartRun(rates, FString(), false)) {
+			UE_LOG(LogTemp, Warning, TEXT("Arduino perf run already running !"));
+		}
+	}));
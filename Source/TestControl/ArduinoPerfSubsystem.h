@@ -0,0 +1,160 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Tickable.h"
+#include "ArduinoPerfSubsystem.generated.h"
+
+class ATestControlCharacter;
+class UArduinoDevice;
+
+/** In-engine perf run of the Arduino input path: a scripted board drives the player's character at several frame rates
+*
+* The automation tests in ArduinoPerfTest.cpp run it and report every failed limit:
+*   UE4Editor TestControl -game -nullrhi -unattended -ExecCmds="Automation RunTests TestControl.Arduino.Perf; Quit"
+* Headless without the automation framework, the game quits once the report
+* is written, with exit code 1 if a limit failed:
+*   UE4Editor TestControl /Game/ThirdPersonCPP/Maps/test -game -nullrhi -unattended -ArduinoPerf
+*             [-ArduinoPerfFps=30,60,144] [-ArduinoPerfReport=<file>]
+* or from the console of a running game: Arduino.Perf.Run [fps...]
+*
+* The character's UArduinoInput is moved to a scripted device for the run,
+* so the bytes take the real path: parse thread, input device, player input
+* and CharacterMovement. Each rate runs on a fixed time step of 1/fps, so
+* the game clock does not depend on how fast the machine is; t.MaxFPS
+* paces the frames in real time as well. For each rate it measures:
+*   frames from a "J" being injected to the character leaving the ground
+*   distance run for RunSeconds of steps, 4 a second, the same at any rate
+*   bytes waiting in the board's queue, every frame
+*   game thread time of the input path, every frame
+* A rate passes when they stay within the limits below, read from the
+* [/Script/TestControl.ArduinoPerfSubsystem] section of Game.ini (or
+* -ini:Game:[/Script/TestControl.ArduinoPerfSubsystem]:JumpTrials=20 on the
+* command line). The results go to Saved/Profiling/ArduinoInputPerf.json
+* with the build they came from, to trend them across builds.
+*/
+UCLASS(config=Game)
+class TESTCONTROL_API UArduinoPerfSubsystem : public UGameInstanceSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	/** Starts a run on -ArduinoPerf */
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+
+	/** Start a run at these frame rates, the report to ReportFile (empty for the default). False if one is running */
+	bool StartRun(const TArray<int32>& Rates, const FString& ReportFile, bool bQuitWhenDone);
+
+	bool IsRunning() const { return phase != EPhase::Idle; }
+
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override { return IsRunning(); }
+	virtual TStatId GetStatId() const override;
+
+	/** Failed limits of the last run that finished, "<fps> fps: <limit>", empty when it passed */
+	const TArray<FString>& GetFailures() const { return failures; }
+	/** Results that could not be judged, such as a distance run while the frames fell behind real time */
+	const TArray<FString>& GetWarnings() const { return warnings; }
+
+	/** Frame rates of a run started without any */
+	UPROPERTY(Config)
+	TArray<int32> FrameRates = { 30, 60, 144 };
+	/** Jumps timed at every rate */
+	UPROPERTY(Config)
+	int32 JumpTrials = 10;
+	/** Game seconds of steps */
+	UPROPERTY(Config)
+	float RunSeconds = 2.0f;
+	/** Limits a rate has to stay within */
+	UPROPERTY(Config)
+	int32 MaxFramesToJump = 2;
+	UPROPERTY(Config)
+	float MaxRunDistanceDeviation = 0.05f;
+	UPROPERTY(Config)
+	int32 MaxBacklogBytes = 64;
+	UPROPERTY(Config)
+	float MaxInputCpuMicros = 250.0f;
+	/** The input device holds the run key for a real time duration, so distances only compare while frames keep up with the fixed step within this ratio */
+	UPROPERTY(Config)
+	float MaxRealTimeDeviation = 0.1f;
+
+protected:
+	enum class EPhase : uint8
+	{
+		Idle,
+		/** Waiting for the player's character */
+		Attach,
+		/** At a new rate, until the frame time settles and the character stands */
+		Settle,
+		Jump,
+		Run,
+		/** Steps are over, until the character stops */
+		RunOut,
+	};
+
+	/** What one rate measured */
+	struct FRateResult
+	{
+		int32 TargetFps = 0;
+		int32 Frames = 0;
+		/** Game and real time spent at this rate */
+		double Seconds = 0.0;
+		double RealSeconds = 0.0;
+		TArray<int32> FramesToJump;
+		int32 MissedJumps = 0;
+		float RunDistance = 0.0f;
+		int32 MaxBacklog = 0;
+		/** Game thread input time of every frame, microseconds */
+		TArray<float> InputCpuMicros;
+	};
+
+	void BeginRate(int32 Index);
+	/** Every frame of a rate: backlog, input time and frame time */
+	void SampleFrame(float DeltaTime);
+	void InjectGesture(const char* Gesture);
+	bool IsCharacterFalling() const;
+	/** Whether a rate's frames kept up with real time, see MaxRealTimeDeviation */
+	bool IsRealTime(const FRateResult& Result) const;
+	/** Write the report, give the character its device back and quit if asked to */
+	void FinishRun();
+	/** Fills failures and warnings, drops the rate a stopped run was in */
+	FString MakeReport();
+
+	EPhase phase = EPhase::Idle;
+	TArray<int32> frame_rates;
+	FString report_file;
+	bool bQuit = false;
+	TArray<FRateResult> results;
+	int32 rate_index = 0;
+	/** The last rate ran to its end */
+	bool bCompleted = false;
+	TArray<FString> failures;
+	TArray<FString> warnings;
+
+	TWeakObjectPtr<ATestControlCharacter> character;
+	UPROPERTY(Transient)
+	UArduinoDevice* scripted_device = nullptr;
+	/** What the character read before the run */
+	UPROPERTY(Transient)
+	UArduinoDevice* previous_device = nullptr;
+	FVector start_location;
+	FRotator start_rotation;
+	float previous_max_fps = 0.0f;
+	bool bPreviousSmoothFrameRate = false;
+	bool bPreviousUseFixedTimeStep = false;
+	double previous_fixed_delta_time = 0.0;
+
+	/** Game time of the run, summed from the ticks' DeltaTime */
+	double game_seconds = 0.0;
+	double rate_start_real_seconds = 0.0;
+	/** Frames or game seconds into the current phase */
+	int32 phase_frames = 0;
+	double phase_start_seconds = 0.0;
+	/** Jump: waiting for the character to leave the ground, else for it to land */
+	bool bJumpInjected = false;
+	double next_step_seconds = 0.0;
+	uint64 last_input_cycles = 0;
+};
@@ -0,0 +1,121 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ArduinoPerfSubsystem.h"
+#include "Engine/Engine.h"
+#include "Engine/GameInstance.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/Paths.h"
+#include "Tests/AutomationCommon.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace
+{
+	/** Map the perf run drives the player's character in */
+	const TCHAR* const PerfMap = TEXT("/Game/ThirdPersonCPP/Maps/test");
+
+	UArduinoPerfSubsystem* FindPerfSubsystem()
+	{
+		if (GEngine == nullptr) {
+			return nullptr;
+		}
+		for (const FWorldContext& context : GEngine->GetWorldContexts()) {
+			if ((context.WorldType == EWorldType::Game || context.WorldType == EWorldType::PIE) && context.OwningGameInstance != nullptr) {
+				return context.OwningGameInstance->GetSubsystem<UArduinoPerfSubsystem>();
+			}
+		}
+		return nullptr;
+	}
+}
+
+/** Starts a perf run in the loaded map, waits for it and hands its failed limits to the test */
+class FArduinoPerfRunCommand : public IAutomationLatentCommand
+{
+public:
+	FArduinoPerfRunCommand(FAutomationTestBase* InTest, const TArray<int32>& InRates, const FString& InReportFile)
+		: test(InTest)
+		, rates(InRates)
+		, report_file(InReportFile)
+	{
+	}
+
+	virtual bool Update() override
+	{
+		if (!bStarted) {
+			UArduinoPerfSubsystem* subsystem = FindPerfSubsystem();
+			if (subsystem == nullptr) {
+				test->AddError(TEXT("No game instance to run the Arduino perf run in"));
+				return true;
+			}
+			if (!subsystem->StartRun(rates, report_file, false)) {
+				test->AddError(TEXT("An Arduino perf run is already running"));
+				return true;
+			}
+			perf = subsystem;
+			bStarted = true;
+			return false;
+		}
+
+		// Gone with its game instance, the run did not finish
+		UArduinoPerfSubsystem* subsystem = perf.Get();
+		if (subsystem == nullptr) {
+			test->AddError(TEXT("The game instance shut down during the Arduino perf run"));
+			return true;
+		}
+		if (subsystem->IsRunning()) {
+			return false;
+		}
+		for (const FString& failure : subsystem->GetFailures()) {
+			test->AddError(failure);
+		}
+		for (const FString& warning : subsystem->GetWarnings()) {
+			test->AddWarning(warning);
+		}
+		test->AddInfo(FString::Printf(TEXT("Report written to %s"), *report_file));
+		return true;
+	}
+
+private:
+	FAutomationTestBase* test;
+	TArray<int32> rates;
+	FString report_file;
+	TWeakObjectPtr<UArduinoPerfSubsystem> perf;
+	bool bStarted = false;
+};
+
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FArduinoPerfTest, "TestControl.Arduino.Perf", EAutomationTestFlags::ClientContext | EAutomationTestFlags::PerfFilter)
+
+void FArduinoPerfTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	// Every rate on its own, then all of them in one run, the only one to compare the distances run
+	const TArray<int32>& rates = GetDefault<UArduinoPerfSubsystem>()->FrameRates;
+	FString all_rates;
+	for (int32 rate : rates) {
+		OutBeautifiedNames.Add(FString::Printf(TEXT("%d fps"), rate));
+		OutTestCommands.Add(FString::FromInt(rate));
+		all_rates += FString::Printf(TEXT("%s%d"), all_rates.IsEmpty() ? TEXT("") : TEXT(","), rate);
+	}
+	if (rates.Num() > 1) {
+		OutBeautifiedNames.Add(TEXT("All rates"));
+		OutTestCommands.Add(all_rates);
+	}
+}
+
+bool FArduinoPerfTest::RunTest(const FString& Parameters)
+{
+	TArray<FString> items;
+	Parameters.ParseIntoArray(items, TEXT(","));
+	TArray<int32> rates;
+	for (const FString& item : items) {
+		rates.Add(FCString::Atoi(*item));
+	}
+	const FString report_file = FPaths::ProfilingDir() / FString::Printf(TEXT("ArduinoInputPerf-%s.json"), *Parameters.Replace(TEXT(","), TEXT("-")));
+
+	AutomationOpenMap(PerfMap);
+	ADD_LATENT_AUTOMATION_COMMAND(FWaitForMapToLoadCommand());
+	ADD_LATENT_AUTOMATION_COMMAND(FArduinoPerfRunCommand(this, rates, report_file));
+	return true;
+}
+
+#endif
@@ -6,8 +6,8 @@
 // Sets default values
 ATest::ATest()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	PrimaryActorTick.bCanEverTick = true;
+ 	// Nothing to do per frame, do not register a tick function at all
+	PrimaryActorTick.bCanEverTick = false;
 
 }
 
@@ -17,11 +17,3 @@ void ATest::BeginPlay()
 	Super::BeginPlay();
 	
 }
-
-// Called every frame
-void ATest::Tick(float DeltaTime)
-{
-	Super::Tick(DeltaTime);
-
-}
-
@@ -12,7 +12,6 @@
 //////////////////////////////////////////////////////////////////////////
 // ATestControlCharacter
 
-#define TOTAL_RUNNING 50
 
 ATestControlCharacter::ATestControlCharacter()
 {
@@ -58,11 +57,16 @@ void ATestControlCharacter::SetupPlayerInputComponent(class UInputComponent* Pla
 {
 	// Set up gameplay key bindings
 	check(PlayerInputComponent);
-	PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &ACharacter::Jump);
+
+	// Only done for the local player's pawn: in a networked game that is the one the board on this machine belongs to
+	ArduinoInput->AcquireDevice();
+
+	PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &ATestControlCharacter::JumpWithFeedback);
 	PlayerInputComponent->BindAction("Jump", IE_Released, this, &ACharacter::StopJumping);
 
 	PlayerInputComponent->BindAxis("MoveForward", this, &ATestControlCharacter::MoveForward);
 	PlayerInputComponent->BindAxis("MoveRight", this, &ATestControlCharacter::MoveRight);
+	PlayerInputComponent->BindAxis("Run", this, &ATestControlCharacter::Run);
 
 	// We have 2 versions of the rotation bindings to handle different kinds of devices differently
 	// "turn" handles devices that provide an absolute delta, such as a mouse.
@@ -80,36 +84,22 @@ void ATestControlCharacter::SetupPlayerInputComponent(class UInputComponent* Pla
 	PlayerInputComponent->BindAction("ResetVR", IE_Pressed, this, &ATestControlCharacter::OnResetVR);
 }
 
-void ATestControlCharacter::Tick(float DeltaTime)
+void ATestControlCharacter::JumpWithFeedback()
 {
-	Super::Tick(DeltaTime);
-
-	FString getInput;
-	if (isRunning) {
-		running_counter++;
-		if (running_counter != TOTAL_RUNNING) {
-			ATestControlCharacter::MoveForward(1);
-		}
-		else {
-			isRunning = false;
-		}
-		// This is for jump+run()
-		// TODO Hopefully, we'll have time to refactor this part :)
-		if (ArduinoInput->ReturnNextInputInQueue(getInput)) {
-			if (getInput == "J") {
-				ACharacter::Jump();
-			}
-		}
+	ACharacter::Jump();
+	if (JumpRumbleMotor >= 0) {
+		ArduinoInput->PulseRumble(JumpRumbleMotor, 1.0f, JumpRumbleSeconds);
 	}
-	else if (ArduinoInput->ReturnNextInputInQueue(getInput)) {
-		if (getInput == "J") {
-			ACharacter::Jump();
-		}
-		else if (getInput == "W") {
-			isRunning = true;
-			running_counter = 0;
-		}
+}
+
+void ATestControlCharacter::Run(float Value)
+{
+	const bool was_running = isRunning;
+	isRunning = Value > 0.0f;
+	if (isRunning != was_running && RunLed >= 0) {
+		ArduinoInput->SetLedColor(RunLed, isRunning ? RunColor : FColor::Black);
 	}
+	MoveForward(Value);
 }
 
 
@@ -68,9 +68,27 @@ protected:
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 	// End of APawn interface
 
-	virtual void Tick(float DeltaTime) override;
+	/** Jump action: jump, and pulse the board's rumble motor */
+	void JumpWithFeedback();
+
+	/** Run axis (ArduinoRun): move forward while the board reports running, and light RunLed */
+	void Run(float Value);
+
+protected:
+	/** Rumble motor pulsed on every jump, -1 for none. Needs a board on the binary protocol */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Arduino|Feedback")
+	int32 JumpRumbleMotor = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Arduino|Feedback")
+	float JumpRumbleSeconds = 0.12f;
+
+	/** LED lit with RunColor while running, -1 for none */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Arduino|Feedback")
+	int32 RunLed = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Arduino|Feedback")
+	FColor RunColor = FColor::Green;
 
-	int running_counter = 0;
 	bool isRunning = false;
 
 public:
@@ -78,5 +96,7 @@ public:
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
 	/** Returns FollowCamera subobject **/
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
+	/** Returns ArduinoInput subobject **/
+	FORCEINLINE class UArduinoInput* GetArduinoInput() const { return ArduinoInput; }
 };
 